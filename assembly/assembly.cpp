@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <stdio.h>
+#include <stdlib.h>
 #include "assembly.h"
 #include "../trycasts.cpp"
 
@@ -27,40 +28,19 @@ namespace Compiler
     ///             Assembly             ///
     ////////////////////////////////////////
 
-    unsigned int calc_stack_size(std::shared_ptr<Typechecker::ResolvedType> resolved_type)
+    unsigned int calc_stack_size(const Typechecker::ResolvedType* resolved_type)
     {
-        switch(resolved_type->type_name)
-        {
-            case Typechecker::INT:
-            case Typechecker::FLOAT:
-            case Typechecker::BOOL:
-                return 8;
-            case Typechecker::TUPLE:
-                {
-                    std::shared_ptr<Typechecker::TupleRType> resolved_as_tuple = std::static_pointer_cast<Typechecker::TupleRType>(resolved_type);
-                    unsigned int sum_size = 0;
-                    for (int i = 0; i < resolved_as_tuple->element_types.size(); i++)
-                        sum_size += calc_stack_size(resolved_as_tuple->element_types[i]);
-                    return sum_size;
-                }
-            case Typechecker::ARRAY:
-                {
-                    std::shared_ptr<Typechecker::ArrayRType> resolved_as_array = std::static_pointer_cast<Typechecker::ArrayRType>(resolved_type);
-                    return 8 + 8 * resolved_as_array->rank;
-                }
-            default:
-                throw CompilerException("Could not recognize type " + resolved_type->toString() + " for stack analysis."); 
-        }
+        return resolved_type->size;
     }
 
 #pragma region Assembly
 
     Assembly::Assembly(const Typechecker::Scope& scope, unsigned char _optimization_level) : optimization_level(_optimization_level)
     {
-        for (const auto& kvp : scope.symbol_table)
+        for (const Typechecker::Scope::Binding& binding : scope.globals)
         {
-            std::string function_name = kvp.first;
-            Typechecker::NameInfo* info = kvp.second.get();
+            std::string function_name = Lexer::interner().name(binding.symbol);
+            Typechecker::NameInfo* info = binding.info.get();
             
             if (Typechecker::FuncInfo* func_info = dynamic_cast<Typechecker::FuncInfo*>(info))
             {
@@ -98,6 +78,9 @@ namespace Compiler
     {
         char buffer[50];
         std::sprintf(buffer, "dq %.10e", constant);
+        // Folded constants may need every digit to be read back exactly.
+        if (std::strtod(buffer + 3, nullptr) != constant)
+            std::sprintf(buffer, "dq %.16e", constant);
         return add_constant_raw(std::string(buffer));
     }
 
@@ -160,28 +143,27 @@ namespace Compiler
 
 #pragma region StackDescription
 
-    void StackDescription::add_temporary(std::string name, const int offset)
+    void StackDescription::add_temporary(Lexer::Symbol name, const int offset)
     {
         temporaries[name] = offset;
     }
 
     void StackDescription::add_argument(Parser::ArgumentNode* argument, const std::shared_ptr<Typechecker::ResolvedType>& r_type, const int offset)
     {
-        // <variable>
+        switch (argument->kind)
         {
-            Parser::VarArgumentNode* result;
-            if (tryCast<Parser::ArgumentNode, Parser::VarArgumentNode>(argument, result))
+            // <variable>
+            case Parser::VAR_ARGUMENT:
             {
-                add_temporary(result->token_s, offset);
+                Parser::VarArgumentNode* result = static_cast<Parser::VarArgumentNode*>(argument);
+                add_temporary(result->symbol, offset);
                 return;
             }
-        }
-        
-        // <variable> [ <variable> , ... ]
-        {
-            Parser::ArrayArgumentNode* result;
-            if (tryCast<Parser::ArgumentNode, Parser::ArrayArgumentNode>(argument, result))
+
+            // <variable> [ <variable> , ... ]
+            case Parser::ARRAY_ARGUMENT:
             {
+                Parser::ArrayArgumentNode* result = static_cast<Parser::ArrayArgumentNode*>(argument);
                 // regiser arguments where the array in the stack is:
                 // -----
                 // ptr in mem
@@ -191,110 +173,144 @@ namespace Compiler
                 // number of elements in dimension 1
                 // -----
 
-                for (int i = 0; i < result->array_dimensions_names.size(); i++)
-                {
-                    std::string name = result->array_dimensions_names[i];                    
-                    add_temporary(name, offset - 8 * i);
-                }
+                for (int i = 0; i < result->array_dimensions_symbols.size(); i++)
+                    add_temporary(result->array_dimensions_symbols[i], offset - 8 * i);
 
-                add_temporary(result->array_argument_name, offset);
+                add_temporary(result->array_argument_symbol, offset);
                 return;
             }
+            default:
+                break;
         }
     }
 
-    void StackDescription::add_lvalue(Parser::LValue* lvalue, const std::shared_ptr<Typechecker::ResolvedType>& r_type, const int offset)
+    // Adds the lvalues from an explicit list rather than by recursion, so that deeply nested
+    // lvalues take no more native stack than shallow ones.
+    void StackDescription::add_lvalue(Parser::LValue* root, const std::shared_ptr<Typechecker::ResolvedType>& root_type, const int root_offset)
     {
-        
-        // <argument>
+        struct Entry
         {
-            Parser::ArgumentLValue* result;
-            if (tryCast<Parser::LValue, Parser::ArgumentLValue>(lvalue, result))
-            {
-                add_argument(result->argument.get(), r_type, offset);
-                return;
-            }
-        }
+            Parser::LValue* lvalue;
+            std::shared_ptr<Typechecker::ResolvedType> r_type;
+            int offset;
+        };
+        std::vector<Entry> work = {{root, root_type, root_offset}};
 
-        // pseudo arg
+        while (!work.empty())
         {
-            Typechecker::PseudoArgumentLValue* result;
-            if (tryCast<Parser::LValue, Typechecker::PseudoArgumentLValue>(lvalue, result))
-            {
-                add_argument(result->argument, r_type, offset);
-                return;
-            }
-        }
+            Entry entry = std::move(work.back());
+            work.pop_back();
+            Parser::LValue* lvalue = entry.lvalue;
+            size_t first = work.size();
 
-        // { <lvalue>, }
-        {
-            Parser::TupleLValueNode* result;
-            if (tryCast<Parser::LValue, Parser::TupleLValueNode>(lvalue, result))
+            switch (lvalue->kind)
             {
-                unsigned int next_offset = offset;
-                std::shared_ptr<Typechecker::TupleRType> tuple_rtype = std::static_pointer_cast<Typechecker::TupleRType>(r_type);
+                // <argument>
+                case Parser::ARGUMENT_LVALUE:
+                {
+                    Parser::ArgumentLValue* result = static_cast<Parser::ArgumentLValue*>(lvalue);
+                    add_argument(result->argument.get(), entry.r_type, entry.offset);
+                    break;
+                }
 
-                for (int i = 0; i < result->lvalues.size(); i++)
+                // pseudo arg
+                case Parser::PSEUDO_ARGUMENT_LVALUE:
                 {
-                    Parser::LValue* sub_lvalue = result->lvalues[i].get();
-                    std::shared_ptr<Typechecker::ResolvedType> sub_rtype = tuple_rtype->element_types[i];
-                    add_lvalue(sub_lvalue, sub_rtype, next_offset);
-                    next_offset -= calc_stack_size(sub_rtype);
+                    Typechecker::PseudoArgumentLValue* result = static_cast<Typechecker::PseudoArgumentLValue*>(lvalue);
+                    add_argument(result->argument, entry.r_type, entry.offset);
+                    break;
                 }
-                return;
-            }
-        }
 
-        // pseudo tuple
-        {
-            Typechecker::PseudoTupleLValue* result;
-            if (tryCast<Parser::LValue, Typechecker::PseudoTupleLValue>(lvalue, result))
-            {
-                unsigned int next_offset = offset;
-                std::shared_ptr<Typechecker::TupleRType> tuple_rtype = std::static_pointer_cast<Typechecker::TupleRType>(r_type);
+                // { <lvalue>, }
+                case Parser::TUPLE_LVALUE:
+                {
+                    Parser::TupleLValueNode* result = static_cast<Parser::TupleLValueNode*>(lvalue);
+                    int next_offset = entry.offset;
+                    Typechecker::TupleRType* tuple_rtype = static_cast<Typechecker::TupleRType*>(entry.r_type.get());
+
+                    for (int i = 0; i < result->lvalues.size(); i++)
+                    {
+                        std::shared_ptr<Typechecker::ResolvedType> sub_rtype = tuple_rtype->element_types[i];
+                        work.push_back({result->lvalues[i].get(), sub_rtype, next_offset});
+                        next_offset -= calc_stack_size(sub_rtype.get());
+                    }
+                    break;
+                }
 
-                for (int i = 0; i < result->lvalues.size(); i++)
+                // pseudo tuple
+                case Parser::PSEUDO_TUPLE_LVALUE:
                 {
-                    Parser::LValue* sub_lvalue = result->lvalues[i].get();
-                    std::shared_ptr<Typechecker::ResolvedType> sub_rtype = tuple_rtype->element_types[i];
-                    add_lvalue(sub_lvalue, sub_rtype, next_offset);
-                    next_offset -= calc_stack_size(sub_rtype);
+                    Typechecker::PseudoTupleLValue* result = static_cast<Typechecker::PseudoTupleLValue*>(lvalue);
+                    int next_offset = entry.offset;
+                    Typechecker::TupleRType* tuple_rtype = static_cast<Typechecker::TupleRType*>(entry.r_type.get());
+
+                    for (int i = 0; i < result->lvalues.size(); i++)
+                    {
+                        std::shared_ptr<Typechecker::ResolvedType> sub_rtype = tuple_rtype->element_types[i];
+                        work.push_back({result->lvalues[i].get(), sub_rtype, next_offset});
+                        next_offset -= calc_stack_size(sub_rtype.get());
+                    }
+                    break;
                 }
-                return;
+                default:
+                    break;
             }
+
+            // The last element is taken first, so the elements go on in reverse.
+            std::reverse(work.begin() + first, work.end());
         }
     }
 
-    void StackDescription::add_binding(Parser::BindingNode* binding, const std::shared_ptr<Typechecker::ResolvedType>& r_type, const int offset)
+    // Adds the bindings from an explicit list, like add_lvalue.
+    void StackDescription::add_binding(Parser::BindingNode* root, const std::shared_ptr<Typechecker::ResolvedType>& root_type, const int root_offset)
     {
-        // <argument> : <type>
+        struct Entry
         {
-            Parser::VarBindingNode* result;
-            if (tryCast<Parser::BindingNode, Parser::VarBindingNode>(binding, result))
-            {
-                add_argument(result->argument.get(), r_type, offset);
-                return;
-            }
-        }
+            Parser::BindingNode* binding;
+            std::shared_ptr<Typechecker::ResolvedType> r_type;
+            int offset;
+        };
+        std::vector<Entry> work = {{root, root_type, root_offset}};
 
-        // {<binding>, <binding>, ...}
+        while (!work.empty())
         {
-            Parser::TupleBindingNode* result;
-            if (tryCast<Parser::BindingNode, Parser::TupleBindingNode>(binding, result))
-            {
-                unsigned int sub_offset = offset;
+            Entry entry = std::move(work.back());
+            work.pop_back();
+            Parser::BindingNode* binding = entry.binding;
+            size_t first = work.size();
 
-                Typechecker::TupleRType* tuple = static_cast<Typechecker::TupleRType*>(r_type.get());
+            switch (binding->kind)
+            {
+                // <argument> : <type>
+                case Parser::VAR_BINDING:
+                {
+                    Parser::VarBindingNode* result = static_cast<Parser::VarBindingNode*>(binding);
+                    add_argument(result->argument.get(), entry.r_type, entry.offset);
+                    break;
+                }
 
-                for (int i = 0; i < result->bindings.size(); i++)
+                // {<binding>, <binding>, ...}
+                case Parser::TUPLE_BINDING:
                 {
-                    std::unique_ptr<Parser::BindingNode>& sub_binding = result->bindings[i];
-                    std::shared_ptr<Typechecker::ResolvedType> sub_type = tuple->element_types[i];
-                    add_binding(sub_binding.get(), sub_type, sub_offset);
-                    sub_offset -= calc_stack_size(sub_type);
+                    Parser::TupleBindingNode* result = static_cast<Parser::TupleBindingNode*>(binding);
+                    int sub_offset = entry.offset;
+
+                    Typechecker::TupleRType* tuple = static_cast<Typechecker::TupleRType*>(entry.r_type.get());
+
+                    for (int i = 0; i < result->bindings.size(); i++)
+                    {
+                        std::shared_ptr<Typechecker::ResolvedType> sub_type = tuple->element_types[i];
+                        work.push_back({result->bindings[i].get(), sub_type, sub_offset});
+                        sub_offset -= calc_stack_size(sub_type.get());
+                    }
+                    break;
                 }
-                return;
+                default:
+                    break;
             }
+
+            // The last binding is taken first, so the bindings go on in reverse.
+            std::reverse(work.begin() + first, work.end());
         }
     }
 
@@ -319,9 +335,7 @@ namespace Compiler
 
     bool CallingConvention::is_void_return_type(std::shared_ptr<Typechecker::ResolvedType> r_type)
     {
-        std::vector<std::shared_ptr<Typechecker::ResolvedType>> _empty;
-        Typechecker::TupleRType void_return(_empty);
-        return *r_type == void_return;
+        return r_type == Typechecker::tupleType({});
     }
 
     std::string CallingConvention::get_register_name(MemoryLocation loc)
@@ -410,7 +424,7 @@ namespace Compiler
             case Typechecker::ARRAY:
             case Typechecker::TUPLE:
                 return_location = STACK;
-                return_size = calc_stack_size(return_type);
+                return_size = calc_stack_size(return_type.get());
                 next_free_r_register++; //RDI taken up by return.
                 break;
             }
@@ -441,7 +455,7 @@ namespace Compiler
             {
                 MemoryLocationData data {STACK, i};
                 stack.push_back(data);
-                stack_argument_size += calc_stack_size(arg_type);
+                stack_argument_size += calc_stack_size(arg_type.get());
             }
         }
 
@@ -465,7 +479,7 @@ namespace Compiler
         {
             assembly_code.push_back("push rdi ; $return");
             stack_size += 8;
-            stack_size.add_temporary("$return", stack_size.get_size_of_temporaries());
+            stack_size.add_temporary(return_temporary(), stack_size.get_size_of_temporaries());
         }
 
         for (int i = 0; i < cc.argument_pop_order.size(); i++)
@@ -491,7 +505,7 @@ namespace Compiler
             else
             {
                 stack_size.add_binding(binding_node, binding_type, stack_args_dist_from_rbp);
-                stack_args_dist_from_rbp -=  (int) calc_stack_size(binding_type);
+                stack_args_dist_from_rbp -=  (int) calc_stack_size(binding_type.get());
             }
         }
 
@@ -499,7 +513,7 @@ namespace Compiler
 
         bool had_return = false;
 
-        for (const std::unique_ptr<Parser::StmtNode>& stmt : cmd->function_contents)
+        for (const Parser::NodePtr<Parser::StmtNode>& stmt : cmd->function_contents)
         {
             had_return = cg_stmt(stmt.get(), cc) || had_return;
         }
@@ -510,91 +524,88 @@ namespace Compiler
 
 #pragma region Commands
 
-    void AFunction::cg_cmd(std::unique_ptr<Parser::CmdNode>& cmd)
+    void AFunction::cg_cmd(Parser::NodePtr<Parser::CmdNode>& cmd)
     {
+        // Nested time commands are unwrapped by a loop: each timer starts before the command
+        // inside it and stops after, innermost first.
+        std::vector<std::pair<Parser::TimeCmdNode*, unsigned int>> timers;
         Parser::CmdNode* cmd_ptr = cmd.get();
-        
+        while (cmd_ptr->kind == Parser::TIME_CMD)
+        {
+            Parser::TimeCmdNode* time = static_cast<Parser::TimeCmdNode*>(cmd_ptr);
+            timers.push_back({time, cg_starttime(time)});
+            cmd_ptr = time->command.get();
+        }
+
+        cg_cmdkind(cmd_ptr);
+
+        for (size_t i = timers.size(); i > 0; i--)
+            cg_stoptime(timers[i - 1].second);
+    }
+
+    void AFunction::cg_cmdkind(Parser::CmdNode* cmd_ptr)
+    {
+        switch (cmd_ptr->kind)
         {
-            Parser::ShowCmdNode* result;
-            if (tryCastCmd<Parser::ShowCmdNode>(cmd_ptr, result))
+            case Parser::SHOW_CMD:
             {
+                Parser::ShowCmdNode* result = static_cast<Parser::ShowCmdNode*>(cmd_ptr);
                 cg_showcmd(result);
                 return;
             }
-        }
 
-        {
-            Parser::LetCmdNode* result;
-            if (tryCastCmd<Parser::LetCmdNode>(cmd_ptr, result))
+            case Parser::LET_CMD:
             {
+                Parser::LetCmdNode* result = static_cast<Parser::LetCmdNode*>(cmd_ptr);
                 cg_letcmd(result);
                 return;
             }
-        }
 
-        {
-            Parser::ReadCmdNode* result;
-            if (tryCastCmd<Parser::ReadCmdNode>(cmd_ptr, result))
+            case Parser::READ_CMD:
             {
+                Parser::ReadCmdNode* result = static_cast<Parser::ReadCmdNode*>(cmd_ptr);
                 cg_readcmd(result);
                 return;
             }
-        }
 
-        {
-            Parser::FnCmd* result;
-            if (tryCastCmd<Parser::FnCmd>(cmd_ptr, result))
+            case Parser::FN_CMD:
             {
+                Parser::FnCmd* result = static_cast<Parser::FnCmd*>(cmd_ptr);
                 cg_fncmd(result);
                 return;
             }
-        }
 
-        {
-            Parser::AssertCmdNode* result;
-            if (tryCastCmd<Parser::AssertCmdNode>(cmd_ptr, result))
+            case Parser::ASSERT_CMD:
             {
+                Parser::AssertCmdNode* result = static_cast<Parser::AssertCmdNode*>(cmd_ptr);
                 cg_assertcmd(result);
                 return;
             }
-        }
 
-        {
-            Parser::TypeCmdNode* result;
-            if (tryCastCmd<Parser::TypeCmdNode>(cmd_ptr, result))
+            case Parser::TYPE_CMD:
             {
                 return;
             }
-        }
 
-        {
-            Parser::PrintCmdNode* result;
-            if (tryCastCmd<Parser::PrintCmdNode>(cmd_ptr, result))
+            case Parser::PRINT_CMD:
             {
+                Parser::PrintCmdNode* result = static_cast<Parser::PrintCmdNode*>(cmd_ptr);
                 cg_printcmd(result);
                 return;
             }
-        }
 
-        {
-            Parser::WriteCmdNode* result;
-            if (tryCastCmd<Parser::WriteCmdNode>(cmd_ptr, result))
+            case Parser::WRITE_CMD:
             {
+                Parser::WriteCmdNode* result = static_cast<Parser::WriteCmdNode*>(cmd_ptr);
                 cg_writecmd(result);
                 return;
             }
-        }
 
-        {
-            Parser::TimeCmdNode* result;
-            if (tryCastCmd<Parser::TimeCmdNode>(cmd_ptr, result))
-            {
-                cg_timecmd(result);
-                return;
-            }
+            default:
+                break;
         }
 
-        throw CompilerException("Unrecognized command " + cmd->token_s + ".");
+        throw CompilerException("Unrecognized command " + cmd_ptr->token_s + ".");
     }
 
 #define FUNCTION_CALL_ALIGNMENT_CHECK(argument_size_on_stack) bool needs_alignment = (stack_size.get_stack_size() + argument_size_on_stack) % 16 != 0; if (needs_alignment){assembly_code.push_back("sub rsp, 8 ;align stack");stack_size.increment_stack_size(8);}
@@ -625,17 +636,17 @@ namespace Compiler
     {
         cg_expr(cmd->expression);
         assembly_code.push_back("; " + cmd->token_s + " | line: " + std::to_string(cmd->line));
-        stack_size.add_lvalue(cmd->lvalue.get(), cmd->expression->resolvedType, stack_size.get_size_of_temporaries());
+        stack_size.add_lvalue(cmd->lvalue.get(), cmd->expression->resolvedType->shared_from_this(), stack_size.get_size_of_temporaries());
     }
 
     void AFunction::cg_readcmd(Parser::ReadCmdNode* cmd)
     {
-        std::shared_ptr<Typechecker::FloatRType> r_float = std::make_shared<Typechecker::FloatRType>();
+        std::shared_ptr<Typechecker::ResolvedType> r_float = Typechecker::floatType();
         std::vector<std::shared_ptr<Typechecker::ResolvedType>> r_floats {r_float, r_float, r_float, r_float};
-        std::shared_ptr<Typechecker::ResolvedType> r_tuple = std::make_shared<Typechecker::TupleRType>(r_floats);
-        std::shared_ptr<Typechecker::ResolvedType> r_pict = std::make_shared<Typechecker::ArrayRType>(r_tuple, 2);
+        std::shared_ptr<Typechecker::ResolvedType> r_tuple = Typechecker::tupleType(r_floats);
+        std::shared_ptr<Typechecker::ResolvedType> r_pict = Typechecker::arrayType(r_tuple, 2);
         
-        unsigned int return_size_on_stack = calc_stack_size(r_pict); // Size of Array Image in Stack
+        unsigned int return_size_on_stack = calc_stack_size(r_pict.get()); // Size of Array Image in Stack
         stack_size += return_size_on_stack;
         
 
@@ -694,7 +705,7 @@ namespace Compiler
         FUNCTION_CALL_ALIGNMENT_CLOSE
     }
 
-    void AFunction::cg_timecmd(Parser::TimeCmdNode* cmd)
+    unsigned int AFunction::cg_starttime(Parser::TimeCmdNode* cmd)
     {
         assembly_code.push_back("; Timing call to " + cmd->command->token_s);
         {
@@ -706,10 +717,11 @@ namespace Compiler
         stack_size += 8;
         assembly_code.push_back("movsd [rsp], xmm0 ; collecting _get_time return");
 
-        unsigned int start_offset = stack_size.get_stack_size();
-
-        cg_cmd(cmd->command);
+        return stack_size.get_stack_size();
+    }
 
+    void AFunction::cg_stoptime(unsigned int start_offset)
+    {
         {
         FUNCTION_CALL_ALIGNMENT_CHECK(0)
         assembly_code.push_back("call _get_time ; getting post-op time");
@@ -736,15 +748,44 @@ namespace Compiler
 #pragma endregion
 
 #pragma region Expressions
-    void AFunction::cg_expr(std::unique_ptr<Parser::ExprNode>& expr)
+    void AFunction::cg_expr(Parser::NodePtr<Parser::ExprNode>& expr)
     {
         Parser::ExprNode* expr_ptr = expr.get();
+        add_task([this, expr_ptr] {cg_exprkind(expr_ptr);});
+    }
+
+    void AFunction::then(std::function<void()> work)
+    {
+        add_task(std::move(work));
+    }
+
+    void AFunction::add_task(std::function<void()> task)
+    {
+        tasks.push_back(std::move(task));
+        if (generating)
+            return;
+
+        generating = true;
+        while (!tasks.empty())
+        {
+            std::function<void()> next = std::move(tasks.back());
+            tasks.pop_back();
+            size_t added = tasks.size();
+            next();
+            // The stack runs the tasks just added last first, so they are turned around.
+            std::reverse(tasks.begin() + added, tasks.end());
+        }
+        generating = false;
+    }
+
+    void AFunction::cg_exprkind(Parser::ExprNode* expr_ptr)
+    {
 
         /* OPTIMIZES TOO MUCH
         {
             if (assembly.get_optimization_level() > 1 && expr_ptr->cp->type == Parser::CPValue::INT)
             {
-                Parser::IntValue* as_int = static_cast<Parser::IntValue*>(expr_ptr->cp.get());
+                Parser::IntValue* as_int = static_cast<Parser::IntValue*>(expr_ptr->cp);
                 cg_push_constant_int(as_int->value);
                 return;
             }
@@ -752,147 +793,132 @@ namespace Compiler
 
 #pragma region Primitive Literals Casting
         
+        switch (expr_ptr->kind)
         {
-            Parser::IntExprNode* result;
-            if (tryCastExpr<Parser::IntExprNode>(expr_ptr, result))
+            case Parser::INT_EXPR:
             {
+                Parser::IntExprNode* result = static_cast<Parser::IntExprNode*>(expr_ptr);
                 cg_intexpr(result);
                 return;
             }
-        }
 
-        {
-            Parser::FloatExprNode* result;
-            if (tryCastExpr<Parser::FloatExprNode>(expr_ptr, result))
+            case Parser::FLOAT_EXPR:
             {
+                Parser::FloatExprNode* result = static_cast<Parser::FloatExprNode*>(expr_ptr);
                 cg_floatexpr(result);
                 return;
             }
-        }
 
-        {
-            Parser::TrueExprNode* result;
-            if (tryCastExpr<Parser::TrueExprNode>(expr_ptr, result))
+            case Parser::TRUE_EXPR:
             {
+                Parser::TrueExprNode* result = static_cast<Parser::TrueExprNode*>(expr_ptr);
                 cg_trueexpr(result);
                 return;
             }
-        }
 
-        {
-            Parser::FalseExprNode* result;
-            if (tryCastExpr<Parser::FalseExprNode>(expr_ptr, result))
+            case Parser::FALSE_EXPR:
             {
+                Parser::FalseExprNode* result = static_cast<Parser::FalseExprNode*>(expr_ptr);
                 cg_falseexpr(result);
                 return;
             }
-        }
 
 #pragma endregion
-        
+
 #pragma region Operations Casting
-        
-        {
-            Parser::UnopExprNode* result;
-            if (tryCastExpr<Parser::UnopExprNode>(expr_ptr, result))
+
+            case Parser::UNOP_EXPR:
             {
+                Parser::UnopExprNode* result = static_cast<Parser::UnopExprNode*>(expr_ptr);
                 cg_unopexpr(result);
                 return;
             }
-        }
 
-        {
-            Parser::BinopExprNode* result;
-            if (tryCastExpr<Parser::BinopExprNode>(expr_ptr, result))
+            case Parser::BINOP_EXPR:
             {
+                Parser::BinopExprNode* result = static_cast<Parser::BinopExprNode*>(expr_ptr);
                 cg_binopexpr(result);
                 return;
             }
-        }
 
 #pragma endregion
 
 #pragma region Tuple and Array Literals Casting
 
-        {
-            Parser::TupleLiteralExprNode* result;
-            if (tryCastExpr<Parser::TupleLiteralExprNode>(expr_ptr, result))
+            case Parser::TUPLE_LITERAL_EXPR:
             {
+                Parser::TupleLiteralExprNode* result = static_cast<Parser::TupleLiteralExprNode*>(expr_ptr);
                 cg_tupleexpr(result);
                 return;
             }
-        }
 
-        {
-            Parser::ArrayLiteralExprNode* result;
-            if (tryCastExpr<Parser::ArrayLiteralExprNode>(expr_ptr, result))
+            case Parser::ARRAY_LITERAL_EXPR:
             {
+                Parser::ArrayLiteralExprNode* result = static_cast<Parser::ArrayLiteralExprNode*>(expr_ptr);
                 cg_arrayexpr(result);
                 return;
             }
-        }
 
 #pragma endregion
 
 #pragma region Tuple and Array Accesses Casting
 
-        {
-            Parser::TupleIndexExprNode* result;
-            if (tryCastExpr<Parser::TupleIndexExprNode>(expr_ptr, result))
+            case Parser::TUPLE_INDEX_EXPR:
             {
+                Parser::TupleIndexExprNode* result = static_cast<Parser::TupleIndexExprNode*>(expr_ptr);
                 cg_tupleaccessexpr(result);
                 return;
             }
-        }
 
-        {
-            Parser::ArrayIndexExprNode* result;
-            if (tryCastExpr<Parser::ArrayIndexExprNode>(expr_ptr, result))
+            case Parser::ARRAY_INDEX_EXPR:
             {
+                Parser::ArrayIndexExprNode* result = static_cast<Parser::ArrayIndexExprNode*>(expr_ptr);
                 cg_arrayindexexpr(result);
                 return;
             }
-        }
 
 #pragma endregion
 
-        {
-            Parser::VariableExprNode* result;
-            if (tryCastExpr<Parser::VariableExprNode>(expr_ptr, result))
+            case Parser::VARIABLE_EXPR:
             {
+                Parser::VariableExprNode* result = static_cast<Parser::VariableExprNode*>(expr_ptr);
                 cg_variableexpr(result);
                 return;
             }
-        }
 
-        {
-            Parser::CallExprNode* result;
-            if (tryCastExpr<Parser::CallExprNode>(expr_ptr, result))
+            case Parser::CALL_EXPR:
             {
+                Parser::CallExprNode* result = static_cast<Parser::CallExprNode*>(expr_ptr);
                 cg_callexpr(result);
                 return;
             }
-        }
 
-        {
-            Parser::IfExprNode* result;
-            if (tryCastExpr<Parser::IfExprNode>(expr_ptr, result))
+            case Parser::IF_EXPR:
             {
+                Parser::IfExprNode* result = static_cast<Parser::IfExprNode*>(expr_ptr);
                 cg_ifexpr(result);
                 return;
             }
-        }
 
-        {
-            Parser::LoopExprNode* result;
-            if (tryCastExpr<Parser::LoopExprNode>(expr_ptr, result))
+            case Parser::ARRAY_LOOP_EXPR:
+            case Parser::SUM_LOOP_EXPR:
             {
+                Parser::LoopExprNode* result = static_cast<Parser::LoopExprNode*>(expr_ptr);
                 cg_loopexpr(result);
                 return;
             }
+
+            case Parser::INLINED_CALL_EXPR:
+            {
+                Parser::InlinedCallExprNode* result = static_cast<Parser::InlinedCallExprNode*>(expr_ptr);
+                cg_inlinedcallexpr(result);
+                return;
+            }
+            default:
+                break;
         }
 
-        throw CompilerException("Unrecognized expression " + expr->token_s + ".");
+        throw CompilerException("Unrecognized expression " + expr_ptr->token_s + ".");
     }
 
 #pragma region Primitive Literals
@@ -927,6 +953,11 @@ namespace Compiler
     void AFunction::cg_unopexpr(Parser::UnopExprNode* expr)
     {
         cg_expr(expr->expression);
+        then([this, expr] {cg_unop(expr);});
+    }
+
+    void AFunction::cg_unop(Parser::UnopExprNode* expr)
+    {
         assembly_code.push_back("; " + expr->token_s);
 
         switch(expr->operation)
@@ -974,10 +1005,9 @@ namespace Compiler
     }
 
 #define BINOP_PRINT assembly_code.push_back("; " + expr->token_s);
-#define BINOP_GET_TWO_ARGS cg_expr(expr->rhs); cg_expr(expr->lhs); BINOP_PRINT
 
-#define BINOP_GET_TWO_INT_ARGS BINOP_GET_TWO_ARGS assembly_code.push_back("pop rax"); stack_size -= 8; assembly_code.push_back("pop r10"); stack_size -= 8;
-#define BINOP_GET_TWO_FLOATS_ARGS BINOP_GET_TWO_ARGS assembly_code.push_back("movsd xmm0, [rsp]"); assembly_code.push_back("add rsp, 8"); stack_size -= 8; assembly_code.push_back("movsd xmm1, [rsp]"); assembly_code.push_back("add rsp, 8"); stack_size -=8;
+#define BINOP_GET_TWO_INT_ARGS BINOP_PRINT assembly_code.push_back("pop rax"); stack_size -= 8; assembly_code.push_back("pop r10"); stack_size -= 8;
+#define BINOP_GET_TWO_FLOATS_ARGS BINOP_PRINT assembly_code.push_back("movsd xmm0, [rsp]"); assembly_code.push_back("add rsp, 8"); stack_size -= 8; assembly_code.push_back("movsd xmm1, [rsp]"); assembly_code.push_back("add rsp, 8"); stack_size -=8;
 
     void AFunction::cg_binopexpr(Parser::BinopExprNode* expr)
     {
@@ -991,6 +1021,65 @@ namespace Compiler
                 break;
         }
 
+        // multiply to shift left logical for powers of 2
+        long power;
+        Parser::NodePtr<Parser::ExprNode>* shifted = shifted_operand(expr, power);
+        if (shifted)
+        {
+            cg_expr(*shifted);
+            then([this, expr, power]
+            {
+                if (power == 0)
+                    return;
+                BINOP_PRINT
+                assembly_code.push_back("pop rax");
+                stack_size -= 8;
+                assembly_code.push_back("shl rax, " + std::to_string(power));
+                assembly_code.push_back("push rax");
+                stack_size += 8;
+            });
+            return;
+        }
+
+        cg_expr(expr->rhs);
+        cg_expr(expr->lhs);
+        then([this, expr] {cg_binop(expr);});
+    }
+
+    Parser::NodePtr<Parser::ExprNode>* AFunction::shifted_operand(Parser::BinopExprNode* expr, long& power)
+    {
+        if (assembly.get_optimization_level() < 1 || expr->operation != Parser::BinopExprNode::TIMES
+            || expr->resolvedType->type_name != Typechecker::INT)
+            return nullptr;
+
+        auto is_known_power = [&](Parser::ExprNode* operand)
+        {
+            long value;
+            if (assembly.get_optimization_level() == 1) // literals
+            {
+                Parser::IntExprNode* operand_cast;
+                if (! tryCastExpr<Parser::IntExprNode>(operand, operand_cast))
+                    return false;
+                value = operand_cast->value;
+            }
+            else // CPValues
+            {
+                if (operand->cp->type != Parser::CPValue::INT)
+                    return false;
+                value = static_cast<Parser::IntValue*>(operand->cp)->value;
+            }
+            return is_power_of_two(value, power) && value != 0;
+        };
+
+        if (is_known_power(expr->lhs.get()))
+            return &expr->rhs;
+        if (is_known_power(expr->rhs.get()))
+            return &expr->lhs;
+        return nullptr;
+    }
+
+    void AFunction::cg_binop(Parser::BinopExprNode* expr)
+    {
         switch (expr->operation)
         {
             case Parser::BinopExprNode::PLUS:
@@ -1037,113 +1126,6 @@ namespace Compiler
                 switch (expr->resolvedType->type_name)
                 {
                     case Typechecker::INT:
-
-                        if (assembly.get_optimization_level() == 1) // multiply to shift left logical for powers of 2
-                        {
-                            Parser::ExprNode* lhs = expr->lhs.get();
-                            Parser::IntExprNode* lhs_cast;
-                            bool lhs_casted = tryCastExpr<Parser::IntExprNode>(lhs, lhs_cast);
-                            long power;
-                            long multiply_amount = 0;
-
-                            bool optimized = false;
-
-                            if (lhs_casted && (is_power_of_two(lhs_cast->value, power) && lhs_cast->value != 0))
-                            {
-                                multiply_amount = lhs_cast->value;
-                                if (multiply_amount != 0)
-                                    cg_expr(expr->rhs);
-                                optimized = true;
-                            }
-
-                            if (! optimized)
-                            {
-                                Parser::ExprNode* rhs = expr->rhs.get();
-                                Parser::IntExprNode* rhs_cast;
-                                bool rhs_casted = tryCastExpr<Parser::IntExprNode>(rhs, rhs_cast);
-
-                                if (rhs_casted && (is_power_of_two(rhs_cast->value, power) && rhs_cast->value != 0))
-                                {
-                                    multiply_amount = rhs_cast->value;
-                                    if (multiply_amount != 0)
-                                        cg_expr(expr->lhs);
-                                    optimized = true;
-                                }
-                            }
-
-                            if (optimized && power != 0)
-                            {
-                                BINOP_PRINT
-                                assembly_code.push_back("pop rax");
-                                stack_size -= 8;
-                                assembly_code.push_back("shl rax, " + std::to_string(power));
-                                assembly_code.push_back("push rax");
-                                stack_size += 8;
-                                return;
-                            }
-                            else if (power == 0 && multiply_amount == 1)
-                            {
-                                return;
-                            }
-                        }
-
-                        if (assembly.get_optimization_level() > 1) // multiply to shift left logical for powers of 2 CPValues
-                        {
-                            bool optimized = false;
-                            long power;
-                            long multiply_amount = 0;
-
-                            Parser::CPValue* lhs = expr->lhs->cp.get();
-                            bool can_cast_lhs = lhs->type == Parser::CPValue::INT;
-                            
-                            if (can_cast_lhs)
-                            {
-                                Parser::IntValue* lhs_cast = static_cast<Parser::IntValue*>(lhs); 
-
-                                if (is_power_of_two(lhs_cast->value, power) && lhs_cast->value != 0)
-                                {
-                                    multiply_amount = lhs_cast->value;
-                                    if (multiply_amount != 0)
-                                        cg_expr(expr->rhs);
-                                    optimized = true;
-                                }
-                            }
-
-                            if (! optimized)
-                            {
-                                Parser::CPValue* rhs = expr->rhs->cp.get();
-                                bool can_cast_rhs = rhs->type == Parser::CPValue::INT;
-                                
-                                if (can_cast_rhs)
-                                {
-                                    Parser::IntValue* rhs_cast = static_cast<Parser::IntValue*>(rhs);
-
-                                    if (is_power_of_two(rhs_cast->value, power) && rhs_cast->value != 0)
-                                    {
-                                        multiply_amount = rhs_cast->value;
-                                        if (multiply_amount != 0)
-                                            cg_expr(expr->lhs);
-                                        optimized = true;
-                                    }
-                                }
-                            }
-
-                            if (optimized && power != 0)
-                            {
-                                BINOP_PRINT
-                                assembly_code.push_back("pop rax");
-                                stack_size -= 8;
-                                assembly_code.push_back("shl rax, " + std::to_string(power));
-                                assembly_code.push_back("push rax");
-                                stack_size += 8;
-                                return;
-                            }
-                            else if (power == 0 && multiply_amount == 1)
-                            {
-                                return;
-                            }
-                        }
-
                         BINOP_GET_TWO_INT_ARGS
                         assembly_code.push_back("imul rax, r10");
                         assembly_code.push_back("push rax");
@@ -1216,13 +1198,13 @@ namespace Compiler
                         }
                     case Typechecker::FLOAT:
                         {
-                        //FUNCTION_CALL_ALIGNMENT_CHECK(-16)
                         BINOP_GET_TWO_FLOATS_ARGS
+                        FUNCTION_CALL_ALIGNMENT_CHECK(0)
                         assembly_code.push_back("call _fmod");
+                        FUNCTION_CALL_ALIGNMENT_CLOSE
                         assembly_code.push_back("sub rsp, 8");
                         stack_size += 8;
                         assembly_code.push_back("movsd [rsp], xmm0");
-                        //FUNCTION_CALL_ALIGNMENT_CLOSE
                         return;
                         }
                     default:
@@ -1386,8 +1368,8 @@ namespace Compiler
     
     void AFunction::cg_arrayexpr(Parser::ArrayLiteralExprNode* expr)
     {
-        Typechecker::ArrayRType* array_r_type = static_cast<Typechecker::ArrayRType*>(expr->resolvedType.get());
-        unsigned int element_size = calc_stack_size(array_r_type->element_type);
+        Typechecker::ArrayRType* array_r_type = static_cast<Typechecker::ArrayRType*>(expr->resolvedType);
+        unsigned int element_size = calc_stack_size(array_r_type->element_type.get());
         unsigned int heap_size = element_size * expr->array_expressions.size();
 
         // Check for overflow
@@ -1397,27 +1379,30 @@ namespace Compiler
         for (int i = expr->array_expressions.size() - 1 ; i >= 0; i--)
             cg_expr(expr->array_expressions[i]);
 
-        assembly_code.push_back("mov  rdi, " + std::to_string(heap_size));
-        FUNCTION_CALL_ALIGNMENT_CHECK(0)
-        assembly_code.push_back("call _jpl_alloc");
-        FUNCTION_CALL_ALIGNMENT_CLOSE
-
-        assembly_code.push_back("; moving " + std::to_string(heap_size) + " from rsp to rax onto the heap.");
-        
-        for (int i = heap_size / 8 - 1; i >= 0; i-- )
+        then([this, expr, heap_size]
         {
-            unsigned int offset = i * 8; 
-            assembly_code.push_back("mov r10, [rsp + " + std::to_string(offset) + "]");
-            assembly_code.push_back("mov [rax + " + std::to_string(offset) + "], r10");
-        }
+            assembly_code.push_back("mov  rdi, " + std::to_string(heap_size));
+            FUNCTION_CALL_ALIGNMENT_CHECK(0)
+            assembly_code.push_back("call _jpl_alloc");
+            FUNCTION_CALL_ALIGNMENT_CLOSE
 
-        assembly_code.push_back("add rsp, " + std::to_string(heap_size));
-        stack_size -= heap_size;
-        assembly_code.push_back("push rax");
-        stack_size += 8;
-        assembly_code.push_back("mov rax, " + std::to_string(expr->array_expressions.size()));
-        assembly_code.push_back("push rax");
-        stack_size += 8;
+            assembly_code.push_back("; moving " + std::to_string(heap_size) + " from rsp to rax onto the heap.");
+
+            for (int i = heap_size / 8 - 1; i >= 0; i-- )
+            {
+                unsigned int offset = i * 8; 
+                assembly_code.push_back("mov r10, [rsp + " + std::to_string(offset) + "]");
+                assembly_code.push_back("mov [rax + " + std::to_string(offset) + "], r10");
+            }
+
+            assembly_code.push_back("add rsp, " + std::to_string(heap_size));
+            stack_size -= heap_size;
+            assembly_code.push_back("push rax");
+            stack_size += 8;
+            assembly_code.push_back("mov rax, " + std::to_string(expr->array_expressions.size()));
+            assembly_code.push_back("push rax");
+            stack_size += 8;
+        });
     }
     
 #pragma endregion
@@ -1428,30 +1413,33 @@ namespace Compiler
     {
         cg_expr(expr->tuple_expression);
 
-        long tuple_index = expr->tuple_index;
+        then([this, expr]
+        {
+            long tuple_index = expr->tuple_index;
 
-        unsigned int total_tuple_size = calc_stack_size(expr->tuple_expression->resolvedType);
-        Typechecker::TupleRType* tuple_r_type = static_cast<Typechecker::TupleRType*>(expr->tuple_expression->resolvedType.get());
-        unsigned int element_size = calc_stack_size(tuple_r_type->element_types[tuple_index]);
-        
-        unsigned int move_operations = element_size / 8;
-        unsigned int element_offset = 0;
-        for (int i = 0; i < tuple_index; i++)
-            element_offset += calc_stack_size(tuple_r_type->element_types[i]);
-        unsigned int stack_size_removed = total_tuple_size - element_size;
-        
-        assembly_code.push_back("; moving " + std::to_string(element_size) + " bytes from rsp  + " + std::to_string(element_offset) + " to rsp + " + std::to_string(stack_size_removed));
+            unsigned int total_tuple_size = calc_stack_size(expr->tuple_expression->resolvedType);
+            Typechecker::TupleRType* tuple_r_type = static_cast<Typechecker::TupleRType*>(expr->tuple_expression->resolvedType);
+            unsigned int element_size = calc_stack_size(tuple_r_type->element_types[tuple_index].get());
 
-        for (int i = move_operations - 1; i >= 0; i--)
-        {
-            unsigned int initial_offset = element_offset + i * 8;
-            unsigned int final_offset = stack_size_removed + i * 8;
-            assembly_code.push_back("mov r10, [rsp " + ((initial_offset == 0) ? "" : "+ " + std::to_string(initial_offset)) + "]");
-            assembly_code.push_back("mov [rsp " + ((final_offset == 0) ? "" : "+ " + std::to_string(final_offset)) + "], r10");
-        }
+            unsigned int move_operations = element_size / 8;
+            unsigned int element_offset = 0;
+            for (int i = 0; i < tuple_index; i++)
+                element_offset += calc_stack_size(tuple_r_type->element_types[i].get());
+            unsigned int stack_size_removed = total_tuple_size - element_size;
+
+            assembly_code.push_back("; moving " + std::to_string(element_size) + " bytes from rsp  + " + std::to_string(element_offset) + " to rsp + " + std::to_string(stack_size_removed));
+
+            for (int i = move_operations - 1; i >= 0; i--)
+            {
+                unsigned int initial_offset = element_offset + i * 8;
+                unsigned int final_offset = stack_size_removed + i * 8;
+                assembly_code.push_back("mov r10, [rsp " + ((initial_offset == 0) ? "" : "+ " + std::to_string(initial_offset)) + "]");
+                assembly_code.push_back("mov [rsp " + ((final_offset == 0) ? "" : "+ " + std::to_string(final_offset)) + "], r10");
+            }
 
-        assembly_code.push_back("add rsp, " + std::to_string(stack_size_removed));
-        stack_size -= stack_size_removed;
+            assembly_code.push_back("add rsp, " + std::to_string(stack_size_removed));
+            stack_size -= stack_size_removed;
+        });
     }
 
 #pragma endregion
@@ -1460,7 +1448,7 @@ namespace Compiler
     {
         if (assembly.get_optimization_level() > 1 && expr->cp->type == Parser::CPValue::INT)
         {
-            Parser::IntValue* int_val = static_cast<Parser::IntValue*>(expr->cp.get());
+            Parser::IntValue* int_val = static_cast<Parser::IntValue*>(expr->cp);
 
             if (under_32_bits(int_val->value))
             {
@@ -1469,9 +1457,9 @@ namespace Compiler
             }
         }
 
-        if (stack_size.has_temporary(expr->token_s))
+        if (stack_size.has_temporary(expr->symbol))
         {
-            int offset = stack_size.get_offset(expr->token_s);
+            int offset = stack_size.get_offset(expr->symbol);
             unsigned int bytes_to_move = calc_stack_size(expr->resolvedType);
             assembly_code.push_back("sub rsp, " + std::to_string(bytes_to_move));
             stack_size += bytes_to_move;
@@ -1484,7 +1472,7 @@ namespace Compiler
         }
         else
         {
-            int offset = global_stack->get_offset(expr->token_s);
+            int offset = global_stack->get_offset(expr->symbol);
             unsigned int bytes_to_move = calc_stack_size(expr->resolvedType);
             assembly_code.push_back("sub rsp, " + std::to_string(bytes_to_move));
             stack_size += bytes_to_move;
@@ -1517,121 +1505,129 @@ namespace Compiler
             // calculate the value of the expression
         }
 
-        for (const CallingConvention::MemoryLocationData& memdata : cc.argument_pop_order)
+        then([this, expr, cc, needs_alignment]
         {
-            if (CallingConvention::is_r_register(memdata.location))
+            for (const CallingConvention::MemoryLocationData& memdata : cc.argument_pop_order)
             {
-                assembly_code.push_back("pop " + CallingConvention::get_register_name(memdata.location));
-                stack_size -= 8;
+                if (CallingConvention::is_r_register(memdata.location))
+                {
+                    assembly_code.push_back("pop " + CallingConvention::get_register_name(memdata.location));
+                    stack_size -= 8;
+                }
+                else if (CallingConvention::is_f_register(memdata.location))
+                {
+                    assembly_code.push_back("movsd " + CallingConvention::get_register_name(memdata.location) + ", [rsp]");
+                    assembly_code.push_back("add rsp, 8");
+                    stack_size -= 8;
+                }
+                else
+                    break;
             }
-            else if (CallingConvention::is_f_register(memdata.location))
+
+            if (! cc.is_void_return && cc.return_location == CallingConvention::STACK)
             {
-                assembly_code.push_back("movsd " + CallingConvention::get_register_name(memdata.location) + ", [rsp]");
-                assembly_code.push_back("add rsp, 8");
-                stack_size -= 8;
+                unsigned int distance_from_return = cc.stack_argument_size + ((needs_alignment)? 8 : 0);
+                assembly_code.push_back("lea rdi, [rsp + " + std::to_string(distance_from_return) + "]; putting return into rdi");
             }
-            else
-                break;
-        }
 
-        if (! cc.is_void_return && cc.return_location == CallingConvention::STACK)
-        {
-            unsigned int distance_from_return = cc.stack_argument_size + ((needs_alignment)? 8 : 0);
-            assembly_code.push_back("lea rdi, [rsp + " + std::to_string(distance_from_return) + "]; putting return into rdi");
-        }
+            assembly_code.push_back("call _" + expr->function_name);
 
-        assembly_code.push_back("call _" + expr->function_name);
-        
-        for (int i = 0; i < cc.argument_pop_order.size(); i++)
-        {
-            const CallingConvention::MemoryLocationData& data = cc.argument_pop_order[i];
-            if (data.location == CallingConvention::STACK)
+            for (int i = 0; i < cc.argument_pop_order.size(); i++)
             {
-                unsigned int bytes_to_remove = calc_stack_size(cc.arg_signature[data.argument_number]);
-                assembly_code.push_back("add rsp, " + std::to_string(bytes_to_remove));
-                stack_size -= bytes_to_remove;
+                const CallingConvention::MemoryLocationData& data = cc.argument_pop_order[i];
+                if (data.location == CallingConvention::STACK)
+                {
+                    unsigned int bytes_to_remove = calc_stack_size(cc.arg_signature[data.argument_number].get());
+                    assembly_code.push_back("add rsp, " + std::to_string(bytes_to_remove));
+                    stack_size -= bytes_to_remove;
+                }
             }
-        }
-
-        /*
-        if (cc.stack_argument_size > 0)
-        {
-            The GOOD way to remove all the stack arguments
-            assembly_code.push_back("add rsp, " + std::to_string(cc.stack_argument_size));
-            stack_size -= cc.stack_argument_size;
-        }*/
-        
-        FUNCTION_CALL_ALIGNMENT_CLOSE
 
-        if (! cc.is_void_return)
-        {
-            if (CallingConvention::is_r_register(cc.return_location))
+            /*
+            if (cc.stack_argument_size > 0)
             {
-                assembly_code.push_back("push " + CallingConvention::get_register_name(cc.return_location));
-                stack_size += 8;
-            }
+                The GOOD way to remove all the stack arguments
+                assembly_code.push_back("add rsp, " + std::to_string(cc.stack_argument_size));
+                stack_size -= cc.stack_argument_size;
+            }*/
 
-            if (CallingConvention::is_f_register(cc.return_location))
+            FUNCTION_CALL_ALIGNMENT_CLOSE
+
+            if (! cc.is_void_return)
             {
-                assembly_code.push_back("sub rsp, 8");
-                assembly_code.push_back("movsd [rsp], " + CallingConvention::get_register_name(cc.return_location));
-                stack_size += 8;
+                if (CallingConvention::is_r_register(cc.return_location))
+                {
+                    assembly_code.push_back("push " + CallingConvention::get_register_name(cc.return_location));
+                    stack_size += 8;
+                }
+
+                if (CallingConvention::is_f_register(cc.return_location))
+                {
+                    assembly_code.push_back("sub rsp, 8");
+                    assembly_code.push_back("movsd [rsp], " + CallingConvention::get_register_name(cc.return_location));
+                    stack_size += 8;
+                }
             }
-        }
+        });
     }
 
     void AFunction::cg_ifexpr(Parser::IfExprNode* expr)
     {
         cg_expr(expr->condition);
         
-        // if b then 1 else 0 optimization
-        if (assembly.get_optimization_level() == 1)
-        {
-            Parser::ExprNode* _then = expr->then_expr.get();
-            Parser::ExprNode* _else = expr->else_expr.get();
-            Parser::IntExprNode* then_cast;
-            Parser::IntExprNode* else_cast;
-            bool then_cast_success = tryCastExpr<Parser::IntExprNode>(_then, then_cast);
-            bool else_cast_success = tryCastExpr<Parser::IntExprNode>(_else, else_cast);
-            if (then_cast_success && else_cast_success && then_cast->value == 1 && else_cast->value == 0)
-                return;
-        }
-        else if (assembly.get_optimization_level() > 1)
-        {
-            Parser::CPValue* _then = expr->then_expr->cp.get();
-            Parser::CPValue* _else = expr->else_expr->cp.get();
-            bool then_cast_success = _then->type == Parser::CPValue::INT;
-            bool else_cast_success = _else->type == Parser::CPValue::INT;
-            if (then_cast_success && else_cast_success)
-            {
-                Parser::IntValue* then_cast = static_cast<Parser::IntValue*>(_then);
-                Parser::IntValue* else_cast = static_cast<Parser::IntValue*>(_else);
-                
-                if (then_cast->value == 1 && else_cast->value == 0)
+        then([this, expr]
+        {
+            // if b then 1 else 0 optimization
+            if (assembly.get_optimization_level() == 1)
+            {
+                Parser::ExprNode* _then = expr->then_expr.get();
+                Parser::ExprNode* _else = expr->else_expr.get();
+                Parser::IntExprNode* then_cast;
+                Parser::IntExprNode* else_cast;
+                bool then_cast_success = tryCastExpr<Parser::IntExprNode>(_then, then_cast);
+                bool else_cast_success = tryCastExpr<Parser::IntExprNode>(_else, else_cast);
+                if (then_cast_success && else_cast_success && then_cast->value == 1 && else_cast->value == 0)
                     return;
             }
-        }
+            else if (assembly.get_optimization_level() > 1)
+            {
+                Parser::CPValue* _then = expr->then_expr->cp;
+                Parser::CPValue* _else = expr->else_expr->cp;
+                bool then_cast_success = _then->type == Parser::CPValue::INT;
+                bool else_cast_success = _else->type == Parser::CPValue::INT;
+                if (then_cast_success && else_cast_success)
+                {
+                    Parser::IntValue* then_cast = static_cast<Parser::IntValue*>(_then);
+                    Parser::IntValue* else_cast = static_cast<Parser::IntValue*>(_else);
 
-        // regular if statement
-        assembly_code.push_back("pop rax");
-        stack_size -= 8;
-        assembly_code.push_back("cmp rax, 0 ; " + expr->token_s);
+                    if (then_cast->value == 1 && else_cast->value == 0)
+                        return;
+                }
+            }
 
-        std::string else_jump = assembly.get_new_jump();
-        std::string end_jump = assembly.get_new_jump();
+            // regular if statement
+            assembly_code.push_back("pop rax");
+            stack_size -= 8;
+            assembly_code.push_back("cmp rax, 0 ; " + expr->token_s);
 
-        assembly_code.push_back("je " + else_jump);
-        // Then
-        cg_expr(expr->then_expr);
-        assembly_code.push_back("jmp " + end_jump);
-        
-        stack_size -= calc_stack_size(expr->resolvedType); // Only one of the two options will get pushed.
+            std::string else_jump = assembly.get_new_jump();
+            std::string end_jump = assembly.get_new_jump();
+
+            assembly_code.push_back("je " + else_jump);
+            // Then
+            cg_expr(expr->then_expr);
+            then([this, expr, else_jump, end_jump]
+            {
+                assembly_code.push_back("jmp " + end_jump);
 
-        // Else
-        assembly_code.push_back(else_jump + ":");
-        cg_expr(expr->else_expr);
+                stack_size -= calc_stack_size(expr->resolvedType); // Only one of the two options will get pushed.
 
-        assembly_code.push_back(end_jump + ":");
+                // Else
+                assembly_code.push_back(else_jump + ":");
+                cg_expr(expr->else_expr);
+                then([this, end_jump] {assembly_code.push_back(end_jump + ":");});
+            });
+        });
     }
 
     inline void AFunction::cg_shortcircuit(Parser::BinopExprNode* expr)
@@ -1654,19 +1650,25 @@ namespace Compiler
 
         cg_expr(expr->lhs);
         
-        assembly_code.push_back("pop rax");
-        stack_size -= 8;
-        assembly_code.push_back("cmp rax, 0");
-        std::string rhs_skip_label = assembly.get_new_jump();
-        assembly_code.push_back(jmp + rhs_skip_label);
-        
-        cg_expr(expr->rhs);
-        assembly_code.push_back("pop rax");
-        stack_size -= 8;
-        
-        assembly_code.push_back(rhs_skip_label + ":");
-        assembly_code.push_back("push rax");
-        stack_size += 8;
+        then([this, expr, jmp]
+        {
+            assembly_code.push_back("pop rax");
+            stack_size -= 8;
+            assembly_code.push_back("cmp rax, 0");
+            std::string rhs_skip_label = assembly.get_new_jump();
+            assembly_code.push_back(jmp + rhs_skip_label);
+
+            cg_expr(expr->rhs);
+            then([this, rhs_skip_label]
+            {
+                assembly_code.push_back("pop rax");
+                stack_size -= 8;
+
+                assembly_code.push_back(rhs_skip_label + ":");
+                assembly_code.push_back("push rax");
+                stack_size += 8;
+            });
+        });
     }
 
 #pragma endregion
@@ -1675,31 +1677,30 @@ namespace Compiler
 
     bool AFunction::cg_stmt(Parser::StmtNode* stmt, CallingConvention cc)
     {
+        switch (stmt->kind)
         {
-            Parser::LetStmtNode* result;
-            if (tryCastStmt<Parser::LetStmtNode>(stmt, result))
+            case Parser::LET_STMT:
             {
+                Parser::LetStmtNode* result = static_cast<Parser::LetStmtNode*>(stmt);
                 cg_letstmt(result);
                 return false;
             }
-        }
 
-        {
-            Parser::ReturnStmtNode* result;
-            if (tryCastStmt<Parser::ReturnStmtNode>(stmt, result))
+            case Parser::RETURN_STMT:
             {
+                Parser::ReturnStmtNode* result = static_cast<Parser::ReturnStmtNode*>(stmt);
                 cg_returnstmt(result, cc);
                 return true;
             }
-        }
 
-        {
-            Parser::AssertStmtNode* result;
-            if (tryCastStmt<Parser::AssertStmtNode>(stmt, result))
+            case Parser::ASSERT_STMT:
             {
+                Parser::AssertStmtNode* result = static_cast<Parser::AssertStmtNode*>(stmt);
                 cg_assertstmt(result);
                 return false;
             }
+            default:
+                break;
         }
 
         throw CompilerException("Could not generate code for unimplemented statement.");
@@ -1708,22 +1709,31 @@ namespace Compiler
     void AFunction::cg_letstmt(Parser::LetStmtNode* stmt)
     {
         cg_expr(stmt->variable_expression);
-        assembly_code.push_back("; " + stmt->token_s + " | line: " + std::to_string(stmt->line));
-        stack_size.add_lvalue(stmt->set_variable_name.get(), stmt->variable_expression->resolvedType, stack_size.get_size_of_temporaries());
+        then([this, stmt]
+        {
+            assembly_code.push_back("; " + stmt->token_s + " | line: " + std::to_string(stmt->line));
+            stack_size.add_lvalue(stmt->set_variable_name.get(), stmt->variable_expression->resolvedType->shared_from_this(), stack_size.get_size_of_temporaries());
+        });
     }
 
     void AFunction::cg_returnstmt(Parser::ReturnStmtNode* stmt, CallingConvention cc)
     {
         cg_expr(stmt->expression);
 
-        add_function_return_code(cc);
+        then([this, cc]
+        {
+            add_function_return_code(cc);
+        });
     }
 
     void AFunction::cg_arrayindexexpr(Parser::ArrayIndexExprNode* expr)
     {
         Parser::ExprNode* array_non_cast = expr->array_expression.get();
-        Parser::VariableExprNode* array_cast;
-        bool  optimize_array_copy = (assembly.get_optimization_level() > 0) && (tryCastExpr<Parser::VariableExprNode>(array_non_cast, array_cast));
+        Parser::VariableExprNode* array_cast = nullptr;
+        // Only an array on this function's stack is indexed in place; a global one read from a
+        // function is copied like any other expression.
+        bool  optimize_array_copy = (assembly.get_optimization_level() > 0) && (tryCastExpr<Parser::VariableExprNode>(array_non_cast, array_cast))
+            && stack_size.has_temporary(array_cast->symbol);
 
         if (! optimize_array_copy)
             cg_expr(expr->array_expression);
@@ -1734,354 +1744,494 @@ namespace Compiler
             cg_expr(expr->array_indices[i]);
         }
 
-        // Check indices are valid
-        long indices_size = expr->array_indices.size() * 8;
-        long gap = (optimize_array_copy) ? stack_size.get_stack_size() - stack_size.get_offset(array_cast->token_s) : indices_size;
-
-        std::string neg_expt = "negative array index";
-        std::string neg_expt_const = assembly.add_constant_string(neg_expt);
-        std::string ovr_expt = "index too large";
-        std::string ovr_expt_const = assembly.add_constant_string(ovr_expt);
-        
-        for (int i  = 0; i < expr->array_indices.size(); i++)
+        then([this, expr, optimize_array_copy, array_cast]
         {
-            std::string neg_good_jump = assembly.get_new_jump();
-            std::string ovr_good_jump = assembly.get_new_jump();
+            // Check indices are valid
+            long indices_size = expr->array_indices.size() * 8;
+            long gap = (optimize_array_copy) ? stack_size.get_stack_size() - stack_size.get_offset(array_cast->symbol) : indices_size;
 
-            // negative
-            assembly_code.push_back("mov rax, [rsp + " + std::to_string(i * 8) + "]");
-            assembly_code.push_back("cmp rax, 0");
-            assembly_code.push_back("jge " + neg_good_jump);
-            {
-            FUNCTION_CALL_ALIGNMENT_CHECK(0);
-            assembly_code.push_back("lea rdi, [rel " + neg_expt_const + "] ; " + neg_expt);
-            assembly_code.push_back("call _fail_assertion");
-            FUNCTION_CALL_ALIGNMENT_CLOSE
-            }
-            assembly_code.push_back(neg_good_jump + ":");
+            std::string neg_expt = "negative array index";
+            std::string neg_expt_const = assembly.add_constant_string(neg_expt);
+            std::string ovr_expt = "index too large";
+            std::string ovr_expt_const = assembly.add_constant_string(ovr_expt);
 
-            // overflow
-            assembly_code.push_back("cmp rax, [rsp + " + std::to_string(i * 8 + gap) + "]");
-            assembly_code.push_back("jl " + ovr_good_jump);
+            for (int i  = 0; i < expr->array_indices.size(); i++)
             {
-            FUNCTION_CALL_ALIGNMENT_CHECK(0);
-            assembly_code.push_back("lea rdi, [rel " + ovr_expt_const + "] ; " + ovr_expt);
-            assembly_code.push_back("call _fail_assertion");
-            FUNCTION_CALL_ALIGNMENT_CLOSE
-            }
-            assembly_code.push_back(ovr_good_jump + ":");
-        }
+                // The optimizer marks the checks known to pass.
+                bool check_negative = i >= expr->nonnegative.size() || !expr->nonnegative[i];
+                bool check_overflow = i >= expr->in_bounds.size() || !expr->in_bounds[i];
+                if (check_negative || check_overflow)
+                    assembly_code.push_back("mov rax, [rsp + " + std::to_string(i * 8) + "]");
 
-        // Compute address to index into
-        if (assembly.get_optimization_level() < 1)
-        {  // mov rax, 0 ; imul rax, [rsp + ... ] ; add rax, [rsp + ...] is wasteful
-            assembly_code.push_back("mov rax, 0");
+                // negative
+                if (check_negative)
+                {
+                    std::string neg_good_jump = assembly.get_new_jump();
+                    assembly_code.push_back("cmp rax, 0");
+                    assembly_code.push_back("jge " + neg_good_jump);
+                    {
+                    FUNCTION_CALL_ALIGNMENT_CHECK(0);
+                    assembly_code.push_back("lea rdi, [rel " + neg_expt_const + "] ; " + neg_expt);
+                    assembly_code.push_back("call _fail_assertion");
+                    FUNCTION_CALL_ALIGNMENT_CLOSE
+                    }
+                    assembly_code.push_back(neg_good_jump + ":");
+                }
 
-            for (int i = 0; i < expr->array_indices.size(); i++)
-            {
-                assembly_code.push_back("imul rax, [rsp + " + std::to_string(i * 8 + gap)  + "]");
-                assembly_code.push_back("add rax, [rsp + " + std::to_string(i * 8) + "]");
+                // overflow
+                if (check_overflow)
+                {
+                    std::string ovr_good_jump = assembly.get_new_jump();
+                    assembly_code.push_back("cmp rax, [rsp + " + std::to_string(i * 8 + gap) + "]");
+                    assembly_code.push_back("jl " + ovr_good_jump);
+                    {
+                    FUNCTION_CALL_ALIGNMENT_CHECK(0);
+                    assembly_code.push_back("lea rdi, [rel " + ovr_expt_const + "] ; " + ovr_expt);
+                    assembly_code.push_back("call _fail_assertion");
+                    FUNCTION_CALL_ALIGNMENT_CLOSE
+                    }
+                    assembly_code.push_back(ovr_good_jump + ":");
+                }
             }
-        }
-        else if (assembly.get_optimization_level() == 1 || expr->array_expression->cp->type != Parser::CPValue::ARRAY)
-        { // mov rax, [rsp]
-            assembly_code.push_back("mov rax, [rsp]");
 
-            for (int i = 1; i < expr->array_indices.size(); i++)
-            { // optimize ?
-                assembly_code.push_back("imul rax, [rsp + " + std::to_string(i * 8 + gap)  + "]");
-                assembly_code.push_back("add rax, [rsp + " + std::to_string(i * 8) + "]");
-            }
-        }
-        else
-        {
-            assembly_code.push_back("mov rax, [rsp]");
-            Parser::ArrayValue* array_value = static_cast<Parser::ArrayValue*>(expr->array_expression->cp.get());
+            // Compute address to index into
+            if (assembly.get_optimization_level() < 1)
+            {  // mov rax, 0 ; imul rax, [rsp + ... ] ; add rax, [rsp + ...] is wasteful
+                assembly_code.push_back("mov rax, 0");
 
-            for (int i = 1; i < expr->array_indices.size(); i++)
-            { // optimize ?
-                Parser::CPValue* index_value = array_value->lengths[i].get();
-                
-                if (index_value->type == Parser::CPValue::INT)
+                for (int i = 0; i < expr->array_indices.size(); i++)
                 {
-                    Parser::IntValue* int_index_value = static_cast<Parser::IntValue*>(index_value);
-                    long mult_amount = int_index_value->value;
-                    long power;
-                    if (is_power_of_two(mult_amount, power))
-                        assembly_code.push_back("shl rax, " + std::to_string(power));
-                    else        
-                        assembly_code.push_back("imul rax, " + std::to_string(mult_amount));
+                    assembly_code.push_back("imul rax, [rsp + " + std::to_string(i * 8 + gap)  + "]");
+                    assembly_code.push_back("add rax, [rsp + " + std::to_string(i * 8) + "]");
                 }
-                else
+            }
+            else if (assembly.get_optimization_level() == 1 || expr->array_expression->cp->type != Parser::CPValue::ARRAY)
+            { // mov rax, [rsp]
+                assembly_code.push_back("mov rax, [rsp]");
+
+                for (int i = 1; i < expr->array_indices.size(); i++)
+                { // optimize ?
                     assembly_code.push_back("imul rax, [rsp + " + std::to_string(i * 8 + gap)  + "]");
-                assembly_code.push_back("add rax, [rsp + " + std::to_string(i * 8) + "]");
+                    assembly_code.push_back("add rax, [rsp + " + std::to_string(i * 8) + "]");
+                }
             }
-        }
-        // optimize
-        long mult_amount = calc_stack_size(expr->resolvedType);
-        long power;
-        if (assembly.get_optimization_level() > 0 && is_power_of_two(mult_amount, power))
-            assembly_code.push_back("shl rax, " + std::to_string(power) + " ; multiply by size of elements");
-        else        
-            assembly_code.push_back("imul rax, " + std::to_string(mult_amount) + " ; multiply by size of elements");
-        assembly_code.push_back("add rax, [rsp + " + std::to_string(indices_size + gap) + "] ; add ptr for address in heap");
+            else
+            {
+                assembly_code.push_back("mov rax, [rsp]");
+                Parser::ArrayValue* array_value = static_cast<Parser::ArrayValue*>(expr->array_expression->cp);
 
-        // Free indices
-        if (! optimize_array_copy)
-        {
-            for (int i = 0; i < expr->array_indices.size(); i++)
+                for (int i = 1; i < expr->array_indices.size(); i++)
+                { // optimize ?
+                    Parser::CPValue* index_value = array_value->lengths[i];
+
+                    if (index_value->type == Parser::CPValue::INT)
+                    {
+                        Parser::IntValue* int_index_value = static_cast<Parser::IntValue*>(index_value);
+                        long mult_amount = int_index_value->value;
+                        long power;
+                        if (is_power_of_two(mult_amount, power))
+                            assembly_code.push_back("shl rax, " + std::to_string(power));
+                        else        
+                            assembly_code.push_back("imul rax, " + std::to_string(mult_amount));
+                    }
+                    else
+                        assembly_code.push_back("imul rax, [rsp + " + std::to_string(i * 8 + gap)  + "]");
+                    assembly_code.push_back("add rax, [rsp + " + std::to_string(i * 8) + "]");
+                }
+            }
+            // optimize
+            long mult_amount = calc_stack_size(expr->resolvedType);
+            long power;
+            if (assembly.get_optimization_level() > 0 && is_power_of_two(mult_amount, power))
+                assembly_code.push_back("shl rax, " + std::to_string(power) + " ; multiply by size of elements");
+            else        
+                assembly_code.push_back("imul rax, " + std::to_string(mult_amount) + " ; multiply by size of elements");
+            assembly_code.push_back("add rax, [rsp + " + std::to_string(indices_size + gap) + "] ; add ptr for address in heap");
+
+            // Free indices
+            if (! optimize_array_copy)
             {
-                assembly_code.push_back("add rsp, 8");
-                stack_size -= 8;
+                for (int i = 0; i < expr->array_indices.size(); i++)
+                {
+                    assembly_code.push_back("add rsp, 8");
+                    stack_size -= 8;
+                }
+            }
+            else // THE METHOD FOR FREEING INDICES CHANGED
+            {
+                assembly_code.push_back("add rsp, " + std::to_string(indices_size));
+                stack_size -= indices_size;
             }
-        }
-        else // THE METHOD FOR FREEING INDICES CHANGED
-        {
-            assembly_code.push_back("add rsp, " + std::to_string(indices_size));
-            stack_size -= indices_size;
-        }
 
-        // Free array
-        if (! optimize_array_copy)
-        {
-            assembly_code.push_back("add rsp, " + std::to_string(calc_stack_size(expr->array_expression->resolvedType)));
-            stack_size -= calc_stack_size(expr->array_expression->resolvedType);
-        }
+            // Free array
+            if (! optimize_array_copy)
+            {
+                assembly_code.push_back("add rsp, " + std::to_string(calc_stack_size(expr->array_expression->resolvedType)));
+                stack_size -= calc_stack_size(expr->array_expression->resolvedType);
+            }
 
-        // Get value off the stack
-        assembly_code.push_back("sub rsp, " + std::to_string(calc_stack_size(expr->resolvedType)));
-        stack_size += calc_stack_size(expr->resolvedType);
+            // Get value off the stack
+            assembly_code.push_back("sub rsp, " + std::to_string(calc_stack_size(expr->resolvedType)));
+            stack_size += calc_stack_size(expr->resolvedType);
 
-        unsigned int bytes_to_move = calc_stack_size(expr->resolvedType);
+            unsigned int bytes_to_move = calc_stack_size(expr->resolvedType);
 
-        assembly_code.push_back("; Extracting array element of " + std::to_string(bytes_to_move) + " bytes from rax to rsp");
-        move_bytes(bytes_to_move, "rax", "rsp");
+            assembly_code.push_back("; Extracting array element of " + std::to_string(bytes_to_move) + " bytes from rax to rsp");
+            move_bytes(bytes_to_move, "rax", "rsp");
+        });
     }
 
     void AFunction::cg_loopexpr(Parser::LoopExprNode* expr)
     {
-        bool sum_is_int = true;
-        
         [[maybe_unused]] Parser::SumLoopExprNode* _;
         bool is_sum = tryCast<Parser::LoopExprNode, Parser::SumLoopExprNode>(expr, _);
+        bool sum_is_int = ! is_sum || expr->resolvedType->type_name == Typechecker::INT;
         // TODO: support array loop. Assuming sum loop for now
-        
-        // Make room for counter
-        if (is_sum)
-        {
-            assembly_code.push_back("sub rsp, 8 ; 8 bytes for sum");
-            stack_size += 8;
-            sum_is_int = expr->resolvedType->type_name == Typechecker::INT;
-        }
-        else
-        {
-            // set up array on heap
-            assembly_code.push_back("sub rsp, 8 ; 8 bytes for array ptr");
-            stack_size += 8;
-        }
-
-        // Compute loop bounds (check gt zero)
-        std::string invalid_bound_expt = "non-positive loop bound";
-        for (int i = expr->bounds.size() - 1; i >= 0; i--)
-        {
-            assembly_code.push_back("; Adding " + expr->bounds[i]->first + " bound to stack.");
-            cg_expr(expr->bounds[i]->second);
-
-            std::string valid_jump = assembly.get_new_jump();
-            assembly_code.push_back("mov rax, [rsp]");
-            assembly_code.push_back("cmp rax, 0");
-            assembly_code.push_back("jg " + valid_jump);
-            FUNCTION_CALL_ALIGNMENT_CHECK(0)
-            std::string invalid_bound_expt_const = assembly.add_constant_string(invalid_bound_expt);
-            assembly_code.push_back("lea rdi, [rel " + invalid_bound_expt_const + "]");    
-            assembly_code.push_back("call _fail_assertion");
-            FUNCTION_CALL_ALIGNMENT_CLOSE
-            assembly_code.push_back(valid_jump + ":");
-        }
 
         int indices_size = expr->bounds.size() * 8;
 
-        // Write 0 to counter loc
-        if (is_sum)
-        {
-            assembly_code.push_back("mov rax, 0");
-            assembly_code.push_back("mov [rsp + " + std::to_string(expr->bounds.size() * 8) + "], rax ; initialize sum");
-        }
-        else // Allocate an array
-        {
-            unsigned int element_size = calc_stack_size(expr->loop_expression->resolvedType);
-            
-            // calc size
-            assembly_code.push_back("; Computing total size of heap memory to allocate.");
-            assembly_code.push_back("mov rdi, " + std::to_string(element_size) + " ; sizeof array element");
-            
-            std::string ovr_expt = "overflow computing array size";
-            for (int i = 0; i < expr->bounds.size(); i++)
-            {
-                std::string no_ovr_jump = assembly.get_new_jump();
-                std::string ovr_expt_const = assembly.add_constant_string(ovr_expt);
-                // don't optimize. Need check for overflow
-                assembly_code.push_back("imul rdi, [rsp + " + std::to_string(i * 8) + "] ; multiply by " + expr->bounds[i]->second->token_s);
-                // check for overflow
-                assembly_code.push_back("jno " + no_ovr_jump + " ; check that " + expr->bounds[i]->first + "'s bound doesn't overflow");
-                FUNCTION_CALL_ALIGNMENT_CHECK(0)
-                assembly_code.push_back("lea rdi, [rel " + ovr_expt_const + "] ; " + ovr_expt);
-                assembly_code.push_back("call _fail_assertion");
-                FUNCTION_CALL_ALIGNMENT_CLOSE
-                assembly_code.push_back(no_ovr_jump + ":");
-            }
-            
-            // allocate array
-            FUNCTION_CALL_ALIGNMENT_CHECK(0)
-            assembly_code.push_back("call _jpl_alloc ; allocate array");
-            FUNCTION_CALL_ALIGNMENT_CLOSE
-            assembly_code.push_back("mov [rsp + " + std::to_string(indices_size) + "], rax ; Move array pointer to stack");
-        }
+        // Make room for invariants below everything else, so the loop's value can be moved over them
+        unsigned int invariants_size = 0;
+        for (auto& invariant : expr->invariants)
+            invariants_size += calc_stack_size(invariant.expression->resolvedType);
 
-        // Push indices (default value 0; save where on the stack it is)
-        for (int i = expr->bounds.size() - 1; i >= 0; i--)
+        if (invariants_size > 0)
         {
-            assembly_code.push_back("mov rax, 0");
-            assembly_code.push_back("push rax; adding " + expr->bounds[i]->first + " to stack.");
-            stack_size += 8;
-            stack_size.add_temporary(expr->bounds[i]->first, stack_size.get_size_of_temporaries());
-        }
+            assembly_code.push_back("sub rsp, " + std::to_string(invariants_size) + " ; " + std::to_string(invariants_size) + " bytes for loop invariants");
+            stack_size += invariants_size;
 
-        // Loop body (label + compute + add to counter)
-        std::string loop_body_jump = assembly.get_new_jump();
-
-        assembly_code.push_back(loop_body_jump + ": ; loop body");
-        cg_expr(expr->loop_expression);
+            int next_offset = stack_size.get_size_of_temporaries();
+            for (auto& invariant : expr->invariants)
+            {
+                stack_size.add_temporary(invariant.symbol, next_offset);
+                next_offset -= calc_stack_size(invariant.expression->resolvedType);
+            }
 
-        if (is_sum)
+            cg_invariants(expr, 0);
+        }
+        
+        then([this, is_sum]
         {
-            if (sum_is_int)
+            // Make room for counter
+            if (is_sum)
             {
-                assembly_code.push_back("pop rax");
-                stack_size -= 8;
-                assembly_code.push_back("add [rsp + " + std::to_string(indices_size * 2) + "], rax ; Add loop body to sum");
+                assembly_code.push_back("sub rsp, 8 ; 8 bytes for sum");
+                stack_size += 8;
             }
             else
             {
-                assembly_code.push_back("movsd xmm0, [rsp]");
-                assembly_code.push_back("add rsp, 8");
-                stack_size -= 8;
-                assembly_code.push_back("addsd xmm0, [rsp + " + std::to_string(indices_size * 2) + "] ; Load sum");
-                assembly_code.push_back("movsd [rsp + " + std::to_string(indices_size * 2) + "], xmm0 ; Save sum");
+                // set up array on heap
+                assembly_code.push_back("sub rsp, 8 ; 8 bytes for array ptr");
+                stack_size += 8;
             }
-        }
-        else // Update array on heap
+        });
+
+        // Compute loop bounds (check gt zero)
+        for (int i = expr->bounds.size() - 1; i >= 0; i--)
         {
-            unsigned int element_size = calc_stack_size(expr->loop_expression->resolvedType);
-            
-            // Calculate storage index
-            if (assembly.get_optimization_level() < 1)
+            then([this, expr, i]
+            {
+                assembly_code.push_back("; Adding " + expr->bounds[i].first + " bound to stack.");
+                cg_expr(expr->bounds[i].second);
+
+                then([this]
+                {
+                    std::string invalid_bound_expt = "non-positive loop bound";
+                    std::string valid_jump = assembly.get_new_jump();
+                    assembly_code.push_back("mov rax, [rsp]");
+                    assembly_code.push_back("cmp rax, 0");
+                    assembly_code.push_back("jg " + valid_jump);
+                    FUNCTION_CALL_ALIGNMENT_CHECK(0)
+                    std::string invalid_bound_expt_const = assembly.add_constant_string(invalid_bound_expt);
+                    assembly_code.push_back("lea rdi, [rel " + invalid_bound_expt_const + "]");    
+                    assembly_code.push_back("call _fail_assertion");
+                    FUNCTION_CALL_ALIGNMENT_CLOSE
+                    assembly_code.push_back(valid_jump + ":");
+                });
+            });
+        }
+
+        then([this, expr, is_sum, sum_is_int, indices_size, invariants_size]
+        {
+            // Write 0 to counter loc
+            if (is_sum)
             {
                 assembly_code.push_back("mov rax, 0");
+                assembly_code.push_back("mov [rsp + " + std::to_string(expr->bounds.size() * 8) + "], rax ; initialize sum");
+            }
+            else // Allocate an array
+            {
+                unsigned int element_size = calc_stack_size(expr->loop_expression->resolvedType);
+
+                // calc size
+                assembly_code.push_back("; Computing total size of heap memory to allocate.");
+                assembly_code.push_back("mov rdi, " + std::to_string(element_size) + " ; sizeof array element");
 
+                std::string ovr_expt = "overflow computing array size";
                 for (int i = 0; i < expr->bounds.size(); i++)
                 {
-                    assembly_code.push_back("imul rax, [rsp + " + std::to_string(element_size + i * 8 + indices_size)  + "]");
-                    assembly_code.push_back("add rax, [rsp + " + std::to_string(element_size + i * 8) + "]");
+                    std::string no_ovr_jump = assembly.get_new_jump();
+                    std::string ovr_expt_const = assembly.add_constant_string(ovr_expt);
+                    // don't optimize. Need check for overflow
+                    assembly_code.push_back("imul rdi, [rsp + " + std::to_string(i * 8) + "] ; multiply by " + expr->bounds[i].second->token_s);
+                    // check for overflow
+                    assembly_code.push_back("jno " + no_ovr_jump + " ; check that " + expr->bounds[i].first + "'s bound doesn't overflow");
+                    FUNCTION_CALL_ALIGNMENT_CHECK(0)
+                    assembly_code.push_back("lea rdi, [rel " + ovr_expt_const + "] ; " + ovr_expt);
+                    assembly_code.push_back("call _fail_assertion");
+                    FUNCTION_CALL_ALIGNMENT_CLOSE
+                    assembly_code.push_back(no_ovr_jump + ":");
                 }
+
+                // allocate array
+                FUNCTION_CALL_ALIGNMENT_CHECK(0)
+                assembly_code.push_back("call _jpl_alloc ; allocate array");
+                FUNCTION_CALL_ALIGNMENT_CLOSE
+                assembly_code.push_back("mov [rsp + " + std::to_string(indices_size) + "], rax ; Move array pointer to stack");
             }
-            else
+
+            // Push indices (default value 0; save where on the stack it is)
+            for (int i = expr->bounds.size() - 1; i >= 0; i--)
             {
-                assembly_code.push_back("mov rax, [rsp + " + std::to_string(element_size) + "]");
+                assembly_code.push_back("mov rax, 0");
+                assembly_code.push_back("push rax; adding " + expr->bounds[i].first + " to stack.");
+                stack_size += 8;
+                stack_size.add_temporary(expr->bound_symbols[i], stack_size.get_size_of_temporaries());
+            }
 
-                for (int i = 1; i < expr->bounds.size(); i++)
-                {
-                    Parser::ExprNode* bound = expr->bounds[i]->second.get();
-                    bool is_constant = false;
-                    long constant_value;
+            // Loop body (label + compute + add to counter)
+            std::string loop_body_jump = assembly.get_new_jump();
 
-                    if (assembly.get_optimization_level() == 1)
+            // Where to continue once an index changes: the first level after it that has invariants to
+            // recompute, or the body.
+            std::vector<std::string> level_jumps(expr->bounds.size() + 1, loop_body_jump);
+            for (int level = expr->bounds.size() - 1; level > 0; level--)
+            {
+                level_jumps[level] = level_jumps[level + 1];
+                for (auto& invariant : expr->invariants)
+                    if (invariant.level == level)
                     {
-                        Parser::IntExprNode* bound_constant;
-                        is_constant = tryCastExpr<Parser::IntExprNode>(bound, bound_constant);
-                        constant_value = bound_constant->value;
+                        level_jumps[level] = assembly.get_new_jump();
+                        break;
                     }
-                    else // work with CPValues
+            }
+
+            for (int level = 1; level < expr->bounds.size(); level++)
+                if (level_jumps[level] != level_jumps[level + 1])
+                {
+                    then([this, expr, level, level_jumps]
                     {
-                        is_constant = bound->cp->type == Parser::CPValue::INT;
-                        if (is_constant)
-                            constant_value = static_cast<Parser::IntValue*>(bound->cp.get())->value;
+                        assembly_code.push_back(level_jumps[level] + ": ; invariants of " + expr->bounds[level - 1].first);
+                        cg_invariants(expr, level);
+                    });
+                }
+
+            then([this, expr, is_sum, sum_is_int, indices_size, invariants_size, level_jumps, loop_body_jump]
+            {
+                assembly_code.push_back(loop_body_jump + ": ; loop body");
+                cg_expr(expr->loop_expression);
+
+                then([this, expr, is_sum, sum_is_int, indices_size, invariants_size, level_jumps]
+                {
+                    if (is_sum)
+                    {
+                        if (sum_is_int)
+                        {
+                            assembly_code.push_back("pop rax");
+                            stack_size -= 8;
+                            assembly_code.push_back("add [rsp + " + std::to_string(indices_size * 2) + "], rax ; Add loop body to sum");
+                        }
+                        else
+                        {
+                            assembly_code.push_back("movsd xmm0, [rsp]");
+                            assembly_code.push_back("add rsp, 8");
+                            stack_size -= 8;
+                            assembly_code.push_back("addsd xmm0, [rsp + " + std::to_string(indices_size * 2) + "] ; Load sum");
+                            assembly_code.push_back("movsd [rsp + " + std::to_string(indices_size * 2) + "], xmm0 ; Save sum");
+                        }
                     }
-                    
+                    else // Update array on heap
+                    {
+                        unsigned int element_size = calc_stack_size(expr->loop_expression->resolvedType);
+
+                        // Calculate storage index
+                        if (assembly.get_optimization_level() < 1)
+                        {
+                            assembly_code.push_back("mov rax, 0");
+
+                            for (int i = 0; i < expr->bounds.size(); i++)
+                            {
+                                assembly_code.push_back("imul rax, [rsp + " + std::to_string(element_size + i * 8 + indices_size)  + "]");
+                                assembly_code.push_back("add rax, [rsp + " + std::to_string(element_size + i * 8) + "]");
+                            }
+                        }
+                        else
+                        {
+                            assembly_code.push_back("mov rax, [rsp + " + std::to_string(element_size) + "]");
+
+                            for (int i = 1; i < expr->bounds.size(); i++)
+                            {
+                                Parser::ExprNode* bound = expr->bounds[i].second.get();
+                                bool is_constant = false;
+                                long constant_value;
+
+                                if (assembly.get_optimization_level() == 1)
+                                {
+                                    Parser::IntExprNode* bound_constant;
+                                    is_constant = tryCastExpr<Parser::IntExprNode>(bound, bound_constant);
+                                    if (is_constant)
+                                        constant_value = bound_constant->value;
+                                }
+                                else // work with CPValues
+                                {
+                                    is_constant = bound->cp->type == Parser::CPValue::INT;
+                                    if (is_constant)
+                                        constant_value = static_cast<Parser::IntValue*>(bound->cp)->value;
+                                }
+
 
-                    if (is_constant)
-                    { // optimize
+                                if (is_constant)
+                                { // optimize
+                                    long power;
+                                    if (is_power_of_two(constant_value, power))
+                                        assembly_code.push_back("shl rax, " + std::to_string(power));
+                                    else if (under_32_bits(constant_value))
+                                        assembly_code.push_back("imul rax, " + std::to_string(constant_value));
+                                    else
+                                        assembly_code.push_back("imul rax, [rsp + " + std::to_string(element_size + i * 8 + indices_size)  + "]");
+                                }
+                                else
+                                    assembly_code.push_back("imul rax, [rsp + " + std::to_string(element_size + i * 8 + indices_size)  + "]");
+
+                                assembly_code.push_back("add rax, [rsp + " + std::to_string(element_size + i * 8) + "]");
+                            }
+                        }
+
+                        // optimize
                         long power;
-                        if (is_power_of_two(constant_value, power))
-                            assembly_code.push_back("shl rax, " + std::to_string(power));
-                        else if (under_32_bits(constant_value))
-                            assembly_code.push_back("imul rax, " + std::to_string(constant_value));
+                        if (assembly.get_optimization_level() > 0 && is_power_of_two(element_size, power))
+                            assembly_code.push_back("shl rax, " + std::to_string(power) + " ; multiply by size of elements");
                         else
-                            assembly_code.push_back("imul rax, [rsp + " + std::to_string(element_size + i * 8 + indices_size)  + "]");
+                            assembly_code.push_back("imul rax, " + std::to_string(element_size) + " ; multiply by size of elements");
+
+                        assembly_code.push_back("add rax, [rsp + " + std::to_string(element_size + indices_size * 2) + "] ; add ptr for address in heap");
+
+                        // Move element
+                        assembly_code.push_back("; Moving newly created element into array");
+                        move_bytes(element_size, "rsp", "rax");
+
+                        assembly_code.push_back("add rsp, " + std::to_string(element_size));
+                        stack_size -= element_size;
                     }
-                    else
-                        assembly_code.push_back("imul rax, [rsp + " + std::to_string(element_size + i * 8 + indices_size)  + "]");
-    
-                    assembly_code.push_back("add rax, [rsp + " + std::to_string(element_size + i * 8) + "]");
-                }
-            }
 
-            // optimize
-            long power;
-            if (assembly.get_optimization_level() > 0 && is_power_of_two(element_size, power))
-                assembly_code.push_back("shl rax, " + std::to_string(power) + " ; multiply by size of elements");
-            else
-                assembly_code.push_back("imul rax, " + std::to_string(element_size) + " ; multiply by size of elements");
+                    // Increment indices (and if overflow, increment next)
+                    for (int i = expr->bounds.size() - 1; i >= 0; i--)
+                    {
+                        std::string index_name = expr->bounds[i].first;
+
+                        assembly_code.push_back("; Increment " + index_name);
+                        assembly_code.push_back("add qword [rsp + " + std::to_string(i * 8) + "], 1");
+                        assembly_code.push_back("mov rax, [rsp + " + std::to_string(i * 8) + "]");
+                        assembly_code.push_back("cmp rax, [rsp + " + std::to_string(i * 8 + indices_size) +"]");
+                        assembly_code.push_back("jl " + level_jumps[i + 1] + " ; If "+ index_name +" < bound, next iter");
+                        if (i != 0)
+                            assembly_code.push_back("mov qword [rsp + " + std::to_string(i * 8) + "], 0 ; "+ index_name +" = 0");
+                    }
 
-            assembly_code.push_back("add rax, [rsp + " + std::to_string(element_size + indices_size * 2) + "] ; add ptr for address in heap");
+                    // Free loop indices and bounds (keep counter or pointer)
+                    assembly_code.push_back("; end loop body");
+                    assembly_code.push_back("add rsp, " + std::to_string(indices_size) + " ; free loop indices");
+                    stack_size -= indices_size;
+                    if (is_sum) // If we're making an array, the bounds are part of the array and should not be removed.
+                    {
+                        assembly_code.push_back("add rsp, " + std::to_string(indices_size) + " ; free loop bounds");
+                        stack_size -= indices_size;
+                    }
+
+                    // Free invariants (move the sum or array over them)
+                    if (invariants_size > 0)
+                    {
+                        unsigned int bytes_to_move = calc_stack_size(expr->resolvedType);
+                        assembly_code.push_back("; Moving " + std::to_string(bytes_to_move) + " bytes of loop value over its invariants");
+                        move_bytes(bytes_to_move, "rsp", "rsp + " + std::to_string(invariants_size));
+                        assembly_code.push_back("add rsp, " + std::to_string(invariants_size) + " ; free loop invariants");
+                        stack_size -= invariants_size;
+                    }
+                });
+            });
+        });
+    }
 
-            // Move element
-            assembly_code.push_back("; Moving newly created element into array");
-            move_bytes(element_size, "rsp", "rax");
+    void AFunction::cg_invariants(Parser::LoopExprNode* expr, size_t level)
+    {
+        for (auto& invariant : expr->invariants)
+        {
+            if (invariant.level != level)
+                continue;
 
-            assembly_code.push_back("add rsp, " + std::to_string(element_size));
-            stack_size -= element_size;
+            then([this, &invariant]
+            {
+                unsigned int bytes_to_move = calc_stack_size(invariant.expression->resolvedType);
+                assembly_code.push_back("; Computing loop invariant " + Lexer::interner().name(invariant.symbol));
+                cg_expr(invariant.expression);
+                then([this, &invariant, bytes_to_move]
+                {
+                    assembly_code.push_back("lea rax, [rbp - " + std::to_string(stack_size.get_offset(invariant.symbol)) + "]");
+                    move_bytes(bytes_to_move, "rsp", "rax");
+                    assembly_code.push_back("add rsp, " + std::to_string(bytes_to_move));
+                    stack_size -= bytes_to_move;
+                });
+            });
         }
+    }
 
-        // Increment indices (and if overflow, increment next)
-        for (int i = expr->bounds.size() - 1; i >= 0; i--)
+    void AFunction::cg_inlinedcallexpr(Parser::InlinedCallExprNode* expr)
+    {
+        assembly_code.push_back("; Inlined call " + expr->token_s + " | line: " + std::to_string(expr->line));
+        unsigned int start = stack_size.get_size_of_temporaries();
+
+        for (auto& u_stmt : expr->statements)
         {
-            std::string index_name = expr->bounds[i]->first;
-
-            assembly_code.push_back("; Increment " + index_name);
-            assembly_code.push_back("add qword [rsp + " + std::to_string(i * 8) + "], 1");
-            assembly_code.push_back("mov rax, [rsp + " + std::to_string(i * 8) + "]");
-            assembly_code.push_back("cmp rax, [rsp + " + std::to_string(i * 8 + indices_size) +"]");
-            assembly_code.push_back("jl " + loop_body_jump + " ; If "+ index_name +" < bound, next iter");
-            if (i != 0)
-                assembly_code.push_back("mov qword [rsp + " + std::to_string(i * 8) + "], 0 ; "+ index_name +" = 0");
+            Parser::LetStmtNode* let_stmt;
+            if (tryCast<Parser::StmtNode, Parser::LetStmtNode>(u_stmt.get(), let_stmt))
+                cg_letstmt(let_stmt);
+            else
+                cg_assertstmt(static_cast<Parser::AssertStmtNode*>(u_stmt.get()));
         }
+        cg_expr(expr->result);
 
-        // Free loop indices and bounds (keep counter or pointer)
-        assembly_code.push_back("; end loop body");
-        assembly_code.push_back("add rsp, " + std::to_string(indices_size) + " ; free loop indices");
-        stack_size -= indices_size;
-        if (is_sum) // If we're making an array, the bounds are part of the array and should not be removed.
+        then([this, expr, start]
         {
-            assembly_code.push_back("add rsp, " + std::to_string(indices_size) + " ; free loop bounds");
-            stack_size -= indices_size;
-        }
+            // Free the variables of the body (move the result over them)
+            unsigned int bytes_to_move = calc_stack_size(expr->resolvedType);
+            unsigned int locals_size = stack_size.get_size_of_temporaries() - bytes_to_move - start;
+            if (locals_size > 0)
+            {
+                assembly_code.push_back("; Moving " + std::to_string(bytes_to_move) + " bytes of " + expr->function_name + "'s result over its variables");
+                move_bytes(bytes_to_move, "rsp", "rsp + " + std::to_string(locals_size));
+                assembly_code.push_back("add rsp, " + std::to_string(locals_size) + " ; free inlined variables");
+                stack_size -= locals_size;
+            }
+        });
     }
 
     void AFunction::cg_assertstmt(Parser::AssertStmtNode* stmt)
     {
         cg_expr(stmt->expression);
-        assembly_code.push_back("pop rax");
-        stack_size -= 8;
-        assembly_code.push_back("cmp rax, 0 ; check assert");
-        std::string jump_name = assembly.get_new_jump();
-        assembly_code.push_back("jne " + jump_name);
-        FUNCTION_CALL_ALIGNMENT_CHECK(0)
-        std::string error_message_constant = assembly.add_constant_string(stmt->string->getValue());
-        assembly_code.push_back("lea rdi, [rel " + error_message_constant + "] ; " + stmt->string->getValue());
-        assembly_code.push_back("call _fail_assertion");
-        FUNCTION_CALL_ALIGNMENT_CLOSE
-        assembly_code.push_back(jump_name + ":");
+        then([this, stmt]
+        {
+            assembly_code.push_back("pop rax");
+            stack_size -= 8;
+            assembly_code.push_back("cmp rax, 0 ; check assert");
+            std::string jump_name = assembly.get_new_jump();
+            assembly_code.push_back("jne " + jump_name);
+            FUNCTION_CALL_ALIGNMENT_CHECK(0)
+            std::string error_message_constant = assembly.add_constant_string(stmt->string->getValue());
+            assembly_code.push_back("lea rdi, [rel " + error_message_constant + "] ; " + stmt->string->getValue());
+            assembly_code.push_back("call _fail_assertion");
+            FUNCTION_CALL_ALIGNMENT_CLOSE
+            assembly_code.push_back(jump_name + ":");
+        });
     }
 
     void AFunction::add_function_return_code(CallingConvention cc)
@@ -2102,7 +2252,7 @@ namespace Compiler
             }
             else
             {
-                assembly_code.push_back("mov rax, [rbp - " + std::to_string(stack_size.get_offset("$return")) +"] ; Address to write return value into");
+                assembly_code.push_back("mov rax, [rbp - " + std::to_string(stack_size.get_offset(return_temporary())) +"] ; Address to write return value into");
                 
                 unsigned int bytes_to_move = cc.return_size;
                 
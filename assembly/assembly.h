@@ -1,6 +1,7 @@
 #include <vector>
 #include <utility>
 #include <memory>
+#include <functional>
 #include <unordered_map>
 #include "../parser/parser.h"
 #include "../typechecker/typechecker.h"
@@ -51,7 +52,7 @@ namespace Compiler
             "extern _to_int\n"
             "extern _to_float\n";
 
-    unsigned int calc_stack_size(std::shared_ptr<Typechecker::ResolvedType> resolved_type);
+    unsigned int calc_stack_size(const Typechecker::ResolvedType* resolved_type);
 
     class CallingConvention
     {
@@ -132,10 +133,17 @@ namespace Compiler
         CallingConvention get_calling_convention(std::string function_name);
     };
 
+    // The temporary holding the address a function writes its return value into.
+    inline Lexer::Symbol return_temporary()
+    {
+        static const Lexer::Symbol symbol = Lexer::intern("$return");
+        return symbol;
+    }
+
     class StackDescription
     {
     private:
-        std::unordered_map<std::string, int> temporaries;
+        std::unordered_map<Lexer::Symbol, int> temporaries;
         unsigned int stack_size;
         const unsigned int init_stack_size;
     public:
@@ -146,7 +154,7 @@ namespace Compiler
         
         const unsigned int get_size_of_temporaries() {return stack_size - init_stack_size;};
 
-        void add_temporary(std::string name, const int offset);
+        void add_temporary(Lexer::Symbol name, const int offset);
         void add_argument(Parser::ArgumentNode* argument, const std::shared_ptr<Typechecker::ResolvedType>& r_type, int offset);
         void add_lvalue(Parser::LValue* lvalue, const std::shared_ptr<Typechecker::ResolvedType>& r_type, int offset);
         void add_binding(Parser::BindingNode* binding, const std::shared_ptr<Typechecker::ResolvedType>& r_type, const int offset);
@@ -160,12 +168,12 @@ namespace Compiler
             return decrement_stack_size(dec);
         }
 
-        const int get_offset(std::string temporary_name)
+        const int get_offset(Lexer::Symbol temporary_name)
         {
             return temporaries[temporary_name] + init_stack_size;
         }
 
-        bool has_temporary(std::string temporary_name)
+        bool has_temporary(Lexer::Symbol temporary_name)
         {
             return temporaries.count(temporary_name) > 0;
         }
@@ -180,17 +188,26 @@ namespace Compiler
         bool is_main;
         StackDescription stack_size;
         StackDescription* global_stack;
+        // Expressions are generated from a list of tasks rather than by recursion, so that deeply
+        // nested ones take no more native stack than shallow ones. A task generating an expression
+        // adds tasks for its operands, and for the code after them with then; the tasks a task adds
+        // run in the order they were added, before any added earlier. Outside such a task, cg_expr
+        // and then generate what they add before returning.
+        std::vector<std::function<void()>> tasks;
+        bool generating = false;
 
     public:
         AFunction(Assembly& _assembly) : name("jpl_main"), assembly(_assembly), is_main(true), stack_size(8), global_stack(&stack_size)
         {
-            stack_size.add_temporary("argnum", -24);
-            stack_size.add_temporary("args", -24);
+            stack_size.add_temporary(Lexer::intern("argnum"), -24);
+            stack_size.add_temporary(Lexer::intern("args"), -24);
         }
         AFunction(Parser::FnCmd* cmd, Assembly& _assembly, StackDescription* _global_stack);
         // Code Generation Methods. Used for writing assembly
         // of any expression or command type. Updates the stack size if necessary.
-        void cg_cmd(std::unique_ptr<Parser::CmdNode>& cmd);
+        void cg_cmd(Parser::NodePtr<Parser::CmdNode>& cmd);
+        // The command cmd_ptr, which is not a time command.
+        void cg_cmdkind(Parser::CmdNode* cmd_ptr);
         void cg_showcmd(Parser::ShowCmdNode* cmd);
         void cg_letcmd(Parser::LetCmdNode* cmd);
 
@@ -200,15 +217,22 @@ namespace Compiler
         void cg_assertcmd(Parser::AssertCmdNode* cmd);
         void cg_printcmd(Parser::PrintCmdNode* cmd);
         void cg_writecmd(Parser::WriteCmdNode* cmd);
-        void cg_timecmd(Parser::TimeCmdNode* cmd);
+        // Save the time before the command cmd times, and return the stack size with it saved.
+        unsigned int cg_starttime(Parser::TimeCmdNode* cmd);
+        // Print the time since the time saved at start_offset.
+        void cg_stoptime(unsigned int start_offset);
 
-        void cg_expr(std::unique_ptr<Parser::ExprNode>& expr);
+        void cg_expr(Parser::NodePtr<Parser::ExprNode>& expr);
         void cg_intexpr(Parser::IntExprNode* expr);    
         void cg_floatexpr(Parser::FloatExprNode* expr);    
         void cg_trueexpr(Parser::TrueExprNode* expr);    
         void cg_falseexpr(Parser::FalseExprNode* expr);    
         void cg_unopexpr(Parser::UnopExprNode* expr);
+        // Computes the operation of expr on its operand, at the top of the stack.
+        void cg_unop(Parser::UnopExprNode* expr);
         void cg_binopexpr(Parser::BinopExprNode* expr);
+        // Computes the operation of expr on its operands, at the top of the stack.
+        void cg_binop(Parser::BinopExprNode* expr);
         void cg_tupleexpr(Parser::TupleLiteralExprNode* expr);
         void cg_arrayexpr(Parser::ArrayLiteralExprNode* expr);
         void cg_tupleaccessexpr(Parser::TupleIndexExprNode* expr);
@@ -220,6 +244,9 @@ namespace Compiler
         inline void cg_shortcircuit(Parser::BinopExprNode* expr);
         void cg_arrayindexexpr(Parser::ArrayIndexExprNode* expr);
         void cg_loopexpr(Parser::LoopExprNode* expr);
+        // Computes the invariants of a loop that depend on its first level indices.
+        void cg_invariants(Parser::LoopExprNode* expr, size_t level);
+        void cg_inlinedcallexpr(Parser::InlinedCallExprNode* expr);
 
         bool cg_stmt(Parser::StmtNode* stmt, CallingConvention cc);
         void cg_letstmt(Parser::LetStmtNode* stmt);
@@ -231,9 +258,17 @@ namespace Compiler
         virtual ~AFunction() {};
 
     private:
+        void add_task(std::function<void()> task);
+        // Generates code once the expressions and code added before it are generated.
+        void then(std::function<void()> work);
+        void cg_exprkind(Parser::ExprNode* expr);
+
         bool under_32_bits(long x) {return (x & ((1l << 31) - 1)) == x;}
         void cg_push_constant_int(long constant_value, std::string extra_comments = "");
         bool is_power_of_two(long to_check, long& power);
+        // The operand of an int multiplication to shift left by power instead, when the other is a
+        // power of two known at the optimization level; otherwise null.
+        Parser::NodePtr<Parser::ExprNode>* shifted_operand(Parser::BinopExprNode* expr, long& power);
 
     private:
         void add_function_return_code(CallingConvention cc);
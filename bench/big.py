@@ -0,0 +1,40 @@
+#!/usr/bin/env python3
+"""Prints a large valid JPL program, for timing passes over many nodes.
+
+Each of the given number of units is a function that uses every kind of expression and
+statement, followed by commands that call it. A unit is about 160 nodes.
+
+Usage: big.py <units>
+"""
+
+import sys
+
+UNIT = """\
+type pair{i} = {{int, float}}
+
+fn f{i}(a : int, b : float, m[H, W] : int[,]) : pair{i} {{
+    let x = a * {i} + m[a % H, (a + 1) % W] - -a
+    let y = b / 2.5 + to_float(x) * {i}.25
+    let s = sum[i : H, j : W] if i < j && !(x == j) then i * j + x else m[i, j] / (j + 1)
+    let v = array[k : 5] if k <= 2 || y > 1.0 then y else -y
+    let {{p, q}} = {{s % 7, v[3]}}
+    assert p >= 0, "negative remainder in f{i}"
+    return {{x + s - p, v[2] + q + sqrt(y * y)}}
+}}
+
+let m{i} = array[i : 3, j : 4] i + j * {i}
+let t{i} = f{i}({i}, 1.5, m{i})
+show t{i}{{0}}
+time print "unit {i}"
+"""
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+    units = int(float(sys.argv[1]))
+    sys.stdout.write("".join(UNIT.format(i=i) for i in range(units)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+"""Times compiling each given file with -s, without the cache (-c), on a cache miss and on a
+cache hit, at -O0 and -O3. A miss starts from an empty JPL_CACHE_DIR; a hit reuses the one
+the miss filled. Fails unless all three compilations print the same assembly. Typechecking
+alone (-t) is timed too, as the most a hit can save.
+
+Usage: cache.py <compiler> <file>...
+"""
+
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+ROUNDS = 5
+LEVELS = ["-O0", "-O3"]
+
+
+def compile_(compiler, filename, flags, cache_dir=None, mode="-s"):
+    environment = dict(os.environ)
+    if cache_dir is not None:
+        environment["JPL_CACHE_DIR"] = cache_dir
+    start = time.perf_counter()
+    output = subprocess.run([compiler, filename, mode] + flags, env=environment,
+                            stdout=subprocess.PIPE, check=True).stdout
+    return time.perf_counter() - start, output
+
+
+def best(runs):
+    """The least time of runs, and the output, which must be the same for each."""
+    outputs = {output for _, output in runs}
+    if len(outputs) != 1:
+        sys.exit("runs of the same compilation printed different output")
+    return min(elapsed for elapsed, _ in runs), outputs.pop()
+
+
+def measure(compiler, filename, level):
+    uncached = best([compile_(compiler, filename, [level]) for _ in range(ROUNDS)])
+
+    misses = []
+    hits = []
+    for _ in range(ROUNDS):
+        with tempfile.TemporaryDirectory() as cache_dir:
+            misses.append(compile_(compiler, filename, [level, "-c"], cache_dir))
+            hits.append(compile_(compiler, filename, [level, "-c"], cache_dir))
+    miss = best(misses)
+    hit = best(hits)
+
+    if not uncached[1].endswith(b"Compilation succeeded\n"):
+        sys.exit(f"{filename} {level}: does not compile")
+    if miss[1] != uncached[1] or hit[1] != uncached[1]:
+        sys.exit(f"{filename} {level}: a cached compilation printed different assembly")
+    return uncached[0], miss[0], hit[0]
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit(__doc__)
+    compiler = sys.argv[1]
+    print(f"{'file':<32} {'level':<6} {'no cache':>10} {'miss':>10} {'hit':>10}")
+    for filename in sys.argv[2:]:
+        typecheck = best([compile_(compiler, filename, [], mode="-t") for _ in range(ROUNDS)])[0]
+        print(f"{filename:<32} {'-t':<6} {typecheck * 1e3:8.1f}ms")
+        for level in LEVELS:
+            uncached, miss, hit = measure(compiler, filename, level)
+            print(f"{filename:<32} {level:<6} {uncached * 1e3:8.1f}ms {miss * 1e3:8.1f}ms {hit * 1e3:8.1f}ms")
+
+
+if __name__ == "__main__":
+    main()
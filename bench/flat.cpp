@@ -0,0 +1,238 @@
+// Measures the FlatAST against the tree it is converted from: the bytes each representation
+// takes per node, and the time per traversal of a pass that sums the integer literals of every
+// expression. The tree and the FlatAST are walked recursively from the same roots, and the
+// FlatAST is also scanned front to back, which its post-order allows.
+//
+// Usage: flat.out <file>
+#include "../lexer/lexer.cpp"
+#include "../parser/parser.cpp"
+#include "../parser/flat_ast.cpp"
+#include "../typechecker/typechecker.cpp"
+#include "../optimization/optimization.cpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <sstream>
+
+namespace
+{
+    constexpr size_t ROUNDS = 7;
+
+    // Bytes allocated through operator new and not yet freed. Each allocation is preceded by a
+    // header that holds its size.
+    std::atomic<size_t> live_bytes{0};
+    constexpr size_t HEADER = alignof(std::max_align_t);
+
+    // The outermost expressions of the commands and statements of a program.
+    class Roots : public Optimization::ASTVisitor
+    {
+    public:
+        std::vector<Parser::ExprNode*> roots;
+
+    protected:
+        virtual void walk_expr(Parser::NodePtr<Parser::ExprNode>& u_expr) override
+        {
+            roots.push_back(u_expr.get());
+        }
+    };
+
+    struct Totals
+    {
+        size_t expressions = 0;
+        long integers = 0;
+
+        bool operator==(const Totals& other) const {return expressions == other.expressions && integers == other.integers;}
+    };
+
+    void walk_tree(const Parser::ExprNode* expr, Totals& totals)
+    {
+        totals.expressions++;
+        switch (expr->kind)
+        {
+            case Parser::INT_EXPR:
+                totals.integers += static_cast<const Parser::IntExprNode*>(expr)->value;
+                break;
+            case Parser::TUPLE_LITERAL_EXPR:
+                for (auto& u_expr : static_cast<const Parser::TupleLiteralExprNode*>(expr)->tuple_expressions)
+                    walk_tree(u_expr.get(), totals);
+                break;
+            case Parser::ARRAY_LITERAL_EXPR:
+                for (auto& u_expr : static_cast<const Parser::ArrayLiteralExprNode*>(expr)->array_expressions)
+                    walk_tree(u_expr.get(), totals);
+                break;
+            case Parser::TUPLE_INDEX_EXPR:
+                walk_tree(static_cast<const Parser::TupleIndexExprNode*>(expr)->tuple_expression.get(), totals);
+                break;
+            case Parser::ARRAY_INDEX_EXPR:
+            {
+                auto array_index_expr = static_cast<const Parser::ArrayIndexExprNode*>(expr);
+                walk_tree(array_index_expr->array_expression.get(), totals);
+                for (auto& u_expr : array_index_expr->array_indices)
+                    walk_tree(u_expr.get(), totals);
+                break;
+            }
+            case Parser::CALL_EXPR:
+                for (auto& u_expr : static_cast<const Parser::CallExprNode*>(expr)->arguments)
+                    walk_tree(u_expr.get(), totals);
+                break;
+            case Parser::UNOP_EXPR:
+                walk_tree(static_cast<const Parser::UnopExprNode*>(expr)->expression.get(), totals);
+                break;
+            case Parser::BINOP_EXPR:
+                walk_tree(static_cast<const Parser::BinopExprNode*>(expr)->lhs.get(), totals);
+                walk_tree(static_cast<const Parser::BinopExprNode*>(expr)->rhs.get(), totals);
+                break;
+            case Parser::IF_EXPR:
+            {
+                auto if_expr = static_cast<const Parser::IfExprNode*>(expr);
+                walk_tree(if_expr->condition.get(), totals);
+                walk_tree(if_expr->then_expr.get(), totals);
+                walk_tree(if_expr->else_expr.get(), totals);
+                break;
+            }
+            case Parser::ARRAY_LOOP_EXPR:
+            case Parser::SUM_LOOP_EXPR:
+            {
+                auto loop_expr = static_cast<const Parser::LoopExprNode*>(expr);
+                for (auto& bound : loop_expr->bounds)
+                    walk_tree(bound.second.get(), totals);
+                walk_tree(loop_expr->loop_expression.get(), totals);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    // Every child of an expression in a FlatAST is an expression.
+    void walk_flat(const Parser::FlatAST& flat, Parser::NodeIndex index, Totals& totals)
+    {
+        const Parser::FlatNode& node = flat[index];
+        totals.expressions++;
+        if (node.kind == Parser::INT_EXPR)
+            totals.integers += flat.integers[node.data];
+        for (uint32_t i = 0; i < node.child_count; i++)
+            walk_flat(flat, flat.children[node.first_child + i], totals);
+    }
+
+    void scan_flat(const Parser::FlatAST& flat, Totals& totals)
+    {
+        for (const Parser::FlatNode& node : flat.nodes)
+        {
+            if (node.kind < Parser::INT_EXPR || node.kind > Parser::SUM_LOOP_EXPR)
+                continue;
+            totals.expressions++;
+            if (node.kind == Parser::INT_EXPR)
+                totals.integers += flat.integers[node.data];
+        }
+    }
+
+    // The least time f takes over ROUNDS runs, in nanoseconds, after checking that every run
+    // finds what the first walk of the tree found.
+    template<class F>
+    double best_time(F f, const Totals& expected, const char* name)
+    {
+        double best = 1e300;
+        for (size_t round = 0; round < ROUNDS; round++)
+        {
+            Totals totals;
+            auto start = std::chrono::steady_clock::now();
+            f(totals);
+            std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+
+            if (!(totals == expected))
+            {
+                std::fprintf(stderr, "%s found %zu expressions summing to %ld instead of %zu summing to %ld.\n",
+                    name, totals.expressions, totals.integers, expected.expressions, expected.integers);
+                std::exit(1);
+            }
+        }
+        return best;
+    }
+}
+
+void* operator new(size_t size)
+{
+    char* allocation = (char*) std::malloc(size + HEADER);
+    if (allocation == nullptr)
+        throw std::bad_alloc();
+    *(size_t*) allocation = size;
+    live_bytes += size;
+    return allocation + HEADER;
+}
+
+void operator delete(void* pointer) noexcept
+{
+    if (pointer == nullptr)
+        return;
+    char* allocation = (char*) pointer - HEADER;
+    live_bytes -= *(size_t*) allocation;
+    std::free(allocation);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+    operator delete(pointer);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2)
+    {
+        std::fprintf(stderr, "Usage: %s <file>\n", argv[0]);
+        return 1;
+    }
+
+    std::ifstream file(argv[1]);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    std::string source = contents.str();
+
+    // The tree is measured before it is typechecked, as it leaves the parser; the FlatAST
+    // holds only references to the types the typechecker adds.
+    size_t before_parse = live_bytes;
+    Lexer::TokenStream* tokens = Lexer::lexStream(source);
+    Parser::Arena arena;
+    std::vector<Parser::NodePtr<Parser::CmdNode>> tree = Parser::parse(tokens, arena);
+    Lexer::destroy_token_list(tokens);
+    size_t tree_bytes = arena.memoryUsage() + live_bytes - before_parse;
+    Typechecker::typecheck(tree);
+
+    size_t before_flat = live_bytes;
+    Parser::FlatAST flat(tree);
+    size_t flat_bytes = live_bytes - before_flat;
+
+    Roots roots;
+    roots.visit_all_cmds(tree);
+    std::unordered_map<const Parser::ASTNode*, Parser::NodeIndex> indices;
+    for (Parser::NodeIndex index = 0; index < flat.size(); index++)
+        indices[flat.origins[index]] = index;
+    std::vector<Parser::NodeIndex> flat_roots;
+    for (Parser::ExprNode* root : roots.roots)
+        flat_roots.push_back(indices.at(root));
+
+    Totals expected;
+    for (Parser::ExprNode* root : roots.roots)
+        walk_tree(root, expected);
+
+    double tree_time = best_time([&](Totals& totals) {for (Parser::ExprNode* root : roots.roots) walk_tree(root, totals);},
+        expected, "Tree walk");
+    double flat_time = best_time([&](Totals& totals) {for (Parser::NodeIndex root : flat_roots) walk_flat(flat, root, totals);},
+        expected, "FlatAST walk");
+    double scan_time = best_time([&](Totals& totals) {scan_flat(flat, totals);}, expected, "FlatAST scan");
+
+    std::printf("%zu nodes, %zu expressions\n", flat.size(), expected.expressions);
+    std::printf("tree:    %6.1f bytes per node\n", (double) tree_bytes / flat.size());
+    std::printf("FlatAST: %6.1f bytes per node (%.1f by memoryUsage)\n", (double) flat_bytes / flat.size(),
+        (double) flat.memoryUsage() / flat.size());
+    std::printf("traversal, tree walk:    %8.3f ms (%5.2f ns per expression)\n", tree_time / 1e6, tree_time / expected.expressions);
+    std::printf("traversal, FlatAST walk: %8.3f ms (%5.2f ns per expression)\n", flat_time / 1e6, flat_time / expected.expressions);
+    std::printf("traversal, FlatAST scan: %8.3f ms (%5.2f ns per expression)\n", scan_time / 1e6, scan_time / expected.expressions);
+
+    Parser::destroy_tree(tree, arena);
+    return 0;
+}
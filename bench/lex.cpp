@@ -0,0 +1,77 @@
+// Measures identifier throughput: the keyword lookup alone over a fixed mix of identifiers and
+// keywords, beside the scan over every keyword that it replaced, and a source of identifiers
+// lexed through a TokenStream.
+//
+// Usage: lex.out [identifiers]
+#include "../lexer/lexer.cpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+namespace
+{
+    const char* const WORDS[20] = {"x", "i", "width", "array", "img", "sum", "color", "if",
+        "return", "to_float", "y", "let", "blur_radius", "show", "n", "then", "pixel", "write", "k", "float"};
+
+    // The lookup before the perfect hash: each keyword is compared in turn.
+    Lexer::TokenType scanKeywords(const char* word, size_t length)
+    {
+        for (auto const& kvp : Lexer::KEYWORDS)
+            if (kvp.first.size() == length && !memcmp(kvp.first.data(), word, length))
+                return kvp.second;
+        return Lexer::VARIABLE;
+    }
+
+    template<class F>
+    double nanoseconds_per_word(F lookup, size_t rounds)
+    {
+        size_t lengths[20];
+        for (size_t i = 0; i < 20; i++)
+            lengths[i] = strlen(WORDS[i]);
+
+        unsigned long checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t round = 0; round < rounds; round++)
+            for (size_t i = 0; i < 20; i++)
+                checksum += lookup(WORDS[i], lengths[i]);
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+        // Keeps the lookups from being optimized away.
+        volatile unsigned long sink = checksum;
+        (void) sink;
+        return elapsed.count() / (rounds * 20);
+    }
+
+    double identifiers_per_second(const std::string& source, size_t count, bool threaded)
+    {
+        auto start = std::chrono::steady_clock::now();
+        Lexer::TokenStream stream(source, threaded);
+        size_t lexed = 0;
+        for (size_t index = 0; stream.has(index) && stream.type(index) != Lexer::END_OF_FILE; index++)
+            lexed += stream.type(index) != Lexer::NEWLINE;
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        if (lexed != count)
+        {
+            std::fprintf(stderr, "Lexed %zu words instead of %zu.\n", lexed, count);
+            std::exit(1);
+        }
+        return count / elapsed.count();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+    std::printf("lookup, keyword scan:     %6.1f ns per word\n", nanoseconds_per_word(scanKeywords, 1000000));
+    std::printf("lookup, perfect hash:     %6.1f ns per word\n", nanoseconds_per_word(Lexer::lookupKeyword, 1000000));
+
+    std::string source;
+    for (size_t i = 0; i < count; i++)
+        source.append(WORDS[i % 20]).append(i % 16 == 15 ? "\n" : " ");
+
+    std::printf("TokenStream, unthreaded:  %6.1fM words/s\n", identifiers_per_second(source, count, false) / 1e6);
+    std::printf("TokenStream, threaded:    %6.1fM words/s\n", identifiers_per_second(source, count, true) / 1e6);
+    return 0;
+}
@@ -0,0 +1,195 @@
+// Measures the cost per node visit of dispatching on a node's kind. The expressions of a
+// typechecked program are walked twice by the same code, once reading each node's kind tag
+// and once finding it with the dynamic_cast chain visitors used before the tag. A pass of an
+// ASTVisitor that changes nothing is timed as well.
+//
+// Usage: visit.out <file>
+#include "../lexer/lexer.cpp"
+#include "../parser/parser.cpp"
+#include "../parser/flat_ast.cpp"
+#include "../typechecker/typechecker.cpp"
+#include "../optimization/optimization.cpp"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+    constexpr size_t ROUNDS = 7;
+
+    // The outermost expressions of the commands and statements of a program.
+    class Roots : public Optimization::ASTVisitor
+    {
+    public:
+        std::vector<Parser::ExprNode*> roots;
+
+    protected:
+        virtual void walk_expr(Parser::NodePtr<Parser::ExprNode>& u_expr) override
+        {
+            roots.push_back(u_expr.get());
+        }
+    };
+
+    class Unchanged : public Optimization::ASTVisitor {};
+
+    Parser::NodeKind kind_by_tag(const Parser::ExprNode* expr)
+    {
+        return expr->kind;
+    }
+
+    // In the order the visitors tried each class.
+    Parser::NodeKind kind_by_cast(const Parser::ExprNode* expr)
+    {
+        if (dynamic_cast<const Parser::IntExprNode*>(expr))
+            return Parser::INT_EXPR;
+        if (dynamic_cast<const Parser::FloatExprNode*>(expr))
+            return Parser::FLOAT_EXPR;
+        if (dynamic_cast<const Parser::TrueExprNode*>(expr))
+            return Parser::TRUE_EXPR;
+        if (dynamic_cast<const Parser::FalseExprNode*>(expr))
+            return Parser::FALSE_EXPR;
+        if (dynamic_cast<const Parser::VariableExprNode*>(expr))
+            return Parser::VARIABLE_EXPR;
+        if (dynamic_cast<const Parser::TupleLiteralExprNode*>(expr))
+            return Parser::TUPLE_LITERAL_EXPR;
+        if (dynamic_cast<const Parser::ArrayLiteralExprNode*>(expr))
+            return Parser::ARRAY_LITERAL_EXPR;
+        if (dynamic_cast<const Parser::TupleIndexExprNode*>(expr))
+            return Parser::TUPLE_INDEX_EXPR;
+        if (dynamic_cast<const Parser::ArrayIndexExprNode*>(expr))
+            return Parser::ARRAY_INDEX_EXPR;
+        if (dynamic_cast<const Parser::CallExprNode*>(expr))
+            return Parser::CALL_EXPR;
+        if (dynamic_cast<const Parser::UnopExprNode*>(expr))
+            return Parser::UNOP_EXPR;
+        if (dynamic_cast<const Parser::BinopExprNode*>(expr))
+            return Parser::BINOP_EXPR;
+        if (dynamic_cast<const Parser::IfExprNode*>(expr))
+            return Parser::IF_EXPR;
+        if (dynamic_cast<const Parser::ArrayLoopExprNode*>(expr))
+            return Parser::ARRAY_LOOP_EXPR;
+        if (dynamic_cast<const Parser::SumLoopExprNode*>(expr))
+            return Parser::SUM_LOOP_EXPR;
+        return Parser::INLINED_CALL_EXPR;
+    }
+
+    // Visits expr and the expressions in it, returning how many there are.
+    template<Parser::NodeKind (*kind_of)(const Parser::ExprNode*)>
+    size_t walk(const Parser::ExprNode* expr)
+    {
+        size_t visited = 1;
+        switch (kind_of(expr))
+        {
+            case Parser::TUPLE_LITERAL_EXPR:
+                for (auto& u_expr : static_cast<const Parser::TupleLiteralExprNode*>(expr)->tuple_expressions)
+                    visited += walk<kind_of>(u_expr.get());
+                break;
+            case Parser::ARRAY_LITERAL_EXPR:
+                for (auto& u_expr : static_cast<const Parser::ArrayLiteralExprNode*>(expr)->array_expressions)
+                    visited += walk<kind_of>(u_expr.get());
+                break;
+            case Parser::TUPLE_INDEX_EXPR:
+                visited += walk<kind_of>(static_cast<const Parser::TupleIndexExprNode*>(expr)->tuple_expression.get());
+                break;
+            case Parser::ARRAY_INDEX_EXPR:
+            {
+                auto array_index_expr = static_cast<const Parser::ArrayIndexExprNode*>(expr);
+                visited += walk<kind_of>(array_index_expr->array_expression.get());
+                for (auto& u_expr : array_index_expr->array_indices)
+                    visited += walk<kind_of>(u_expr.get());
+                break;
+            }
+            case Parser::CALL_EXPR:
+                for (auto& u_expr : static_cast<const Parser::CallExprNode*>(expr)->arguments)
+                    visited += walk<kind_of>(u_expr.get());
+                break;
+            case Parser::UNOP_EXPR:
+                visited += walk<kind_of>(static_cast<const Parser::UnopExprNode*>(expr)->expression.get());
+                break;
+            case Parser::BINOP_EXPR:
+                visited += walk<kind_of>(static_cast<const Parser::BinopExprNode*>(expr)->lhs.get());
+                visited += walk<kind_of>(static_cast<const Parser::BinopExprNode*>(expr)->rhs.get());
+                break;
+            case Parser::IF_EXPR:
+            {
+                auto if_expr = static_cast<const Parser::IfExprNode*>(expr);
+                visited += walk<kind_of>(if_expr->condition.get());
+                visited += walk<kind_of>(if_expr->then_expr.get());
+                visited += walk<kind_of>(if_expr->else_expr.get());
+                break;
+            }
+            case Parser::ARRAY_LOOP_EXPR:
+            case Parser::SUM_LOOP_EXPR:
+            {
+                auto loop_expr = static_cast<const Parser::LoopExprNode*>(expr);
+                for (auto& bound : loop_expr->bounds)
+                    visited += walk<kind_of>(bound.second.get());
+                visited += walk<kind_of>(loop_expr->loop_expression.get());
+                break;
+            }
+            default:
+                break;
+        }
+        return visited;
+    }
+
+    // The least time f takes over ROUNDS runs, in nanoseconds.
+    template<class F>
+    double best_time(F f)
+    {
+        double best = 1e300;
+        for (size_t round = 0; round < ROUNDS; round++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            f();
+            std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+        return best;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2)
+    {
+        std::fprintf(stderr, "Usage: %s <file>\n", argv[0]);
+        return 1;
+    }
+
+    std::ifstream file(argv[1]);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    std::string source = contents.str();
+
+    Lexer::TokenStream* tokens = Lexer::lexStream(source);
+    Parser::Arena arena;
+    std::vector<Parser::NodePtr<Parser::CmdNode>> tree = Parser::parse(tokens, arena);
+    Lexer::destroy_token_list(tokens);
+    Typechecker::typecheck(tree);
+
+    Roots roots;
+    roots.visit_all_cmds(tree);
+    size_t nodes = 0;
+    for (Parser::ExprNode* root : roots.roots)
+        nodes += walk<kind_by_tag>(root);
+
+    size_t visited = 0;
+    double by_tag = best_time([&] {for (Parser::ExprNode* root : roots.roots) visited += walk<kind_by_tag>(root);});
+    double by_cast = best_time([&] {for (Parser::ExprNode* root : roots.roots) visited += walk<kind_by_cast>(root);});
+    double pass = best_time([&] {Unchanged().visit_all_cmds(tree);});
+    if (visited != 2 * ROUNDS * nodes)
+    {
+        std::fprintf(stderr, "Walks visited %zu expressions instead of %zu.\n", visited, 2 * ROUNDS * nodes);
+        return 1;
+    }
+
+    std::printf("%zu expressions\n", nodes);
+    std::printf("walk, dynamic_cast chain: %6.2f ns per visit\n", by_cast / nodes);
+    std::printf("walk, kind tag:           %6.2f ns per visit\n", by_tag / nodes);
+    std::printf("ASTVisitor pass:          %6.2f ns per expression\n", pass / nodes);
+
+    Parser::destroy_tree(tree, arena);
+    return 0;
+}
@@ -0,0 +1,1053 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+#include <unordered_map>
+#include <unistd.h>
+#include "cache.h"
+
+namespace Cache
+{
+    uint64_t hashBytes(std::string_view bytes)
+    {
+        // Mixes in eight bytes at a time; the file is hashed on every load, so this has to be fast.
+        uint64_t hash = 0xcbf29ce484222325 ^ bytes.size();
+        size_t i = 0;
+        for (; i + 8 <= bytes.size(); i += 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, bytes.data() + i, 8);
+            hash = (hash ^ word) * 0x9e3779b97f4a7c15;
+            hash ^= hash >> 32;
+        }
+        for (; i < bytes.size(); i++)
+        {
+            hash = (hash ^ (unsigned char) bytes[i]) * 0x9e3779b97f4a7c15;
+            hash ^= hash >> 32;
+        }
+        return hash;
+    }
+
+    std::string cachePath(const std::string& directory, std::string_view source)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.jplc", (unsigned long long) hashBytes(source));
+        return directory + "/" + name;
+    }
+
+#pragma region Storing
+
+    // Collects the sections of a cache file.
+    class Writer
+    {
+        public:
+            // The packed nodes, in order.
+            std::string nodes;
+            std::vector<uint32_t> symbol_lists;
+            std::vector<Type> types;
+            std::vector<uint32_t> type_elements;
+            std::vector<Global> globals;
+            std::vector<Name> names;
+            std::string name_text;
+            // The text of the nodes, in order.
+            std::string text;
+
+            void addNode(const Node& node)
+            {
+                nodes += (char) node.kind;
+                if (node.kind == Parser::UNOP_EXPR || node.kind == Parser::BINOP_EXPR)
+                    nodes += (char) node.operation;
+
+                addNumber(node.child_count);
+                addNumber(node.data);
+                addNumber(node.symbol + 1);
+                int64_t line_change = (int64_t) node.line - previous_line;
+                addNumber(line_change < 0 ? -2 * line_change - 1 : 2 * line_change);
+                addNumber(node.pos);
+                addNumber(node.type + 1);
+                addNumber(node.shared_child + 1);
+                addNumber(node.shared_size);
+                addNumber(node.head_size);
+                addNumber(node.tail_size);
+                previous_line = node.line;
+            }
+
+            // The index of symbol in names, adding it if needed.
+            uint32_t name(Lexer::Symbol symbol)
+            {
+                if (symbol == Lexer::NO_SYMBOL)
+                    return NONE;
+
+                auto found = name_indices.find(symbol);
+                if (found != name_indices.end())
+                    return found->second;
+
+                const std::string& name_text = Lexer::interner().name(symbol);
+                names.push_back({this->name_text.size(), name_text.size()});
+                this->name_text += name_text;
+                name_indices.emplace(symbol, names.size() - 1);
+                return names.size() - 1;
+            }
+
+            // The index of rtype in types, adding it (after its elements) if needed.
+            uint32_t type(const std::shared_ptr<Typechecker::ResolvedType>& rtype)
+            {
+                if (rtype == nullptr)
+                    return NONE;
+
+                // Most expressions have a scalar type, which is looked up without hashing.
+                bool scalar = rtype->type_name != Typechecker::ARRAY && rtype->type_name != Typechecker::TUPLE;
+                if (scalar && scalar_indices[rtype->type_name] != NONE)
+                    return scalar_indices[rtype->type_name];
+
+                auto found = type_indices.find(rtype.get());
+                if (found != type_indices.end())
+                    return found->second;
+
+                Type stored = {(uint32_t) rtype->type_name, 0, 0, 0};
+                std::vector<uint32_t> elements;
+
+                if (rtype->type_name == Typechecker::ARRAY)
+                {
+                    Typechecker::ArrayRType* array = static_cast<Typechecker::ArrayRType*>(rtype.get());
+                    stored.rank = array->rank;
+                    elements.push_back(type(array->element_type));
+                }
+                else if (rtype->type_name == Typechecker::TUPLE)
+                {
+                    for (const auto& element : static_cast<Typechecker::TupleRType*>(rtype.get())->element_types)
+                        elements.push_back(type(element));
+                }
+
+                // Resolved types are interned, so each distinct type is one object and is stored once.
+                stored.first_element = type_elements.size();
+                stored.element_count = elements.size();
+                type_elements.insert(type_elements.end(), elements.begin(), elements.end());
+                types.push_back(stored);
+
+                uint32_t index = types.size() - 1;
+                if (scalar)
+                    scalar_indices[rtype->type_name] = index;
+                else
+                    type_indices.emplace(rtype.get(), index);
+                return index;
+            }
+
+            void addNumber(uint64_t number)
+            {
+                while (number >= 0x80)
+                {
+                    nodes += (char) (number | 0x80);
+                    number >>= 7;
+                }
+                nodes += (char) number;
+            }
+
+            // Stores the text of the node at index around the longest run it shares with the
+            // text of one of its children.
+            void addNodeText(Node& node, const Parser::FlatAST& flat, Parser::NodeIndex index)
+            {
+                std::string_view node_text = flat.origins[index]->token_s;
+                size_t shared_at = 0;
+                node.shared_child = NONE;
+                node.shared_size = 0;
+
+                for (uint32_t c = 0; c < flat[index].child_count; c++)
+                {
+                    std::string_view child_text = flat.origins[flat.child(index, c)]->token_s;
+                    if (child_text.size() <= node.shared_size)
+                        continue;
+
+                    // Clipped texts only share a prefix of the child's text, so the match is found
+                    // by its start and then extended.
+                    size_t at = node_text.find(child_text.substr(0, PROBE_SIZE));
+                    if (at == std::string_view::npos)
+                        continue;
+
+                    size_t size = std::mismatch(child_text.begin(), child_text.end(), node_text.begin() + at, node_text.end()).first - child_text.begin();
+                    if (size > node.shared_size)
+                    {
+                        node.shared_child = c;
+                        node.shared_size = size;
+                        shared_at = at;
+                    }
+                }
+
+                node.head_size = shared_at;
+                node.tail_size = node_text.size() - shared_at - node.shared_size;
+                text += node_text.substr(0, node.head_size);
+                text += node_text.substr(shared_at + node.shared_size);
+            }
+
+        private:
+            // How much of a child's text has to match for the rest of it to be compared.
+            static constexpr size_t PROBE_SIZE = 16;
+
+            uint32_t previous_line = 0;
+            std::unordered_map<Lexer::Symbol, uint32_t> name_indices;
+            uint32_t scalar_indices[Typechecker::TUPLE + 1] = {NONE, NONE, NONE, NONE, NONE};
+            std::unordered_map<Typechecker::ResolvedType*, uint32_t> type_indices;
+    };
+
+    template<class T>
+    static void appendSection(std::string& out, const T* section, size_t count)
+    {
+        out.append((const char*) section, count * sizeof(T));
+        out.resize((out.size() + 7) & ~(size_t) 7, '\0');
+    }
+
+    bool store(const std::string& path, std::string_view source, const std::vector<Parser::NodePtr<Parser::CmdNode>>& tree, Typechecker::Scope& scope)
+    {
+        Parser::FlatAST flat(tree);
+        Writer writer;
+
+        writer.nodes.reserve(flat.size() * 12);
+        for (Parser::NodeIndex i = 0; i < flat.size(); i++)
+        {
+            const Parser::FlatNode& flat_node = flat[i];
+
+            Node node = {};
+            node.kind = flat_node.kind;
+            node.operation = flat_node.operation;
+            node.child_count = flat_node.child_count;
+            node.data = flat_node.data;
+            node.symbol = writer.name(flat_node.symbol);
+            node.line = flat.lines[i];
+            node.pos = flat.positions[i];
+            node.type = writer.type(flat.types[i]);
+            writer.addNodeText(node, flat, i);
+
+            // Symbol lists hold symbols, so they are rewritten as names too.
+            if (flat_node.kind == Parser::ARRAY_ARGUMENT)
+            {
+                uint32_t dimensions = flat.symbol_lists[flat_node.data];
+                node.data = writer.symbol_lists.size();
+                writer.symbol_lists.push_back(dimensions);
+                for (uint32_t d = 0; d < dimensions; d++)
+                    writer.symbol_lists.push_back(writer.name(flat.symbol_lists[flat_node.data + 1 + d]));
+            }
+            else if (flat_node.kind == Parser::ARRAY_LOOP_EXPR || flat_node.kind == Parser::SUM_LOOP_EXPR)
+            {
+                node.data = writer.symbol_lists.size();
+                for (uint32_t b = 0; b + 1 < flat_node.child_count; b++)
+                    writer.symbol_lists.push_back(writer.name(flat.symbol_lists[flat_node.data + b]));
+            }
+
+            writer.addNode(node);
+        }
+
+        for (const Typechecker::Scope::Binding& binding : scope.globals)
+        {
+            Global global = {writer.name(binding.symbol), Global::VARIABLE, NONE, 0, 0};
+            Typechecker::NameInfo* info = binding.info.get();
+
+            if (Typechecker::VariableInfo* variable = dynamic_cast<Typechecker::VariableInfo*>(info))
+                global.type = writer.type(variable->rtype);
+            else if (Typechecker::TypeInfo* type = dynamic_cast<Typechecker::TypeInfo*>(info))
+            {
+                global.kind = Global::TYPE;
+                global.type = writer.type(type->stored_type);
+            }
+            else if (Typechecker::FuncInfo* function = dynamic_cast<Typechecker::FuncInfo*>(info))
+            {
+                global.kind = Global::FUNCTION;
+                global.type = writer.type(function->return_type);
+
+                std::vector<uint32_t> arguments;
+                for (const auto& argument : function->arguments)
+                    arguments.push_back(writer.type(argument));
+
+                global.first_argument = writer.type_elements.size();
+                global.argument_count = arguments.size();
+                writer.type_elements.insert(writer.type_elements.end(), arguments.begin(), arguments.end());
+            }
+            else
+                return false;
+
+            writer.globals.push_back(global);
+        }
+
+        std::vector<int64_t> integers(flat.integers.begin(), flat.integers.end());
+
+        Header header = {};
+        header.magic = MAGIC;
+        header.version = VERSION;
+        header.source_hash = hashBytes(source);
+        header.source_size = source.size();
+        header.node_count = flat.size();
+        header.node_size = writer.nodes.size();
+        header.command_count = flat.commands.size();
+        header.integer_count = integers.size();
+        header.float_count = flat.floats.size();
+        header.symbol_list_count = writer.symbol_lists.size();
+        header.type_count = writer.types.size();
+        header.type_element_count = writer.type_elements.size();
+        header.global_count = writer.globals.size();
+        header.name_count = writer.names.size();
+        header.name_text_size = writer.name_text.size();
+        header.text_size = writer.text.size();
+
+        std::string out;
+        appendSection(out, &header, 1);
+        size_t payload = out.size();
+        appendSection(out, writer.nodes.data(), writer.nodes.size());
+        appendSection(out, integers.data(), integers.size());
+        appendSection(out, flat.floats.data(), flat.floats.size());
+        appendSection(out, writer.symbol_lists.data(), writer.symbol_lists.size());
+        appendSection(out, writer.types.data(), writer.types.size());
+        appendSection(out, writer.type_elements.data(), writer.type_elements.size());
+        appendSection(out, writer.globals.data(), writer.globals.size());
+        appendSection(out, writer.names.data(), writer.names.size());
+        appendSection(out, writer.name_text.data(), writer.name_text.size());
+        appendSection(out, writer.text.data(), writer.text.size());
+        appendSection(out, source.data(), source.size());
+
+        uint64_t checksum = hashBytes(std::string_view(out).substr(payload));
+        std::memcpy(&out[offsetof(Header, checksum)], &checksum, sizeof(checksum));
+
+        // Written beside the destination and renamed into place, so that a compile running at
+        // the same time never maps a half written file.
+        std::string temporary_path = path + "." + std::to_string(getpid()) + ".tmp";
+        {
+            std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+            if (!file.write(out.data(), out.size()))
+            {
+                std::remove(temporary_path.c_str());
+                return false;
+            }
+        }
+
+        if (std::rename(temporary_path.c_str(), path.c_str()) != 0)
+        {
+            std::remove(temporary_path.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+#pragma endregion
+
+#pragma region Loading
+
+    // Thrown while loading when the file does not describe a well formed program.
+    class DamagedCache : public std::exception {};
+
+    // Reads the sections of a cache file in place and rebuilds what they describe.
+    class Loader
+    {
+        public:
+            const Header* header = nullptr;
+            const uint8_t* nodes;
+            const int64_t* integers;
+            const double* floats;
+            const uint32_t* symbol_lists;
+            const Type* types;
+            const uint32_t* type_elements;
+            const Global* globals;
+            const Name* names;
+            const char* name_text;
+            const char* text;
+            const char* source;
+
+            Loader(std::string_view _cached, Parser::Arena& _arena) : cached(_cached), arena(_arena) {}
+
+            void readHeader()
+            {
+                header = take<Header>(1);
+                if (header->magic != MAGIC || header->version != VERSION)
+                    throw DamagedCache();
+            }
+
+            void readSections()
+            {
+                if (header->checksum != hashBytes(cached.substr(offset)))
+                    throw DamagedCache();
+
+                nodes = take<uint8_t>(header->node_size);
+                integers = take<int64_t>(header->integer_count);
+                floats = take<double>(header->float_count);
+                symbol_lists = take<uint32_t>(header->symbol_list_count);
+                types = take<Type>(header->type_count);
+                type_elements = take<uint32_t>(header->type_element_count);
+                globals = take<Global>(header->global_count);
+                names = take<Name>(header->name_count);
+                name_text = take<char>(header->name_text_size);
+                text = take<char>(header->text_size);
+                source = take<char>(header->source_size);
+            }
+
+            void internNames()
+            {
+                symbols.reserve(header->name_count);
+                for (uint32_t i = 0; i < header->name_count; i++)
+                {
+                    const Name& name = names[i];
+                    if (name.text_offset > header->name_text_size || name.text_size > header->name_text_size - name.text_offset)
+                        throw DamagedCache();
+                    symbols.push_back(Lexer::intern(std::string_view(name_text + name.text_offset, name.text_size)));
+                }
+            }
+
+            void buildTypes()
+            {
+                resolved_types.reserve(header->type_count);
+                for (uint32_t i = 0; i < header->type_count; i++)
+                {
+                    const Type& type = types[i];
+                    std::vector<std::shared_ptr<Typechecker::ResolvedType>> elements = typeList(type.first_element, type.element_count, i);
+
+                    switch (type.type_name)
+                    {
+                        case Typechecker::INT:
+                            resolved_types.push_back(Typechecker::intType());
+                            break;
+                        case Typechecker::FLOAT:
+                            resolved_types.push_back(Typechecker::floatType());
+                            break;
+                        case Typechecker::BOOL:
+                            resolved_types.push_back(Typechecker::boolType());
+                            break;
+                        case Typechecker::ARRAY:
+                        {
+                            if (elements.size() != 1)
+                                throw DamagedCache();
+                            resolved_types.push_back(Typechecker::arrayType(elements[0], type.rank));
+                            break;
+                        }
+                        case Typechecker::TUPLE:
+                            resolved_types.push_back(Typechecker::tupleType(elements));
+                            break;
+                        default:
+                            throw DamagedCache();
+                    }
+                }
+            }
+
+            std::shared_ptr<Typechecker::Scope> buildScope()
+            {
+                std::shared_ptr<Typechecker::Scope> scope = std::make_shared<Typechecker::Scope>();
+
+                for (uint32_t i = 0; i < header->global_count; i++)
+                {
+                    const Global& global = globals[i];
+                    std::shared_ptr<Typechecker::ResolvedType> type = typeAt(global.type, header->type_count);
+                    std::unique_ptr<Typechecker::NameInfo> info;
+
+                    switch (global.kind)
+                    {
+                        case Global::VARIABLE:
+                            info.reset(new Typechecker::VariableInfo(type));
+                            break;
+                        case Global::TYPE:
+                            info.reset(new Typechecker::TypeInfo(type));
+                            break;
+                        case Global::FUNCTION:
+                        {
+                            std::vector<std::shared_ptr<Typechecker::ResolvedType>> arguments = typeList(global.first_argument, global.argument_count, header->type_count);
+                            info.reset(new Typechecker::FuncInfo(type, arguments));
+                            break;
+                        }
+                        default:
+                            throw DamagedCache();
+                    }
+
+                    if (!scope->add(symbolAt(global.name), info.get()))
+                        throw DamagedCache();
+                    info.release();
+                }
+
+                return scope;
+            }
+
+            // Builds every node. Nodes are stored in post-order, so each node's children are
+            // built before it and the tree is put together in one pass, without recursion.
+            void buildTree(std::vector<Parser::NodePtr<Parser::CmdNode>>& tree)
+            {
+                for (uint32_t i = 0; i < header->node_count; i++)
+                    buildNode(readNode());
+
+                if (trees.size() != header->command_count)
+                    throw DamagedCache();
+
+                base = 0;
+                for (uint32_t i = 0; i < header->command_count; i++)
+                    tree.push_back(child<Parser::CmdNode>(i));
+            }
+
+        private:
+            std::string_view cached;
+            size_t offset = 0;
+            Parser::Arena& arena;
+
+            std::vector<Lexer::Symbol> symbols;
+            std::vector<std::shared_ptr<Typechecker::ResolvedType>> resolved_types;
+            // The trees that were built but not yet given to a parent, in order.
+            std::vector<Parser::ASTNode*> trees;
+            // Where the children of the node being built start in trees.
+            size_t base;
+            // Where the next node and its text start.
+            uint64_t node_offset = 0;
+            uint64_t text_offset = 0;
+            uint32_t previous_line = 0;
+
+            uint8_t readByte()
+            {
+                if (node_offset >= header->node_size)
+                    throw DamagedCache();
+                return nodes[node_offset++];
+            }
+
+            uint64_t readNumber()
+            {
+                uint64_t number = 0;
+                for (int shift = 0; shift < 64; shift += 7)
+                {
+                    uint8_t byte = readByte();
+                    number |= (uint64_t) (byte & 0x7f) << shift;
+                    if (byte < 0x80)
+                        return number;
+                }
+                throw DamagedCache();
+            }
+
+            // A field stored plus one, so that NONE is 0.
+            uint32_t readIndex()
+            {
+                return (uint32_t) (readNumber() - 1);
+            }
+
+            Node readNode()
+            {
+                Node node;
+                node.kind = readByte();
+                node.operation = (node.kind == Parser::UNOP_EXPR || node.kind == Parser::BINOP_EXPR) ? readByte() : 0;
+                node.child_count = readNumber();
+                node.data = readNumber();
+                node.symbol = readIndex();
+                uint64_t line_change = readNumber();
+                node.line = previous_line + ((line_change & 1) ? -(int64_t) (line_change >> 1) - 1 : (int64_t) (line_change >> 1));
+                node.pos = readNumber();
+                node.type = readIndex();
+                node.shared_child = readIndex();
+                node.shared_size = readNumber();
+                node.head_size = readNumber();
+                node.tail_size = readNumber();
+                previous_line = node.line;
+                return node;
+            }
+
+            template<class T>
+            const T* take(uint64_t count)
+            {
+                uint64_t size = count * sizeof(T);
+                if (count > cached.size() || size > cached.size() - offset)
+                    throw DamagedCache();
+
+                const T* section = (const T*) (cached.data() + offset);
+                offset = (offset + size + 7) & ~(uint64_t) 7;
+                offset = std::min<uint64_t>(offset, cached.size());
+                return section;
+            }
+
+            std::string_view textAt(uint64_t text_offset, uint64_t text_size)
+            {
+                if (text_offset > header->text_size || text_size > header->text_size - text_offset)
+                    throw DamagedCache();
+                return std::string_view(text + text_offset, text_size);
+            }
+
+            Lexer::Symbol symbolAt(uint32_t name)
+            {
+                if (name == NONE)
+                    return Lexer::NO_SYMBOL;
+                if (name >= symbols.size())
+                    throw DamagedCache();
+                return symbols[name];
+            }
+
+            // The type at type_index, which must come before limit.
+            std::shared_ptr<Typechecker::ResolvedType> typeAt(uint32_t type_index, uint32_t limit)
+            {
+                if (type_index == NONE)
+                    return nullptr;
+                if (type_index >= limit)
+                    throw DamagedCache();
+                return resolved_types[type_index];
+            }
+
+            std::vector<std::shared_ptr<Typechecker::ResolvedType>> typeList(uint32_t first, uint32_t count, uint32_t limit)
+            {
+                if (first > header->type_element_count || count > header->type_element_count - first)
+                    throw DamagedCache();
+
+                std::vector<std::shared_ptr<Typechecker::ResolvedType>> list;
+                for (uint32_t i = first; i < first + count; i++)
+                {
+                    list.push_back(typeAt(type_elements[i], limit));
+                    if (list.back() == nullptr)
+                        throw DamagedCache();
+                }
+                return list;
+            }
+
+            const uint32_t* symbolList(uint32_t first, uint32_t count)
+            {
+                if (first > header->symbol_list_count || count > header->symbol_list_count - first)
+                    throw DamagedCache();
+                return symbol_lists + first;
+            }
+
+            // Whether a node of kind may stand where the tree expects a T.
+            template<class T>
+            static bool holds(Parser::NodeKind kind)
+            {
+                if constexpr (std::is_same<T, Parser::ExprNode>::value)
+                    return kind >= Parser::INT_EXPR && kind <= Parser::SUM_LOOP_EXPR;
+                else if constexpr (std::is_same<T, Parser::StmtNode>::value)
+                    return kind >= Parser::LET_STMT && kind <= Parser::RETURN_STMT;
+                else if constexpr (std::is_same<T, Parser::TypeNode>::value)
+                    return kind >= Parser::INT_TYPE && kind <= Parser::TUPLE_TYPE;
+                else if constexpr (std::is_same<T, Parser::CmdNode>::value)
+                    return kind >= Parser::READ_CMD && kind <= Parser::FN_CMD;
+                else if constexpr (std::is_same<T, Parser::ArgumentNode>::value)
+                    return kind == Parser::VAR_ARGUMENT || kind == Parser::ARRAY_ARGUMENT;
+                else if constexpr (std::is_same<T, Parser::BindingNode>::value)
+                    return kind == Parser::TUPLE_BINDING || kind == Parser::VAR_BINDING;
+                else if constexpr (std::is_same<T, Parser::LValue>::value)
+                    return kind == Parser::ARGUMENT_LVALUE || kind == Parser::TUPLE_LVALUE;
+                else
+                    return kind == T::KIND;
+            }
+
+            // Hands the i-th child of the node being built to it.
+            template<class T>
+            Parser::NodePtr<T> child(uint32_t i)
+            {
+                if (base + i >= trees.size())
+                    throw DamagedCache();
+
+                Parser::ASTNode* node = trees[base + i];
+                if (node == nullptr || !holds<T>(node->kind))
+                    throw DamagedCache();
+
+                trees[base + i] = nullptr;
+                return Parser::NodePtr<T>(static_cast<T*>(node));
+            }
+
+            // Hands the children [begin, end) of the node being built to it.
+            template<class T>
+            void childList(Parser::ArenaVector<Parser::NodePtr<T>>& list, uint32_t begin, uint32_t end)
+            {
+                for (uint32_t i = begin; i < end; i++)
+                    list.push_back(child<T>(i));
+            }
+
+            template<class T>
+            T* make()
+            {
+                return new (arena) T(arena);
+            }
+
+            void buildNode(const Node& node)
+            {
+                uint32_t count = node.child_count;
+
+                if (count > trees.size())
+                    throw DamagedCache();
+                base = trees.size() - count;
+
+                std::string node_text = nodeText(node);
+                Parser::ASTNode* result;
+
+                switch (node.kind)
+                {
+                    case Parser::STRING:
+                        result = make<Parser::StringNode>();
+                        break;
+                    case Parser::VAR_ARGUMENT:
+                        result = make<Parser::VarArgumentNode>();
+                        break;
+                    case Parser::ARRAY_ARGUMENT:
+                    {
+                        Parser::ArrayArgumentNode* argument = make<Parser::ArrayArgumentNode>();
+                        argument->array_argument_symbol = symbolAt(node.symbol);
+                        argument->array_argument_name = Lexer::interner().name(argument->array_argument_symbol);
+
+                        uint32_t dimensions = *symbolList(node.data, 1);
+                        const uint32_t* dimension_names = symbolList(node.data + 1, dimensions);
+                        for (uint32_t d = 0; d < dimensions; d++)
+                        {
+                            argument->array_dimensions_symbols.push_back(symbolAt(dimension_names[d]));
+                            argument->array_dimensions_names.emplace_back(arena, Lexer::interner().name(argument->array_dimensions_symbols.back()));
+                        }
+                        result = argument;
+                        break;
+                    }
+                    case Parser::TUPLE_BINDING:
+                    {
+                        Parser::TupleBindingNode* binding = make<Parser::TupleBindingNode>();
+                        childList(binding->bindings, 0, count);
+                        result = binding;
+                        break;
+                    }
+                    case Parser::VAR_BINDING:
+                    {
+                        Parser::VarBindingNode* binding = make<Parser::VarBindingNode>();
+                        binding->argument = child<Parser::ArgumentNode>(0);
+                        binding->type = child<Parser::TypeNode>(1);
+                        result = binding;
+                        break;
+                    }
+                    case Parser::ARGUMENT_LVALUE:
+                    {
+                        Parser::ArgumentLValue* lvalue = make<Parser::ArgumentLValue>();
+                        lvalue->argument = child<Parser::ArgumentNode>(0);
+                        result = lvalue;
+                        break;
+                    }
+                    case Parser::TUPLE_LVALUE:
+                    {
+                        Parser::TupleLValueNode* lvalue = make<Parser::TupleLValueNode>();
+                        childList(lvalue->lvalues, 0, count);
+                        result = lvalue;
+                        break;
+                    }
+                    case Parser::INT_EXPR:
+                    {
+                        Parser::IntExprNode* expr = make<Parser::IntExprNode>();
+                        expr->value = integerAt(node.data);
+                        result = expr;
+                        break;
+                    }
+                    case Parser::FLOAT_EXPR:
+                    {
+                        Parser::FloatExprNode* expr = make<Parser::FloatExprNode>();
+                        if (node.data >= header->float_count)
+                            throw DamagedCache();
+                        expr->value = floats[node.data];
+                        result = expr;
+                        break;
+                    }
+                    case Parser::TRUE_EXPR:
+                    {
+                        Parser::TrueExprNode* expr = make<Parser::TrueExprNode>();
+                        expr->value = true;
+                        result = expr;
+                        break;
+                    }
+                    case Parser::FALSE_EXPR:
+                    {
+                        Parser::FalseExprNode* expr = make<Parser::FalseExprNode>();
+                        expr->value = false;
+                        result = expr;
+                        break;
+                    }
+                    case Parser::VARIABLE_EXPR:
+                        result = make<Parser::VariableExprNode>();
+                        break;
+                    case Parser::TUPLE_LITERAL_EXPR:
+                    {
+                        Parser::TupleLiteralExprNode* expr = make<Parser::TupleLiteralExprNode>();
+                        childList(expr->tuple_expressions, 0, count);
+                        result = expr;
+                        break;
+                    }
+                    case Parser::ARRAY_LITERAL_EXPR:
+                    {
+                        Parser::ArrayLiteralExprNode* expr = make<Parser::ArrayLiteralExprNode>();
+                        childList(expr->array_expressions, 0, count);
+                        result = expr;
+                        break;
+                    }
+                    case Parser::TUPLE_INDEX_EXPR:
+                    {
+                        Parser::TupleIndexExprNode* expr = make<Parser::TupleIndexExprNode>();
+                        expr->tuple_expression = child<Parser::ExprNode>(0);
+                        expr->tuple_index = integerAt(node.data);
+                        result = expr;
+                        break;
+                    }
+                    case Parser::ARRAY_INDEX_EXPR:
+                    {
+                        Parser::ArrayIndexExprNode* expr = make<Parser::ArrayIndexExprNode>();
+                        expr->array_expression = child<Parser::ExprNode>(0);
+                        childList(expr->array_indices, 1, count);
+                        result = expr;
+                        break;
+                    }
+                    case Parser::CALL_EXPR:
+                    {
+                        Parser::CallExprNode* expr = make<Parser::CallExprNode>();
+                        expr->function_symbol = symbolAt(node.symbol);
+                        expr->function_name = Lexer::interner().name(expr->function_symbol);
+                        childList(expr->arguments, 0, count);
+                        result = expr;
+                        break;
+                    }
+                    case Parser::UNOP_EXPR:
+                    {
+                        Parser::UnopExprNode* expr = make<Parser::UnopExprNode>();
+                        expr->operation = (Parser::UnopExprNode::UnopType) node.operation;
+                        expr->expression = child<Parser::ExprNode>(0);
+                        result = expr;
+                        break;
+                    }
+                    case Parser::BINOP_EXPR:
+                    {
+                        Parser::BinopExprNode* expr = make<Parser::BinopExprNode>();
+                        expr->lhs = child<Parser::ExprNode>(0);
+                        expr->operation = (Parser::BinopExprNode::BinopType) node.operation;
+                        expr->rhs = child<Parser::ExprNode>(1);
+                        result = expr;
+                        break;
+                    }
+                    case Parser::IF_EXPR:
+                    {
+                        Parser::IfExprNode* expr = make<Parser::IfExprNode>();
+                        expr->condition = child<Parser::ExprNode>(0);
+                        expr->then_expr = child<Parser::ExprNode>(1);
+                        expr->else_expr = child<Parser::ExprNode>(2);
+                        result = expr;
+                        break;
+                    }
+                    case Parser::ARRAY_LOOP_EXPR:
+                    case Parser::SUM_LOOP_EXPR:
+                    {
+                        Parser::LoopExprNode* expr;
+                        if (node.kind == Parser::ARRAY_LOOP_EXPR)
+                            expr = make<Parser::ArrayLoopExprNode>();
+                        else
+                            expr = make<Parser::SumLoopExprNode>();
+
+                        if (count == 0)
+                            throw DamagedCache();
+
+                        const uint32_t* bound_names = symbolList(node.data, count - 1);
+                        for (uint32_t b = 0; b + 1 < count; b++)
+                        {
+                            Lexer::Symbol bound_symbol = symbolAt(bound_names[b]);
+                            Parser::NodePtr<Parser::ExprNode> bound = child<Parser::ExprNode>(b);
+                            expr->bounds.emplace_back(Parser::Text(arena, Lexer::interner().name(bound_symbol)), std::move(bound));
+                            expr->bound_symbols.push_back(bound_symbol);
+                        }
+                        expr->loop_expression = child<Parser::ExprNode>(count - 1);
+                        result = expr;
+                        break;
+                    }
+                    case Parser::LET_STMT:
+                    {
+                        Parser::LetStmtNode* stmt = make<Parser::LetStmtNode>();
+                        stmt->set_variable_name = child<Parser::LValue>(0);
+                        stmt->variable_expression = child<Parser::ExprNode>(1);
+                        result = stmt;
+                        break;
+                    }
+                    case Parser::ASSERT_STMT:
+                    {
+                        Parser::AssertStmtNode* stmt = make<Parser::AssertStmtNode>();
+                        stmt->expression = child<Parser::ExprNode>(0);
+                        stmt->string = child<Parser::StringNode>(1);
+                        result = stmt;
+                        break;
+                    }
+                    case Parser::RETURN_STMT:
+                    {
+                        Parser::ReturnStmtNode* stmt = make<Parser::ReturnStmtNode>();
+                        stmt->expression = child<Parser::ExprNode>(0);
+                        result = stmt;
+                        break;
+                    }
+                    case Parser::INT_TYPE:
+                        result = make<Parser::IntTypeNode>();
+                        break;
+                    case Parser::BOOL_TYPE:
+                        result = make<Parser::BoolTypeNode>();
+                        break;
+                    case Parser::FLOAT_TYPE:
+                        result = make<Parser::FloatTypeNode>();
+                        break;
+                    case Parser::VARIABLE_TYPE:
+                        result = make<Parser::VariableTypeNode>();
+                        break;
+                    case Parser::ARRAY_TYPE:
+                    {
+                        Parser::ArrayTypeNode* type = make<Parser::ArrayTypeNode>();
+                        type->array_type = child<Parser::TypeNode>(0);
+                        type->rank = node.data;
+                        result = type;
+                        break;
+                    }
+                    case Parser::TUPLE_TYPE:
+                    {
+                        Parser::TupleTypeNode* type = make<Parser::TupleTypeNode>();
+                        childList(type->tuple_types, 0, count);
+                        result = type;
+                        break;
+                    }
+                    case Parser::READ_CMD:
+                    {
+                        Parser::ReadCmdNode* cmd = make<Parser::ReadCmdNode>();
+                        cmd->fileName = child<Parser::StringNode>(0);
+                        cmd->readInto = child<Parser::ArgumentNode>(1);
+                        result = cmd;
+                        break;
+                    }
+                    case Parser::WRITE_CMD:
+                    {
+                        Parser::WriteCmdNode* cmd = make<Parser::WriteCmdNode>();
+                        cmd->toSave = child<Parser::ExprNode>(0);
+                        cmd->fileName = child<Parser::StringNode>(1);
+                        result = cmd;
+                        break;
+                    }
+                    case Parser::TYPE_CMD:
+                    {
+                        Parser::TypeCmdNode* cmd = make<Parser::TypeCmdNode>();
+                        cmd->variable_symbol = symbolAt(node.symbol);
+                        cmd->variable = Lexer::interner().name(cmd->variable_symbol);
+                        cmd->type = child<Parser::TypeNode>(0);
+                        result = cmd;
+                        break;
+                    }
+                    case Parser::LET_CMD:
+                    {
+                        Parser::LetCmdNode* cmd = make<Parser::LetCmdNode>();
+                        cmd->lvalue = child<Parser::LValue>(0);
+                        cmd->expression = child<Parser::ExprNode>(1);
+                        result = cmd;
+                        break;
+                    }
+                    case Parser::ASSERT_CMD:
+                    {
+                        Parser::AssertCmdNode* cmd = make<Parser::AssertCmdNode>();
+                        cmd->expression = child<Parser::ExprNode>(0);
+                        cmd->string = child<Parser::StringNode>(1);
+                        result = cmd;
+                        break;
+                    }
+                    case Parser::PRINT_CMD:
+                    {
+                        Parser::PrintCmdNode* cmd = make<Parser::PrintCmdNode>();
+                        cmd->string = child<Parser::StringNode>(0);
+                        result = cmd;
+                        break;
+                    }
+                    case Parser::SHOW_CMD:
+                    {
+                        Parser::ShowCmdNode* cmd = make<Parser::ShowCmdNode>();
+                        cmd->expression = child<Parser::ExprNode>(0);
+                        result = cmd;
+                        break;
+                    }
+                    case Parser::TIME_CMD:
+                    {
+                        Parser::TimeCmdNode* cmd = make<Parser::TimeCmdNode>();
+                        cmd->command = child<Parser::CmdNode>(0);
+                        result = cmd;
+                        break;
+                    }
+                    case Parser::FN_CMD:
+                    {
+                        Parser::FnCmd* cmd = make<Parser::FnCmd>();
+                        if (node.data >= count)
+                            throw DamagedCache();
+
+                        cmd->function_symbol = symbolAt(node.symbol);
+                        cmd->function_name = Lexer::interner().name(cmd->function_symbol);
+                        childList(cmd->arguments, 0, node.data);
+                        cmd->return_type = child<Parser::TypeNode>(node.data);
+                        childList(cmd->function_contents, node.data + 1, count);
+                        result = cmd;
+                        break;
+                    }
+                    default:
+                        throw DamagedCache();
+                }
+
+                result->token_s = node_text;
+                result->line = node.line;
+                result->pos = node.pos;
+
+                if (node.kind == Parser::VAR_ARGUMENT || node.kind == Parser::VARIABLE_EXPR || node.kind == Parser::VARIABLE_TYPE)
+                    result->symbol = symbolAt(node.symbol);
+
+                if (holds<Parser::ExprNode>(result->kind))
+                {
+                    Parser::ExprNode* expr = static_cast<Parser::ExprNode*>(result);
+                    expr->resolvedType = typeAt(node.type, header->type_count).get();
+                }
+
+                trees.resize(base);
+                trees.push_back(result);
+            }
+
+            // Puts the text of node back together, from the text section and the text of the
+            // child it shares text with, which was already built.
+            std::string nodeText(const Node& node)
+            {
+                std::string_view head = textAt(text_offset, node.head_size);
+                std::string_view tail = textAt(text_offset + node.head_size, node.tail_size);
+                text_offset += head.size() + tail.size();
+
+                if (node.shared_child == NONE)
+                    return std::string(head) += tail;
+
+                if (node.shared_child >= node.child_count)
+                    throw DamagedCache();
+
+                std::string_view child_text = trees[base + node.shared_child]->token_s;
+                if (node.shared_size > child_text.size())
+                    throw DamagedCache();
+
+                std::string node_text;
+                node_text.reserve(head.size() + node.shared_size + tail.size());
+                node_text += head;
+                node_text += child_text.substr(0, node.shared_size);
+                node_text += tail;
+                return node_text;
+            }
+
+            long integerAt(uint32_t integer_index)
+            {
+                if (integer_index >= header->integer_count)
+                    throw DamagedCache();
+                return integers[integer_index];
+            }
+    };
+
+    bool load(std::string_view cached, std::string_view source, Parser::Arena& arena, std::vector<Parser::NodePtr<Parser::CmdNode>>& tree, std::shared_ptr<Typechecker::Scope>& scope)
+    {
+        Loader loader(cached, arena);
+
+        try
+        {
+            loader.readHeader();
+            if (loader.header->source_size != source.size() || loader.header->source_hash != hashBytes(source))
+                return false;
+
+            loader.readSections();
+            if (std::string_view(loader.source, loader.header->source_size) != source)
+                return false;
+
+            loader.internNames();
+            loader.buildTypes();
+            std::shared_ptr<Typechecker::Scope> loaded_scope = loader.buildScope();
+
+            std::vector<Parser::NodePtr<Parser::CmdNode>> loaded_tree;
+            loader.buildTree(loaded_tree);
+
+            tree = std::move(loaded_tree);
+            scope = std::move(loaded_scope);
+            return true;
+        }
+        catch (const DamagedCache&)
+        {
+            return false;
+        }
+    }
+
+#pragma endregion
+}
@@ -0,0 +1,126 @@
+#include <string>
+#include <string_view>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include "../parser/flat_ast.h"
+#include "../typechecker/typechecker.h"
+
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+// Stores typechecked programs on disk so that recompiling an unchanged source can skip lexing,
+// parsing and typechecking. A cache file holds the FlatAST of the tree (with each node's text and
+// resolved type) and the global scope, keyed by a hash of the source they were compiled from. The
+// file also holds that source, which a load compares in full, so a hash collision is a miss.
+//
+// Layout: a Header, then each section of the header's counts in the order the counts are listed.
+// Every section starts on an 8 byte boundary. Names and types are stored once and referred to by
+// index, so symbols are re-interned and shared types stay shared when the file is loaded.
+namespace Cache
+{
+    // "JPLC"
+    constexpr uint32_t MAGIC = 0x434c504a;
+    // Bump whenever the layout or anything the tree is built from changes.
+    constexpr uint32_t VERSION = 1;
+    constexpr uint32_t NONE = UINT32_MAX;
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t source_hash;
+        uint64_t source_size;
+        // The hash of everything after the header, so that a damaged file is not mistaken for a program.
+        uint64_t checksum;
+
+        uint32_t node_count;
+        uint32_t command_count;
+        uint32_t integer_count;
+        uint32_t float_count;
+        uint32_t symbol_list_count;
+        uint32_t type_count;
+        uint32_t type_element_count;
+        uint32_t global_count;
+        uint32_t name_count;
+        uint32_t name_text_size;
+        uint64_t node_size;
+        uint64_t text_size;
+        // The source section, which is source_size characters, comes last.
+    };
+
+    // A FlatNode, with its symbols as indices into the names. Nodes are stored in the post-order
+    // of the FlatAST, so the children of a node are the child_count trees just before it and the
+    // trees left at the end are the commands.
+    //
+    // A node's text mostly repeats the text of one of its children, so only the rest is stored:
+    // the text is head_size characters of the text section, then the first shared_size characters
+    // of the text of child shared_child (NONE if there is none), then tail_size more characters.
+    // Each node's characters follow those of the node before it.
+    //
+    // Most fields are small, so nodes are packed one after another into node_size bytes: the kind
+    // as a byte, the operation as a byte for operator expressions, then the other fields in order
+    // as LEB128 numbers. Fields that may be NONE are stored plus one, and line as the (zigzag
+    // encoded) difference from the line of the node before.
+    struct Node
+    {
+        uint8_t kind;
+        uint8_t operation;
+        uint32_t child_count;
+        uint32_t data;
+        uint32_t symbol;
+        uint32_t line;
+        uint32_t pos;
+        // Index into the types, or NONE.
+        uint32_t type;
+        uint32_t shared_child;
+        uint32_t shared_size;
+        uint32_t head_size;
+        uint32_t tail_size;
+    };
+
+    // A ResolvedType. The elements of tuples (or the one element of arrays) are
+    // type_elements[first_element, first_element + element_count), and always come earlier.
+    // Equal types are stored once.
+    struct Type
+    {
+        uint32_t type_name;
+        uint32_t rank;
+        uint32_t first_element;
+        uint32_t element_count;
+    };
+
+    // An entry of the global scope. Function arguments are stored like tuple elements.
+    struct Global
+    {
+        enum Kind : uint32_t {VARIABLE, TYPE, FUNCTION};
+
+        uint32_t name;
+        Kind kind;
+        uint32_t type;
+        uint32_t first_argument;
+        uint32_t argument_count;
+    };
+
+    // A name, in the name text section.
+    struct Name
+    {
+        uint64_t text_offset;
+        uint64_t text_size;
+    };
+
+    uint64_t hashBytes(std::string_view bytes);
+    // Where the cache of source is kept within directory.
+    std::string cachePath(const std::string& directory, std::string_view source);
+
+    // Writes the typechecked tree of source and its global scope to path. Returns whether the
+    // file was written; a cache that cannot be written only costs the next compile its hit.
+    bool store(const std::string& path, std::string_view source, const std::vector<Parser::NodePtr<Parser::CmdNode>>& tree, Typechecker::Scope& scope);
+
+    // Rebuilds the tree and global scope stored in cached, allocating the nodes from arena.
+    // Returns false, leaving tree and scope untouched, if cached is missing, damaged, from
+    // another version or was compiled from a different source.
+    bool load(std::string_view cached, std::string_view source, Parser::Arena& arena, std::vector<Parser::NodePtr<Parser::CmdNode>>& tree, std::shared_ptr<Typechecker::Scope>& scope);
+}
+
+#endif
@@ -1,13 +1,64 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "lexer/lexer.cpp"
 #include "parser/parser.cpp"
+#include "parser/flat_ast.cpp"
 #include "typechecker/typechecker.cpp"
+#include "cache/cache.cpp"
 #include "assembly/assembly.cpp"
 #include "optimization/optimization.cpp"
 
 
+// A file's contents, mapped read-only into memory for the lifetime of the object.
+// Tokens point into the mapping, so it must outlive every token list lexed from it.
+// A file that cannot be opened reads as empty.
+class MappedFile
+{
+    public:
+        MappedFile(const char* filename)
+        {
+            int fd = open(filename, O_RDONLY);
+            if (fd < 0)
+                return;
+
+            struct stat file_stat;
+            if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0)
+            {
+                void* mapping = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapping != MAP_FAILED)
+                {
+                    data = (const char*) mapping;
+                    size = file_stat.st_size;
+                }
+            }
+
+            close(fd);
+        }
+
+        ~MappedFile()
+        {
+            if (data != nullptr)
+                munmap((void*) data, size);
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        std::string_view contents() const
+        {
+            return std::string_view(data, size);
+        }
+
+    private:
+        const char* data = nullptr;
+        size_t size = 0;
+};
+
 bool find_flag(const char* flag_to_find, const unsigned int& flag_count, char**& flags)
 {
     for(unsigned int i = 0; i < flag_count; i++)
@@ -30,6 +81,86 @@ unsigned char get_op_level(const unsigned int& flag_count, char**& flags)
     return 0;
 }
 
+// Runs the passes of optimization level over the typechecked tree, before code generation.
+// Functions they add are declared in scope. With report, says what they did on stderr.
+void optimize(std::vector<Parser::NodePtr<Parser::CmdNode>>& tree, Parser::Arena& arena, Typechecker::Scope& scope, unsigned char level, bool report)
+{
+    if (level > 0)
+    {
+        Optimization::FunctionSpecialization specialization(arena, scope);
+        specialization.specialize(tree);
+        if (report)
+            for (auto& [function, redirected] : specialization.report)
+                std::cerr << "specialize: " << redirected << " calls redirected in " << function << "\n";
+
+        // Each level inlines functions of up to four times as many expressions.
+        Optimization::FunctionInlining inlining(arena, level == 1 ? 64 : level == 2 ? 256 : 1024);
+        inlining.inline_calls(tree);
+        if (report)
+            for (auto& [function, inlined] : inlining.report)
+                std::cerr << "inline: " << inlined << " call sites inlined in " << function << "\n";
+
+        Optimization::ConstantFolding folding(arena);
+        folding.visit_all_cmds(tree);
+        // Folding leaves the lets of the variables it substituted unread.
+        Optimization::DeadLetElimination dead_lets;
+        dead_lets.eliminate(tree);
+        // Specialization and inlining leave functions that are no longer called.
+        Optimization::DeadFunctionElimination dead_functions;
+        dead_functions.eliminate(tree);
+        if (report)
+            for (auto& function : dead_functions.report)
+                std::cerr << "dfe: " << function << " removed\n";
+
+        Optimization::CommonSubexpressionElimination cse(arena);
+        cse.eliminate(tree);
+        if (report)
+            for (auto& [function, eliminated] : cse.report)
+                std::cerr << "cse: " << eliminated << " expressions eliminated from " << function << "\n";
+
+        Optimization::LoopInvariantCodeMotion licm(arena);
+        licm.move_invariants(tree);
+        if (report)
+            for (auto& [function, moved] : licm.report)
+                std::cerr << "licm: " << moved << " expressions moved out of loops in " << function << "\n";
+    }
+
+    if (level > 1)
+    {
+        Optimization::ConstantPropagation cp(arena);
+        cp.propagate(tree);
+        if (report)
+            for (auto& [function, summary] : cp.report)
+                std::cerr << "ipcp: " << function << summary << "\n";
+
+        Optimization::BoundsCheckElimination bounds;
+        bounds.eliminate(tree);
+        if (report)
+            for (auto& [function, removed, kept] : bounds.report)
+                std::cerr << "bounds: " << removed << " checks removed, " << kept << " kept in " << function << "\n";
+    }
+}
+
+// Where -c keeps the typechecked programs it caches; JPL_CACHE_DIR if set. Returns the cache
+// file of source, creating the directory if needed.
+std::string cache_path(std::string_view source)
+{
+    const char* directory = std::getenv("JPL_CACHE_DIR");
+    std::string cache_directory = directory != nullptr ? directory : ".jplcache";
+    mkdir(cache_directory.c_str(), 0777);
+    return Cache::cachePath(cache_directory, source);
+}
+
+// With -c, fills tree and scope from the cache of source and returns true if source was compiled
+// before, so that lexing, parsing and typechecking can be skipped.
+bool load_cached(const std::string& path, std::string_view source, Parser::Arena& arena, std::vector<Parser::NodePtr<Parser::CmdNode>>& tree, std::shared_ptr<Typechecker::Scope>& scope)
+{
+    if (path.empty())
+        return false;
+
+    MappedFile cached_f(path.c_str());
+    return Cache::load(cached_f.contents(), source, arena, tree, scope);
+}
 
 int main(int argc, char **argv) {
     if (argc < 2)
@@ -43,14 +174,9 @@ int main(int argc, char **argv) {
     unsigned int flag_count = argc - 2;
     char** flags = argv + 2;
 
-    // Gotten from: https://stackoverflow.com/questions/18398167/how-to-copy-a-txt-file-to-a-char-array-in-c 
-    // Get the source JPL code as a file.
-    std::ifstream source_f(filename);
-    // Get the source as a C++ string. 
-    std::string source_s((std::istreambuf_iterator<char>(source_f)), 
-        std::istreambuf_iterator<char>());
-    // Get the source as a C string.
-    const char* source_c = source_s.c_str();
+    // Map the source JPL code into memory; tokens refer to it directly.
+    MappedFile source_f(filename);
+    std::string_view source_c = source_f.contents();
 
     if (find_flag("-l", flag_count, flags))
     {
@@ -61,10 +187,10 @@ int main(int argc, char **argv) {
 
     if (find_flag("-p", flag_count, flags))
     {
-        std::vector<Lexer::token>* v;
+        Lexer::TokenStream* v;
         try
         {
-            v = Lexer::lexAll(source_c);
+            v = Lexer::lexStream(source_c);
         }
         catch(const Lexer::LexerException& exception)
         {
@@ -80,13 +206,15 @@ int main(int argc, char **argv) {
     
     if (find_flag("-t", flag_count, flags))
     {
-        std::vector<Lexer::token>* v;
-        v = Lexer::lexAll(source_c);
-        std::vector<std::unique_ptr<Parser::CmdNode>> tree;
+        Lexer::TokenStream* v;
+        v = Lexer::lexStream(source_c);
+        // Owns the tree's nodes, so it is declared first and destroyed last.
+        Parser::Arena arena;
+        std::vector<Parser::NodePtr<Parser::CmdNode>> tree;
         
         try
         {
-            tree = Parser::parse(v);
+            tree = Parser::parse(v, arena);
         }
         catch(const Parser::ParserException& e)
         {
@@ -99,60 +227,70 @@ int main(int argc, char **argv) {
         {
             Typechecker::typecheck(tree);
 
-            for(std::unique_ptr<Parser::CmdNode>& cmd : tree)
+            Parser::FlatAST flat(tree);
+            for(Parser::NodeIndex cmd : flat.commands)
             {
-                std::cout << cmd.get()->toString() + "\n";
+                std::cout << flat.toString(cmd) + "\n";
             }
         }
         catch(const Typechecker::TypeException& e)
         {
             std::printf("Compilation failed\n");
             destroy_token_list(v);
+            Parser::destroy_tree(tree, arena);
             return 0;
         }
 
         std::printf("Compilation succeeded\n");
         destroy_token_list(v);
+        Parser::destroy_tree(tree, arena);
         return 0;
     }
 
+    std::string cached_path = find_flag("-c", flag_count, flags) ? cache_path(source_c) : "";
+
     if (find_flag("-s", flag_count, flags))
     {
-         std::vector<Lexer::token>* v;
-        v = Lexer::lexAll(source_c);
-        std::vector<std::unique_ptr<Parser::CmdNode>> tree;
-        
-        try
-        {
-            tree = Parser::parse(v);
-        }
-        catch(const Parser::ParserException& e)
-        {
-            std::printf("Compilation failed\n");
-            destroy_token_list(v);
-            return 0;
-        }
-
+        // Owns the tree's nodes, so it is declared first and destroyed last.
+        Parser::Arena arena;
+        std::vector<Parser::NodePtr<Parser::CmdNode>> tree;
         std::shared_ptr<Typechecker::Scope> scope;
 
-        try
+        if (!load_cached(cached_path, source_c, arena, tree, scope))
         {
-            scope = Typechecker::typecheck(tree);
-        }
-        catch(const Typechecker::TypeException& e)
-        {
-            std::printf("Compilation failed\n");
-            destroy_token_list(v);
-            return 0;
-        }
+            Lexer::TokenStream* v;
+            v = Lexer::lexStream(source_c);
 
-        destroy_token_list(v);
+            try
+            {
+                tree = Parser::parse(v, arena);
+            }
+            catch(const Parser::ParserException& e)
+            {
+                std::printf("Compilation failed\n");
+                destroy_token_list(v);
+                return 0;
+            }
 
-        if (get_op_level(flag_count, flags) > 1)
-        {
-            Optimization::ConstantPropagation cp;
-            cp.visit_all_cmds(tree);
+            try
+            {
+                scope = Typechecker::typecheck(tree);
+            }
+            catch(const Typechecker::TypeException& e)
+            {
+                std::printf("Compilation failed\n");
+                destroy_token_list(v);
+                Parser::destroy_tree(tree, arena);
+                return 0;
+            }
+
+            destroy_token_list(v);
+
+            if (!cached_path.empty())
+                Cache::store(cached_path, source_c, tree, *scope);
         }
+
+        optimize(tree, arena, *scope, get_op_level(flag_count, flags), find_flag("-r", flag_count, flags));
         
         Compiler::Assembly assembly(*scope, get_op_level(flag_count, flags));
         std::shared_ptr<Compiler::AFunction> main_function = std::make_shared<Compiler::AFunction>(assembly);
@@ -165,24 +303,30 @@ int main(int argc, char **argv) {
         std::cout << assembly.toString();
 
         std::printf("Compilation succeeded\n");
+        Parser::destroy_tree(tree, arena);
         
         return 0;
     }
 
 
-    std::vector<Lexer::token>* v = Lexer::lexAll(source_c);
+    Parser::Arena arena;
+    std::vector<Parser::NodePtr<Parser::CmdNode>> tree;
+    std::shared_ptr<Typechecker::Scope> scope;
 
-    std::vector<std::unique_ptr<Parser::CmdNode>> tree = Parser::parse(v);
+    if (!load_cached(cached_path, source_c, arena, tree, scope))
+    {
+        Lexer::TokenStream* v = Lexer::lexStream(source_c);
+        tree = Parser::parse(v, arena);
 
-    destroy_token_list(v);
-    std::shared_ptr<Typechecker::Scope> scope = Typechecker::typecheck(tree);
+        destroy_token_list(v);
+        scope = Typechecker::typecheck(tree);
 
-    if (get_op_level(flag_count, flags) > 1)
-    {
-        Optimization::ConstantPropagation cp;
-        cp.visit_all_cmds(tree);
+        if (!cached_path.empty())
+            Cache::store(cached_path, source_c, tree, *scope);
     }
 
+    optimize(tree, arena, *scope, get_op_level(flag_count, flags), find_flag("-r", flag_count, flags));
+
     Compiler::Assembly assembly(*scope, get_op_level(flag_count, flags));
     std::shared_ptr<Compiler::AFunction> main_function = std::make_shared<Compiler::AFunction>(assembly);
 
@@ -190,6 +334,7 @@ int main(int argc, char **argv) {
         main_function->cg_cmd(command);
 
     assembly.add_function(main_function);
+    Parser::destroy_tree(tree, arena);
 
     return 0;
 }
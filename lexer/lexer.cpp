@@ -1,79 +1,304 @@
 #include "lexer.h"
-#include <regex>
-#include <map>
+#include <array>
 #include <cstring>
 #include <algorithm>
 #include <string>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 namespace Lexer
 {
+#pragma region Character Classes
+    ///////////////////////////////////////////////////////////
+    //                  Character Classes                    //
+    ///////////////////////////////////////////////////////////
+
+    // Bit flags describing which parts of the grammar a character can appear in.
+    enum CharClass : unsigned char
+    {
+        SUPPORTED = 1,      // [\n -~]
+        DIGIT = 2,          // [0-9]
+        WORD_START = 4,     // [a-zA-Z_]
+        WORD = 8,           // [a-zA-Z0-9_]
+        VARIABLE_BODY = 16  // [a-zA-Z0-9_.]
+    };
+
+    constexpr std::array<unsigned char, 256> makeCharClasses()
+    {
+        std::array<unsigned char, 256> classes {};
+
+        classes['\n'] = SUPPORTED;
+        for (int c = ' '; c <= '~'; c++)
+            classes[c] = SUPPORTED;
+
+        for (int c = '0'; c <= '9'; c++)
+            classes[c] |= DIGIT | WORD | VARIABLE_BODY;
+        for (int c = 'a'; c <= 'z'; c++)
+            classes[c] |= WORD_START | WORD | VARIABLE_BODY;
+        for (int c = 'A'; c <= 'Z'; c++)
+            classes[c] |= WORD_START | WORD | VARIABLE_BODY;
+
+        classes['_'] |= WORD_START | WORD | VARIABLE_BODY;
+        classes['.'] |= VARIABLE_BODY;
+
+        return classes;
+    }
+
+    // The class of every byte, indexed by its unsigned value.
+    constexpr std::array<unsigned char, 256> CHAR_CLASSES = makeCharClasses();
+
+    inline bool hasClass(char c, unsigned char char_class)
+    {
+        return CHAR_CLASSES[(unsigned char) c] & char_class;
+    }
+
+    // Returns the first character at or after c that is not in char_class.
+    inline const char* skipClass(const char* c, const char* end, unsigned char char_class)
+    {
+        while (c != end && hasClass(*c, char_class))
+            c++;
+        return c;
+    }
+
+#pragma endregion
+
+#pragma region Skipping
+    ////////////////////////////////////////////////////
+    //                  Skipping                      //
+    ////////////////////////////////////////////////////
+
+    // Indentation and comment bodies make up most of some sources, so they are skipped 16 or 32
+    // bytes at a time when the CPU supports it. Every skip stops at the first byte the scalar
+    // whitespace lexer needs to look at, which keeps line and position tracking exact.
+
+    // What a skip stops at.
+    enum SkipKind
+    {
+        SKIP_SPACES,        // anything but ' '
+        SKIP_LINE_COMMENT,  // '\n' or an unsupported character
+        SKIP_BLOCK_COMMENT  // '*', '\n' or an unsupported character
+    };
+
+    typedef const char* (*SkipFunction)(const char*, const char*);
+
+    template<SkipKind kind>
+    inline bool stopsSkip(char c)
+    {
+        if constexpr (kind == SKIP_SPACES)
+            return c != ' ';
+        else if constexpr (kind == SKIP_LINE_COMMENT)
+            return c == '\n' || !hasClass(c, SUPPORTED);
+        else
+            return c == '*' || c == '\n' || !hasClass(c, SUPPORTED);
+    }
+
+    template<SkipKind kind>
+    const char* skipScalar(const char* c, const char* end)
+    {
+        while (c != end && !stopsSkip<kind>(*c))
+            c++;
+        return c;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    // Each byte of the result is all ones where the byte in bytes stops the skip. As signed bytes,
+    // everything from 0x80 up is below ' ', so one comparison finds '\n' and most unsupported bytes.
+    template<SkipKind kind>
+    __attribute__((target("sse2"))) inline __m128i stopsSkipSSE2(__m128i bytes)
+    {
+        if constexpr (kind == SKIP_SPACES)
+            return _mm_xor_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')), _mm_set1_epi8(-1));
+
+        __m128i stops = _mm_or_si128(_mm_cmplt_epi8(bytes, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8(0x7f)));
+        if constexpr (kind == SKIP_BLOCK_COMMENT)
+            stops = _mm_or_si128(stops, _mm_cmpeq_epi8(bytes, _mm_set1_epi8('*')));
+        return stops;
+    }
+
+    template<SkipKind kind>
+    __attribute__((target("sse2"))) const char* skipSSE2(const char* c, const char* end)
+    {
+        for (; end - c >= 16; c += 16)
+        {
+            unsigned mask = _mm_movemask_epi8(stopsSkipSSE2<kind>(_mm_loadu_si128((const __m128i*) c)));
+            if (mask != 0)
+                return c + __builtin_ctz(mask);
+        }
+        return skipScalar<kind>(c, end);
+    }
+
+    template<SkipKind kind>
+    __attribute__((target("avx2"))) inline __m256i stopsSkipAVX2(__m256i bytes)
+    {
+        if constexpr (kind == SKIP_SPACES)
+            return _mm256_xor_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')), _mm256_set1_epi8(-1));
+
+        __m256i stops = _mm256_or_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(' '), bytes), _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(0x7f)));
+        if constexpr (kind == SKIP_BLOCK_COMMENT)
+            stops = _mm256_or_si256(stops, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('*')));
+        return stops;
+    }
+
+    template<SkipKind kind>
+    __attribute__((target("avx2"))) const char* skipAVX2(const char* c, const char* end)
+    {
+        for (; end - c >= 32; c += 32)
+        {
+            unsigned mask = _mm256_movemask_epi8(stopsSkipAVX2<kind>(_mm256_loadu_si256((const __m256i*) c)));
+            if (mask != 0)
+                return c + __builtin_ctz(mask);
+        }
+        return skipSSE2<kind>(c, end);
+    }
+#endif
+
+    // Picks the widest implementation the CPU supports, as reported by CPUID.
+    template<SkipKind kind>
+    SkipFunction chooseSkip()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return skipAVX2<kind>;
+        if (__builtin_cpu_supports("sse2"))
+            return skipSSE2<kind>;
+#endif
+        return skipScalar<kind>;
+    }
+
+    template<SkipKind kind>
+    const SkipFunction CHOSEN_SKIP = chooseSkip<kind>();
+
+    // Returns the first character at or after c that stops a skip of the given kind, or end.
+    template<SkipKind kind>
+    inline const char* skip(const char* c, const char* end)
+    {
+        return CHOSEN_SKIP<kind>(c, end);
+    }
+
+#pragma endregion
+
 #pragma region String to TokenType Mappings
     /////////////////////////////////////////////////////////////////
     //                  String-TokenType Mappings                  //
     /////////////////////////////////////////////////////////////////
 
-    struct RegexTypeMapping
+    struct KeywordTypeMapping
     {
-        std::regex first;
+        std::string_view first;
         TokenType second;
     };
 
     // A mapping of identifying strings to keyword token types.
-    const RegexTypeMapping KEYWORDS[22] = {
-        {std::regex("^array(?![a-zA-Z0-9_])"), ARRAY},
-        {std::regex("^assert(?![a-zA-Z0-9_])"), ASSERT},
-        {std::regex("^bool(?![a-zA-Z0-9_])"), BOOL},
-        {std::regex("^else(?![a-zA-Z0-9_])"), ELSE},
-        {std::regex("^false(?![a-zA-Z0-9_])"), FALSE},
-        {std::regex("^float(?![a-zA-Z0-9_])"), FLOAT},
-        {std::regex("^fn(?![a-zA-Z0-9_])"), FN},
-        {std::regex("^if(?![a-zA-Z0-9_])"), IF},
-        {std::regex("^image(?![a-zA-Z0-9_])"), IMAGE},
-        {std::regex("^int(?![a-zA-Z0-9_])"), INT},
-        {std::regex("^let(?![a-zA-Z0-9_])"), LET},
-        {std::regex("^print(?![a-zA-Z0-9_])"), PRINT},
-        {std::regex("^read(?![a-zA-Z0-9_])"), READ},
-        {std::regex("^return(?![a-zA-Z0-9_])"), RETURN},
-        {std::regex("^show(?![a-zA-Z0-9_])"), SHOW},
-        {std::regex("^sum(?![a-zA-Z0-9_])"), SUM},
-        {std::regex("^then(?![a-zA-Z0-9_])"), THEN},
-        {std::regex("^time(?![a-zA-Z0-9_])"), TIME},
-        {std::regex("^to(?![a-zA-Z0-9_])"), TO},
-        {std::regex("^true(?![a-zA-Z0-9_])"), TRUE},
-        {std::regex("^type(?![a-zA-Z0-9_])"), TYPE},
-        {std::regex("^write(?![a-zA-Z0-9_])"), WRITE}
+    constexpr KeywordTypeMapping KEYWORDS[22] = {
+        {"array", ARRAY},
+        {"assert", ASSERT},
+        {"bool", BOOL},
+        {"else", ELSE},
+        {"false", FALSE},
+        {"float", FLOAT},
+        {"fn", FN},
+        {"if", IF},
+        {"image", IMAGE},
+        {"int", INT},
+        {"let", LET},
+        {"print", PRINT},
+        {"read", READ},
+        {"return", RETURN},
+        {"show", SHOW},
+        {"sum", SUM},
+        {"then", THEN},
+        {"time", TIME},
+        {"to", TO},
+        {"true", TRUE},
+        {"type", TYPE},
+        {"write", WRITE}
     };
 
-    // A list of identifying strings that can represent an operator.
-    const std::regex OPERATORS[] = {
-        std::regex("^=="),
-        std::regex("^>="),
-        std::regex("^<="),
-        std::regex("^>"),
-        std::regex("^<"),
-        std::regex("^!="),
-        std::regex("^\\+"),
-        std::regex("^-"),
-        std::regex("^\\*(?!\\/)"),
-        std::regex("^\\/(?!\\*)"),
-        std::regex("^%"),
-        std::regex("^&&"),
-        std::regex("^\\|\\|"),
-        std::regex("^!")
-    };
+    constexpr size_t KEYWORD_MIN_LENGTH = 2;
+    constexpr size_t KEYWORD_MAX_LENGTH = 6;
+    constexpr size_t KEYWORD_TABLE_SIZE = 64;
 
-    // A mapping of identifying strings to token types of punctuation, parentheses, and equals.
-    const RegexTypeMapping OTHER[9] = {
-        {std::regex("^:"), COLON},
-        {std::regex("^,"), COMMA},
-        {std::regex("^="), EQUALS},
-        {std::regex("^\\("), LPAREN},
-        {std::regex("^\\["), LSQUARE},
-        {std::regex("^\\{"), LCURLY},
-        {std::regex("^\\)"), RPAREN},
-        {std::regex("^\\]"), RSQUARE},
-        {std::regex("^\\}"), RCURLY}
-    };
+    // A perfect hash over KEYWORDS for words of KEYWORD_MIN_LENGTH to KEYWORD_MAX_LENGTH characters.
+    constexpr size_t keywordHash(const char* word, size_t length)
+    {
+        return (2 * (unsigned char) word[0] + (unsigned char) word[1] + 5 * length) % KEYWORD_TABLE_SIZE;
+    }
+
+    constexpr std::array<KeywordTypeMapping, KEYWORD_TABLE_SIZE> makeKeywordTable()
+    {
+        std::array<KeywordTypeMapping, KEYWORD_TABLE_SIZE> table {};
+
+        for (auto& slot : table)
+            slot = {"", VARIABLE};
+        for (auto const& kvp : KEYWORDS)
+            table[keywordHash(kvp.first.data(), kvp.first.size())] = kvp;
+
+        return table;
+    }
+
+    // Keywords by hash; empty slots hold VARIABLE.
+    constexpr std::array<KeywordTypeMapping, KEYWORD_TABLE_SIZE> KEYWORD_TABLE = makeKeywordTable();
+
+    constexpr bool keywordTableIsPerfect()
+    {
+        for (auto const& kvp : KEYWORDS)
+        {
+            if (kvp.first.size() < KEYWORD_MIN_LENGTH || kvp.first.size() > KEYWORD_MAX_LENGTH)
+                return false;
+            if (KEYWORD_TABLE[keywordHash(kvp.first.data(), kvp.first.size())].second != kvp.second)
+                return false;
+        }
+        return true;
+    }
+
+    static_assert(keywordTableIsPerfect(), "Keywords collide in KEYWORD_TABLE; adjust keywordHash.");
+
+    // Returns the keyword spelled by the word [word, word + length), or VARIABLE if it is not a keyword.
+    inline TokenType lookupKeyword(const char* word, size_t length)
+    {
+        if (length < KEYWORD_MIN_LENGTH || length > KEYWORD_MAX_LENGTH)
+            return VARIABLE;
+
+        const KeywordTypeMapping& candidate = KEYWORD_TABLE[keywordHash(word, length)];
+        return (candidate.first == std::string_view(word, length)) ? candidate.second : VARIABLE;
+    }
+
+#pragma endregion
+
+#pragma region Interner
+    //////////////////////////////////////////////////////
+    //                  Interner                        //
+    //////////////////////////////////////////////////////
+
+    Interner& interner()
+    {
+        static Interner global_interner;
+        return global_interner;
+    }
+
+    Symbol Interner::intern(std::string_view name)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        auto found = symbols.find(name);
+        if (found != symbols.end())
+            return found->second;
+
+        Symbol symbol = names.size();
+        names.emplace_back(name);
+        symbols.emplace(names.back(), symbol);
+        return symbol;
+    }
+
+    const std::string& Interner::name(Symbol symbol)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return names[symbol];
+    }
 
 #pragma endregion
 
@@ -82,13 +307,13 @@ namespace Lexer
     //                  Lexer Exception Implementation                  //
     //////////////////////////////////////////////////////////////////////
 
-    LexerException::LexerException(const std::string& m, unsigned long line, unsigned long pos, const char* source)
+    LexerException::LexerException(const std::string& m, unsigned long line, unsigned long pos, const char* source, const char* end)
     {
-        std::cmatch cm;
-        static std::regex rex("^[^ \n]*(?=[ \n]|$)");
-        std::regex_search(source, cm, rex);
+        const char* token_end = source;
+        while (token_end != end && *token_end != ' ' && *token_end != '\n')
+            token_end++;
 
-        std::string c_token(cm.str());
+        std::string c_token(source, token_end);
         std::string header = "\nEncountered Error at Lexing Step. Line " + std::to_string(line) + ", Position " + std::to_string(pos) + ", Token \"" + c_token + "\".\n";
         std::string middle = m;
 
@@ -100,314 +325,487 @@ namespace Lexer
         return message.c_str();
     }
 
-#pragma endregion
+    UnsupportedCharacterException::UnsupportedCharacterException(unsigned long line, unsigned long pos, const char* source, const char* end)
+        : LexerException("Not all characters supported.", line, pos, source, end) {}
+
+    [[noreturn]] void throwLexError(const LexError& error, const char* end)
+    {
+        if (error.unsupported_character)
+            throw UnsupportedCharacterException(error.line, error.pos, error.source, end);
+        throw LexerException(error.message, error.line, error.pos, error.source, end);
+    }
 
-    void clean_token(token& t)
+    // Describes the failure to lex a token at source. The scanner never consumes an unsupported
+    // character, so the first one at or after source is the first in the file and is reported instead.
+    LexResult unrecognizedToken(LEX_FUNC_ARGS_NAMED)
     {
-        free(t.text);
+        unsigned long c_line = line;
+        unsigned long c_pos = pos;
+
+        for (const char* c = source; c != end; c++)
+        {
+            if (!hasClass(*c, SUPPORTED))
+                return {{NONE, {}, line, pos}, {"Not all characters supported.", c_line, c_pos, c, true}};
+            else if (*c == '\n')
+            {
+                c_line++;
+                c_pos = 0;
+            }
+            else
+                c_pos++;
+        }
+
+        return {{NONE, {}, line, pos}, {"Could not recognize token.", line, pos, source, false}};
     }
 
+#pragma endregion
+
 #pragma region Lexer Functions
     ///////////////////////////////////////////////////////
     //                  Lexer Functions                  //
     ///////////////////////////////////////////////////////
     
-    token lexRegex(LEX_FUNC_ARGS_NAMED, std::regex rex, TokenType token_type, std::string error_message)
+    // Makes a token of the next length characters and moves past them.
+    LexResult lexSpan(LEX_FUNC_ARGS_NAMED, size_t length, TokenType token_type)
     {
-        std::cmatch cm;
-        bool is_match = std::regex_search(source, cm, rex);
+        std::string_view contents(source, length);
 
-        if (! is_match)
-            throw LexerException(error_message, line, pos, source);
-        
-        char* contents_copy = (char*) malloc((cm.length() + 1) * sizeof(char));
-        strcpy(contents_copy, cm.str().c_str());
+        source += length;
+        pos += length;
 
-        source += cm.length();
-        pos += cm.length();
-
-        return {token_type, contents_copy, line, pos};
+        return {{token_type, contents, line, pos}, {}};
     }
 
-#pragma region Keyword Lexer Functions
-    // Tries to lex the next token as all JPL keywords.
-    token const lexAllKeywords(LEX_FUNC_ARGS_NAMED)
+    // Returns the end of the block comment whose contents start at c, or nullptr if it is never closed.
+    // Counts the newlines inside it into newlines and points line_start after the last one.
+    // Like the pattern \/\*([^\*]|\*[^\/])*\*\/, a '*' that does not close the comment also consumes the
+    // character after it, so "/* a **/" is still open.
+    const char* skipBlockComment(const char* c, const char* end, unsigned long& newlines, const char*& line_start)
     {
-        token ret;
-        bool returned = false;
-
-        for (auto const& kvp : KEYWORDS)
+        while (true)
         {
-            try
+            c = skip<SKIP_BLOCK_COMMENT>(c, end);
+
+            if (c == end || !hasClass(*c, SUPPORTED))
+                return nullptr;
+
+            if (*c == '\n')
             {
-                ret = lexRegex(source, line, pos, kvp.first, kvp.second, "Could not lex token as keyword " + tokenTypeToString(kvp.second) + ".");
-                returned = true;
-                break;
+                newlines++;
+                line_start = ++c;
+                continue;
             }
-            catch(const LexerException& e){}
-        }
 
-        if (! returned)
-        {
-            std::string message = "Could not lex token as any keyword.";
-            throw LexerException(message, line, pos, source);
+            // *c is a '*'.
+            if (c + 1 == end || !hasClass(c[1], SUPPORTED))
+                return nullptr;
+            if (c[1] == '/')
+                return c + 2;
+            if (c[1] == '\n')
+            {
+                newlines++;
+                line_start = c + 2;
+            }
+            c += 2;
         }
-
-        return ret;
     }
 
-#pragma endregion
+    // Checks whether a line comment starts within the whitespace [start, end) and runs into a line
+    // continuation. The original regex-based newline check counted these as newlines, e.g. a "//"
+    // inside a block comment followed by "\\\n".
+    bool continuesCommentedLine(const char* start, const char* end)
+    {
+        const char* comment = std::search(start, end, "//", "//" + 2);
+        return comment != end && std::find(comment, end, '\n') != end;
+    }
 
-#pragma region Symbol Lexer Functions
-    // Tries to lex the next token as all JPL symbols.
-    token const lexAllSymbols(LEX_FUNC_ARGS_NAMED)
+    // Tries to lex whitespace.
+    token const lexWhitespace(LEX_FUNC_ARGS_NAMED)
     {
-        token ret;
-        bool returned = false;
+        const char* c = source;
+        const char* line_start = nullptr;
+        unsigned long newlines = 0;
+        bool contains_newline = false;
+        bool continues_line = false;
 
-        for (std::regex op_string : OPERATORS)
+        while (c != end)
         {
-            try
+            const char next = (c + 1 != end) ? c[1] : '\0';
+
+            if (*c == ' ')
             {
-                ret = lexRegex(source, line, pos, op_string, OP, "Could not lex token as operator.");
-                returned = true;
-                break;
+                // Most runs are a single space between tokens, which are not worth a call.
+                if (++c != end && *c == ' ')
+                    c = skip<SKIP_SPACES>(c + 1, end);
+                continue;
             }
-            catch(const LexerException& e){}
-        }
+            else if (*c == '\n')
+            {
+                contains_newline = true;
+                c++;
+            }
+            else if (*c == '\\' && next == '\n')
+            {
+                continues_line = true;
+                c += 2;
+            }
+            else if (*c == '/' && next == '/')
+            {
+                const char* comment_end = skip<SKIP_LINE_COMMENT>(c + 2, end);
 
-        if (! returned)
-        {
-            for (auto const& kvp : OTHER)
+                if (comment_end == end || *comment_end != '\n')
+                    break;
+
+                contains_newline = true;
+                c = comment_end + 1;
+            }
+            else if (*c == '/' && next == '*')
             {
-                try
-                {
-                    ret = lexRegex(source, line, pos, kvp.first, kvp.second, "Could not lex token as keyword " + tokenTypeToString(kvp.second) + ".");
-                    returned = true;
+                unsigned long comment_newlines = 0;
+                const char* comment_line_start = line_start;
+                const char* comment_end = skipBlockComment(c + 2, end, comment_newlines, comment_line_start);
+
+                if (comment_end == nullptr)
                     break;
-                }
-                catch(const LexerException& e){}
+
+                contains_newline |= comment_newlines != 0;
+                newlines += comment_newlines;
+                line_start = comment_line_start;
+                c = comment_end;
+                continue;
             }
+            else
+                break;
+
+            // Every branch that falls through here consumed a trailing newline.
+            newlines++;
+            line_start = c;
         }
 
-        if (! returned)
+        if (!contains_newline && continues_line)
+            contains_newline = continuesCommentedLine(source, c);
+
+        token t;
+
+        if (contains_newline)
+        {
+            t = {NEWLINE, "\n", line, pos};
+            line += newlines;
+            pos = c - line_start;
+        }
+        else
         {
-            std::string message = "Could not lex token as any symbol.";
-            throw LexerException(message, line, pos, source);
+            t = {NONE, {}, line, pos};
+            pos += c - source;
         }
+        
+        source = c;
 
-        return ret;
+        return t;
     }
 
-#pragma endregion
-    char* getNextSegment(char* start, char* end)
+    LexResult lexToken(LEX_FUNC_ARGS_NAMED)
     {
-        while (start != end)
+        const char first = *source;
+        const char next = (source + 1 != end) ? source[1] : '\0';
+
+        // Keywords and variables.
+        if (hasClass(first, WORD_START))
         {
-            if (*start == ' ' || *start == '\n')
-                return start;
-            start++;
+            const char* word_end = skipClass(source + 1, end, WORD);
+            TokenType keyword = lookupKeyword(source, word_end - source);
+            if (keyword != VARIABLE)
+                return lexSpan(source, end, line, pos, word_end - source, keyword);
+
+            LexResult variable = lexSpan(source, end, line, pos, skipClass(word_end, end, VARIABLE_BODY) - source, VARIABLE);
+            variable.value.symbol = intern(variable.value.text);
+            return variable;
         }
-        return end;
-    }
-    
-    // Tries to lex the next token as a JPL string.
-    token const lexString(LEX_FUNC_ARGS_NAMED)
-    {
-        static std::regex rex = std::regex("^\"[^\\n\"]*\"");
-        return lexRegex(source, line, pos, rex, STRING, "Could not lex token as string value.");
-    }
-    // Tries to lex the next token as a JPL float.
-    token const lexFloatVal(LEX_FUNC_ARGS_NAMED)
-    {
-        std::cmatch cm;
-        static std::regex rex(R"(^[0-9]+\.[0-9]*|^\.[0-9]+)");
-        return lexRegex(source, line, pos, rex, FLOATVAL, "Could not lex token as float value.");
-    }
-    // Tries to lex the next token as a JPL int.
-    token const lexIntVal(LEX_FUNC_ARGS_NAMED)
-    {
-        static std::regex rex("^[\\d]+(?![\\.\\d])");
-        return lexRegex(source, line, pos, rex, INTVAL, "Could not lex token as int value");
-    }
-    // Tries to lex the next token as a JPL variable.
-    token const lexVariable(LEX_FUNC_ARGS_NAMED)
-    {
-        static std::regex rex = std::regex("^[a-zA-Z_][a-zA-Z0-9_\\.]*");
-        return lexRegex(source, line, pos, rex, VARIABLE, "Could not lex token as variable.");
-    }
-    // Tries to lex whitespace.
-    token const lexWhitespace(LEX_FUNC_ARGS_NAMED)
-    {
-        static std::string newline = "\n";
-        
-        static std::string contline = "\\\\\n";
-        static std::string space = " ";
-        static std::string one_line_comment = R"(\/\/.*\n)";
-        static std::string block_comments = R"(\/\*([^\*]|\*[^\/])*\*\/)";
 
-        static std::regex white_space("^((" + newline + ")|(" + contline + ")|(" + space + ")|(" + one_line_comment + ")|(" + block_comments + "))*");
-        // Check for a newline at the start of the string, a newline preceeded by a non-backslash, a newline after a one-line comment,
-        // or a newline in block comment. 
-        static std::regex newline_check("^\n|[^\\\\]\n|//.*\n|/\\*([^\\*]|\\*[^/])*\n([^\\*]|\\*[^/])*\\*/");
+        // Ints and floats that start with a digit.
+        if (hasClass(first, DIGIT))
+        {
+            const char* digits_end = skipClass(source + 1, end, DIGIT);
+            if (digits_end != end && *digits_end == '.')
+                return lexSpan(source, end, line, pos, skipClass(digits_end + 1, end, DIGIT) - source, FLOATVAL);
 
-        std::cmatch cm;
-        std::regex_search(source, cm, white_space);
+            return lexSpan(source, end, line, pos, digits_end - source, INTVAL);
+        }
 
-        std::cmatch _;
+        switch (first)
+        {
+            case '"':
+            {
+                const char* string_end = source + 1;
+                while (string_end != end && *string_end != '"' && *string_end != '\n' && hasClass(*string_end, SUPPORTED))
+                    string_end++;
 
-        bool contains_newline = (cm.length() != 0) && (std::regex_search(cm.str().c_str(), _, newline_check));
-        
-        token t;
+                if (string_end != end && *string_end == '"')
+                    return lexSpan(source, end, line, pos, string_end + 1 - source, STRING);
+                break;
+            }
+            case '.':
+                if (hasClass(next, DIGIT))
+                    return lexSpan(source, end, line, pos, skipClass(source + 1, end, DIGIT) - source, FLOATVAL);
+                break;
+            case '=':
+                if (next == '=')
+                    return lexSpan(source, end, line, pos, 2, OP);
+                return lexSpan(source, end, line, pos, 1, EQUALS);
+            case '<':
+            case '>':
+            case '!':
+                return lexSpan(source, end, line, pos, (next == '=') ? 2 : 1, OP);
+            case '+':
+            case '-':
+            case '%':
+                return lexSpan(source, end, line, pos, 1, OP);
+            // "*/" and "/*" are never operators.
+            case '*':
+                if (next != '/')
+                    return lexSpan(source, end, line, pos, 1, OP);
+                break;
+            case '/':
+                if (next != '*')
+                    return lexSpan(source, end, line, pos, 1, OP);
+                break;
+            case '&':
+            case '|':
+                if (next == first)
+                    return lexSpan(source, end, line, pos, 2, OP);
+                break;
+            case ':':
+                return lexSpan(source, end, line, pos, 1, COLON);
+            case ',':
+                return lexSpan(source, end, line, pos, 1, COMMA);
+            case '(':
+                return lexSpan(source, end, line, pos, 1, LPAREN);
+            case '[':
+                return lexSpan(source, end, line, pos, 1, LSQUARE);
+            case '{':
+                return lexSpan(source, end, line, pos, 1, LCURLY);
+            case ')':
+                return lexSpan(source, end, line, pos, 1, RPAREN);
+            case ']':
+                return lexSpan(source, end, line, pos, 1, RSQUARE);
+            case '}':
+                return lexSpan(source, end, line, pos, 1, RCURLY);
+        }
 
-        if (contains_newline)
-        {
+        return unrecognizedToken(source, end, line, pos);
+    }
 
-            t = {NEWLINE, strdup("\n"), line, pos};
+#pragma endregion
 
-            long new_pos = 0;
-            
-            for (char c : cm.str())
-            {
-                if (c == '\n')
-                {
-                    line++;
-                    new_pos = 0;
-                }
-                else
-                    new_pos++;
-            }
+#pragma region Token Stream
+    ///////////////////////////////////////////////////////////
+    //                  Token Stream                         //
+    ///////////////////////////////////////////////////////////
 
-            pos = new_pos;
-        }
-        else
+    LexResult Scanner::next()
+    {
+        if (at_whitespace)
         {
-            t = {NONE, strdup(""), line, pos};
-            pos += cm.length();
+            at_whitespace = false;
+            token whitespace = lexWhitespace(source, end, line, pos);
+            if (whitespace.type != NONE)
+                return {whitespace, {}};
         }
-        
-        source += cm.length();
 
-        return t;
+        if (source == end)
+            return {{END_OF_FILE, "", 0, 0}, {}};
+
+        at_whitespace = true;
+        return lexToken(source, end, line, pos);
     }
 
-    const token (*SUB_LEX_FUNCTIONS[])(LEX_FUNC_ARGS) = {
-        lexAllKeywords,
-        lexAllSymbols,
-        lexString,
-        lexFloatVal,
-        lexIntVal,
-        lexVariable
-    };
+    TokenStream::TokenStream(std::string_view _source, bool threaded)
+        : source(_source.data()), end(_source.data() + _source.size()), scanner(_source),
+          types(RING_SIZE), offsets(RING_SIZE), lengths(RING_SIZE), line_numbers(RING_SIZE), char_numbers(RING_SIZE), symbols(RING_SIZE)
+    {
+        static_assert((RING_SIZE & (RING_SIZE - 1)) == 0 && RING_SIZE % CHUNK_SIZE == 0, "RING_SIZE must be a power of two and a multiple of CHUNK_SIZE.");
+
+        // Token offsets and positions are stored in 32 bits.
+        if (_source.size() > UINT32_MAX)
+            throw LexerException("Source files must be smaller than 4GB.", 0, 0, source, end);
+
+        if (threaded)
+            lexing_thread = std::thread(&TokenStream::lexAhead, this);
+    }
 
-    token lexToken(LEX_FUNC_ARGS_NAMED)
+    TokenStream::~TokenStream()
     {
-        bool lexed = false;
-        token ret;
+        if (!lexing_thread.joinable())
+            return;
 
-        for (auto lex_func : SUB_LEX_FUNCTIONS)
         {
-            try
-            {
-                ret = lex_func(source, line, pos);
-                lexed = true;
-                break;
-            }
-            catch(const LexerException& e) { }
+            std::lock_guard<std::mutex> guard(lock);
+            cancelled = true;
         }
+        changed.notify_all();
+        lexing_thread.join();
+    }
 
-        if (! lexed)
+    bool TokenStream::lexNext(size_t index, LexError& lex_error)
+    {
+        LexResult result = scanner.next();
+        if (result.error.failed())
         {
-            std::string message = "Could not recognize token.";
-            throw LexerException(message, line, pos, source);
+            lex_error = result.error;
+            return false;
         }
 
-        return ret;
+        const token& t = result.value;
+        // NEWLINE and END_OF_FILE tokens have fixed text that is not in the source.
+        bool in_source = t.type != NEWLINE && t.type != END_OF_FILE;
+        size_t i = slot(index);
+
+        types[i] = t.type;
+        offsets[i] = in_source ? t.text.data() - source : 0;
+        lengths[i] = in_source ? t.text.size() : 0;
+        line_numbers[i] = t.line_number;
+        char_numbers[i] = t.char_numer;
+        symbols[i] = t.symbol;
+
+        return t.type != END_OF_FILE;
     }
 
-    // Check that all tokens are valid.
-    void lexPreprocess(const char*& source)
+    void TokenStream::lexAhead()
     {
-        std::cmatch cm;
-        static std::regex rex("[\n -~]");
-        unsigned long line = 0;
-        unsigned long pos = 0;
-        for (int i = 0; i < std::strlen(source); i++)
+        size_t index = 0;
+        bool done = false;
+
+        while (!done)
         {
-            char character[2] = { source[i], '\0'};
-            if (!std::regex_match(character, cm, rex))
             {
-                throw LexerException("Not all characters supported.", line, pos, source + i);
+                // Wait until the next chunk would not overwrite tokens the parser may still read.
+                std::unique_lock<std::mutex> guard(lock);
+                changed.wait(guard, [&] {return cancelled || draining || index + CHUNK_SIZE <= shared_low + RING_SIZE;});
+                if (cancelled)
+                    return;
             }
-            else if(source[i] == '\n')
+
+            LexError lex_error;
+            for (size_t chunk_end = index + CHUNK_SIZE; !done && index < chunk_end; )
             {
-                line++;
-                pos = 0;
+                bool more = lexNext(index, lex_error);
+                if (!lex_error.failed())
+                    index++;
+                done = !more;
             }
-            else
-                pos++;
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                shared_available = index;
+                shared_finished = done;
+                shared_error = lex_error;
+            }
+            changed.notify_all();
         }
     }
 
-    std::vector<token>* lexAll(const char* source)
+    void TokenStream::synchronize(size_t index, bool wait)
     {
-        lexPreprocess(source);   
-
-        size_t source_len = strlen(source);
-        char* source_copy = (char*) malloc(sizeof(char) * (source_len + 1));
-        strcpy(source_copy, source);
-        char* source_pointer = source_copy;
+        std::unique_lock<std::mutex> guard(lock);
 
-        unsigned long line = 0;
-        unsigned long pos = 0;
+        reported_low = (furthest > LOOKBEHIND) ? furthest - LOOKBEHIND : 0;
+        shared_low = reported_low;
+        changed.notify_all();
 
-        std::vector<token>* token_list = new std::vector<token>();
+        if (wait)
+            changed.wait(guard, [&] {return index < shared_available || shared_finished;});
 
-        token ret = lexWhitespace(source_pointer, line, pos);
-        if (ret.type != NONE)
-            token_list->push_back(ret);
-        else
-            clean_token(ret);
+        available = shared_available;
+        finished = shared_finished;
+        error = shared_error;
+    }
 
-        char* end = source_copy + source_len;
+    bool TokenStream::has(size_t index)
+    {
+        if (index + LOOKBEHIND < furthest)
+            throw std::out_of_range("Token " + std::to_string(index) + " is no longer buffered.");
+        furthest = std::max(furthest, index);
 
-        while (source_pointer != end)
+        if (index >= available && !finished)
         {
-            char* next_segment_end = getNextSegment(source_pointer, end);
-            int segment_size = next_segment_end - source_pointer;
-            char* segment = (char*) malloc(sizeof(char) * (segment_size + 1));
-            char* segmover = segment;
-            strncpy(segment, source_pointer, segment_size);
-            segment[segment_size] = '\0';
-            source_pointer += segment_size;
-
-            while(segmover != segment + segment_size)
+            if (lexing_thread.joinable())
+                synchronize(index, true);
+            else
             {
-                try
-                {
-                    ret = lexToken(segmover, line, pos);
-                }
-                catch(const LexerException& e)
+                while (index >= available && !finished)
                 {
-                    free(segment);
-                    throw;
+                    finished = !lexNext(available, error);
+                    if (!error.failed())
+                        available++;
                 }
-                
-                token_list->push_back(ret);
             }
+        }
+        else if (lexing_thread.joinable() && furthest >= reported_low + LOOKBEHIND + CHUNK_SIZE)
+            synchronize(index, false);
+
+        if (index < available)
+            return true;
+        if (error.failed())
+            throwLexError(error, end);
+        return false;
+    }
 
-            free(segment);
+    void TokenStream::drain()
+    {
+        if (lexing_thread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                draining = true;
+            }
+            changed.notify_all();
 
-            ret = lexWhitespace(source_pointer, line, pos);
-            if (ret.type != NONE)
-                token_list->push_back(ret);
-            else
-                clean_token(ret);
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&] {return shared_finished;});
+            error = shared_error;
+        }
+        else
+        {
+            // Later tokens overwrite the buffered ones, which are no longer needed.
+            for (size_t index = available; !finished; index++)
+                finished = !lexNext(index, error);
         }
 
-        token_list->push_back({END_OF_FILE, strdup(""), 0, 0});
-        free(source_copy);
-        return token_list;
+        if (error.failed())
+            throwLexError(error, end);
+    }
+
+    std::string_view TokenStream::text(size_t index) const
+    {
+        size_t i = slot(index);
+
+        switch (types[i])
+        {
+            case NEWLINE:
+                return "\n";
+            case END_OF_FILE:
+                return "";
+            default:
+                return std::string_view(source + offsets[i], lengths[i]);
+        }
+    }
+
+    token TokenStream::operator[](size_t index) const
+    {
+        size_t i = slot(index);
+        return {types[i], text(index), line_numbers[i], char_numbers[i], symbols[i]};
+    }
+
+#pragma endregion
+
+#pragma region Lexer Driver
+    ///////////////////////////////////////////////////////
+    //                  Lexer Driver                     //
+    ///////////////////////////////////////////////////////
+
+    TokenStream* lexStream(std::string_view source)
+    {
+        return new TokenStream(source);
     }
 
     std::string tokenTypeToString(TokenType to_convert)
@@ -506,95 +904,40 @@ namespace Lexer
                 std::printf("%s\n", enum_name.c_str());
                 break;
             default:
-                std::printf("%s '%s'\n", enum_name.c_str(), t.text);
+                std::printf("%s '%.*s'\n", enum_name.c_str(), (int) t.text.size(), t.text.data());
                 break;
         }
     }
 
-    void lexPrintAll(const char* source)
+    void lexPrintAll(std::string_view source)
     {
-        try
-        {
-            lexPreprocess(source);
-        }
-        catch(const LexerException& e)
-        {
-            std::printf("Compilation failed\n");
-            return;
-        }
+        // Nothing is printed for sources with unsupported characters. Lexing always fails on
+        // them, so checking up front lets every other token be printed as soon as it is lexed.
+        bool supported = std::all_of(source.begin(), source.end(), [](char c) {return hasClass(c, SUPPORTED);});
+        Scanner scanner(source);
+        LexResult result;
 
-        size_t source_len = strlen(source);
-        char* source_copy = (char*) malloc(sizeof(char) * (source_len + 1));
-        strcpy(source_copy, source);
-        char* source_pointer = source_copy;
-
-        unsigned long line = 0;
-        unsigned long pos = 0;
-
-        token ret;
-        
-        try
-        {
-            ret = lexWhitespace(source_pointer, line, pos);
-        }
-        catch(const LexerException& e)
+        while (supported)
         {
-            free(source_copy);
-            std::printf("Compilation failed\n");
-            return;
-        }
-
-        if (ret.type != NONE)
-            print_token(ret);
-        clean_token(ret);
+            result = scanner.next();
+            if (result.error.failed())
+                break;
 
-        while (source_pointer != source_copy + source_len)
-        {
-            try
-            {
-                ret = lexToken(source_pointer, line, pos);
-            }
-            catch(const LexerException& e)
-            {
-                free(source_copy);
-                std::printf("Compilation failed\n");
-                return;
-            }
-            
-            print_token(ret);
-            clean_token(ret);
-            try
-            {
-                ret = lexWhitespace(source_pointer, line, pos);   
-            }
-            catch(const LexerException& e)
-            {
-                free(source_copy);
-                std::printf("Compilation failed\n");
-                return;
-            }
-            
-            if (ret.type != NONE)
-                print_token(ret);
-            clean_token(ret);
+            print_token(result.value);
+            if (result.value.type == END_OF_FILE)
+                break;
         }
-        token eof = {END_OF_FILE, strdup(""), 0, 0};
-        print_token(eof);
-        clean_token(eof);
-        
-        free(source_copy);
-        std::printf("Compilation succeeded: lexical analysis complete\n");
+
+        if (!supported || result.error.failed())
+            std::printf("Compilation failed\n");
+        else
+            std::printf("Compilation succeeded: lexical analysis complete\n");
     }
 
 #pragma endregion
     
-    void destroy_token_list(std::vector<token>*& list)
+    void destroy_token_list(TokenStream*& list)
     {
-        for(token t : *list)
-        {
-            clean_token(t);
-        }
-
         delete list;
     }
 }
\ No newline at end of file
@@ -1,8 +1,15 @@
 #include <vector>
+#include <deque>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
 
-#define LEX_FUNC_ARGS_NAMED char* &source, unsigned long& line, unsigned long& pos 
-#define LEX_FUNC_ARGS char*&, unsigned long&, unsigned long&
+#define LEX_FUNC_ARGS_NAMED const char* &source, const char* end, unsigned long& line, unsigned long& pos 
+#define LEX_FUNC_ARGS const char*&, const char*, unsigned long&, unsigned long&
 
 #ifndef __LEXER_H__
 #define __LEXER_H__ 
@@ -12,35 +19,171 @@ namespace Lexer
     ///////////////////////////////////////////////////
     //                  Lexer Types                  //
     ///////////////////////////////////////////////////
-    enum TokenType {ARRAY, ASSERT, BOOL, ELSE, FALSE, FLOAT, FN, IF, IMAGE, INT, LET, PRINT,
+    enum TokenType : unsigned char {ARRAY, ASSERT, BOOL, ELSE, FALSE, FLOAT, FN, IF, IMAGE, INT, LET, PRINT,
     READ, RETURN, SHOW, SUM, THEN, TIME, TO, TRUE, TYPE, WRITE,
     COLON, LCURLY, RCURLY, LPAREN, RPAREN, COMMA, LSQUARE, RSQUARE, EQUALS,
     STRING, INTVAL, FLOATVAL, VARIABLE, OP, NEWLINE, END_OF_FILE, NONE};
 
+    // An interned name. Equal names always intern to the same symbol.
+    typedef uint32_t Symbol;
+    constexpr Symbol NO_SYMBOL = UINT32_MAX;
+
+    // Maps names to symbols and back. Shared by every stage so that names can be
+    // compared and hashed as integers. Safe to use from multiple threads.
+    class Interner
+    {
+        private:
+            std::mutex lock;
+            // Names are stored in a deque so that the views used as keys stay valid.
+            std::deque<std::string> names;
+            std::unordered_map<std::string_view, Symbol> symbols;
+        public:
+            Symbol intern(std::string_view name);
+            const std::string& name(Symbol symbol);
+    };
+
+    Interner& interner();
+    inline Symbol intern(std::string_view name) {return interner().intern(name);}
+
     typedef struct token {
         TokenType type;
-        char* text;
+        // A view into the source buffer, which must outlive the token.
+        std::string_view text;
         unsigned long line_number;
         unsigned long char_numer;
+        // The interned text of VARIABLE tokens.
+        Symbol symbol = NO_SYMBOL;
     } token;
 
+    // Where and why lexing stopped. The lexer reports errors as values; TokenStream::has and
+    // TokenStream::drain turn them into exceptions once the parser reaches them.
+    struct LexError
+    {
+        const char* message = nullptr;
+        unsigned long line = 0;
+        unsigned long pos = 0;
+        const char* source = nullptr;
+        bool unsupported_character = false;
+
+        bool failed() const { return message != nullptr; }
+    };
+
+    // Either a lexed token or the error that prevented lexing it.
+    struct LexResult
+    {
+        token value;
+        LexError error;
+    };
+
     class LexerException : public std::exception 
     {
         public:
             std::string message;
-            LexerException(const std::string& m, unsigned long line, unsigned long pos, const char* source);
+            LexerException(const std::string& m, unsigned long line, unsigned long pos, const char* source, const char* end);
             const char* what () const noexcept override;
     };
 
+    // Thrown when the source contains a character outside of [\n -~]. Takes precedence over
+    // any other lexing error, as if every character were checked before lexing began.
+    class UnsupportedCharacterException : public LexerException
+    {
+        public:
+            UnsupportedCharacterException(unsigned long line, unsigned long pos, const char* source, const char* end);
+    };
+
+    // Lexes a source one token at a time, tracking the line and position of each token.
+    class Scanner
+    {
+        private:
+            const char* source;
+            const char* end;
+            unsigned long line = 0;
+            unsigned long pos = 0;
+            // Whitespace is lexed once before every token.
+            bool at_whitespace = true;
+        public:
+            Scanner(std::string_view _source) : source(_source.data()), end(_source.data() + _source.size()) {}
+            // Returns the next token, END_OF_FILE once the source is exhausted, or the error that stopped lexing.
+            LexResult next();
+    };
+
+    // The tokens of a source, lexed on demand as the parser asks for them. Only the
+    // RING_SIZE most recent tokens are kept, as parallel arrays, so memory does not grow
+    // with the source. Large sources are lexed ahead of the parser on a separate thread.
+    class TokenStream
+    {
+        public:
+            // Both powers of two; a lexing thread publishes tokens CHUNK_SIZE at a time.
+            static constexpr size_t RING_SIZE = 4096;
+            static constexpr size_t CHUNK_SIZE = 256;
+            // How far behind the furthest requested token the parser may still look.
+            static constexpr size_t LOOKBEHIND = 16;
+            // Sources at least this large are lexed on a separate thread.
+            static constexpr size_t THREADED_SOURCE_SIZE = 1 << 20;
+
+            TokenStream(std::string_view _source, bool threaded);
+            TokenStream(std::string_view _source) : TokenStream(_source, _source.size() >= THREADED_SOURCE_SIZE) {}
+            ~TokenStream();
+
+            // Whether the source has a token at index, lexing up to it if needed.
+            // Throws a LexerException if lexing fails at or before index.
+            bool has(size_t index);
+            TokenType type(size_t index) const {return types[slot(index)];}
+            std::string_view text(size_t index) const;
+            token operator[](size_t index) const;
+            // The number of tokens lexed so far.
+            size_t lexed() const {return available;}
+            // Lexes the rest of the source, throwing the first error if there is one.
+            void drain();
+
+        private:
+            const char* source;
+            const char* end;
+            Scanner scanner;
+
+            std::vector<TokenType> types;
+            std::vector<uint32_t> offsets;
+            std::vector<uint32_t> lengths;
+            std::vector<uint32_t> line_numbers;
+            std::vector<uint32_t> char_numbers;
+            std::vector<Symbol> symbols;
+
+            // Tokens [0, available) have been lexed and can be read without locking.
+            size_t available = 0;
+            size_t furthest = 0;
+            size_t reported_low = 0;
+            bool finished = false;
+            LexError error;
+
+            // State shared with the lexing thread, guarded by lock.
+            std::thread lexing_thread;
+            std::mutex lock;
+            std::condition_variable changed;
+            size_t shared_available = 0;
+            size_t shared_low = 0;
+            bool shared_finished = false;
+            bool draining = false;
+            bool cancelled = false;
+            LexError shared_error;
+
+            size_t slot(size_t index) const {return index & (RING_SIZE - 1);}
+            // Lexes the token at index into its slot. Returns false once there are no more tokens.
+            bool lexNext(size_t index, LexError& lex_error);
+            // Body of the lexing thread.
+            void lexAhead();
+            // Tells the lexing thread how far the parser has read, optionally waiting for the token at index.
+            void synchronize(size_t index, bool wait);
+    };
+
     ///////////////////////////////////////////////////////
     //                  Lexer Functions                  //
     ///////////////////////////////////////////////////////
 
-    std::vector<token>* lexAll(const char* source);
-    void lexPrintAll(const char* source);
-    token lexToken(LEX_FUNC_ARGS_NAMED);
+    TokenStream* lexStream(std::string_view source);
+    void lexPrintAll(std::string_view source);
+    LexResult lexToken(LEX_FUNC_ARGS_NAMED);
     std::string tokenTypeToString(TokenType to_convert);
-    void destroy_token_list(std::vector<token>*&);
+    void destroy_token_list(TokenStream*&);
 }
 
 #endif
\ No newline at end of file
@@ -1,11 +1,16 @@
 #include "optimization.h"
 #include "../trycasts.cpp"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
 
 namespace Optimization
 {
 
 #pragma region ASTVisitor
-    void ASTVisitor::visit_all_cmds(std::vector<std::unique_ptr<Parser::CmdNode>>& cmds)
+    void ASTVisitor::visit_all_cmds(std::vector<Parser::NodePtr<Parser::CmdNode>>& cmds)
     {
         for (auto& u_cmd : cmds)
         {
@@ -14,86 +19,88 @@ namespace Optimization
     }
 
     //cmds
-    void ASTVisitor::visit_cmd(std::unique_ptr<Parser::CmdNode>& u_cmd)
+    void ASTVisitor::visit_cmd(Parser::NodePtr<Parser::CmdNode>& u_cmd)
     {
-        Parser::CmdNode* cmd = u_cmd.get();
+        // The command a time command times is visited next by this loop, not by recursion.
+        Parser::NodePtr<Parser::CmdNode>* slot = &u_cmd;
+        while ((*slot)->kind == Parser::TIME_CMD)
+        {
+            Parser::TimeCmdNode* time_cmd = static_cast<Parser::TimeCmdNode*>(slot->get());
+            if (Parser::CmdNode* new_cmd = visit_time_cmd(time_cmd))
+            {
+                slot->reset(new_cmd);
+                return;
+            }
+            slot = &time_cmd->command;
+        }
+
+        Parser::CmdNode* cmd = slot->get();
 
         Parser::CmdNode* new_cmd = nullptr;
 
+        switch (cmd->kind)
         {
-            Parser::ReadCmdNode* result;
-            if (tryCastCmd<Parser::ReadCmdNode>(cmd, result))
+            case Parser::READ_CMD:
             {
+                Parser::ReadCmdNode* result = static_cast<Parser::ReadCmdNode*>(cmd);
                 new_cmd = visit_read_cmd(result);
+                break;
             }
-        }
 
-        {
-            Parser::WriteCmdNode* result;
-            if (tryCastCmd<Parser::WriteCmdNode>(cmd, result))
+            case Parser::WRITE_CMD:
             {
+                Parser::WriteCmdNode* result = static_cast<Parser::WriteCmdNode*>(cmd);
                 new_cmd = visit_write_cmd(result);
+                break;
             }
-        }
 
-        {
-            Parser::TypeCmdNode* result;
-            if (tryCastCmd<Parser::TypeCmdNode>(cmd, result))
+            case Parser::TYPE_CMD:
             {
+                Parser::TypeCmdNode* result = static_cast<Parser::TypeCmdNode*>(cmd);
                 new_cmd = visit_type_cmd(result);
+                break;
             }
-        }
 
-        {
-            Parser::LetCmdNode* result;
-            if (tryCastCmd<Parser::LetCmdNode>(cmd, result))
+            case Parser::LET_CMD:
             {
+                Parser::LetCmdNode* result = static_cast<Parser::LetCmdNode*>(cmd);
                 new_cmd = visit_let_cmd(result);
+                break;
             }
-        }
 
-        {
-            Parser::AssertCmdNode* result;
-            if (tryCastCmd<Parser::AssertCmdNode>(cmd, result))
+            case Parser::ASSERT_CMD:
             {
+                Parser::AssertCmdNode* result = static_cast<Parser::AssertCmdNode*>(cmd);
                 new_cmd = visit_assert_cmd(result);
+                break;
             }
-        }
 
-        {
-            Parser::PrintCmdNode* result;
-            if (tryCastCmd<Parser::PrintCmdNode>(cmd, result))
+            case Parser::PRINT_CMD:
             {
+                Parser::PrintCmdNode* result = static_cast<Parser::PrintCmdNode*>(cmd);
                 new_cmd = visit_print_cmd(result);
+                break;
             }
-        }
 
-        {
-            Parser::ShowCmdNode* result;
-            if (tryCastCmd<Parser::ShowCmdNode>(cmd, result))
+            case Parser::SHOW_CMD:
             {
+                Parser::ShowCmdNode* result = static_cast<Parser::ShowCmdNode*>(cmd);
                 new_cmd = visit_show_cmd(result);
+                break;
             }
-        }
-
-        {
-            Parser::TimeCmdNode* result;
-            if (tryCastCmd<Parser::TimeCmdNode>(cmd, result))
-            {
-                new_cmd = visit_time_cmd(result);
-            }
-        }
 
-        {
-            Parser::FnCmd* result;
-            if (tryCastCmd<Parser::FnCmd>(cmd, result))
+            case Parser::FN_CMD:
             {
+                Parser::FnCmd* result = static_cast<Parser::FnCmd*>(cmd);
                 new_cmd = visit_fn_cmd(result);
+                break;
             }
+            default:
+                break;
         }
 
         if (new_cmd)
-            u_cmd.reset(new_cmd);
+            slot->reset(new_cmd);
     }
 
     Parser::CmdNode* ASTVisitor::visit_read_cmd(Parser::ReadCmdNode* read_cmd)
@@ -138,7 +145,6 @@ namespace Optimization
 
     Parser::CmdNode* ASTVisitor::visit_time_cmd(Parser::TimeCmdNode* time_cmd)
     {
-        visit_cmd(time_cmd->command);
         return nullptr;
     }
 
@@ -152,34 +158,36 @@ namespace Optimization
     }
 
     //stmts
-    void ASTVisitor::visit_stmt(std::unique_ptr<Parser::StmtNode>& u_stmt)
+    void ASTVisitor::visit_stmt(Parser::NodePtr<Parser::StmtNode>& u_stmt)
     {
         Parser::StmtNode* stmt = u_stmt.get();
 
         Parser::StmtNode* new_stmt = nullptr;
 
+        switch (stmt->kind)
         {
-            Parser::LetStmtNode* result;
-            if (tryCastStmt<Parser::LetStmtNode>(stmt, result))
+            case Parser::LET_STMT:
             {
+                Parser::LetStmtNode* result = static_cast<Parser::LetStmtNode*>(stmt);
                 new_stmt = visit_let_stmt(result);
+                break;
             }
-        }
 
-        {
-            Parser::AssertStmtNode* result;
-            if (tryCastStmt<Parser::AssertStmtNode>(stmt, result))
+            case Parser::ASSERT_STMT:
             {
+                Parser::AssertStmtNode* result = static_cast<Parser::AssertStmtNode*>(stmt);
                 new_stmt = visit_assert_stmt(result);
+                break;
             }
-        }
 
-        {
-            Parser::ReturnStmtNode* result;
-            if (tryCastStmt<Parser::ReturnStmtNode>(stmt, result))
+            case Parser::RETURN_STMT:
             {
+                Parser::ReturnStmtNode* result = static_cast<Parser::ReturnStmtNode*>(stmt);
                 new_stmt = visit_return_stmt(result);
+                break;
             }
+            default:
+                break;
         }
 
         if (new_stmt)
@@ -205,124 +213,166 @@ namespace Optimization
     }
 
     //exprs
-    void ASTVisitor::visit_expr(std::unique_ptr<Parser::ExprNode>& u_expr)
+    void ASTVisitor::visit_expr(Parser::NodePtr<Parser::ExprNode>& u_expr)
+    {
+        add({&u_expr, nullptr});
+    }
+
+    void ASTVisitor::then(std::function<Parser::ExprNode*()> work)
+    {
+        add({visiting, std::move(work)});
+    }
+
+    void ASTVisitor::add(Task task)
+    {
+        tasks.push_back(std::move(task));
+        if (walking)
+            return;
+
+        walking = true;
+        while (!tasks.empty())
+        {
+            Task next = std::move(tasks.back());
+            tasks.pop_back();
+            size_t added = tasks.size();
+
+            if (next.work)
+            {
+                visiting = next.slot;
+                Parser::ExprNode* new_expr = next.work();
+                if (new_expr)
+                    next.slot->reset(new_expr);
+            }
+            else
+                walk_expr(*next.slot);
+
+            // The stack runs the tasks just added last first, so they are turned around.
+            std::reverse(tasks.begin() + added, tasks.end());
+        }
+        walking = false;
+        visiting = nullptr;
+    }
+
+    void ASTVisitor::walk_expr(Parser::NodePtr<Parser::ExprNode>& u_expr)
     {
         Parser::ExprNode* expr = u_expr.get();
+        Parser::NodePtr<Parser::ExprNode>* outer = visiting;
+        visiting = &u_expr;
 
         Parser::ExprNode* new_expr = nullptr;
 
+        switch (expr->kind)
         {
-            Parser::IntExprNode* result;
-            if (tryCastExpr<Parser::IntExprNode>(expr, result))
+            case Parser::INT_EXPR:
             {
+                Parser::IntExprNode* result = static_cast<Parser::IntExprNode*>(expr);
                 new_expr = visit_int_expr(result);
+                break;
             }
-        }
 
-        {
-            Parser::FloatExprNode* result;
-            if (tryCastExpr<Parser::FloatExprNode>(expr, result))
+            case Parser::FLOAT_EXPR:
             {
+                Parser::FloatExprNode* result = static_cast<Parser::FloatExprNode*>(expr);
                 new_expr = visit_float_expr(result);
+                break;
             }
-        }
 
-        {
-            Parser::TrueExprNode* result;
-            if (tryCastExpr<Parser::TrueExprNode>(expr, result))
+            case Parser::TRUE_EXPR:
             {
+                Parser::TrueExprNode* result = static_cast<Parser::TrueExprNode*>(expr);
                 new_expr = visit_true_expr(result);
+                break;
             }
-        }
 
-        {
-            Parser::FalseExprNode* result;
-            if (tryCastExpr<Parser::FalseExprNode>(expr, result))
+            case Parser::FALSE_EXPR:
             {
+                Parser::FalseExprNode* result = static_cast<Parser::FalseExprNode*>(expr);
                 new_expr = visit_false_expr(result);
+                break;
             }
-        }
 
-        {
-            Parser::VariableExprNode* result;
-            if (tryCastExpr<Parser::VariableExprNode>(expr, result))
+            case Parser::VARIABLE_EXPR:
             {
+                Parser::VariableExprNode* result = static_cast<Parser::VariableExprNode*>(expr);
                 new_expr = visit_variable_expr(result);
+                break;
             }
-        }
 
-        {
-            Parser::TupleLiteralExprNode* result;
-            if (tryCastExpr<Parser::TupleLiteralExprNode>(expr, result))
+            case Parser::TUPLE_LITERAL_EXPR:
             {
+                Parser::TupleLiteralExprNode* result = static_cast<Parser::TupleLiteralExprNode*>(expr);
                 new_expr = visit_tuple_expr(result);
+                break;
             }
-        }
 
-        {
-            Parser::ArrayLiteralExprNode* result;
-            if (tryCastExpr<Parser::ArrayLiteralExprNode>(expr, result))
+            case Parser::ARRAY_LITERAL_EXPR:
             {
+                Parser::ArrayLiteralExprNode* result = static_cast<Parser::ArrayLiteralExprNode*>(expr);
                 new_expr = visit_array_expr(result);
+                break;
             }
-        }
 
-        {
-            Parser::TupleIndexExprNode* result;
-            if (tryCastExpr<Parser::TupleIndexExprNode>(expr, result))
+            case Parser::TUPLE_INDEX_EXPR:
             {
+                Parser::TupleIndexExprNode* result = static_cast<Parser::TupleIndexExprNode*>(expr);
                 new_expr = visit_tuple_index_expr(result);
+                break;
             }
-        }
 
-        {
-            Parser::ArrayIndexExprNode* result;
-            if (tryCastExpr<Parser::ArrayIndexExprNode>(expr, result))
+            case Parser::ARRAY_INDEX_EXPR:
             {
+                Parser::ArrayIndexExprNode* result = static_cast<Parser::ArrayIndexExprNode*>(expr);
                 new_expr = visit_array_index_expr(result);
+                break;
             }
-        }
 
-        {
-            Parser::CallExprNode* result;
-            if (tryCastExpr<Parser::CallExprNode>(expr, result))
+            case Parser::CALL_EXPR:
             {
+                Parser::CallExprNode* result = static_cast<Parser::CallExprNode*>(expr);
                 new_expr = visit_call_expr(result);
+                break;
             }
-        }
 
-        {
-            Parser::UnopExprNode* result;
-            if (tryCastExpr<Parser::UnopExprNode>(expr, result))
+            case Parser::UNOP_EXPR:
             {
+                Parser::UnopExprNode* result = static_cast<Parser::UnopExprNode*>(expr);
                 new_expr = visit_unop_expr(result);
+                break;
             }
-        }
 
-        {
-            Parser::BinopExprNode* result;
-            if (tryCastExpr<Parser::BinopExprNode>(expr, result))
+            case Parser::BINOP_EXPR:
             {
+                Parser::BinopExprNode* result = static_cast<Parser::BinopExprNode*>(expr);
                 new_expr = visit_binop_expr(result);
+                break;
             }
-        }
 
-        {
-            Parser::IfExprNode* result;
-            if (tryCastExpr<Parser::IfExprNode>(expr, result))
+            case Parser::IF_EXPR:
             {
+                Parser::IfExprNode* result = static_cast<Parser::IfExprNode*>(expr);
                 new_expr = visit_if_expr(result);
+                break;
             }
-        }
 
-        {
-            Parser::LoopExprNode* result;
-            if (tryCastExpr<Parser::LoopExprNode>(expr, result))
+            case Parser::ARRAY_LOOP_EXPR:
+            case Parser::SUM_LOOP_EXPR:
             {
+                Parser::LoopExprNode* result = static_cast<Parser::LoopExprNode*>(expr);
                 new_expr = visit_loop_expr(result);
+                break;
+            }
+
+            case Parser::INLINED_CALL_EXPR:
+            {
+                Parser::InlinedCallExprNode* result = static_cast<Parser::InlinedCallExprNode*>(expr);
+                new_expr = visit_inlined_call_expr(result);
+                break;
             }
+            default:
+                break;
         }
 
+        visiting = outer;
         if (new_expr)
             u_expr.reset(new_expr);
     }
@@ -411,122 +461,427 @@ namespace Optimization
     Parser::ExprNode* ASTVisitor::visit_loop_expr(Parser::LoopExprNode* loop_expr)
     {
         for (auto& u_bound : loop_expr->bounds)
-            visit_expr(u_bound->second);
+            visit_expr(u_bound.second);
+        for (auto& invariant : loop_expr->invariants)
+            visit_expr(invariant.expression);
         visit_expr(loop_expr->loop_expression);
         return nullptr;
     }
 
+    Parser::ExprNode* ASTVisitor::visit_inlined_call_expr(Parser::InlinedCallExprNode* inlined_call_expr)
+    {
+        for (auto& u_stmt : inlined_call_expr->statements)
+            visit_stmt(u_stmt);
+        visit_expr(inlined_call_expr->result);
+        return nullptr;
+    }
+
 #pragma endregion
 
 #pragma region ConstantPropagation
 
-    ConstantPropagation::ConstantPropagation()
+    ConstantPropagation::ConstantPropagation(Parser::Arena& _arena) : arena(_arena)
     {
-        context["argnum"] = std::make_shared<Parser::CPValue>();
+        set(Lexer::intern("argnum"), arena.make<Parser::CPValue>());
         // May need to change args to use ArrayValue
-        std::vector<std::shared_ptr<Parser::CPValue>> lengths = {std::make_shared<Parser::CPValue>()};
-        context["args"] = std::make_shared<Parser::ArrayValue>(lengths);
+        std::vector<Parser::CPValue*> lengths = {arena.make<Parser::CPValue>()};
+        set(Lexer::intern("args"), arena.make<Parser::ArrayValue>(arena, lengths));
     }
 
     Parser::ExprNode* ConstantPropagation::visit_int_expr(Parser::IntExprNode* int_expr)
     {
-        // May cause mem leak or weird behaviour bc not sure how reset on a shred ptr handles the old value / ref counter.
-        int_expr->cp.reset(new Parser::IntValue(int_expr->value));
+        int_expr->cp = arena.make<Parser::IntValue>(int_expr->value);
         return nullptr;
     }
 
-    Parser::CmdNode* ConstantPropagation::visit_let_cmd(Parser::LetCmdNode* let_expr)
+    void ConstantPropagation::propagate(std::vector<Parser::NodePtr<Parser::CmdNode>>& cmds)
     {
-        visit_expr(let_expr->expression);
+        visit_all_cmds(cmds);
 
-        Parser::ArgumentLValue* arg_lvalue;
-        // decompose the lvalue and update context
-        if (tryCast<Parser::LValue, Parser::ArgumentLValue>(let_expr->lvalue.get(), arg_lvalue))
+        // Every call to a function comes after it, so each body is visited once all the calls to
+        // it have been, with its parameters bound to what they pass.
+        for (auto it = cmds.rbegin(); it != cmds.rend(); it++)
         {
-            Parser::VarArgumentNode* var_argument;
-            if (tryCast<Parser::ArgumentNode, Parser::VarArgumentNode>(arg_lvalue->argument.get(), var_argument))
+            Parser::FnCmd* fn_cmd;
+            if (!tryCast<Parser::CmdNode, Parser::FnCmd>(it->get(), fn_cmd))
+                continue;
+
+            Summary& summary = summaries[fn_cmd->function_symbol];
+            // A function calling itself may pass its parameters anything.
+            std::vector<Parser::CPValue*> values;
+            for (auto& argument : summary.arguments)
+                values.push_back(argument && !summary.calls_itself ? argument : arena.make<Parser::CPValue>());
+
+            // A body only reads its own variables and those defined before it, which are never
+            // bound again, so the context the top level ends with serves for every body.
+            size_t outside = shadowed.size();
+            current = &summary;
+            bind_parameters(summary, values);
+            visit_body(fn_cmd);
+            restore(outside);
+
+            std::string text;
+            for (size_t i = 0; i < values.size(); i++)
             {
-                context[var_argument->token_s] = let_expr->expression->cp;
+                Parser::VarBindingNode* var_binding;
+                if (!tryCast<Parser::BindingNode, Parser::VarBindingNode>(fn_cmd->arguments[i].get(), var_binding))
+                    continue;
+                Parser::ArrayArgumentNode* array_argument;
+                std::string name = tryCast<Parser::ArgumentNode, Parser::ArrayArgumentNode>(var_binding->argument.get(), array_argument)
+                    ? array_argument->array_argument_name : var_binding->argument->token_s;
+                text += (text.empty() ? "" : ", ") + name + " = " + describe(summary, values[i]);
             }
-            else if (let_expr->expression->cp->type == Parser::CPValue::ARRAY)
+            report.push_back({fn_cmd->function_name, "(" + text + ") returns " + describe(summary, summary.result)});
+        }
+        std::reverse(report.begin(), report.end());
+        current = nullptr;
+    }
+
+    Parser::CmdNode* ConstantPropagation::visit_let_cmd(Parser::LetCmdNode* let_expr)
+    {
+        visit_expr(let_expr->expression);
+        bind(let_expr->lvalue.get(), let_expr->expression->cp);
+        return nullptr;
+    }
+
+    Parser::StmtNode* ConstantPropagation::visit_let_stmt(Parser::LetStmtNode* let_stmt)
+    {
+        visit_expr(let_stmt->variable_expression);
+        then([this, let_stmt]
+        {
+            bind(let_stmt->set_variable_name.get(), let_stmt->variable_expression->cp);
+            return nullptr;
+        });
+        return nullptr;
+    }
+
+    void ConstantPropagation::set(Lexer::Symbol symbol, Parser::CPValue* value)
+    {
+        Parser::CPValue*& binding = context[symbol];
+        shadowed.push_back({symbol, binding});
+        binding = value;
+    }
+
+    void ConstantPropagation::restore(size_t size)
+    {
+        while (shadowed.size() > size)
+        {
+            context[shadowed.back().first] = std::move(shadowed.back().second);
+            shadowed.pop_back();
+        }
+    }
+
+    void ConstantPropagation::bind(Parser::LValue* root, Parser::CPValue* root_value)
+    {
+        // The lvalues inside tuples are bound from a list rather than by recursion.
+        std::vector<Parser::LValue*> lvalues = {root};
+        while (!lvalues.empty())
+        {
+            Parser::LValue* lvalue = lvalues.back();
+            lvalues.pop_back();
+            // Tuples have no known values.
+            Parser::CPValue* value = lvalue == root ? root_value : arena.make<Parser::CPValue>();
+
+            Parser::ArgumentLValue* arg_lvalue;
+            Parser::TupleLValueNode* tuple_lvalue;
+            // decompose the lvalue and update context
+            if (tryCast<Parser::LValue, Parser::ArgumentLValue>(lvalue, arg_lvalue))
             {
-                Parser::ArrayValue* array_value = static_cast<Parser::ArrayValue*>(let_expr->expression->cp.get());
-                Parser::ArrayArgumentNode* array_argument = static_cast<Parser::ArrayArgumentNode*>(arg_lvalue->argument.get());
-                for (int i = 0; i < array_argument->array_dimensions_names.size(); i++)
+                Parser::VarArgumentNode* var_argument;
+                if (tryCast<Parser::ArgumentNode, Parser::VarArgumentNode>(arg_lvalue->argument.get(), var_argument))
                 {
-                    std::string dimension = array_argument->array_dimensions_names[i];
-                    std::shared_ptr<Parser::CPValue> dimension_cpv = array_value->lengths[i];
-                    context[dimension] = dimension_cpv;
+                    set(var_argument->symbol, value);
+                    continue;
                 }
-                context[array_argument->array_argument_name] = let_expr->expression->cp;
+
+                bind_array(static_cast<Parser::ArrayArgumentNode*>(arg_lvalue->argument.get()), value);
+            }
+            else if (tryCast<Parser::LValue, Parser::TupleLValueNode>(lvalue, tuple_lvalue))
+            {
+                // The last lvalue is taken first, so they go on in reverse.
+                for (size_t i = tuple_lvalue->lvalues.size(); i > 0; i--)
+                    lvalues.push_back(tuple_lvalue->lvalues[i - 1].get());
             }
         }
+    }
+
+    Parser::ExprNode* ConstantPropagation::visit_loop_expr(Parser::LoopExprNode* loop_expr)
+    {
+        for (auto& u_bound : loop_expr->bounds)
+            visit_expr(u_bound.second);
+
+        then([this, loop_expr]
+        {
+            // Nothing is known of the indices, whatever a variable of the same name defined after
+            // the function holds.
+            size_t outside = shadowed.size();
+            for (Lexer::Symbol symbol : loop_expr->bound_symbols)
+                set(symbol, nullptr);
+            for (auto& invariant : loop_expr->invariants)
+                visit_expr(invariant.expression);
+            visit_expr(loop_expr->loop_expression);
+
+            then([this, loop_expr, outside]
+            {
+                restore(outside);
+
+                std::vector<Parser::CPValue*> array_lengths;
+                for (auto& u_bound : loop_expr->bounds)
+                    array_lengths.push_back(u_bound.second->cp);
+                if (loop_expr->kind == Parser::ARRAY_LOOP_EXPR)
+                    loop_expr->cp = arena.make<Parser::ArrayValue>(arena, array_lengths);
+                return nullptr;
+            });
+            return nullptr;
+        });
         return nullptr;
     }
 
-    Parser::StmtNode* ConstantPropagation::visit_let_stmt(Parser::LetStmtNode* let_stmt)
+    Parser::ExprNode* ConstantPropagation::visit_variable_expr(Parser::VariableExprNode* variable_expr)
     {
-        visit_expr(let_stmt->variable_expression);
-        // decompose the lvalue and update context
-        if (let_stmt->variable_expression->cp->type == Parser::CPValue::INT)
+        auto found = context.find(variable_expr->symbol);
+        if (found != context.end() && found->second)
+            variable_expr->cp = found->second;
+        return nullptr;
+    }
+
+    Parser::ExprNode* ConstantPropagation::visit_call_expr(Parser::CallExprNode* call_expr)
+    {
+        ASTVisitor::visit_call_expr(call_expr);
+        then([this, call_expr]
+        {
+            auto found = summaries.find(call_expr->function_symbol);
+            if (found == summaries.end())
+            {
+                call_expr->cp = arena.make<Parser::CPValue>();
+                return nullptr;
+            }
+            Summary& callee = found->second;
+
+            if (&callee == current)
+                callee.calls_itself = true;
+            // Inside a function summarized for the first time, the arguments may be its parameters.
+            if (record_calls)
+                for (size_t i = 0; i < call_expr->arguments.size(); i++)
+                    callee.arguments[i] = meet(callee.arguments[i], call_expr->arguments[i]->cp);
+
+            call_expr->cp = instantiate(callee, callee.result, call_expr);
+            return nullptr;
+        });
+        return nullptr;
+    }
+
+    Parser::CmdNode* ConstantPropagation::visit_fn_cmd(Parser::FnCmd* fn_cmd)
+    {
+        Summary& summary = summaries[fn_cmd->function_symbol];
+        summary.function = fn_cmd;
+        // The variables of a function are out of scope after it, where another function may bind
+        // the same names.
+        size_t outside = shadowed.size();
+        summary.arguments.resize(fn_cmd->arguments.size());
+
+        // Each parameter, and each length of an array parameter, is a value of its own that stands
+        // for what the caller passes.
+        for (size_t i = 0; i < fn_cmd->arguments.size(); i++)
         {
-            Parser::ArgumentLValue* lvalue = static_cast<Parser::ArgumentLValue*>(let_stmt->set_variable_name.get());
-            Parser::VarArgumentNode* argument = static_cast<Parser::VarArgumentNode*>(lvalue->argument.get());
+            Parser::VarBindingNode* var_binding;
+            Parser::ArrayArgumentNode* array_argument;
+            Parser::CPValue* parameter;
+            if (tryCast<Parser::BindingNode, Parser::VarBindingNode>(fn_cmd->arguments[i].get(), var_binding)
+                && tryCast<Parser::ArgumentNode, Parser::ArrayArgumentNode>(var_binding->argument.get(), array_argument))
+            {
+                std::vector<Parser::CPValue*> lengths;
+                for (size_t j = 0; j < array_argument->array_dimensions_symbols.size(); j++)
+                {
+                    lengths.push_back(arena.make<Parser::CPValue>());
+                    summary.sources[lengths.back()] = {i, j};
+                }
+                parameter = arena.make<Parser::ArrayValue>(arena, lengths);
+            }
+            else
+                parameter = arena.make<Parser::CPValue>();
 
-            context[argument->token_s] = let_stmt->variable_expression->cp;
+            if (var_binding)
+                summary.sources[parameter] = {i, NO_DIMENSION};
+            summary.parameters.push_back(parameter);
         }
+
+        current = &summary;
+        record_calls = false;
+        bind_parameters(summary, summary.parameters);
+        summary.result = visit_body(fn_cmd);
+        record_calls = true;
+        current = nullptr;
+
+        restore(outside);
         return nullptr;
     }
 
-    Parser::ExprNode* ConstantPropagation::visit_loop_expr(Parser::LoopExprNode* loop_expr)
+    void ConstantPropagation::bind_parameters(Summary& summary, const std::vector<Parser::CPValue*>& values)
+    {
+        for (size_t i = 0; i < values.size(); i++)
+            bind_parameter(summary.function->arguments[i].get(), values[i]);
+    }
+
+    void ConstantPropagation::bind_parameter(Parser::BindingNode* root, Parser::CPValue* root_value)
     {
-        Parser::ArrayLoopExprNode* array_loop_expr;
-        if (tryCast<Parser::LoopExprNode, Parser::ArrayLoopExprNode>(loop_expr, array_loop_expr))
+        // The bindings inside tuples are bound from a list, like the lvalues in bind.
+        std::vector<Parser::BindingNode*> bindings = {root};
+        while (!bindings.empty())
         {
-            std::vector<std::shared_ptr<Parser::CPValue>> array_lengths;
-            for (auto& u_bound : loop_expr->bounds)
+            Parser::BindingNode* binding = bindings.back();
+            bindings.pop_back();
+            Parser::CPValue* value = binding == root ? root_value : arena.make<Parser::CPValue>();
+
+            Parser::VarBindingNode* var_binding;
+            if (!tryCast<Parser::BindingNode, Parser::VarBindingNode>(binding, var_binding))
             {
-                visit_expr(u_bound->second);
-                array_lengths.push_back(u_bound->second->cp);
+                Parser::TupleBindingNode* tuple_binding = static_cast<Parser::TupleBindingNode*>(binding);
+                for (size_t i = tuple_binding->bindings.size(); i > 0; i--)
+                    bindings.push_back(tuple_binding->bindings[i - 1].get());
+                continue;
             }
-            visit_expr(loop_expr->loop_expression);
 
-            std::shared_ptr<Parser::ArrayValue> array_value = std::make_shared<Parser::ArrayValue>(array_lengths);
-            loop_expr->cp = array_value;
+            Parser::ArrayArgumentNode* array_argument;
+            if (!tryCast<Parser::ArgumentNode, Parser::ArrayArgumentNode>(var_binding->argument.get(), array_argument))
+            {
+                set(var_binding->argument->symbol, value);
+                continue;
+            }
+            bind_array(array_argument, value);
         }
-        else
+    }
+
+    void ConstantPropagation::bind_array(Parser::ArrayArgumentNode* array_argument, Parser::CPValue* value)
+    {
+        // An array of unknown lengths still has one value for each of them, which its dimension
+        // variables and the array share.
+        Parser::CPValue* array_value = value;
+        if (value->type != Parser::CPValue::ARRAY)
         {
-            ASTVisitor::visit_loop_expr(loop_expr);
+            std::vector<Parser::CPValue*> lengths;
+            for (size_t i = 0; i < array_argument->array_dimensions_symbols.size(); i++)
+                lengths.push_back(arena.make<Parser::CPValue>());
+            array_value = arena.make<Parser::ArrayValue>(arena, lengths);
         }
 
-        return nullptr;
+        for (size_t i = 0; i < array_argument->array_dimensions_symbols.size(); i++)
+            set(array_argument->array_dimensions_symbols[i], static_cast<Parser::ArrayValue*>(array_value)->lengths[i]);
+        set(array_argument->array_argument_symbol, array_value);
     }
 
-    Parser::ExprNode* ConstantPropagation::visit_variable_expr(Parser::VariableExprNode* variable_expr)
+    Parser::CPValue* ConstantPropagation::visit_body(Parser::FnCmd* fn_cmd)
+    {
+        Parser::CPValue* result = nullptr;
+        for (auto& u_stmt : fn_cmd->function_contents)
+        {
+            visit_stmt(u_stmt);
+            if (u_stmt->kind == Parser::RETURN_STMT)
+                result = meet(result, static_cast<Parser::ReturnStmtNode*>(u_stmt.get())->expression->cp);
+        }
+        return result ? result : arena.make<Parser::CPValue>();
+    }
+
+    Parser::ExprNode* ConstantPropagation::visit_inlined_call_expr(Parser::InlinedCallExprNode* inlined_call_expr)
     {
-        if (context[variable_expr->token_s])
-            variable_expr->cp = context[variable_expr->token_s];
+        ASTVisitor::visit_inlined_call_expr(inlined_call_expr);
+        then([inlined_call_expr]
+        {
+            inlined_call_expr->cp = inlined_call_expr->result->cp;
+            return nullptr;
+        });
         return nullptr;
     }
 
+    Parser::CPValue* ConstantPropagation::meet(Parser::CPValue* a, Parser::CPValue* b)
+    {
+        if (!a || a == b)
+            return b;
+        if (!b)
+            return a;
+
+        if (a->type == Parser::CPValue::INT && b->type == Parser::CPValue::INT
+            && static_cast<Parser::IntValue*>(a)->value == static_cast<Parser::IntValue*>(b)->value)
+            return a;
+
+        if (a->type == Parser::CPValue::ARRAY && b->type == Parser::CPValue::ARRAY)
+        {
+            Parser::ArrayValue* a_array = static_cast<Parser::ArrayValue*>(a);
+            Parser::ArrayValue* b_array = static_cast<Parser::ArrayValue*>(b);
+            // Arrays of one type have one rank.
+            std::vector<Parser::CPValue*> lengths;
+            for (size_t i = 0; i < a_array->lengths.size(); i++)
+                lengths.push_back(meet(a_array->lengths[i], b_array->lengths[i]));
+            return arena.make<Parser::ArrayValue>(arena, lengths);
+        }
+
+        return arena.make<Parser::CPValue>();
+    }
 
+    Parser::CPValue* ConstantPropagation::instantiate(const Summary& summary, Parser::CPValue* value, Parser::CallExprNode* call_expr)
+    {
+        // A function calling itself is called before its result is known.
+        if (!value)
+            return arena.make<Parser::CPValue>();
 
+        auto source = summary.sources.find(value);
+        if (source != summary.sources.end())
+        {
+            auto [argument, dimension] = source->second;
+            Parser::CPValue*& passed = call_expr->arguments[argument]->cp;
+            if (dimension == NO_DIMENSION)
+                return passed;
+            return passed->type == Parser::CPValue::ARRAY
+                ? static_cast<Parser::ArrayValue*>(passed)->lengths[dimension] : arena.make<Parser::CPValue>();
+        }
 
+        if (value->type == Parser::CPValue::INT)
+            return value;
+        if (value->type == Parser::CPValue::ARRAY)
+        {
+            std::vector<Parser::CPValue*> lengths;
+            for (auto& length : static_cast<Parser::ArrayValue*>(value)->lengths)
+                lengths.push_back(instantiate(summary, length, call_expr));
+            return arena.make<Parser::ArrayValue>(arena, lengths);
+        }
+        return arena.make<Parser::CPValue>();
+    }
 
+    std::string ConstantPropagation::describe(const Summary& summary, Parser::CPValue* value) const
+    {
+        auto source = summary.sources.find(value);
+        if (source != summary.sources.end())
+        {
+            auto [argument, dimension] = source->second;
+            Parser::ArgumentNode* parameter = static_cast<Parser::VarBindingNode*>(summary.function->arguments[argument].get())->argument.get();
+            if (dimension != NO_DIMENSION)
+                return static_cast<Parser::ArrayArgumentNode*>(parameter)->array_dimensions_names[dimension];
+            Parser::ArrayArgumentNode* array_argument;
+            return tryCast<Parser::ArgumentNode, Parser::ArrayArgumentNode>(parameter, array_argument)
+                ? array_argument->array_argument_name : parameter->token_s;
+        }
 
+        if (value->type == Parser::CPValue::INT)
+            return std::to_string(static_cast<Parser::IntValue*>(value)->value);
+        if (value->type == Parser::CPValue::ARRAY)
+        {
+            std::string text;
+            for (auto& length : static_cast<Parser::ArrayValue*>(value)->lengths)
+                text += (text.empty() ? "" : ", ") + describe(summary, length);
+            return "[" + text + "]";
+        }
+        return "?";
+    }
 
     Parser::CmdNode* ConstantPropagation::visit_read_cmd(Parser::ReadCmdNode* read_cmd)
     {
-        std::vector<std::shared_ptr<Parser::CPValue>> lengths = {std::make_shared<Parser::CPValue>(), std::make_shared<Parser::CPValue>()};
+        std::vector<Parser::CPValue*> lengths = {arena.make<Parser::CPValue>(), arena.make<Parser::CPValue>()};
         
         Parser::VarArgumentNode* var_argument;
         if (tryCast<Parser::ArgumentNode, Parser::VarArgumentNode>(read_cmd->readInto.get(), var_argument))
-            context[var_argument->token_s] = std::make_shared<Parser::ArrayValue>(lengths);
+            set(var_argument->symbol, arena.make<Parser::ArrayValue>(arena, lengths));
         else
-        {
-            Parser::ArrayArgumentNode* array_argument = static_cast<Parser::ArrayArgumentNode*>(read_cmd->readInto.get());
-            context[array_argument->array_argument_name] = std::make_shared<Parser::ArrayValue>(lengths);
-        }
+            bind_array(static_cast<Parser::ArrayArgumentNode*>(read_cmd->readInto.get()), arena.make<Parser::ArrayValue>(arena, lengths));
         
         return nullptr;
     }
@@ -536,13 +891,2504 @@ namespace Optimization
         for (auto& u_subexpr : array_expr->array_expressions)
             visit_expr(u_subexpr);
         
-        std::shared_ptr<Parser::IntValue> one_length = std::make_shared<Parser::IntValue>(array_expr->array_expressions.size());
-        std::vector<std::shared_ptr<Parser::CPValue>> array_lengths = {one_length};
-        std::shared_ptr<Parser::ArrayValue> array_value = std::make_shared<Parser::ArrayValue>(array_lengths);
+        Parser::IntValue* one_length = arena.make<Parser::IntValue>(array_expr->array_expressions.size());
+        std::vector<Parser::CPValue*> array_lengths = {one_length};
+        Parser::ArrayValue* array_value = arena.make<Parser::ArrayValue>(arena, array_lengths);
         array_expr->cp = array_value; 
         
         return nullptr;
     }
 #pragma endregion
 
+
+#pragma region ConstantFolding
+
+    static bool is_literal(const Parser::ExprNode* expr)
+    {
+        switch (expr->kind)
+        {
+            case Parser::INT_EXPR:
+            case Parser::FLOAT_EXPR:
+            case Parser::TRUE_EXPR:
+            case Parser::FALSE_EXPR:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    static long int_value(const Parser::ExprNode* literal) {return static_cast<const Parser::IntExprNode*>(literal)->value;}
+    static double float_value(const Parser::ExprNode* literal) {return static_cast<const Parser::FloatExprNode*>(literal)->value;}
+    static bool bool_value(const Parser::ExprNode* literal) {return literal->kind == Parser::TRUE_EXPR;}
+
+    // Integer arithmetic wraps around, as it does in the generated code.
+    static long wrap(unsigned long value) {return (long) value;}
+
+    ConstantFolding::ConstantFolding(Parser::Arena& _arena) : arena(_arena) {}
+
+    // An empty node of type T, at the position of original and of its type, to take its place.
+    template<class T>
+    static T* make_node(Parser::Arena& arena, const Parser::ExprNode* original)
+    {
+        T* node = new (arena) T(arena);
+        node->line = original->line;
+        node->pos = original->pos;
+        node->resolvedType = original->resolvedType;
+        return node;
+    }
+
+    // The name of a variable or function the optimizer makes: prefix followed by number. Not a name
+    // a program can use, since prefix starts with a '$', which no name has.
+    static std::string made_name(const std::string& prefix, size_t number)
+    {
+        return prefix + std::to_string(number);
+    }
+
+    template<class T>
+    T* ConstantFolding::make_literal(const Parser::ExprNode* original)
+    {
+        T* literal = make_node<T>(arena, original);
+        literal->cp = arena.make<Parser::CPValue>();
+        return literal;
+    }
+
+    Parser::ExprNode* ConstantFolding::make_int(long value, const Parser::ExprNode* original)
+    {
+        Parser::IntExprNode* literal = make_literal<Parser::IntExprNode>(original);
+        literal->value = value;
+        literal->token_s = std::to_string(value);
+        literal->cp = arena.make<Parser::IntValue>(value);
+        return literal;
+    }
+
+    Parser::ExprNode* ConstantFolding::make_float(double value, const Parser::ExprNode* original)
+    {
+        // Constants are written out as numbers, which cannot be infinite or NaN.
+        if (!std::isfinite(value))
+            return nullptr;
+
+        Parser::FloatExprNode* literal = make_literal<Parser::FloatExprNode>(original);
+        literal->value = value;
+        literal->token_s = std::to_string(value);
+        return literal;
+    }
+
+    Parser::ExprNode* ConstantFolding::make_bool(bool value, const Parser::ExprNode* original)
+    {
+        if (value)
+        {
+            Parser::TrueExprNode* literal = make_literal<Parser::TrueExprNode>(original);
+            literal->value = true;
+            literal->token_s = "true";
+            return literal;
+        }
+
+        Parser::FalseExprNode* literal = make_literal<Parser::FalseExprNode>(original);
+        literal->value = false;
+        literal->token_s = "false";
+        return literal;
+    }
+
+    void ConstantFolding::bind(Parser::LValue* lvalue, Parser::ExprNode* expression)
+    {
+        Parser::ArgumentLValue* arg_lvalue;
+        Parser::VarArgumentNode* var_argument;
+        if (is_literal(expression) && tryCast<Parser::LValue, Parser::ArgumentLValue>(lvalue, arg_lvalue)
+            && tryCast<Parser::ArgumentNode, Parser::VarArgumentNode>(arg_lvalue->argument.get(), var_argument))
+        {
+            constants[var_argument->symbol] = expression;
+            bound.push_back(var_argument->symbol);
+        }
+    }
+
+    Parser::CmdNode* ConstantFolding::visit_let_cmd(Parser::LetCmdNode* let_cmd)
+    {
+        visit_expr(let_cmd->expression);
+        bind(let_cmd->lvalue.get(), let_cmd->expression.get());
+        return nullptr;
+    }
+
+    Parser::CmdNode* ConstantFolding::visit_fn_cmd(Parser::FnCmd* fn_cmd)
+    {
+        size_t outer_bound = bound.size();
+        ASTVisitor::visit_fn_cmd(fn_cmd);
+
+        // The function's variables go out of scope with it.
+        while (bound.size() > outer_bound)
+        {
+            constants.erase(bound.back());
+            bound.pop_back();
+        }
+        return nullptr;
+    }
+
+    Parser::StmtNode* ConstantFolding::visit_let_stmt(Parser::LetStmtNode* let_stmt)
+    {
+        visit_expr(let_stmt->variable_expression);
+        then([this, let_stmt]
+        {
+            bind(let_stmt->set_variable_name.get(), let_stmt->variable_expression.get());
+            return nullptr;
+        });
+        return nullptr;
+    }
+
+    Parser::ExprNode* ConstantFolding::visit_variable_expr(Parser::VariableExprNode* variable_expr)
+    {
+        auto found = constants.find(variable_expr->symbol);
+        if (found == constants.end())
+            return nullptr;
+
+        const Parser::ExprNode* literal = found->second;
+        switch (literal->kind)
+        {
+            case Parser::INT_EXPR:
+                return make_int(int_value(literal), variable_expr);
+            case Parser::FLOAT_EXPR:
+                return make_float(float_value(literal), variable_expr);
+            default:
+                return make_bool(bool_value(literal), variable_expr);
+        }
+    }
+
+    Parser::ExprNode* ConstantFolding::visit_tuple_index_expr(Parser::TupleIndexExprNode* tuple_index_expr)
+    {
+        ASTVisitor::visit_tuple_index_expr(tuple_index_expr);
+        then([tuple_index_expr]() -> Parser::ExprNode*
+        {
+            // Only when dropping the other elements cannot drop a runtime error.
+            if (tuple_index_expr->tuple_expression->kind != Parser::TUPLE_LITERAL_EXPR)
+                return nullptr;
+            Parser::TupleLiteralExprNode* tuple = static_cast<Parser::TupleLiteralExprNode*>(tuple_index_expr->tuple_expression.get());
+            for (auto& u_element : tuple->tuple_expressions)
+                if (!is_literal(u_element.get()))
+                    return nullptr;
+
+            return tuple->tuple_expressions[tuple_index_expr->tuple_index].release();
+        });
+        return nullptr;
+    }
+
+    Parser::ExprNode* ConstantFolding::visit_unop_expr(Parser::UnopExprNode* unop_expr)
+    {
+        ASTVisitor::visit_unop_expr(unop_expr);
+        then([this, unop_expr]() -> Parser::ExprNode*
+        {
+            const Parser::ExprNode* operand = unop_expr->expression.get();
+            switch (operand->kind)
+            {
+                case Parser::INT_EXPR:
+                    return make_int(wrap(0 - (unsigned long) int_value(operand)), unop_expr);
+                // Negation subtracts from zero, so the negation of 0.0 is 0.0.
+                case Parser::FLOAT_EXPR:
+                    return make_float(0.0 - float_value(operand), unop_expr);
+                case Parser::TRUE_EXPR:
+                case Parser::FALSE_EXPR:
+                    return make_bool(!bool_value(operand), unop_expr);
+                default:
+                    return nullptr;
+            }
+            return nullptr;
+        });
+        return nullptr;
+    }
+
+    Parser::ExprNode* ConstantFolding::visit_binop_expr(Parser::BinopExprNode* binop_expr)
+    {
+        ASTVisitor::visit_binop_expr(binop_expr);
+        then([this, binop_expr]() -> Parser::ExprNode*
+        {
+            const Parser::ExprNode* lhs = binop_expr->lhs.get();
+            const Parser::ExprNode* rhs = binop_expr->rhs.get();
+            Parser::BinopExprNode::BinopType operation = binop_expr->operation;
+
+            if (operation == Parser::BinopExprNode::AND || operation == Parser::BinopExprNode::OR)
+            {
+                // The value of the left operand that decides the result without the right one.
+                bool deciding = operation == Parser::BinopExprNode::OR;
+
+                if (is_literal(lhs))
+                    return bool_value(lhs) == deciding ? make_bool(deciding, binop_expr) : binop_expr->rhs.release();
+                // The left operand is still evaluated, so it may only be dropped from the right.
+                if (is_literal(rhs) && bool_value(rhs) != deciding)
+                    return binop_expr->lhs.release();
+                return nullptr;
+            }
+
+            if (!is_literal(lhs) || !is_literal(rhs))
+                return nullptr;
+
+            switch (lhs->kind)
+            {
+                case Parser::INT_EXPR:
+                {
+                    long a = int_value(lhs);
+                    long b = int_value(rhs);
+                    switch (operation)
+                    {
+                        case Parser::BinopExprNode::PLUS: return make_int(wrap((unsigned long) a + (unsigned long) b), binop_expr);
+                        case Parser::BinopExprNode::MINUS: return make_int(wrap((unsigned long) a - (unsigned long) b), binop_expr);
+                        case Parser::BinopExprNode::TIMES: return make_int(wrap((unsigned long) a * (unsigned long) b), binop_expr);
+                        // Division by zero fails, and LONG_MIN / -1 traps.
+                        case Parser::BinopExprNode::DIVIDE: return (b == 0 || (a == LONG_MIN && b == -1)) ? nullptr : make_int(a / b, binop_expr);
+                        case Parser::BinopExprNode::MOD: return (b == 0 || (a == LONG_MIN && b == -1)) ? nullptr : make_int(a % b, binop_expr);
+                        case Parser::BinopExprNode::LESS_THAN: return make_bool(a < b, binop_expr);
+                        case Parser::BinopExprNode::GREATER_THAN: return make_bool(a > b, binop_expr);
+                        case Parser::BinopExprNode::EQUALS: return make_bool(a == b, binop_expr);
+                        case Parser::BinopExprNode::NOT_EQUALS: return make_bool(a != b, binop_expr);
+                        case Parser::BinopExprNode::LESS_THAN_OR_EQUALS: return make_bool(a <= b, binop_expr);
+                        case Parser::BinopExprNode::GREATER_THAN_OR_EQUALS: return make_bool(a >= b, binop_expr);
+                        default: return nullptr;
+                    }
+                }
+                case Parser::FLOAT_EXPR:
+                {
+                    double a = float_value(lhs);
+                    double b = float_value(rhs);
+                    switch (operation)
+                    {
+                        case Parser::BinopExprNode::PLUS: return make_float(a + b, binop_expr);
+                        case Parser::BinopExprNode::MINUS: return make_float(a - b, binop_expr);
+                        case Parser::BinopExprNode::TIMES: return make_float(a * b, binop_expr);
+                        case Parser::BinopExprNode::DIVIDE: return make_float(a / b, binop_expr);
+                        case Parser::BinopExprNode::MOD: return make_float(std::fmod(a, b), binop_expr);
+                        case Parser::BinopExprNode::LESS_THAN: return make_bool(a < b, binop_expr);
+                        case Parser::BinopExprNode::GREATER_THAN: return make_bool(a > b, binop_expr);
+                        case Parser::BinopExprNode::EQUALS: return make_bool(a == b, binop_expr);
+                        case Parser::BinopExprNode::NOT_EQUALS: return make_bool(a != b, binop_expr);
+                        case Parser::BinopExprNode::LESS_THAN_OR_EQUALS: return make_bool(a <= b, binop_expr);
+                        case Parser::BinopExprNode::GREATER_THAN_OR_EQUALS: return make_bool(a >= b, binop_expr);
+                        default: return nullptr;
+                    }
+                }
+                default:
+                {
+                    bool a = bool_value(lhs);
+                    bool b = bool_value(rhs);
+                    switch (operation)
+                    {
+                        case Parser::BinopExprNode::EQUALS: return make_bool(a == b, binop_expr);
+                        case Parser::BinopExprNode::NOT_EQUALS: return make_bool(a != b, binop_expr);
+                        default: return nullptr;
+                    }
+                }
+            }
+            return nullptr;
+        });
+        return nullptr;
+    }
+
+    Parser::ExprNode* ConstantFolding::visit_if_expr(Parser::IfExprNode* if_expr)
+    {
+        ASTVisitor::visit_if_expr(if_expr);
+        then([if_expr]() -> Parser::ExprNode*
+        {
+            // Only the branch taken is ever evaluated.
+            if (!is_literal(if_expr->condition.get()))
+                return nullptr;
+            return bool_value(if_expr->condition.get()) ? if_expr->then_expr.release() : if_expr->else_expr.release();
+        });
+        return nullptr;
+    }
+#pragma endregion
+
+
+#pragma region FailureAnalysis
+
+    // Integer division fails by zero and traps on LONG_MIN / -1, unless the divisor rules both out.
+    static bool division_can_fail(const Parser::BinopExprNode* binop_expr)
+    {
+        bool divides = binop_expr->operation == Parser::BinopExprNode::DIVIDE || binop_expr->operation == Parser::BinopExprNode::MOD;
+        if (!divides || binop_expr->resolvedType->type_name != Typechecker::INT)
+            return false;
+
+        const Parser::ExprNode* divisor = binop_expr->rhs.get();
+        return divisor->kind != Parser::INT_EXPR || int_value(divisor) == 0 || int_value(divisor) == -1;
+    }
+
+    // Bounds must be positive, and the size of an array must not overflow. Both are only known for
+    // literal bounds, whose product is kept far enough from overflowing that the size of any
+    // element cannot make it.
+    static bool bounds_can_fail(const Parser::LoopExprNode* loop_expr)
+    {
+        unsigned long elements = 1;
+        for (auto& u_bound : loop_expr->bounds)
+        {
+            const Parser::ExprNode* bound = u_bound.second.get();
+            if (bound->kind != Parser::INT_EXPR || int_value(bound) <= 0 || int_value(bound) > UINT_MAX / elements)
+                return true;
+            elements *= int_value(bound);
+        }
+        return false;
+    }
+
+    FailureAnalysis::FailureAnalysis()
+    {
+        // None of the runtime's functions can fail.
+        for (const char* name : {"sqrt", "exp", "sin", "cos", "tan", "asin", "acos", "atan", "log", "pow", "atan2", "to_int", "to_float"})
+            safe_functions.insert(Lexer::intern(name));
+    }
+
+    bool FailureAnalysis::can_fail(const Parser::ExprNode* expr) const
+    {
+        switch (expr->kind)
+        {
+            case Parser::ARRAY_INDEX_EXPR:
+                // Indices are bounds checked.
+                return true;
+            case Parser::CALL_EXPR:
+                return !safe_functions.count(static_cast<const Parser::CallExprNode*>(expr)->function_symbol);
+            case Parser::BINOP_EXPR:
+                return division_can_fail(static_cast<const Parser::BinopExprNode*>(expr));
+            case Parser::ARRAY_LOOP_EXPR:
+            case Parser::SUM_LOOP_EXPR:
+                return bounds_can_fail(static_cast<const Parser::LoopExprNode*>(expr));
+            case Parser::INLINED_CALL_EXPR:
+                for (auto& u_stmt : static_cast<const Parser::InlinedCallExprNode*>(expr)->statements)
+                    if (u_stmt->kind != Parser::LET_STMT)
+                        return true;
+                return false;
+            default:
+                return false;
+        }
+    }
+
+    void FailureAnalysis::add_function(const Parser::FnCmd* fn_cmd, bool expressions_can_fail)
+    {
+        if (expressions_can_fail)
+            return;
+        for (auto& u_stmt : fn_cmd->function_contents)
+            if (u_stmt->kind != Parser::LET_STMT && u_stmt->kind != Parser::RETURN_STMT)
+                return;
+        safe_functions.insert(fn_cmd->function_symbol);
+    }
+#pragma endregion
+
+
+#pragma region DeadLetElimination
+
+    static void bound_variables(Parser::ArgumentNode* argument, std::vector<Lexer::Symbol>& variables)
+    {
+        Parser::ArrayArgumentNode* array_argument;
+        if (tryCast<Parser::ArgumentNode, Parser::ArrayArgumentNode>(argument, array_argument))
+        {
+            variables.push_back(array_argument->array_argument_symbol);
+            for (Lexer::Symbol dimension : array_argument->array_dimensions_symbols)
+                variables.push_back(dimension);
+        }
+        else
+            variables.push_back(argument->symbol);
+    }
+
+    // The lvalues inside tuples are taken from a list rather than by recursion, last first.
+    static void bound_variables(Parser::LValue* root, std::vector<Lexer::Symbol>& variables)
+    {
+        std::vector<Parser::LValue*> lvalues = {root};
+        while (!lvalues.empty())
+        {
+            Parser::LValue* lvalue = lvalues.back();
+            lvalues.pop_back();
+
+            Parser::ArgumentLValue* arg_lvalue;
+            if (tryCast<Parser::LValue, Parser::ArgumentLValue>(lvalue, arg_lvalue))
+                bound_variables(arg_lvalue->argument.get(), variables);
+            else
+            {
+                Parser::TupleLValueNode* tuple_lvalue = static_cast<Parser::TupleLValueNode*>(lvalue);
+                for (size_t i = tuple_lvalue->lvalues.size(); i > 0; i--)
+                    lvalues.push_back(tuple_lvalue->lvalues[i - 1].get());
+            }
+        }
+    }
+
+    static void bound_variables(Parser::BindingNode* root, std::vector<Lexer::Symbol>& variables)
+    {
+        std::vector<Parser::BindingNode*> bindings = {root};
+        while (!bindings.empty())
+        {
+            Parser::BindingNode* binding = bindings.back();
+            bindings.pop_back();
+
+            Parser::VarBindingNode* var_binding;
+            if (tryCast<Parser::BindingNode, Parser::VarBindingNode>(binding, var_binding))
+                bound_variables(var_binding->argument.get(), variables);
+            else
+            {
+                Parser::TupleBindingNode* tuple_binding = static_cast<Parser::TupleBindingNode*>(binding);
+                for (size_t i = tuple_binding->bindings.size(); i > 0; i--)
+                    bindings.push_back(tuple_binding->bindings[i - 1].get());
+            }
+        }
+    }
+
+    static void bound_variables(const Parser::ArenaVector<Parser::NodePtr<Parser::StmtNode>>& stmts, std::vector<Lexer::Symbol>& variables)
+    {
+        for (auto& u_stmt : stmts)
+            if (u_stmt->kind == Parser::LET_STMT)
+                bound_variables(static_cast<Parser::LetStmtNode*>(u_stmt.get())->set_variable_name.get(), variables);
+    }
+
+    void DeadLetElimination::eliminate(std::vector<Parser::NodePtr<Parser::CmdNode>>& cmds)
+    {
+        // Functions only call the functions defined before them, so one forward pass finds
+        // every safe function before any call to it is analyzed.
+        for (auto& u_cmd : cmds)
+        {
+            Parser::CmdNode* cmd = u_cmd.get();
+            while (cmd->kind == Parser::TIME_CMD)
+                cmd = static_cast<Parser::TimeCmdNode*>(cmd)->command.get();
+
+            Parser::FnCmd* fn_cmd;
+            if (!tryCast<Parser::CmdNode, Parser::FnCmd>(cmd, fn_cmd))
+                continue;
+            bool expressions_can_fail = false;
+            for (auto& u_stmt : fn_cmd->function_contents)
+            {
+                Parser::LetStmtNode* let_stmt;
+                Parser::ReturnStmtNode* return_stmt;
+                if (tryCast<Parser::StmtNode, Parser::LetStmtNode>(u_stmt.get(), let_stmt))
+                    expressions_can_fail = analyze(let_stmt->variable_expression) || expressions_can_fail;
+                else if (tryCast<Parser::StmtNode, Parser::ReturnStmtNode>(u_stmt.get(), return_stmt))
+                    expressions_can_fail = analyze(return_stmt->expression) || expressions_can_fail;
+            }
+            reads.clear();
+            failures.add_function(fn_cmd, expressions_can_fail);
+        }
+
+        // A variable is live if it is read later, so liveness flows backwards.
+        for (size_t i = cmds.size(); i-- > 0;)
+        {
+            Parser::LetCmdNode* let_cmd;
+            if (tryCast<Parser::CmdNode, Parser::LetCmdNode>(cmds[i].get(), let_cmd))
+            {
+                if (!analyze(let_cmd->expression) && is_dead(let_cmd->lvalue.get()))
+                {
+                    cmds.erase(cmds.begin() + i);
+                    continue;
+                }
+            }
+            else
+            {
+                reads.clear();
+                visit_cmd(cmds[i]);
+            }
+            use_reads();
+        }
+    }
+
+    Parser::CmdNode* DeadLetElimination::visit_fn_cmd(Parser::FnCmd* fn_cmd)
+    {
+        // The body is its own scope: only what it reads from outside is used outside.
+        std::unordered_set<Lexer::Symbol> outer_used;
+        std::swap(used, outer_used);
+
+        // Outside a walk, the body is done with before eliminate returns.
+        Parser::ArenaVector<Parser::NodePtr<Parser::StmtNode>>& stmts = fn_cmd->function_contents;
+        eliminate(stmts, stmts.size(), false, [](bool) {});
+        std::vector<Lexer::Symbol> locals;
+        for (auto& u_binding : fn_cmd->arguments)
+            bound_variables(u_binding.get(), locals);
+        bound_variables(stmts, locals);
+        for (Lexer::Symbol local : locals)
+            used.erase(local);
+
+        std::swap(used, outer_used);
+        reads.insert(reads.end(), outer_used.begin(), outer_used.end());
+        return nullptr;
+    }
+
+    void DeadLetElimination::eliminate(Parser::ArenaVector<Parser::NodePtr<Parser::StmtNode>>& stmts, size_t end, bool stmts_may_fail, std::function<void(bool)> done)
+    {
+        if (end == 0)
+        {
+            done(stmts_may_fail);
+            return;
+        }
+
+        size_t i = end - 1;
+        Parser::StmtNode* stmt = stmts[i].get();
+        Parser::NodePtr<Parser::ExprNode>& expression = stmt->kind == Parser::LET_STMT ? static_cast<Parser::LetStmtNode*>(stmt)->variable_expression
+            : stmt->kind == Parser::ASSERT_STMT ? static_cast<Parser::AssertStmtNode*>(stmt)->expression
+            : static_cast<Parser::ReturnStmtNode*>(stmt)->expression;
+        analyze(expression, [this, &stmts, i, stmts_may_fail, done](bool expression_may_fail)
+        {
+            switch (stmts[i]->kind)
+            {
+                case Parser::LET_STMT:
+                {
+                    Parser::LetStmtNode* let_stmt = static_cast<Parser::LetStmtNode*>(stmts[i].get());
+                    if (!expression_may_fail && is_dead(let_stmt->set_variable_name.get()))
+                    {
+                        stmts.erase(stmts.begin() + i);
+                        eliminate(stmts, i, stmts_may_fail, done);
+                        return;
+                    }
+                    break;
+                }
+                case Parser::ASSERT_STMT:
+                    expression_may_fail = true;
+                    break;
+                default:
+                    break;
+            }
+            use_reads();
+            eliminate(stmts, i, stmts_may_fail || expression_may_fail, done);
+        });
+    }
+
+    Parser::ExprNode* DeadLetElimination::visit_variable_expr(Parser::VariableExprNode* variable_expr)
+    {
+        reads.push_back(variable_expr->symbol);
+        return nullptr;
+    }
+
+    void DeadLetElimination::walk_expr(Parser::NodePtr<Parser::ExprNode>& u_expr)
+    {
+        if (failures.can_fail(u_expr.get()))
+            may_fail = true;
+        ASTVisitor::walk_expr(u_expr);
+    }
+
+    Parser::ExprNode* DeadLetElimination::visit_inlined_call_expr(Parser::InlinedCallExprNode* inlined_call_expr)
+    {
+        // The statements are a scope of their own, like a function body, inside the expression.
+        struct Outside
+        {
+            std::vector<Lexer::Symbol> reads;
+            bool may_fail;
+            std::unordered_set<Lexer::Symbol> used;
+        };
+        std::shared_ptr<Outside> outside = std::make_shared<Outside>();
+        std::swap(reads, outside->reads);
+        outside->may_fail = may_fail;
+        std::swap(used, outside->used);
+
+        analyze(inlined_call_expr->result, [this, inlined_call_expr, outside](bool result_may_fail)
+        {
+            use_reads();
+            Parser::ArenaVector<Parser::NodePtr<Parser::StmtNode>>& stmts = inlined_call_expr->statements;
+            eliminate(stmts, stmts.size(), result_may_fail, [this, inlined_call_expr, outside](bool inlined_may_fail)
+            {
+                std::vector<Lexer::Symbol> locals;
+                bound_variables(inlined_call_expr->statements, locals);
+                for (Lexer::Symbol local : locals)
+                    used.erase(local);
+
+                std::swap(used, outside->used);
+                reads = std::move(outside->reads);
+                reads.insert(reads.end(), outside->used.begin(), outside->used.end());
+                may_fail = outside->may_fail || inlined_may_fail;
+            });
+        });
+        return nullptr;
+    }
+
+    void DeadLetElimination::analyze(Parser::NodePtr<Parser::ExprNode>& expression, std::function<void(bool)> done)
+    {
+        reads.clear();
+        may_fail = false;
+        visit_expr(expression);
+        then([this, done]
+        {
+            done(may_fail);
+            return nullptr;
+        });
+    }
+
+    bool DeadLetElimination::analyze(Parser::NodePtr<Parser::ExprNode>& expression)
+    {
+        bool expression_may_fail = false;
+        analyze(expression, [&](bool can_fail) {expression_may_fail = can_fail;});
+        return expression_may_fail;
+    }
+
+    void DeadLetElimination::use_reads()
+    {
+        used.insert(reads.begin(), reads.end());
+        reads.clear();
+    }
+
+    bool DeadLetElimination::is_dead(Parser::LValue* lvalue) const
+    {
+        std::vector<Lexer::Symbol> variables;
+        bound_variables(lvalue, variables);
+        for (Lexer::Symbol variable : variables)
+            if (used.count(variable))
+                return false;
+        return true;
+    }
+#pragma endregion
+
+
+#pragma region CommonSubexpressionElimination
+
+    bool CommonSubexpressionElimination::Value::operator==(const Value& other) const
+    {
+        return kind == other.kind && operation == other.operation && constant == other.constant && lhs == other.lhs && rhs == other.rhs;
+    }
+
+    size_t CommonSubexpressionElimination::ValueHash::operator()(const Value& value) const
+    {
+        size_t hash = value.kind;
+        for (size_t field : {(size_t) value.operation, (size_t) value.constant, value.lhs, value.rhs})
+            hash = hash * 0x9e3779b97f4a7c15 + field;
+        return hash;
+    }
+
+    CommonSubexpressionElimination::CommonSubexpressionElimination(Parser::Arena& _arena) : arena(_arena) {}
+
+    void CommonSubexpressionElimination::eliminate(std::vector<Parser::NodePtr<Parser::CmdNode>>& cmds)
+    {
+        share_values(cmds, "main");
+
+        // Each function shares only its own values.
+        for (auto& u_cmd : cmds)
+        {
+            Parser::FnCmd* fn_cmd;
+            if (tryCast<Parser::CmdNode, Parser::FnCmd>(u_cmd.get(), fn_cmd))
+                share_values(fn_cmd->function_contents, fn_cmd->function_name);
+        }
+    }
+
+    template<class Nodes>
+    void CommonSubexpressionElimination::share_values(Nodes& nodes, const std::string& name)
+    {
+        typedef typename std::remove_reference<decltype(*nodes[0])>::type Node;
+        constexpr bool top_level = std::is_same<Node, Parser::CmdNode>::value;
+
+        // Functions are shared separately, and what is timed stays timed.
+        auto is_shared = [](const Node* node) {return !top_level || (node->kind != Parser::FN_CMD && node->kind != Parser::TIME_CMD);};
+        auto visit = [&](Parser::NodePtr<Node>& u_node)
+        {
+            if constexpr (top_level)
+                visit_cmd(u_node);
+            else
+                visit_stmt(u_node);
+        };
+
+        values.clear();
+        numbers.clear();
+        needed.clear();
+        temporaries.clear();
+        eliminated = 0;
+
+        for (Phase each : {NUMBER, COUNT})
+        {
+            phase = each;
+            for (auto& u_node : nodes)
+                if (is_shared(u_node.get()))
+                    visit(u_node);
+        }
+
+        phase = REWRITE;
+        std::vector<Parser::NodePtr<Node>> rewritten;
+        rewritten.reserve(nodes.size());
+        for (auto& u_node : nodes)
+        {
+            if (is_shared(u_node.get()))
+                visit(u_node);
+
+            for (auto& [temporary, expression] : hoisted)
+            {
+                Parser::VarArgumentNode* argument = new (arena) Parser::VarArgumentNode(arena);
+                argument->symbol = temporary;
+                argument->token_s = Lexer::interner().name(temporary);
+                argument->line = expression->line;
+                argument->pos = expression->pos;
+
+                Parser::ArgumentLValue* lvalue = new (arena) Parser::ArgumentLValue(arena);
+                lvalue->argument.reset(argument);
+                lvalue->token_s = argument->token_s;
+                lvalue->line = argument->line;
+                lvalue->pos = argument->pos;
+
+                Node* let;
+                if constexpr (top_level)
+                {
+                    Parser::LetCmdNode* let_cmd = new (arena) Parser::LetCmdNode(arena);
+                    let_cmd->lvalue.reset(lvalue);
+                    let_cmd->expression.reset(expression);
+                    let = let_cmd;
+                }
+                else
+                {
+                    Parser::LetStmtNode* let_stmt = new (arena) Parser::LetStmtNode(arena);
+                    let_stmt->set_variable_name.reset(lvalue);
+                    let_stmt->variable_expression.reset(expression);
+                    let = let_stmt;
+                }
+                let->token_s = "let " + argument->token_s + " = " + expression->token_s;
+                let->line = argument->line;
+                let->pos = argument->pos;
+                rewritten.emplace_back(let);
+            }
+            hoisted.clear();
+
+            rewritten.push_back(std::move(u_node));
+        }
+        nodes = std::move(rewritten);
+
+        report.push_back({name, eliminated});
+    }
+
+    Parser::ExprNode* CommonSubexpressionElimination::number(const Parser::ExprNode* expr, const Value& value)
+    {
+        auto found = values.emplace(value, values.size()).first;
+        numbers[expr] = found->second;
+        if (needed.size() < values.size())
+        {
+            needed.push_back(0);
+            temporaries.push_back(Lexer::NO_SYMBOL);
+        }
+        return nullptr;
+    }
+
+    size_t CommonSubexpressionElimination::value_of(const Parser::ExprNode* expr) const
+    {
+        auto found = numbers.find(expr);
+        return found == numbers.end() ? NO_VALUE : found->second;
+    }
+
+    template<class F, class D>
+    Parser::ExprNode* CommonSubexpressionElimination::share(Parser::ExprNode* expr, F visit_operands, D detach)
+    {
+        size_t value = value_of(expr);
+
+        if (phase == COUNT)
+        {
+            // Only the first expression of a value is computed, operands and all.
+            if (value == NO_VALUE || needed[value]++ == 0)
+                visit_operands();
+            return nullptr;
+        }
+
+        if (value == NO_VALUE || needed[value] < 2)
+        {
+            visit_operands();
+            return nullptr;
+        }
+
+        if (temporaries[value] == Lexer::NO_SYMBOL)
+        {
+            // Values shared by the operands are bound first, so that this let can read them.
+            visit_operands();
+            then([this, expr, value, detach]
+            {
+                temporaries[value] = Lexer::intern(made_name("$cse", temporary_count++));
+                hoisted.push_back({temporaries[value], detach()});
+                return read(expr, value);
+            });
+            return nullptr;
+        }
+
+        eliminated++;
+        return read(expr, value);
+    }
+
+    Parser::ExprNode* CommonSubexpressionElimination::read(const Parser::ExprNode* expr, size_t value)
+    {
+        Parser::VariableExprNode* variable = make_node<Parser::VariableExprNode>(arena, expr);
+        variable->symbol = temporaries[value];
+        variable->token_s = Lexer::interner().name(variable->symbol);
+        variable->cp = arena.make<Parser::CPValue>();
+        return variable;
+    }
+
+    Parser::ExprNode* CommonSubexpressionElimination::visit_int_expr(Parser::IntExprNode* int_expr)
+    {
+        if (phase != NUMBER)
+            return nullptr;
+        return number(int_expr, {Parser::INT_EXPR, 0, int_expr->value, 0, 0});
+    }
+
+    Parser::ExprNode* CommonSubexpressionElimination::visit_float_expr(Parser::FloatExprNode* float_expr)
+    {
+        if (phase != NUMBER)
+            return nullptr;
+
+        // By representation, so that 0.0 and -0.0 stay apart.
+        long bits;
+        std::memcpy(&bits, &float_expr->value, sizeof(bits));
+        return number(float_expr, {Parser::FLOAT_EXPR, 0, bits, 0, 0});
+    }
+
+    Parser::ExprNode* CommonSubexpressionElimination::visit_true_expr(Parser::TrueExprNode* true_expr)
+    {
+        if (phase != NUMBER)
+            return nullptr;
+        return number(true_expr, {Parser::TRUE_EXPR, 0, 0, 0, 0});
+    }
+
+    Parser::ExprNode* CommonSubexpressionElimination::visit_false_expr(Parser::FalseExprNode* false_expr)
+    {
+        if (phase != NUMBER)
+            return nullptr;
+        return number(false_expr, {Parser::FALSE_EXPR, 0, 0, 0, 0});
+    }
+
+    Parser::ExprNode* CommonSubexpressionElimination::visit_variable_expr(Parser::VariableExprNode* variable_expr)
+    {
+        if (phase != NUMBER)
+            return nullptr;
+
+        // A loop variable has a different value in every iteration.
+        if (loop_variable_counts.count(variable_expr->symbol))
+            return nullptr;
+        return number(variable_expr, {Parser::VARIABLE_EXPR, 0, (long) variable_expr->symbol, 0, 0});
+    }
+
+    Parser::ExprNode* CommonSubexpressionElimination::visit_tuple_index_expr(Parser::TupleIndexExprNode* tuple_index_expr)
+    {
+        if (phase == NUMBER)
+        {
+            ASTVisitor::visit_tuple_index_expr(tuple_index_expr);
+            then([this, tuple_index_expr]() -> Parser::ExprNode*
+            {
+                size_t tuple = value_of(tuple_index_expr->tuple_expression.get());
+                if (tuple == NO_VALUE)
+                    return nullptr;
+                return number(tuple_index_expr, {Parser::TUPLE_INDEX_EXPR, 0, tuple_index_expr->tuple_index, tuple, 0});
+            });
+            return nullptr;
+        }
+
+        return share(tuple_index_expr, [&] {ASTVisitor::visit_tuple_index_expr(tuple_index_expr);}, [this, tuple_index_expr]
+        {
+            Parser::TupleIndexExprNode* detached = make_node<Parser::TupleIndexExprNode>(arena, tuple_index_expr);
+            detached->token_s = tuple_index_expr->token_s;
+            detached->cp = tuple_index_expr->cp;
+            detached->tuple_index = tuple_index_expr->tuple_index;
+            detached->tuple_expression = std::move(tuple_index_expr->tuple_expression);
+            return detached;
+        });
+    }
+
+    Parser::ExprNode* CommonSubexpressionElimination::visit_unop_expr(Parser::UnopExprNode* unop_expr)
+    {
+        if (phase == NUMBER)
+        {
+            ASTVisitor::visit_unop_expr(unop_expr);
+            then([this, unop_expr]() -> Parser::ExprNode*
+            {
+                size_t operand = value_of(unop_expr->expression.get());
+                if (operand == NO_VALUE)
+                    return nullptr;
+                return number(unop_expr, {Parser::UNOP_EXPR, unop_expr->operation, 0, operand, 0});
+            });
+            return nullptr;
+        }
+
+        return share(unop_expr, [&] {ASTVisitor::visit_unop_expr(unop_expr);}, [this, unop_expr]
+        {
+            Parser::UnopExprNode* detached = make_node<Parser::UnopExprNode>(arena, unop_expr);
+            detached->token_s = unop_expr->token_s;
+            detached->cp = unop_expr->cp;
+            detached->operation = unop_expr->operation;
+            detached->expression = std::move(unop_expr->expression);
+            return detached;
+        });
+    }
+
+    Parser::ExprNode* CommonSubexpressionElimination::visit_binop_expr(Parser::BinopExprNode* binop_expr)
+    {
+        if (phase == NUMBER)
+        {
+            ASTVisitor::visit_binop_expr(binop_expr);
+            then([this, binop_expr]() -> Parser::ExprNode*
+            {
+                size_t lhs = value_of(binop_expr->lhs.get());
+                size_t rhs = value_of(binop_expr->rhs.get());
+                if (lhs == NO_VALUE || rhs == NO_VALUE || failures.can_fail(binop_expr))
+                    return nullptr;
+
+                // Operands are pure, so the order of commutative ones does not matter.
+                switch (binop_expr->operation)
+                {
+                    case Parser::BinopExprNode::PLUS:
+                    case Parser::BinopExprNode::TIMES:
+                    case Parser::BinopExprNode::EQUALS:
+                    case Parser::BinopExprNode::NOT_EQUALS:
+                        if (lhs > rhs)
+                            std::swap(lhs, rhs);
+                        break;
+                    default:
+                        break;
+                }
+                return number(binop_expr, {Parser::BINOP_EXPR, binop_expr->operation, 0, lhs, rhs});
+            });
+            return nullptr;
+        }
+
+        return share(binop_expr, [&] {ASTVisitor::visit_binop_expr(binop_expr);}, [this, binop_expr]
+        {
+            Parser::BinopExprNode* detached = make_node<Parser::BinopExprNode>(arena, binop_expr);
+            detached->token_s = binop_expr->token_s;
+            detached->cp = binop_expr->cp;
+            detached->operation = binop_expr->operation;
+            detached->lhs = std::move(binop_expr->lhs);
+            detached->rhs = std::move(binop_expr->rhs);
+            return detached;
+        });
+    }
+
+    Parser::ExprNode* CommonSubexpressionElimination::visit_loop_expr(Parser::LoopExprNode* loop_expr)
+    {
+        // Bounds are computed before the loop variables are bound.
+        for (auto& u_bound : loop_expr->bounds)
+            visit_expr(u_bound.second);
+
+        then([this, loop_expr]
+        {
+            size_t outer_variables = loop_variables.size();
+            loop_variables.insert(loop_variables.end(), loop_expr->bound_symbols.begin(), loop_expr->bound_symbols.end());
+            count_loop_variables(outer_variables);
+            for (auto& invariant : loop_expr->invariants)
+                visit_expr(invariant.expression);
+            visit_expr(loop_expr->loop_expression);
+            then([this, outer_variables]
+            {
+                pop_loop_variables(outer_variables);
+                return nullptr;
+            });
+            return nullptr;
+        });
+        return nullptr;
+    }
+
+    Parser::ExprNode* CommonSubexpressionElimination::visit_inlined_call_expr(Parser::InlinedCallExprNode* inlined_call_expr)
+    {
+        // The variables an inlined call binds do not exist before it, where values are bound.
+        size_t outer_variables = loop_variables.size();
+        for (auto& u_stmt : inlined_call_expr->statements)
+        {
+            Parser::LetStmtNode* let_stmt;
+            if (tryCast<Parser::StmtNode, Parser::LetStmtNode>(u_stmt.get(), let_stmt))
+                bound_variables(let_stmt->set_variable_name.get(), loop_variables);
+        }
+        count_loop_variables(outer_variables);
+        ASTVisitor::visit_inlined_call_expr(inlined_call_expr);
+        then([this, outer_variables]
+        {
+            pop_loop_variables(outer_variables);
+            return nullptr;
+        });
+        return nullptr;
+    }
+
+    void CommonSubexpressionElimination::count_loop_variables(size_t start)
+    {
+        for (size_t i = start; i < loop_variables.size(); i++)
+            loop_variable_counts[loop_variables[i]]++;
+    }
+
+    void CommonSubexpressionElimination::pop_loop_variables(size_t size)
+    {
+        for (size_t i = size; i < loop_variables.size(); i++)
+        {
+            auto found = loop_variable_counts.find(loop_variables[i]);
+            if (--found->second == 0)
+                loop_variable_counts.erase(found);
+        }
+        loop_variables.resize(size);
+    }
+#pragma endregion
+
+
+#pragma region LoopInvariantCodeMotion
+
+    LoopInvariantCodeMotion::LoopInvariantCodeMotion(Parser::Arena& _arena) : arena(_arena) {}
+
+    void LoopInvariantCodeMotion::move_invariants(std::vector<Parser::NodePtr<Parser::CmdNode>>& cmds)
+    {
+        size_t moved_from_main = 0;
+        for (auto& u_cmd : cmds)
+        {
+            // Functions only call the functions defined before them, so each is known to be safe
+            // or not before any call to it is analyzed.
+            pure.clear();
+            moved = 0;
+            for (Phase each : {ANALYZE, MOVE})
+            {
+                phase = each;
+                visit_cmd(u_cmd);
+            }
+            moved_from_main += moved;
+        }
+        report.insert(report.begin(), {"main", moved_from_main});
+    }
+
+    Parser::CmdNode* LoopInvariantCodeMotion::visit_fn_cmd(Parser::FnCmd* fn_cmd)
+    {
+        size_t moved_outside = moved;
+        moved = 0;
+        ASTVisitor::visit_fn_cmd(fn_cmd);
+
+        if (phase == ANALYZE)
+        {
+            bool expressions_can_fail = false;
+            for (auto& u_stmt : fn_cmd->function_contents)
+            {
+                Parser::LetStmtNode* let_stmt;
+                Parser::ReturnStmtNode* return_stmt;
+                if (tryCast<Parser::StmtNode, Parser::LetStmtNode>(u_stmt.get(), let_stmt))
+                    expressions_can_fail = expressions_can_fail || !pure.count(let_stmt->variable_expression.get());
+                else if (tryCast<Parser::StmtNode, Parser::ReturnStmtNode>(u_stmt.get(), return_stmt))
+                    expressions_can_fail = expressions_can_fail || !pure.count(return_stmt->expression.get());
+            }
+            failures.add_function(fn_cmd, expressions_can_fail);
+        }
+        else
+            report.push_back({fn_cmd->function_name, moved});
+
+        moved = moved_outside;
+        return nullptr;
+    }
+
+    void LoopInvariantCodeMotion::walk_expr(Parser::NodePtr<Parser::ExprNode>& u_expr)
+    {
+        if (phase == MOVE && !loops.empty() && !is_literal(u_expr.get()) && u_expr->kind != Parser::VARIABLE_EXPR)
+        {
+            auto found = pure.find(u_expr.get());
+            if (found != pure.end())
+            {
+                // The first position after the loop variables it reads.
+                size_t position = found->second == 0 ? 0 : MAX_POSITIONS - __builtin_clzll(found->second);
+                if (position < loop_variables.size())
+                {
+                    position = computed_at(position);
+                    if (position == moving_to)
+                        position = computed_at(moving_from);
+                    if (position < loop_variables.size())
+                        return move(u_expr, position);
+                }
+            }
+        }
+        ASTVisitor::walk_expr(u_expr);
+    }
+
+    size_t LoopInvariantCodeMotion::owner(size_t position) const
+    {
+        // The first positions of the loops only grow inwards.
+        auto after = std::upper_bound(loops.begin(), loops.end(), position,
+            [](size_t position, const std::pair<Parser::LoopExprNode*, size_t>& loop) {return position < loop.second;});
+        return after - loops.begin() - 1;
+    }
+
+    size_t LoopInvariantCodeMotion::computed_at(size_t position) const
+    {
+        // Nothing is computed between the variables of an inlined call.
+        size_t owner_index = owner(position);
+        auto next = std::lower_bound(real_loops.begin(), real_loops.end(), owner_index);
+        if (next == real_loops.end())
+            return SIZE_MAX;
+        return *next == owner_index ? position : loops[*next].second;
+    }
+
+    void LoopInvariantCodeMotion::push_loop(Parser::LoopExprNode* loop_expr, size_t start)
+    {
+        if (loop_expr)
+            real_loops.push_back(loops.size());
+        loops.push_back({loop_expr, start});
+    }
+
+    void LoopInvariantCodeMotion::pop_loops(size_t size)
+    {
+        while (!real_loops.empty() && real_loops.back() >= size)
+            real_loops.pop_back();
+        loops.resize(size);
+    }
+
+    void LoopInvariantCodeMotion::push_variables(size_t start)
+    {
+        for (size_t i = start; i < loop_variables.size(); i++)
+            positions[loop_variables[i]].push_back(i);
+    }
+
+    void LoopInvariantCodeMotion::pop_variables(size_t size)
+    {
+        for (size_t i = size; i < loop_variables.size(); i++)
+        {
+            auto found = positions.find(loop_variables[i]);
+            found->second.pop_back();
+            if (found->second.empty())
+                positions.erase(found);
+        }
+        loop_variables.resize(size);
+    }
+
+    void LoopInvariantCodeMotion::move(Parser::NodePtr<Parser::ExprNode>& u_expr, size_t position)
+    {
+        // The innermost loop whose first variable is at or before position binds it.
+        size_t owner_index = owner(position);
+        Parser::LoopExprNode* loop = loops[owner_index].first;
+        size_t level = position - loops[owner_index].second;
+
+        // Held until the walk is done with it, as its parts may be replaced.
+        std::shared_ptr<Parser::NodePtr<Parser::ExprNode>> expression = std::make_shared<Parser::NodePtr<Parser::ExprNode>>(std::move(u_expr));
+        Parser::VariableExprNode* variable = make_node<Parser::VariableExprNode>(arena, expression->get());
+        variable->symbol = Lexer::intern(made_name("$licm", invariant_count++));
+        variable->token_s = Lexer::interner().name(variable->symbol);
+        variable->cp = arena.make<Parser::CPValue>();
+        u_expr.reset(variable);
+        moved++;
+
+        // The parts of the invariant that can be computed further out are moved from where it
+        // was, whose loops and positions it keeps.
+        std::pair<size_t, size_t> moving_outside = {moving_to, moving_from};
+        moving_to = position;
+        moving_from = loop_variables.size();
+        ASTVisitor::walk_expr(*expression);
+        then([this, moving_outside, loop, level, variable, expression]
+        {
+            std::tie(moving_to, moving_from) = moving_outside;
+            loop->invariants.push_back({level, variable->symbol, std::move(*expression)});
+            return nullptr;
+        });
+    }
+
+    void LoopInvariantCodeMotion::combine(const Parser::ExprNode* expr, std::initializer_list<const Parser::ExprNode*> operands)
+    {
+        if (failures.can_fail(expr))
+            return;
+        uint64_t reads = 0;
+        for (const Parser::ExprNode* operand : operands)
+        {
+            auto found = pure.find(operand);
+            if (found == pure.end())
+                return;
+            reads |= found->second;
+        }
+        pure[expr] = reads;
+    }
+
+    template<class T>
+    void LoopInvariantCodeMotion::combine_all(const Parser::ExprNode* expr, const Parser::ArenaVector<Parser::NodePtr<T>>& operands)
+    {
+        if (failures.can_fail(expr))
+            return;
+        uint64_t reads = 0;
+        for (auto& u_operand : operands)
+        {
+            auto found = pure.find(u_operand.get());
+            if (found == pure.end())
+                return;
+            reads |= found->second;
+        }
+        pure[expr] = reads;
+    }
+
+    Parser::ExprNode* LoopInvariantCodeMotion::visit_int_expr(Parser::IntExprNode* int_expr)
+    {
+        if (phase == ANALYZE)
+            pure[int_expr] = 0;
+        return nullptr;
+    }
+
+    Parser::ExprNode* LoopInvariantCodeMotion::visit_float_expr(Parser::FloatExprNode* float_expr)
+    {
+        if (phase == ANALYZE)
+            pure[float_expr] = 0;
+        return nullptr;
+    }
+
+    Parser::ExprNode* LoopInvariantCodeMotion::visit_true_expr(Parser::TrueExprNode* true_expr)
+    {
+        if (phase == ANALYZE)
+            pure[true_expr] = 0;
+        return nullptr;
+    }
+
+    Parser::ExprNode* LoopInvariantCodeMotion::visit_false_expr(Parser::FalseExprNode* false_expr)
+    {
+        if (phase == ANALYZE)
+            pure[false_expr] = 0;
+        return nullptr;
+    }
+
+    Parser::ExprNode* LoopInvariantCodeMotion::visit_variable_expr(Parser::VariableExprNode* variable_expr)
+    {
+        if (phase != ANALYZE)
+            return nullptr;
+
+        // The innermost loop binding the variable, if any, is the one it reads.
+        auto found = positions.find(variable_expr->symbol);
+        if (found == positions.end())
+            pure[variable_expr] = 0;
+        else
+        {
+            size_t position = found->second.back();
+            if (position < MAX_POSITIONS)
+                pure[variable_expr] = (uint64_t) 1 << position;
+        }
+        return nullptr;
+    }
+
+    Parser::ExprNode* LoopInvariantCodeMotion::visit_tuple_expr(Parser::TupleLiteralExprNode* tuple_expr)
+    {
+        ASTVisitor::visit_tuple_expr(tuple_expr);
+        if (phase == ANALYZE)
+            then([this, tuple_expr]
+            {
+                combine_all(tuple_expr, tuple_expr->tuple_expressions);
+                return nullptr;
+            });
+        return nullptr;
+    }
+
+    Parser::ExprNode* LoopInvariantCodeMotion::visit_array_expr(Parser::ArrayLiteralExprNode* array_expr)
+    {
+        ASTVisitor::visit_array_expr(array_expr);
+        if (phase == ANALYZE)
+            then([this, array_expr]
+            {
+                combine_all(array_expr, array_expr->array_expressions);
+                return nullptr;
+            });
+        return nullptr;
+    }
+
+    Parser::ExprNode* LoopInvariantCodeMotion::visit_tuple_index_expr(Parser::TupleIndexExprNode* tuple_index_expr)
+    {
+        ASTVisitor::visit_tuple_index_expr(tuple_index_expr);
+        if (phase == ANALYZE)
+            then([this, tuple_index_expr]
+            {
+                combine(tuple_index_expr, {tuple_index_expr->tuple_expression.get()});
+                return nullptr;
+            });
+        return nullptr;
+    }
+
+    Parser::ExprNode* LoopInvariantCodeMotion::visit_call_expr(Parser::CallExprNode* call_expr)
+    {
+        ASTVisitor::visit_call_expr(call_expr);
+        if (phase == ANALYZE)
+            then([this, call_expr]
+            {
+                combine_all(call_expr, call_expr->arguments);
+                return nullptr;
+            });
+        return nullptr;
+    }
+
+    Parser::ExprNode* LoopInvariantCodeMotion::visit_unop_expr(Parser::UnopExprNode* unop_expr)
+    {
+        ASTVisitor::visit_unop_expr(unop_expr);
+        if (phase == ANALYZE)
+            then([this, unop_expr]
+            {
+                combine(unop_expr, {unop_expr->expression.get()});
+                return nullptr;
+            });
+        return nullptr;
+    }
+
+    Parser::ExprNode* LoopInvariantCodeMotion::visit_binop_expr(Parser::BinopExprNode* binop_expr)
+    {
+        ASTVisitor::visit_binop_expr(binop_expr);
+        if (phase == ANALYZE)
+            then([this, binop_expr]
+            {
+                combine(binop_expr, {binop_expr->lhs.get(), binop_expr->rhs.get()});
+                return nullptr;
+            });
+        return nullptr;
+    }
+
+    Parser::ExprNode* LoopInvariantCodeMotion::visit_if_expr(Parser::IfExprNode* if_expr)
+    {
+        ASTVisitor::visit_if_expr(if_expr);
+        if (phase == ANALYZE)
+            then([this, if_expr]
+            {
+                combine(if_expr, {if_expr->condition.get(), if_expr->then_expr.get(), if_expr->else_expr.get()});
+                return nullptr;
+            });
+        return nullptr;
+    }
+
+    Parser::ExprNode* LoopInvariantCodeMotion::visit_loop_expr(Parser::LoopExprNode* loop_expr)
+    {
+        // Bounds are computed before the loop variables are bound.
+        for (auto& u_bound : loop_expr->bounds)
+            visit_expr(u_bound.second);
+
+        then([this, loop_expr]
+        {
+            size_t start = loop_variables.size();
+            push_loop(loop_expr, start);
+            loop_variables.insert(loop_variables.end(), loop_expr->bound_symbols.begin(), loop_expr->bound_symbols.end());
+            push_variables(start);
+            visit_expr(loop_expr->loop_expression);
+            then([this, loop_expr, start]
+            {
+                pop_variables(start);
+                pop_loops(loops.size() - 1);
+
+                if (phase == ANALYZE && !failures.can_fail(loop_expr))
+                {
+                    auto found = pure.find(loop_expr->loop_expression.get());
+                    if (found == pure.end())
+                        return nullptr;
+
+                    // Its bounds are literals, and reading its own variables does not count outside it.
+                    uint64_t outer = start >= MAX_POSITIONS ? ~(uint64_t) 0 : ((uint64_t) 1 << start) - 1;
+                    pure[loop_expr] = found->second & outer;
+                }
+                return nullptr;
+            });
+            return nullptr;
+        });
+        return nullptr;
+    }
+
+    Parser::ExprNode* LoopInvariantCodeMotion::visit_inlined_call_expr(Parser::InlinedCallExprNode* inlined_call_expr)
+    {
+        size_t start = loop_variables.size();
+        push_loop(nullptr, start);
+        for (auto& u_stmt : inlined_call_expr->statements)
+        {
+            Parser::LetStmtNode* let_stmt;
+            if (tryCast<Parser::StmtNode, Parser::LetStmtNode>(u_stmt.get(), let_stmt))
+                bound_variables(let_stmt->set_variable_name.get(), loop_variables);
+        }
+        push_variables(start);
+        ASTVisitor::visit_inlined_call_expr(inlined_call_expr);
+        then([this, inlined_call_expr, start]
+        {
+            pop_variables(start);
+            pop_loops(loops.size() - 1);
+
+            if (phase == ANALYZE && !failures.can_fail(inlined_call_expr))
+            {
+                // Reading its own variables does not count outside it.
+                std::vector<const Parser::ExprNode*> operands = {inlined_call_expr->result.get()};
+                for (auto& u_stmt : inlined_call_expr->statements)
+                    operands.push_back(static_cast<Parser::LetStmtNode*>(u_stmt.get())->variable_expression.get());
+
+                uint64_t reads = 0;
+                for (const Parser::ExprNode* operand : operands)
+                {
+                    auto found = pure.find(operand);
+                    if (found == pure.end())
+                        return nullptr;
+                    reads |= found->second;
+                }
+                uint64_t outer = start >= MAX_POSITIONS ? ~(uint64_t) 0 : ((uint64_t) 1 << start) - 1;
+                pure[inlined_call_expr] = reads & outer;
+            }
+            return nullptr;
+        });
+        return nullptr;
+    }
+#pragma endregion
+
+
+#pragma region BoundsCheckElimination
+
+    void BoundsCheckElimination::eliminate(std::vector<Parser::NodePtr<Parser::CmdNode>>& cmds)
+    {
+        removed = 0;
+        kept = 0;
+        visit_all_cmds(cmds);
+        report.insert(report.begin(), {"main", removed, kept});
+    }
+
+    Parser::CmdNode* BoundsCheckElimination::visit_let_cmd(Parser::LetCmdNode* let_cmd)
+    {
+        visit_expr(let_cmd->expression);
+        bind(let_cmd->lvalue.get(), let_cmd->expression.get());
+        return nullptr;
+    }
+
+    Parser::CmdNode* BoundsCheckElimination::visit_fn_cmd(Parser::FnCmd* fn_cmd)
+    {
+        size_t removed_outside = removed;
+        size_t kept_outside = kept;
+        removed = 0;
+        kept = 0;
+        // The variables of a function are out of scope after it, where another function may bind
+        // the same names.
+        size_t outside = bound.size();
+        for (auto& u_binding : fn_cmd->arguments)
+            bind_parameter(u_binding.get());
+        ASTVisitor::visit_fn_cmd(fn_cmd);
+        for (size_t i = outside; i < bound.size(); i++)
+            variables.erase(bound[i]);
+        bound.resize(outside);
+
+        report.push_back({fn_cmd->function_name, removed, kept});
+        removed = removed_outside;
+        kept = kept_outside;
+        return nullptr;
+    }
+
+    Parser::CmdNode* BoundsCheckElimination::visit_read_cmd(Parser::ReadCmdNode* read_cmd)
+    {
+        bind_dimensions(read_cmd->readInto.get());
+        return nullptr;
+    }
+
+    Parser::StmtNode* BoundsCheckElimination::visit_let_stmt(Parser::LetStmtNode* let_stmt)
+    {
+        visit_expr(let_stmt->variable_expression);
+        then([this, let_stmt]
+        {
+            bind(let_stmt->set_variable_name.get(), let_stmt->variable_expression.get());
+            return nullptr;
+        });
+        return nullptr;
+    }
+
+    void BoundsCheckElimination::bind(Parser::LValue* root, const Parser::ExprNode* root_expression)
+    {
+        // The lvalues inside tuples are bound from a list rather than by recursion, last first.
+        std::vector<std::pair<Parser::LValue*, const Parser::ExprNode*>> work = {{root, root_expression}};
+        while (!work.empty())
+        {
+            Parser::LValue* lvalue = work.back().first;
+            const Parser::ExprNode* expression = work.back().second;
+            work.pop_back();
+
+            Parser::ArgumentLValue* arg_lvalue;
+            Parser::TupleLValueNode* tuple_lvalue;
+            if (tryCast<Parser::LValue, Parser::ArgumentLValue>(lvalue, arg_lvalue))
+            {
+                if (arg_lvalue->argument->kind == Parser::VAR_ARGUMENT)
+                {
+                    variables[arg_lvalue->argument->symbol] = range_of(expression);
+                    bound.push_back(arg_lvalue->argument->symbol);
+                }
+                else
+                    bind_dimensions(arg_lvalue->argument.get());
+            }
+            else if (tryCast<Parser::LValue, Parser::TupleLValueNode>(lvalue, tuple_lvalue))
+            {
+                const Parser::TupleLiteralExprNode* tuple_expr = expression->kind == Parser::TUPLE_LITERAL_EXPR
+                    ? static_cast<const Parser::TupleLiteralExprNode*>(expression) : nullptr;
+                if (tuple_expr != nullptr)
+                    for (size_t i = tuple_lvalue->lvalues.size(); i > 0; i--)
+                        work.push_back({tuple_lvalue->lvalues[i - 1].get(), tuple_expr->tuple_expressions[i - 1].get()});
+                else
+                    for (auto& u_lvalue : tuple_lvalue->lvalues)
+                        if (u_lvalue->kind == Parser::ARGUMENT_LVALUE)
+                            bind_dimensions(static_cast<Parser::ArgumentLValue*>(u_lvalue.get())->argument.get());
+            }
+        }
+    }
+
+    void BoundsCheckElimination::bind_dimensions(Parser::ArgumentNode* argument)
+    {
+        // Lengths of arrays are never negative.
+        Parser::ArrayArgumentNode* array_argument;
+        if (tryCast<Parser::ArgumentNode, Parser::ArrayArgumentNode>(argument, array_argument))
+            for (Lexer::Symbol dimension : array_argument->array_dimensions_symbols)
+            {
+                variables[dimension] = {0, LONG_MAX, {}};
+                bound.push_back(dimension);
+            }
+    }
+
+    void BoundsCheckElimination::bind_parameter(Parser::BindingNode* root)
+    {
+        // The bindings inside tuples are taken from a list rather than by recursion, last first.
+        std::vector<Parser::BindingNode*> bindings = {root};
+        while (!bindings.empty())
+        {
+            Parser::BindingNode* binding = bindings.back();
+            bindings.pop_back();
+
+            Parser::VarBindingNode* var_binding;
+            if (tryCast<Parser::BindingNode, Parser::VarBindingNode>(binding, var_binding))
+                bind_dimensions(var_binding->argument.get());
+            else
+            {
+                Parser::TupleBindingNode* tuple_binding = static_cast<Parser::TupleBindingNode*>(binding);
+                for (size_t i = tuple_binding->bindings.size(); i > 0; i--)
+                    bindings.push_back(tuple_binding->bindings[i - 1].get());
+            }
+        }
+    }
+
+    BoundsCheckElimination::Range BoundsCheckElimination::range_of(const Parser::ExprNode* expr) const
+    {
+        auto found = ranges.find(expr);
+        return found != ranges.end() ? found->second : Range();
+    }
+
+    void BoundsCheckElimination::trim(Range& range)
+    {
+        if (range.limits.size() <= MAX_LIMITS)
+            return;
+        std::nth_element(range.limits.begin(), range.limits.begin() + MAX_LIMITS, range.limits.end(),
+            [](const auto& a, const auto& b) {return a.second < b.second;});
+        range.limits.resize(MAX_LIMITS);
+    }
+
+    Parser::ExprNode* BoundsCheckElimination::visit_int_expr(Parser::IntExprNode* int_expr)
+    {
+        ranges[int_expr] = {int_expr->value, int_expr->value, {}};
+        return nullptr;
+    }
+
+    Parser::ExprNode* BoundsCheckElimination::visit_variable_expr(Parser::VariableExprNode* variable_expr)
+    {
+        Range range;
+        auto found = variables.find(variable_expr->symbol);
+        if (found != variables.end())
+            range = found->second;
+
+        // The value of constant propagation is the variable's own.
+        Parser::CPValue* value = variable_expr->cp;
+        if (value->type == Parser::CPValue::INT)
+            range.min = range.max = static_cast<Parser::IntValue*>(value)->value;
+        else
+        {
+            range.limits.push_back({value, 1});
+            trim(range);
+        }
+        ranges[variable_expr] = range;
+        return nullptr;
+    }
+
+    Parser::ExprNode* BoundsCheckElimination::visit_array_index_expr(Parser::ArrayIndexExprNode* array_index_expr)
+    {
+        ASTVisitor::visit_array_index_expr(array_index_expr);
+        then([this, array_index_expr]
+        {
+            size_t rank = array_index_expr->array_indices.size();
+            array_index_expr->nonnegative.assign(rank, false);
+            array_index_expr->in_bounds.assign(rank, false);
+            Parser::CPValue* array_value = array_index_expr->array_expression->cp;
+
+            for (size_t i = 0; i < rank; i++)
+            {
+                Range index = range_of(array_index_expr->array_indices[i].get());
+                array_index_expr->nonnegative[i] = index.min >= 0;
+
+                if (array_value->type == Parser::CPValue::ARRAY)
+                {
+                    Parser::CPValue* length = static_cast<Parser::ArrayValue*>(array_value)->lengths[i];
+                    if (length->type == Parser::CPValue::INT)
+                        array_index_expr->in_bounds[i] = index.max < static_cast<Parser::IntValue*>(length)->value;
+                    for (auto [limit, offset] : index.limits)
+                        if (limit == length && offset <= 0)
+                            array_index_expr->in_bounds[i] = true;
+                }
+
+                size_t known = array_index_expr->nonnegative[i] + array_index_expr->in_bounds[i];
+                removed += known;
+                kept += 2 - known;
+            }
+            return nullptr;
+        });
+        return nullptr;
+    }
+
+    Parser::ExprNode* BoundsCheckElimination::visit_unop_expr(Parser::UnopExprNode* unop_expr)
+    {
+        ASTVisitor::visit_unop_expr(unop_expr);
+        then([this, unop_expr]
+        {
+            Range operand = range_of(unop_expr->expression.get());
+            if (unop_expr->operation == Parser::UnopExprNode::NEGATION && operand.min != LONG_MIN)
+                ranges[unop_expr] = {-operand.max, -operand.min, {}};
+            return nullptr;
+        });
+        return nullptr;
+    }
+
+    Parser::ExprNode* BoundsCheckElimination::visit_binop_expr(Parser::BinopExprNode* binop_expr)
+    {
+        ASTVisitor::visit_binop_expr(binop_expr);
+        then([this, binop_expr]
+        {
+            Range lhs = range_of(binop_expr->lhs.get());
+            Range rhs = range_of(binop_expr->rhs.get());
+            // The bounds are computed without overflow; a range past those of a long may wrap.
+            __int128 min, max;
+            Range range;
+            switch (binop_expr->operation)
+            {
+                case Parser::BinopExprNode::PLUS:
+                    min = (__int128) lhs.min + rhs.min;
+                    max = (__int128) lhs.max + rhs.max;
+                    for (auto [limit, offset] : lhs.limits)
+                        if (!__builtin_add_overflow(offset, rhs.max, &offset))
+                            range.limits.push_back({limit, offset});
+                    for (auto [limit, offset] : rhs.limits)
+                        if (!__builtin_add_overflow(offset, lhs.max, &offset))
+                            range.limits.push_back({limit, offset});
+                    break;
+                case Parser::BinopExprNode::MINUS:
+                    min = (__int128) lhs.min - rhs.max;
+                    max = (__int128) lhs.max - rhs.min;
+                    for (auto [limit, offset] : lhs.limits)
+                        if (!__builtin_sub_overflow(offset, rhs.min, &offset))
+                            range.limits.push_back({limit, offset});
+                    break;
+                case Parser::BinopExprNode::TIMES:
+                {
+                    __int128 products[] = {(__int128) lhs.min * rhs.min, (__int128) lhs.min * rhs.max, (__int128) lhs.max * rhs.min, (__int128) lhs.max * rhs.max};
+                    min = *std::min_element(std::begin(products), std::end(products));
+                    max = *std::max_element(std::begin(products), std::end(products));
+                    break;
+                }
+                case Parser::BinopExprNode::DIVIDE:
+                    // A division by zero fails, so a quotient of nonnegative values has a positive
+                    // divisor and is at most the dividend.
+                    if (lhs.min < 0 || rhs.min < 0)
+                        return nullptr;
+                    min = lhs.min / std::max(rhs.max, 1L);
+                    max = lhs.max / std::max(rhs.min, 1L);
+                    range.limits = lhs.limits;
+                    break;
+                case Parser::BinopExprNode::MOD:
+                    // So is a remainder, which is also less than the divisor.
+                    if (lhs.min < 0 || rhs.min < 0)
+                        return nullptr;
+                    min = 0;
+                    max = std::min(lhs.max, std::max(rhs.max, 1L) - 1);
+                    range.limits = lhs.limits;
+                    for (auto [limit, offset] : rhs.limits)
+                        if (!__builtin_sub_overflow(offset, 1, &offset))
+                            range.limits.push_back({limit, offset});
+                    break;
+                default:
+                    return nullptr;
+            }
+
+            if (min < LONG_MIN || max > LONG_MAX)
+                return nullptr;
+            range.min = (long) min;
+            range.max = (long) max;
+            trim(range);
+            ranges[binop_expr] = range;
+            return nullptr;
+        });
+        return nullptr;
+    }
+
+    Parser::ExprNode* BoundsCheckElimination::visit_if_expr(Parser::IfExprNode* if_expr)
+    {
+        ASTVisitor::visit_if_expr(if_expr);
+        then([this, if_expr]
+        {
+            Range then_range = range_of(if_expr->then_expr.get());
+            Range else_range = range_of(if_expr->else_expr.get());
+            Range range = {std::min(then_range.min, else_range.min), std::max(then_range.max, else_range.max), {}};
+            for (auto [limit, offset] : then_range.limits)
+                for (auto [else_limit, else_offset] : else_range.limits)
+                    if (limit == else_limit)
+                        range.limits.push_back({limit, std::max(offset, else_offset)});
+            ranges[if_expr] = range;
+            return nullptr;
+        });
+        return nullptr;
+    }
+
+    Parser::ExprNode* BoundsCheckElimination::visit_loop_expr(Parser::LoopExprNode* loop_expr)
+    {
+        for (size_t i = 0; i < loop_expr->bounds.size(); i++)
+        {
+            visit_expr(loop_expr->bounds[i].second);
+            then([this, loop_expr, i]
+            {
+                // The body only runs for indices from zero up to one less than the bound.
+                Range bound = range_of(loop_expr->bounds[i].second.get());
+                Range index = {0, std::max(bound.max, 1L) - 1, {}};
+                for (auto [limit, offset] : bound.limits)
+                    if (!__builtin_sub_overflow(offset, 1, &offset))
+                        index.limits.push_back({limit, offset});
+                variables[loop_expr->bound_symbols[i]] = index;
+                return nullptr;
+            });
+        }
+        for (auto& invariant : loop_expr->invariants)
+        {
+            visit_expr(invariant.expression);
+            then([this, &invariant]
+            {
+                variables[invariant.symbol] = range_of(invariant.expression.get());
+                return nullptr;
+            });
+        }
+        visit_expr(loop_expr->loop_expression);
+
+        then([this, loop_expr]
+        {
+            for (Lexer::Symbol symbol : loop_expr->bound_symbols)
+                variables.erase(symbol);
+            for (auto& invariant : loop_expr->invariants)
+                variables.erase(invariant.symbol);
+            return nullptr;
+        });
+        return nullptr;
+    }
+
+    Parser::ExprNode* BoundsCheckElimination::visit_inlined_call_expr(Parser::InlinedCallExprNode* inlined_call_expr)
+    {
+        ASTVisitor::visit_inlined_call_expr(inlined_call_expr);
+        then([this, inlined_call_expr]
+        {
+            ranges[inlined_call_expr] = range_of(inlined_call_expr->result.get());
+            return nullptr;
+        });
+        return nullptr;
+    }
+
+#pragma endregion
+
+#pragma region FunctionInlining
+
+    FunctionInlining::FunctionInlining(Parser::Arena& _arena, size_t _size_limit) : size_limit(_size_limit), copier(_arena, true), arena(_arena) {}
+
+    void FunctionInlining::inline_calls(std::vector<Parser::NodePtr<Parser::CmdNode>>& cmds)
+    {
+        // Functions only call the functions defined before them, so each callee is inlined
+        // into, and measured, before any call to it is visited.
+        inlined = 0;
+        visit_all_cmds(cmds);
+        report.insert(report.begin(), {"main", inlined});
+    }
+
+    void FunctionInlining::walk_expr(Parser::NodePtr<Parser::ExprNode>& u_expr)
+    {
+        size++;
+        if (failures.can_fail(u_expr.get()))
+            may_fail = true;
+        ASTVisitor::walk_expr(u_expr);
+    }
+
+    Parser::CmdNode* FunctionInlining::visit_fn_cmd(Parser::FnCmd* fn_cmd)
+    {
+        size_t inlined_outside = inlined;
+        inlined = 0;
+        function = fn_cmd->function_symbol;
+        recursive = false;
+        size = 0;
+        may_fail = false;
+
+        ASTVisitor::visit_fn_cmd(fn_cmd);
+        report.push_back({fn_cmd->function_name, inlined});
+        failures.add_function(fn_cmd, may_fail);
+
+        Parser::ArenaVector<Parser::NodePtr<Parser::StmtNode>>& stmts = fn_cmd->function_contents;
+        bool inlinable = !recursive && size <= size_limit && !stmts.empty() && stmts.back()->kind == Parser::RETURN_STMT;
+        for (size_t i = 0; inlinable && i + 1 < stmts.size(); i++)
+            inlinable = stmts[i]->kind == Parser::LET_STMT || stmts[i]->kind == Parser::ASSERT_STMT;
+        if (inlinable)
+            callees[fn_cmd->function_symbol] = {fn_cmd, size};
+
+        function = Lexer::NO_SYMBOL;
+        inlined = inlined_outside;
+        return nullptr;
+    }
+
+    Parser::ExprNode* FunctionInlining::visit_call_expr(Parser::CallExprNode* call_expr)
+    {
+        struct Arguments
+        {
+            bool may_fail_before;
+            size_t failing = 0;
+        };
+        std::shared_ptr<Arguments> arguments = std::make_shared<Arguments>();
+        arguments->may_fail_before = may_fail;
+        nesting++;
+        for (auto& u_argument : call_expr->arguments)
+        {
+            then([this, &u_argument, arguments]
+            {
+                may_fail = false;
+                visit_expr(u_argument);
+                then([this, arguments]
+                {
+                    arguments->failing += may_fail;
+                    return nullptr;
+                });
+                return nullptr;
+            });
+        }
+
+        then([this, call_expr, arguments]() -> Parser::ExprNode*
+        {
+            nesting--;
+            may_fail = arguments->may_fail_before || arguments->failing > 0;
+
+            if (call_expr->function_symbol == function)
+                recursive = true;
+
+            auto found = callees.find(call_expr->function_symbol);
+            if (found == callees.end() || arguments->failing > 1 || nesting >= MAX_NESTING)
+                return nullptr;
+
+            size += found->second.size;
+            inlined++;
+            return inline_call(call_expr, found->second.fn_cmd);
+        });
+        return nullptr;
+    }
+
+    Parser::InlinedCallExprNode* FunctionInlining::inline_call(Parser::CallExprNode* call_expr, Parser::FnCmd* callee)
+    {
+        Parser::InlinedCallExprNode* inlined_call = make_node<Parser::InlinedCallExprNode>(arena, call_expr);
+        inlined_call->token_s = call_expr->token_s;
+        inlined_call->cp = arena.make<Parser::CPValue>();
+        inlined_call->function_name = call_expr->function_name;
+
+        copier.clear();
+        for (size_t i = 0; i < callee->arguments.size(); i++)
+        {
+            Parser::BindingNode* binding = callee->arguments[i].get();
+
+            Parser::LetStmtNode* let_stmt = new (arena) Parser::LetStmtNode(arena);
+            let_stmt->set_variable_name.reset(copier.copy_binding(binding));
+            let_stmt->variable_expression = std::move(call_expr->arguments[i]);
+            let_stmt->token_s = "let " + binding->token_s + " = " + let_stmt->variable_expression->token_s;
+            let_stmt->line = call_expr->line;
+            let_stmt->pos = call_expr->pos;
+            inlined_call->statements.emplace_back(let_stmt);
+        }
+
+        Parser::ArenaVector<Parser::NodePtr<Parser::StmtNode>>& stmts = callee->function_contents;
+        for (size_t i = 0; i + 1 < stmts.size(); i++)
+            inlined_call->statements.emplace_back(copier.copy_stmt(stmts[i].get()));
+        inlined_call->result.reset(copier.copy_expr(static_cast<Parser::ReturnStmtNode*>(stmts.back().get())->expression.get()));
+        return inlined_call;
+    }
+
+#pragma endregion
+
+#pragma region BodyCopier
+
+    BodyCopier::BodyCopier(Parser::Arena& _arena, bool _rename) : rename(_rename), arena(_arena) {}
+
+    Lexer::Symbol BodyCopier::bind(Lexer::Symbol symbol)
+    {
+        if (!rename)
+            return symbol;
+        Lexer::Symbol new_symbol = Lexer::intern(made_name("$" + std::string(Lexer::interner().name(symbol)) + ".", rename_count++));
+        renamed[symbol] = new_symbol;
+        return new_symbol;
+    }
+
+    Parser::ArgumentNode* BodyCopier::copy_argument(const Parser::ArgumentNode* argument)
+    {
+        Parser::ArgumentNode* copy;
+        const Parser::ArrayArgumentNode* array_argument;
+        if (tryCast<const Parser::ArgumentNode, const Parser::ArrayArgumentNode>(argument, array_argument))
+        {
+            Parser::ArrayArgumentNode* array_copy = new (arena) Parser::ArrayArgumentNode(arena);
+            array_copy->array_argument_symbol = bind(array_argument->array_argument_symbol);
+            array_copy->array_argument_name = Lexer::interner().name(array_copy->array_argument_symbol);
+            for (Lexer::Symbol dimension : array_argument->array_dimensions_symbols)
+            {
+                array_copy->array_dimensions_symbols.push_back(bind(dimension));
+                array_copy->array_dimensions_names.emplace_back(arena, Lexer::interner().name(array_copy->array_dimensions_symbols.back()));
+            }
+            copy = array_copy;
+        }
+        else
+        {
+            copy = new (arena) Parser::VarArgumentNode(arena);
+            copy->symbol = bind(argument->symbol);
+        }
+        copy->token_s = argument->token_s;
+        copy->line = argument->line;
+        copy->pos = argument->pos;
+        return copy;
+    }
+
+    void BodyCopier::add_task(std::function<void()> task)
+    {
+        tasks.push_back(std::move(task));
+        if (copying)
+            return;
+
+        copying = true;
+        while (!tasks.empty())
+        {
+            std::function<void()> next = std::move(tasks.back());
+            tasks.pop_back();
+            size_t added = tasks.size();
+            next();
+            // The stack runs the tasks just added last first, so they are turned around.
+            std::reverse(tasks.begin() + added, tasks.end());
+        }
+        copying = false;
+    }
+
+    Parser::LValue* BodyCopier::copy_binding(const Parser::BindingNode* binding)
+    {
+        Parser::NodePtr<Parser::LValue> copy;
+        copy_binding(copy, binding);
+        return copy.release();
+    }
+
+    Parser::BindingNode* BodyCopier::copy_parameter(const Parser::BindingNode* binding)
+    {
+        Parser::NodePtr<Parser::BindingNode> copy;
+        copy_parameter(copy, binding);
+        return copy.release();
+    }
+
+    Parser::TypeNode* BodyCopier::copy_type(const Parser::TypeNode* type)
+    {
+        Parser::NodePtr<Parser::TypeNode> copy;
+        copy_type(copy, type);
+        return copy.release();
+    }
+
+    Parser::LValue* BodyCopier::copy_lvalue(const Parser::LValue* lvalue)
+    {
+        Parser::NodePtr<Parser::LValue> copy;
+        copy_lvalue(copy, lvalue);
+        return copy.release();
+    }
+
+    Parser::StmtNode* BodyCopier::copy_stmt(const Parser::StmtNode* stmt)
+    {
+        Parser::NodePtr<Parser::StmtNode> copy;
+        copy_stmt(copy, stmt);
+        return copy.release();
+    }
+
+    Parser::ExprNode* BodyCopier::copy_expr(const Parser::ExprNode* expr)
+    {
+        Parser::NodePtr<Parser::ExprNode> copy;
+        copy_expr(copy, expr);
+        return copy.release();
+    }
+
+    void BodyCopier::copy_binding(Parser::NodePtr<Parser::LValue>& into, const Parser::BindingNode* binding)
+    {
+        add_task([this, &into, binding]
+        {
+            const Parser::VarBindingNode* var_binding;
+            if (tryCast<const Parser::BindingNode, const Parser::VarBindingNode>(binding, var_binding))
+            {
+                Parser::ArgumentLValue* lvalue = new (arena) Parser::ArgumentLValue(arena);
+                lvalue->argument.reset(copy_argument(var_binding->argument.get()));
+                lvalue->token_s = var_binding->argument->token_s;
+                lvalue->line = binding->line;
+                lvalue->pos = binding->pos;
+                into.reset(lvalue);
+                return;
+            }
+
+            const Parser::TupleBindingNode* tuple_binding = static_cast<const Parser::TupleBindingNode*>(binding);
+            Parser::TupleLValueNode* lvalue = new (arena) Parser::TupleLValueNode(arena);
+            lvalue->lvalues.resize(tuple_binding->bindings.size());
+            for (size_t i = 0; i < tuple_binding->bindings.size(); i++)
+                copy_binding(lvalue->lvalues[i], tuple_binding->bindings[i].get());
+            lvalue->token_s = binding->token_s;
+            lvalue->line = binding->line;
+            lvalue->pos = binding->pos;
+            into.reset(lvalue);
+        });
+    }
+
+    void BodyCopier::copy_parameter(Parser::NodePtr<Parser::BindingNode>& into, const Parser::BindingNode* binding)
+    {
+        add_task([this, &into, binding]
+        {
+            Parser::BindingNode* copy;
+            const Parser::VarBindingNode* var_binding;
+            if (tryCast<const Parser::BindingNode, const Parser::VarBindingNode>(binding, var_binding))
+            {
+                Parser::VarBindingNode* var_copy = new (arena) Parser::VarBindingNode(arena);
+                var_copy->argument.reset(copy_argument(var_binding->argument.get()));
+                copy_type(var_copy->type, var_binding->type.get());
+                copy = var_copy;
+            }
+            else
+            {
+                const Parser::TupleBindingNode* tuple_binding = static_cast<const Parser::TupleBindingNode*>(binding);
+                Parser::TupleBindingNode* tuple_copy = new (arena) Parser::TupleBindingNode(arena);
+                tuple_copy->bindings.resize(tuple_binding->bindings.size());
+                for (size_t i = 0; i < tuple_binding->bindings.size(); i++)
+                    copy_parameter(tuple_copy->bindings[i], tuple_binding->bindings[i].get());
+                copy = tuple_copy;
+            }
+            copy->token_s = binding->token_s;
+            copy->line = binding->line;
+            copy->pos = binding->pos;
+            into.reset(copy);
+        });
+    }
+
+    void BodyCopier::copy_type(Parser::NodePtr<Parser::TypeNode>& into, const Parser::TypeNode* type)
+    {
+        add_task([this, &into, type]
+        {
+            Parser::TypeNode* copy;
+            switch (type->kind)
+            {
+                case Parser::INT_TYPE:
+                    copy = new (arena) Parser::IntTypeNode(arena);
+                    break;
+                case Parser::BOOL_TYPE:
+                    copy = new (arena) Parser::BoolTypeNode(arena);
+                    break;
+                case Parser::FLOAT_TYPE:
+                    copy = new (arena) Parser::FloatTypeNode(arena);
+                    break;
+                case Parser::VARIABLE_TYPE:
+                    copy = new (arena) Parser::VariableTypeNode(arena);
+                    copy->symbol = type->symbol;
+                    break;
+                case Parser::ARRAY_TYPE:
+                {
+                    const Parser::ArrayTypeNode* array_type = static_cast<const Parser::ArrayTypeNode*>(type);
+                    Parser::ArrayTypeNode* array_copy = new (arena) Parser::ArrayTypeNode(arena);
+                    copy_type(array_copy->array_type, array_type->array_type.get());
+                    array_copy->rank = array_type->rank;
+                    copy = array_copy;
+                    break;
+                }
+                default:
+                {
+                    const Parser::TupleTypeNode* tuple_type = static_cast<const Parser::TupleTypeNode*>(type);
+                    Parser::TupleTypeNode* tuple_copy = new (arena) Parser::TupleTypeNode(arena);
+                    tuple_copy->tuple_types.resize(tuple_type->tuple_types.size());
+                    for (size_t i = 0; i < tuple_type->tuple_types.size(); i++)
+                        copy_type(tuple_copy->tuple_types[i], tuple_type->tuple_types[i].get());
+                    copy = tuple_copy;
+                    break;
+                }
+            }
+            copy->token_s = type->token_s;
+            copy->line = type->line;
+            copy->pos = type->pos;
+            into.reset(copy);
+        });
+    }
+
+    void BodyCopier::copy_lvalue(Parser::NodePtr<Parser::LValue>& into, const Parser::LValue* lvalue)
+    {
+        add_task([this, &into, lvalue]
+        {
+            Parser::LValue* copy;
+            const Parser::ArgumentLValue* arg_lvalue;
+            if (tryCast<const Parser::LValue, const Parser::ArgumentLValue>(lvalue, arg_lvalue))
+            {
+                Parser::ArgumentLValue* arg_copy = new (arena) Parser::ArgumentLValue(arena);
+                arg_copy->argument.reset(copy_argument(arg_lvalue->argument.get()));
+                copy = arg_copy;
+            }
+            else
+            {
+                const Parser::TupleLValueNode* tuple_lvalue = static_cast<const Parser::TupleLValueNode*>(lvalue);
+                Parser::TupleLValueNode* tuple_copy = new (arena) Parser::TupleLValueNode(arena);
+                tuple_copy->lvalues.resize(tuple_lvalue->lvalues.size());
+                for (size_t i = 0; i < tuple_lvalue->lvalues.size(); i++)
+                    copy_lvalue(tuple_copy->lvalues[i], tuple_lvalue->lvalues[i].get());
+                copy = tuple_copy;
+            }
+            copy->token_s = lvalue->token_s;
+            copy->line = lvalue->line;
+            copy->pos = lvalue->pos;
+            into.reset(copy);
+        });
+    }
+
+    void BodyCopier::copy_stmt(Parser::NodePtr<Parser::StmtNode>& into, const Parser::StmtNode* stmt)
+    {
+        add_task([this, &into, stmt]
+        {
+            Parser::StmtNode* copy;
+            const Parser::LetStmtNode* let_stmt;
+            if (tryCast<const Parser::StmtNode, const Parser::LetStmtNode>(stmt, let_stmt))
+            {
+                Parser::LetStmtNode* let_copy = new (arena) Parser::LetStmtNode(arena);
+                // The expression is computed before the variables are bound.
+                copy_expr(let_copy->variable_expression, let_stmt->variable_expression.get());
+                copy_lvalue(let_copy->set_variable_name, let_stmt->set_variable_name.get());
+                copy = let_copy;
+            }
+            else if (stmt->kind == Parser::RETURN_STMT)
+            {
+                Parser::ReturnStmtNode* return_copy = new (arena) Parser::ReturnStmtNode(arena);
+                copy_expr(return_copy->expression, static_cast<const Parser::ReturnStmtNode*>(stmt)->expression.get());
+                copy = return_copy;
+            }
+            else
+            {
+                const Parser::AssertStmtNode* assert_stmt = static_cast<const Parser::AssertStmtNode*>(stmt);
+                Parser::AssertStmtNode* assert_copy = new (arena) Parser::AssertStmtNode(arena);
+                copy_expr(assert_copy->expression, assert_stmt->expression.get());
+                assert_copy->string.reset(new (arena) Parser::StringNode(arena));
+                assert_copy->string->token_s = assert_stmt->string->token_s;
+                assert_copy->string->line = assert_stmt->string->line;
+                assert_copy->string->pos = assert_stmt->string->pos;
+                copy = assert_copy;
+            }
+            copy->token_s = stmt->token_s;
+            copy->line = stmt->line;
+            copy->pos = stmt->pos;
+            into.reset(copy);
+        });
+    }
+
+    void BodyCopier::copy_all(Parser::ArenaVector<Parser::NodePtr<Parser::ExprNode>>& copies, const Parser::ArenaVector<Parser::NodePtr<Parser::ExprNode>>& originals)
+    {
+        copies.resize(originals.size());
+        for (size_t i = 0; i < originals.size(); i++)
+            copy_expr(copies[i], originals[i].get());
+    }
+
+    void BodyCopier::copy_expr(Parser::NodePtr<Parser::ExprNode>& into, const Parser::ExprNode* expr)
+    {
+        add_task([this, &into, expr] {into.reset(copy_node(expr));});
+    }
+
+    Parser::ExprNode* BodyCopier::copy_node(const Parser::ExprNode* expr)
+    {
+
+        Parser::ExprNode* copy;
+        switch (expr->kind)
+        {
+            case Parser::INT_EXPR:
+            {
+                Parser::IntExprNode* int_copy = make_node<Parser::IntExprNode>(arena, expr);
+                int_copy->value = int_value(expr);
+                copy = int_copy;
+                break;
+            }
+            case Parser::FLOAT_EXPR:
+            {
+                Parser::FloatExprNode* float_copy = make_node<Parser::FloatExprNode>(arena, expr);
+                float_copy->value = float_value(expr);
+                copy = float_copy;
+                break;
+            }
+            case Parser::TRUE_EXPR:
+            {
+                Parser::TrueExprNode* true_copy = make_node<Parser::TrueExprNode>(arena, expr);
+                true_copy->value = true;
+                copy = true_copy;
+                break;
+            }
+            case Parser::FALSE_EXPR:
+            {
+                Parser::FalseExprNode* false_copy = make_node<Parser::FalseExprNode>(arena, expr);
+                false_copy->value = false;
+                copy = false_copy;
+                break;
+            }
+            case Parser::VARIABLE_EXPR:
+            {
+                copy = make_node<Parser::VariableExprNode>(arena, expr);
+                auto found = renamed.find(expr->symbol);
+                copy->symbol = found == renamed.end() ? expr->symbol : found->second;
+                copy->token_s = found == renamed.end() ? expr->token_s : std::string(Lexer::interner().name(copy->symbol));
+                copy->cp = arena.make<Parser::CPValue>();
+                return copy;
+            }
+            case Parser::TUPLE_LITERAL_EXPR:
+            {
+                Parser::TupleLiteralExprNode* tuple_copy = make_node<Parser::TupleLiteralExprNode>(arena, expr);
+                copy_all(tuple_copy->tuple_expressions, static_cast<const Parser::TupleLiteralExprNode*>(expr)->tuple_expressions);
+                copy = tuple_copy;
+                break;
+            }
+            case Parser::ARRAY_LITERAL_EXPR:
+            {
+                Parser::ArrayLiteralExprNode* array_copy = make_node<Parser::ArrayLiteralExprNode>(arena, expr);
+                copy_all(array_copy->array_expressions, static_cast<const Parser::ArrayLiteralExprNode*>(expr)->array_expressions);
+                copy = array_copy;
+                break;
+            }
+            case Parser::TUPLE_INDEX_EXPR:
+            {
+                const Parser::TupleIndexExprNode* tuple_index_expr = static_cast<const Parser::TupleIndexExprNode*>(expr);
+                Parser::TupleIndexExprNode* tuple_index_copy = make_node<Parser::TupleIndexExprNode>(arena, expr);
+                copy_expr(tuple_index_copy->tuple_expression, tuple_index_expr->tuple_expression.get());
+                tuple_index_copy->tuple_index = tuple_index_expr->tuple_index;
+                copy = tuple_index_copy;
+                break;
+            }
+            case Parser::ARRAY_INDEX_EXPR:
+            {
+                const Parser::ArrayIndexExprNode* array_index_expr = static_cast<const Parser::ArrayIndexExprNode*>(expr);
+                Parser::ArrayIndexExprNode* array_index_copy = make_node<Parser::ArrayIndexExprNode>(arena, expr);
+                copy_expr(array_index_copy->array_expression, array_index_expr->array_expression.get());
+                copy_all(array_index_copy->array_indices, array_index_expr->array_indices);
+                copy = array_index_copy;
+                break;
+            }
+            case Parser::CALL_EXPR:
+            {
+                const Parser::CallExprNode* call_expr = static_cast<const Parser::CallExprNode*>(expr);
+                Parser::CallExprNode* call_copy = make_node<Parser::CallExprNode>(arena, expr);
+                call_copy->function_name = call_expr->function_name;
+                call_copy->function_symbol = call_expr->function_symbol;
+                copy_all(call_copy->arguments, call_expr->arguments);
+                copy = call_copy;
+                break;
+            }
+            case Parser::UNOP_EXPR:
+            {
+                const Parser::UnopExprNode* unop_expr = static_cast<const Parser::UnopExprNode*>(expr);
+                Parser::UnopExprNode* unop_copy = make_node<Parser::UnopExprNode>(arena, expr);
+                unop_copy->operation = unop_expr->operation;
+                copy_expr(unop_copy->expression, unop_expr->expression.get());
+                copy = unop_copy;
+                break;
+            }
+            case Parser::BINOP_EXPR:
+            {
+                const Parser::BinopExprNode* binop_expr = static_cast<const Parser::BinopExprNode*>(expr);
+                Parser::BinopExprNode* binop_copy = make_node<Parser::BinopExprNode>(arena, expr);
+                binop_copy->operation = binop_expr->operation;
+                copy_expr(binop_copy->lhs, binop_expr->lhs.get());
+                copy_expr(binop_copy->rhs, binop_expr->rhs.get());
+                copy = binop_copy;
+                break;
+            }
+            case Parser::IF_EXPR:
+            {
+                const Parser::IfExprNode* if_expr = static_cast<const Parser::IfExprNode*>(expr);
+                Parser::IfExprNode* if_copy = make_node<Parser::IfExprNode>(arena, expr);
+                copy_expr(if_copy->condition, if_expr->condition.get());
+                copy_expr(if_copy->then_expr, if_expr->then_expr.get());
+                copy_expr(if_copy->else_expr, if_expr->else_expr.get());
+                copy = if_copy;
+                break;
+            }
+            case Parser::ARRAY_LOOP_EXPR:
+            case Parser::SUM_LOOP_EXPR:
+            {
+                const Parser::LoopExprNode* loop_expr = static_cast<const Parser::LoopExprNode*>(expr);
+                Parser::LoopExprNode* loop_copy;
+                if (expr->kind == Parser::ARRAY_LOOP_EXPR)
+                    loop_copy = make_node<Parser::ArrayLoopExprNode>(arena, expr);
+                else
+                    loop_copy = make_node<Parser::SumLoopExprNode>(arena, expr);
+
+                // Bounds are computed before the loop variables are bound. The copies are filled
+                // in later, so the bounds must not move.
+                loop_copy->bounds.reserve(loop_expr->bounds.size());
+                for (auto& u_bound : loop_expr->bounds)
+                {
+                    loop_copy->bounds.emplace_back(Parser::Text(arena), nullptr);
+                    copy_expr(loop_copy->bounds.back().second, u_bound.second.get());
+                }
+                add_task([this, loop_expr, loop_copy]
+                {
+                    for (size_t i = 0; i < loop_copy->bounds.size(); i++)
+                    {
+                        loop_copy->bound_symbols.push_back(bind(loop_expr->bound_symbols[i]));
+                        loop_copy->bounds[i].first = Lexer::interner().name(loop_copy->bound_symbols.back());
+                    }
+                });
+                loop_copy->invariants.resize(loop_expr->invariants.size());
+                for (size_t i = 0; i < loop_expr->invariants.size(); i++)
+                    add_task([this, loop_expr, loop_copy, i]
+                    {
+                        const Parser::LoopExprNode::Invariant& invariant = loop_expr->invariants[i];
+                        loop_copy->invariants[i].level = invariant.level;
+                        loop_copy->invariants[i].symbol = bind(invariant.symbol);
+                        copy_expr(loop_copy->invariants[i].expression, invariant.expression.get());
+                    });
+                copy_expr(loop_copy->loop_expression, loop_expr->loop_expression.get());
+                copy = loop_copy;
+                break;
+            }
+            case Parser::INLINED_CALL_EXPR:
+            {
+                const Parser::InlinedCallExprNode* inlined_call_expr = static_cast<const Parser::InlinedCallExprNode*>(expr);
+                Parser::InlinedCallExprNode* inlined_call_copy = make_node<Parser::InlinedCallExprNode>(arena, expr);
+                inlined_call_copy->function_name = inlined_call_expr->function_name;
+                inlined_call_copy->statements.resize(inlined_call_expr->statements.size());
+                for (size_t i = 0; i < inlined_call_expr->statements.size(); i++)
+                    copy_stmt(inlined_call_copy->statements[i], inlined_call_expr->statements[i].get());
+                copy_expr(inlined_call_copy->result, inlined_call_expr->result.get());
+                copy = inlined_call_copy;
+                break;
+            }
+            default:
+                throw std::logic_error("Cannot copy expression " + expr->token_s + ".");
+        }
+        copy->token_s = expr->token_s;
+        copy->cp = arena.make<Parser::CPValue>();
+        return copy;
+    }
+#pragma endregion
+
+#pragma region FunctionSpecialization
+
+    FunctionSpecialization::FunctionSpecialization(Parser::Arena& _arena, Typechecker::Scope& _scope) : copier(_arena, false), arena(_arena), scope(_scope) {}
+
+    void FunctionSpecialization::specialize(std::vector<Parser::NodePtr<Parser::CmdNode>>& cmds)
+    {
+        // Functions only call the functions defined before them, so a function is copied from
+        // its specialized body, and placing each copy right after it puts it before every call.
+        redirected = 0;
+        visit_all_cmds(cmds);
+        report.insert(report.begin(), {"main", redirected});
+
+        std::vector<Parser::NodePtr<Parser::CmdNode>> specialized;
+        for (auto& u_cmd : cmds)
+        {
+            Parser::CmdNode* cmd = u_cmd.get();
+            while (cmd->kind == Parser::TIME_CMD)
+                cmd = static_cast<Parser::TimeCmdNode*>(cmd)->command.get();
+
+            Parser::FnCmd* fn_cmd;
+            bool is_function = tryCast<Parser::CmdNode, Parser::FnCmd>(cmd, fn_cmd);
+            specialized.push_back(std::move(u_cmd));
+            if (is_function)
+                for (Parser::FnCmd* copy : copies[fn_cmd->function_symbol])
+                    specialized.emplace_back(copy);
+        }
+        cmds = std::move(specialized);
+    }
+
+    Parser::CmdNode* FunctionSpecialization::visit_fn_cmd(Parser::FnCmd* fn_cmd)
+    {
+        size_t redirected_outside = redirected;
+        redirected = 0;
+        ASTVisitor::visit_fn_cmd(fn_cmd);
+        report.push_back({fn_cmd->function_name, redirected});
+        redirected = redirected_outside;
+
+        // Calls to a function from its own body are not redirected.
+        functions[fn_cmd->function_symbol] = fn_cmd;
+        return nullptr;
+    }
+
+    // The text of a literal, exact for floats.
+    static std::string literal_key(const Parser::ExprNode* literal)
+    {
+        if (literal->kind == Parser::INT_EXPR)
+            return std::to_string(int_value(literal));
+        if (literal->kind == Parser::FLOAT_EXPR)
+        {
+            double value = float_value(literal);
+            unsigned long bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return "f" + std::to_string(bits);
+        }
+        return bool_value(literal) ? "true" : "false";
+    }
+
+    Parser::ExprNode* FunctionSpecialization::visit_call_expr(Parser::CallExprNode* call_expr)
+    {
+        ASTVisitor::visit_call_expr(call_expr);
+        then([this, call_expr]
+        {
+            auto found = functions.find(call_expr->function_symbol);
+            if (found == functions.end())
+                return nullptr;
+            Parser::FnCmd* function = found->second;
+
+            // The function, and the literals with the parameters they are passed to, name the copy.
+            std::vector<bool> literal(call_expr->arguments.size(), false);
+            std::string key = call_expr->function_name;
+            for (size_t i = 0; i < call_expr->arguments.size(); i++)
+            {
+                Parser::ExprNode* argument = call_expr->arguments[i].get();
+                if (!is_literal(argument) || function->arguments[i]->kind != Parser::VAR_BINDING)
+                    continue;
+                literal[i] = true;
+                key += " " + std::to_string(i) + "=" + literal_key(argument);
+            }
+            if (std::find(literal.begin(), literal.end(), true) == literal.end())
+                return nullptr;
+
+            auto copied = copy_of.find(key);
+            if (copied == copy_of.end())
+            {
+                std::vector<Parser::FnCmd*>& function_copies = copies[function->function_symbol];
+                if (function_copies.size() == MAX_COPIES)
+                    return nullptr;
+                function_copies.push_back(copy_function(function, call_expr, literal));
+                copied = copy_of.insert({key, function_copies.back()}).first;
+            }
+
+            call_expr->function_name = copied->second->function_name;
+            call_expr->function_symbol = copied->second->function_symbol;
+            std::vector<Parser::NodePtr<Parser::ExprNode>> arguments;
+            for (size_t i = 0; i < call_expr->arguments.size(); i++)
+                if (!literal[i])
+                    arguments.push_back(std::move(call_expr->arguments[i]));
+            call_expr->arguments = std::move(arguments);
+            redirected++;
+            return nullptr;
+        });
+        return nullptr;
+    }
+
+    Parser::FnCmd* FunctionSpecialization::copy_function(Parser::FnCmd* function, Parser::CallExprNode* call_expr, const std::vector<bool>& literal)
+    {
+        Parser::FnCmd* copy = new (arena) Parser::FnCmd(arena);
+        copy->function_name = made_name("$" + function->function_name + "$", copies[function->function_symbol].size());
+        copy->function_symbol = Lexer::intern(copy->function_name);
+        copy->token_s = function->token_s;
+        copy->line = function->line;
+        copy->pos = function->pos;
+        copy->return_type.reset(copier.copy_type(function->return_type.get()));
+
+        Typechecker::NameInfo* info;
+        scope.lookup(function->function_symbol, info);
+        Typechecker::FuncInfo* func_info = static_cast<Typechecker::FuncInfo*>(info);
+        std::vector<std::shared_ptr<Typechecker::ResolvedType>> argument_types;
+
+        for (size_t i = 0; i < function->arguments.size(); i++)
+        {
+            Parser::BindingNode* binding = function->arguments[i].get();
+            if (!literal[i])
+            {
+                copy->arguments.emplace_back(copier.copy_parameter(binding));
+                argument_types.push_back(func_info->arguments[i]);
+                continue;
+            }
+
+            Parser::LetStmtNode* let_stmt = new (arena) Parser::LetStmtNode(arena);
+            let_stmt->set_variable_name.reset(copier.copy_binding(binding));
+            let_stmt->variable_expression.reset(copier.copy_expr(call_expr->arguments[i].get()));
+            let_stmt->token_s = "let " + static_cast<Parser::VarBindingNode*>(binding)->argument->token_s + " = " + let_stmt->variable_expression->token_s;
+            let_stmt->line = function->line;
+            let_stmt->pos = function->pos;
+            copy->function_contents.emplace_back(let_stmt);
+        }
+        for (auto& u_stmt : function->function_contents)
+            copy->function_contents.emplace_back(copier.copy_stmt(u_stmt.get()));
+
+        scope.add(copy->function_symbol, new Typechecker::FuncInfo(func_info->return_type, argument_types));
+        return copy;
+    }
+#pragma endregion
+
+#pragma region DeadFunctionElimination
+
+    void DeadFunctionElimination::eliminate(std::vector<Parser::NodePtr<Parser::CmdNode>>& cmds)
+    {
+        // Functions only call the functions defined before them, so by the time a function is
+        // reached from the last command back, every call to it has been seen.
+        std::vector<Parser::NodePtr<Parser::CmdNode>> kept;
+        for (size_t i = cmds.size(); i-- > 0;)
+        {
+            Parser::FnCmd* fn_cmd;
+            if (tryCast<Parser::CmdNode, Parser::FnCmd>(cmds[i].get(), fn_cmd) && !called.count(fn_cmd->function_symbol))
+            {
+                report.push_back(fn_cmd->function_name);
+                continue;
+            }
+            visit_cmd(cmds[i]);
+            kept.push_back(std::move(cmds[i]));
+        }
+        std::reverse(kept.begin(), kept.end());
+        std::reverse(report.begin(), report.end());
+        cmds = std::move(kept);
+    }
+
+    Parser::ExprNode* DeadFunctionElimination::visit_call_expr(Parser::CallExprNode* call_expr)
+    {
+        called.insert(call_expr->function_symbol);
+        return ASTVisitor::visit_call_expr(call_expr);
+    }
+#pragma endregion
+
 }
\ No newline at end of file
@@ -2,22 +2,40 @@
 #include "../typechecker/typechecker.h"
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
+#include <climits>
+#include <functional>
+#include <tuple>
 
 #ifndef __OPTIMIZATION_H__
 #define __OPTIMIZATION_H__
 
 namespace Optimization
 {
+    // Expressions are walked from an explicit list of tasks rather than by recursion, so that
+    // deeply nested expressions take no more native stack than shallow ones. While a walk runs,
+    // visit_expr and then only add tasks; outside one, they walk what they add before returning.
+    // The tasks a task adds run in the order they were added, before any task added earlier, so
+    // the operands a visitor visits, and the work it does after them with then, are all done
+    // before the walk goes on past the expression being visited.
+    //
+    // Commands are only visited outside a walk, so their visitors may use what visiting an
+    // expression finds as soon as it returns. Statements are also visited inside the walk of an
+    // inlined call, so their visitors do such work with then.
     class ASTVisitor
     {
     public:
-        void visit_all_cmds(std::vector<std::unique_ptr<Parser::CmdNode>>& cmds);
+        void visit_all_cmds(std::vector<Parser::NodePtr<Parser::CmdNode>>& cmds);
     
     protected:
         virtual ~ASTVisitor() {};
+
+        // Does work once the visits and work added before it are done. If work returns an
+        // expression, it replaces the one being visited when work was added.
+        void then(std::function<Parser::ExprNode*()> work);
         
         //cmds
-        void visit_cmd(std::unique_ptr<Parser::CmdNode>&);
+        void visit_cmd(Parser::NodePtr<Parser::CmdNode>&);
         virtual Parser::CmdNode* visit_read_cmd(Parser::ReadCmdNode*);
         virtual Parser::CmdNode* visit_write_cmd(Parser::WriteCmdNode*);
         virtual Parser::CmdNode* visit_type_cmd(Parser::TypeCmdNode*);
@@ -25,17 +43,21 @@ namespace Optimization
         virtual Parser::CmdNode* visit_assert_cmd(Parser::AssertCmdNode*);
         virtual Parser::CmdNode* visit_print_cmd(Parser::PrintCmdNode*);
         virtual Parser::CmdNode* visit_show_cmd(Parser::ShowCmdNode*);
+        // Called before the command timed is visited, which visit_cmd does unless this returns
+        // a command to replace the time command with.
         virtual Parser::CmdNode* visit_time_cmd(Parser::TimeCmdNode*);
         virtual Parser::CmdNode* visit_fn_cmd(Parser::FnCmd*);
 
         //stmts
-        void visit_stmt(std::unique_ptr<Parser::StmtNode>&);
+        void visit_stmt(Parser::NodePtr<Parser::StmtNode>&);
         virtual Parser::StmtNode* visit_let_stmt(Parser::LetStmtNode*);
         virtual Parser::StmtNode* visit_assert_stmt(Parser::AssertStmtNode*);
         virtual Parser::StmtNode* visit_return_stmt(Parser::ReturnStmtNode*);
         
         //exprs
-        void visit_expr(std::unique_ptr<Parser::ExprNode>&);
+        void visit_expr(Parser::NodePtr<Parser::ExprNode>&);
+        // Called as the walk reaches an expression, to visit it by its kind.
+        virtual void walk_expr(Parser::NodePtr<Parser::ExprNode>&);
         virtual Parser::ExprNode* visit_int_expr(Parser::IntExprNode*);
         virtual Parser::ExprNode* visit_float_expr(Parser::FloatExprNode*);
         virtual Parser::ExprNode* visit_true_expr(Parser::TrueExprNode*);
@@ -50,16 +72,70 @@ namespace Optimization
         virtual Parser::ExprNode* visit_binop_expr(Parser::BinopExprNode*);
         virtual Parser::ExprNode* visit_if_expr(Parser::IfExprNode*);
         virtual Parser::ExprNode* visit_loop_expr(Parser::LoopExprNode*);
+        virtual Parser::ExprNode* visit_inlined_call_expr(Parser::InlinedCallExprNode*);
+
+    private:
+        // An expression to walk, or work to do for the expression in slot.
+        struct Task
+        {
+            Parser::NodePtr<Parser::ExprNode>* slot;
+            std::function<Parser::ExprNode*()> work;
+        };
+
+        std::vector<Task> tasks;
+        bool walking = false;
+        // The expression being visited, or null outside a walk.
+        Parser::NodePtr<Parser::ExprNode>* visiting = nullptr;
+
+        void add(Task task);
     };
 
+    // Gives expressions the int values and array lengths known at compile time. Values follow
+    // calls both ways: a function is summarized by the value of its result in terms of its
+    // parameters, which each call instantiates with its arguments, and a parameter is given the
+    // value every call passes to it. Functions are only called after they are defined, so the top
+    // level and the function bodies are visited first to summarize them and find what the top
+    // level passes, then the bodies are visited again from last to first, each callee after all
+    // of its callers.
     class ConstantPropagation : public ASTVisitor
     {
     private:
-        std::unordered_map<std::string, std::shared_ptr<Parser::CPValue>> context;
+        // What is known about a function.
+        struct Summary
+        {
+            Parser::FnCmd* function;
+            // The value of the result. Where it is a parameter, or a length of one, it is
+            // the value of that parameter in parameters, found in sources.
+            Parser::CPValue* result = nullptr;
+            std::vector<Parser::CPValue*> parameters;
+            // The argument, and the dimension or NO_DIMENSION, each parameter value stands for.
+            std::unordered_map<const Parser::CPValue*, std::pair<size_t, size_t>> sources;
+            // The meet of the arguments of the calls seen so far; null before the first call.
+            std::vector<Parser::CPValue*> arguments;
+            bool calls_itself = false;
+        };
+        static constexpr size_t NO_DIMENSION = SIZE_MAX;
+
+        // The value of each variable in scope; null where nothing is known.
+        std::unordered_map<Lexer::Symbol, Parser::CPValue*> context;
+        // The value each binding in context replaced, so that leaving a scope undoes its bindings.
+        std::vector<std::pair<Lexer::Symbol, Parser::CPValue*>> shadowed;
+        std::unordered_map<Lexer::Symbol, Summary> summaries;
+        // The function whose body is being visited, or null at the top level.
+        Summary* current = nullptr;
+        // Whether the calls visited pass the values of their arguments on to their callees.
+        bool record_calls = true;
+        // Where new values are allocated; the arena of the tree being optimized.
+        Parser::Arena& arena;
 
     public:
         virtual ~ConstantPropagation() {};
-        ConstantPropagation();
+        ConstantPropagation(Parser::Arena& _arena);
+
+        // The values known of the parameters and result of each function, as text.
+        std::vector<std::pair<std::string, std::string>> report;
+
+        void propagate(std::vector<Parser::NodePtr<Parser::CmdNode>>& cmds);
 
     protected:
         virtual Parser::ExprNode* visit_int_expr(Parser::IntExprNode*) override;
@@ -67,9 +143,538 @@ namespace Optimization
         virtual Parser::StmtNode* visit_let_stmt(Parser::LetStmtNode*) override;
         virtual Parser::ExprNode* visit_loop_expr(Parser::LoopExprNode*) override;
         virtual Parser::ExprNode* visit_variable_expr(Parser::VariableExprNode*) override;
+        virtual Parser::ExprNode* visit_call_expr(Parser::CallExprNode*) override;
+        virtual Parser::ExprNode* visit_inlined_call_expr(Parser::InlinedCallExprNode*) override;
+        virtual Parser::CmdNode* visit_fn_cmd(Parser::FnCmd*) override;
 
         virtual Parser::CmdNode* visit_read_cmd(Parser::ReadCmdNode*) override;
         virtual Parser::ExprNode* visit_array_expr(Parser::ArrayLiteralExprNode*) override;
+
+    private:
+        void set(Lexer::Symbol symbol, Parser::CPValue* value);
+        // Undoes the bindings made since shadowed had size entries.
+        void restore(size_t size);
+        void bind(Parser::LValue* lvalue, Parser::CPValue* value);
+        // Binds the parameters of the function of summary to values, one per parameter.
+        void bind_parameters(Summary& summary, const std::vector<Parser::CPValue*>& values);
+        void bind_parameter(Parser::BindingNode* binding, Parser::CPValue* value);
+        void bind_array(Parser::ArrayArgumentNode* array_argument, Parser::CPValue* value);
+        // Visits the statements of a function body, returning the value known of its result.
+        Parser::CPValue* visit_body(Parser::FnCmd* fn_cmd);
+        // The value known of both a and b.
+        Parser::CPValue* meet(Parser::CPValue* a, Parser::CPValue* b);
+        // value, with the parameter values of summary replaced by what call_expr passes.
+        Parser::CPValue* instantiate(const Summary& summary, Parser::CPValue* value, Parser::CallExprNode* call_expr);
+        std::string describe(const Summary& summary, Parser::CPValue* value) const;
+    };
+
+    // Replaces expressions whose operands are all literals with the literal they evaluate to, and
+    // variables let-bound to a literal with a copy of it. Values are computed exactly as the
+    // generated code computes them; an expression that fails at runtime (a division by zero, or a
+    // float that is not finite) is left for the runtime to report.
+    class ConstantFolding : public ASTVisitor
+    {
+    private:
+        // The literal each constant variable in scope is bound to.
+        std::unordered_map<Lexer::Symbol, Parser::ExprNode*> constants;
+        // The variables in constants, in the order they were bound.
+        std::vector<Lexer::Symbol> bound;
+        Parser::Arena& arena;
+
+    public:
+        virtual ~ConstantFolding() {};
+        ConstantFolding(Parser::Arena& _arena);
+
+    protected:
+        virtual Parser::CmdNode* visit_let_cmd(Parser::LetCmdNode*) override;
+        virtual Parser::CmdNode* visit_fn_cmd(Parser::FnCmd*) override;
+        virtual Parser::StmtNode* visit_let_stmt(Parser::LetStmtNode*) override;
+        virtual Parser::ExprNode* visit_variable_expr(Parser::VariableExprNode*) override;
+        virtual Parser::ExprNode* visit_tuple_index_expr(Parser::TupleIndexExprNode*) override;
+        virtual Parser::ExprNode* visit_unop_expr(Parser::UnopExprNode*) override;
+        virtual Parser::ExprNode* visit_binop_expr(Parser::BinopExprNode*) override;
+        virtual Parser::ExprNode* visit_if_expr(Parser::IfExprNode*) override;
+
+    private:
+        void bind(Parser::LValue* lvalue, Parser::ExprNode* expression);
+
+        // A literal that takes the place of original.
+        template<class T>
+        T* make_literal(const Parser::ExprNode* original);
+        Parser::ExprNode* make_int(long value, const Parser::ExprNode* original);
+        Parser::ExprNode* make_float(double value, const Parser::ExprNode* original);
+        Parser::ExprNode* make_bool(bool value, const Parser::ExprNode* original);
+    };
+
+    // Which expressions can fail at runtime: an integer division by what may be zero or -1, an
+    // array index, a loop bound that may not be positive, an assert in an inlined call, and a
+    // call to a function in which any of those can. Each pass asks about the expressions it
+    // visits, combining the answers as it walks, and tells it about each function's body in turn;
+    // functions only call those defined before them, so each is known before any call to it.
+    class FailureAnalysis
+    {
+    private:
+        // The functions that return without failing whenever their arguments are evaluated.
+        std::unordered_set<Lexer::Symbol> safe_functions;
+
+    public:
+        FailureAnalysis();
+
+        // Whether expr can fail once its operands are evaluated without failing. The lets and
+        // result of an inlined call are its operands.
+        bool can_fail(const Parser::ExprNode* expr) const;
+        // Records whether fn_cmd can fail, given whether any expression in its body can. Its
+        // statements other than lets and a return can.
+        void add_function(const Parser::FnCmd* fn_cmd, bool expressions_can_fail);
+    };
+
+    // Removes the lets whose variables are never read. Only lets whose expression cannot fail
+    // are removed: expressions have no I/O, so evaluating one that cannot fail (at a division,
+    // an array index, a loop bound or an assertion in a called function) only computes a value.
+    class DeadLetElimination : public ASTVisitor
+    {
+    private:
+        // The variables read after the command or statement being visited.
+        std::unordered_set<Lexer::Symbol> used;
+        // The variables read by the expressions visited since it was last cleared.
+        std::vector<Lexer::Symbol> reads;
+        // Whether any of those expressions can fail.
+        bool may_fail = false;
+        FailureAnalysis failures;
+
+    public:
+        virtual ~DeadLetElimination() {};
+
+        void eliminate(std::vector<Parser::NodePtr<Parser::CmdNode>>& cmds);
+
+    protected:
+        virtual void walk_expr(Parser::NodePtr<Parser::ExprNode>&) override;
+        virtual Parser::CmdNode* visit_fn_cmd(Parser::FnCmd*) override;
+        virtual Parser::ExprNode* visit_variable_expr(Parser::VariableExprNode*) override;
+        virtual Parser::ExprNode* visit_inlined_call_expr(Parser::InlinedCallExprNode*) override;
+
+    private:
+        // Removes the dead lets among the statements of a function body or inlined call before
+        // end, from the last, given what is read after them. Then calls done with whether any
+        // statement from the first on can fail, given whether those from end on can.
+        void eliminate(Parser::ArenaVector<Parser::NodePtr<Parser::StmtNode>>& stmts, size_t end, bool stmts_may_fail, std::function<void(bool)> done);
+        // Visits expression, leaving the variables it reads in reads, then calls done with
+        // whether it can fail.
+        void analyze(Parser::NodePtr<Parser::ExprNode>& expression, std::function<void(bool)> done);
+        // The same outside a walk, where expression is visited before this returns.
+        bool analyze(Parser::NodePtr<Parser::ExprNode>& expression);
+        // Marks the variables in reads as used.
+        void use_reads();
+        // Whether none of the variables lvalue binds are used.
+        bool is_dead(Parser::LValue* lvalue) const;
+    };
+
+    // Computes each pure value that a function, or the top level, needs more than once only once.
+    // Equal expressions are given the same value number; the first expression of a value that is
+    // needed again is bound to a new variable by a let just before its command or statement, and
+    // every expression of the value reads that variable instead. Only operators and tuple indices
+    // that cannot fail and read no loop variable are shared, so a value is the same wherever it is
+    // needed and computing it earlier changes nothing but how long it takes.
+    class CommonSubexpressionElimination : public ASTVisitor
+    {
+    private:
+        static constexpr size_t NO_VALUE = SIZE_MAX;
+
+        // What a value is computed from: the kind and operation of its expressions, their
+        // constant, tuple index or variable, and the values of their operands.
+        struct Value
+        {
+            Parser::NodeKind kind;
+            int operation;
+            long constant;
+            size_t lhs;
+            size_t rhs;
+
+            bool operator==(const Value& other) const;
+        };
+
+        struct ValueHash
+        {
+            size_t operator()(const Value& value) const;
+        };
+
+        // The commands or statements sharing values are visited once to number their expressions,
+        // once to count the expressions each value is needed for, and once to rewrite them.
+        enum Phase {NUMBER, COUNT, REWRITE};
+        Phase phase;
+
+        std::unordered_map<Value, size_t, ValueHash> values;
+        // The value of each numbered expression; other expressions are not shared.
+        std::unordered_map<const Parser::ExprNode*, size_t> numbers;
+        // How many expressions need each value. The expressions inside one that is not
+        // the first of its value are never computed, so they are not counted.
+        std::vector<size_t> needed;
+        // The variable holding each value, once it is bound.
+        std::vector<Lexer::Symbol> temporaries;
+        // The variables bound by the loops and inlined calls around the expression being visited.
+        std::vector<Lexer::Symbol> loop_variables;
+        // How many times each of them is bound there, so that reading one is found at once.
+        std::unordered_map<Lexer::Symbol, size_t> loop_variable_counts;
+        // The values first computed in the command or statement being rewritten, in the order
+        // their lets must come in.
+        std::vector<std::pair<Lexer::Symbol, Parser::ExprNode*>> hoisted;
+        size_t eliminated;
+        // The number of variables introduced so far, which names the next one.
+        size_t temporary_count = 0;
+        FailureAnalysis failures;
+        Parser::Arena& arena;
+
+    public:
+        virtual ~CommonSubexpressionElimination() {};
+        CommonSubexpressionElimination(Parser::Arena& _arena);
+
+        // The number of expressions eliminated from each function, and from the top level.
+        std::vector<std::pair<std::string, size_t>> report;
+
+        void eliminate(std::vector<Parser::NodePtr<Parser::CmdNode>>& cmds);
+
+    protected:
+        virtual Parser::ExprNode* visit_int_expr(Parser::IntExprNode*) override;
+        virtual Parser::ExprNode* visit_float_expr(Parser::FloatExprNode*) override;
+        virtual Parser::ExprNode* visit_true_expr(Parser::TrueExprNode*) override;
+        virtual Parser::ExprNode* visit_false_expr(Parser::FalseExprNode*) override;
+        virtual Parser::ExprNode* visit_variable_expr(Parser::VariableExprNode*) override;
+        virtual Parser::ExprNode* visit_tuple_index_expr(Parser::TupleIndexExprNode*) override;
+        virtual Parser::ExprNode* visit_unop_expr(Parser::UnopExprNode*) override;
+        virtual Parser::ExprNode* visit_binop_expr(Parser::BinopExprNode*) override;
+        virtual Parser::ExprNode* visit_loop_expr(Parser::LoopExprNode*) override;
+        virtual Parser::ExprNode* visit_inlined_call_expr(Parser::InlinedCallExprNode*) override;
+
+    private:
+        // Shares the values of the commands or statements of one function or of the top level.
+        template<class Nodes>
+        void share_values(Nodes& nodes, const std::string& name);
+
+        // Gives expr the number of value.
+        Parser::ExprNode* number(const Parser::ExprNode* expr, const Value& value);
+        // Counts or rewrites an operator or tuple index once it is numbered. visit_operands visits
+        // its operands, and detach moves them into a new node like it, for a let to bind.
+        template<class F, class D>
+        Parser::ExprNode* share(Parser::ExprNode* expr, F visit_operands, D detach);
+        // A read of the variable bound to value, to replace expr.
+        Parser::ExprNode* read(const Parser::ExprNode* expr, size_t value);
+        // The value number of expr, or NO_VALUE.
+        size_t value_of(const Parser::ExprNode* expr) const;
+        // Counts the loop variables from start on, and forgets those from size on.
+        void count_loop_variables(size_t start);
+        void pop_loop_variables(size_t size);
+    };
+
+    // Moves the parts of loop bodies that do not depend on every index of the loops around them
+    // out of the body, so they are computed once for each value of the indices they read instead
+    // of once per iteration. A part that reads only the first indices of a loop becomes one of its
+    // invariants, at the outermost level where those indices are bound. Like shared values, only
+    // parts that cannot fail are moved, since a moved part is computed even when the body is not.
+    class LoopInvariantCodeMotion : public ASTVisitor
+    {
+    private:
+        // The loop variables around one expression are numbered by position, outermost first;
+        // past the bits of a mask, expressions reading them are never moved.
+        static constexpr size_t MAX_POSITIONS = 64;
+
+        // The commands are visited once to find what can be moved and once to move it. Moving
+        // changes no positions, since the loops inside a moved part stay in it, so what the first
+        // visit finds holds throughout the second.
+        enum Phase {ANALYZE, MOVE};
+        Phase phase;
+
+        // The positions of the loop variables read by each expression that cannot fail, as a mask.
+        std::unordered_map<const Parser::ExprNode*, uint64_t> pure;
+        // The loops around the expression being visited, with the position of their first variable.
+        // The variables of an inlined call take positions too, under a null loop.
+        std::vector<std::pair<Parser::LoopExprNode*, size_t>> loops;
+        // The indices in loops of those that are not inlined calls.
+        std::vector<size_t> real_loops;
+        // The variable at each position, and the positions of each variable, innermost last.
+        std::vector<Lexer::Symbol> loop_variables;
+        std::unordered_map<Lexer::Symbol, std::vector<size_t>> positions;
+        // Where the part being moved is computed and the position it was at, if any. Its own parts
+        // that would be computed with it are computed before the loops inside it instead.
+        size_t moving_to = SIZE_MAX;
+        size_t moving_from = SIZE_MAX;
+        FailureAnalysis failures;
+        size_t moved;
+        // The number of variables introduced so far, which names the next one.
+        size_t invariant_count = 0;
+        Parser::Arena& arena;
+
+    public:
+        virtual ~LoopInvariantCodeMotion() {};
+        LoopInvariantCodeMotion(Parser::Arena& _arena);
+
+        // The number of expressions moved out of loops in each function, and in the top level.
+        std::vector<std::pair<std::string, size_t>> report;
+
+        void move_invariants(std::vector<Parser::NodePtr<Parser::CmdNode>>& cmds);
+
+    protected:
+        virtual void walk_expr(Parser::NodePtr<Parser::ExprNode>&) override;
+        virtual Parser::CmdNode* visit_fn_cmd(Parser::FnCmd*) override;
+        virtual Parser::ExprNode* visit_int_expr(Parser::IntExprNode*) override;
+        virtual Parser::ExprNode* visit_float_expr(Parser::FloatExprNode*) override;
+        virtual Parser::ExprNode* visit_true_expr(Parser::TrueExprNode*) override;
+        virtual Parser::ExprNode* visit_false_expr(Parser::FalseExprNode*) override;
+        virtual Parser::ExprNode* visit_variable_expr(Parser::VariableExprNode*) override;
+        virtual Parser::ExprNode* visit_tuple_expr(Parser::TupleLiteralExprNode*) override;
+        virtual Parser::ExprNode* visit_array_expr(Parser::ArrayLiteralExprNode*) override;
+        virtual Parser::ExprNode* visit_tuple_index_expr(Parser::TupleIndexExprNode*) override;
+        virtual Parser::ExprNode* visit_call_expr(Parser::CallExprNode*) override;
+        virtual Parser::ExprNode* visit_unop_expr(Parser::UnopExprNode*) override;
+        virtual Parser::ExprNode* visit_binop_expr(Parser::BinopExprNode*) override;
+        virtual Parser::ExprNode* visit_if_expr(Parser::IfExprNode*) override;
+        virtual Parser::ExprNode* visit_loop_expr(Parser::LoopExprNode*) override;
+        virtual Parser::ExprNode* visit_inlined_call_expr(Parser::InlinedCallExprNode*) override;
+
+    private:
+        // The innermost loop or inlined call whose first variable is at or before position.
+        size_t owner(size_t position) const;
+        // Where a part reading only the variables before position is computed: there, or before
+        // the next loop if an inlined call binds the variable at position. SIZE_MAX if nowhere.
+        size_t computed_at(size_t position) const;
+        // Enter a loop or inlined call, or the variables bound from start on; and leave those
+        // from size on.
+        void push_loop(Parser::LoopExprNode* loop_expr, size_t start);
+        void pop_loops(size_t size);
+        void push_variables(size_t start);
+        void pop_variables(size_t size);
+        // Marks expr as unable to fail if all of operands are, reading what they read.
+        void combine(const Parser::ExprNode* expr, std::initializer_list<const Parser::ExprNode*> operands);
+        template<class T>
+        void combine_all(const Parser::ExprNode* expr, const Parser::ArenaVector<Parser::NodePtr<T>>& operands);
+        // Moves the expression in u_expr into the invariants of the loop whose variable is at position.
+        void move(Parser::NodePtr<Parser::ExprNode>& u_expr, size_t position);
+    };
+
+    // Marks the array indices that are known to be in bounds, so that code generation leaves out
+    // their checks. Each int expression is given the range its value is in, and the values of
+    // constant propagation it is less than, each plus an offset: a loop index is at least zero and
+    // less than its bound, and an index less than a length of its array is in bounds. Arithmetic
+    // that may overflow has no known range. Runs after constant propagation, whose values it
+    // compares by identity.
+    class BoundsCheckElimination : public ASTVisitor
+    {
+    private:
+        struct Range
+        {
+            long min = LONG_MIN;
+            long max = LONG_MAX;
+            std::vector<std::pair<const Parser::CPValue*, long>> limits;
+        };
+
+        // At most this many limits are kept per range, so that chains of arithmetic do not
+        // carry every value they pass through.
+        static const size_t MAX_LIMITS = 8;
+
+        // The range of each int expression visited; the others have no known range.
+        std::unordered_map<const Parser::ExprNode*, Range> ranges;
+        // The ranges of the int variables in scope.
+        std::unordered_map<Lexer::Symbol, Range> variables;
+        // The variables bound so far. No name is bound twice in one scope or shadows another, so
+        // those bound in a function are the ones to forget after it.
+        std::vector<Lexer::Symbol> bound;
+        size_t removed;
+        size_t kept;
+
+    public:
+        virtual ~BoundsCheckElimination() {};
+
+        // The number of checks removed and kept in each function, and in the top level.
+        std::vector<std::tuple<std::string, size_t, size_t>> report;
+
+        void eliminate(std::vector<Parser::NodePtr<Parser::CmdNode>>& cmds);
+
+    protected:
+        virtual Parser::CmdNode* visit_read_cmd(Parser::ReadCmdNode*) override;
+        virtual Parser::CmdNode* visit_let_cmd(Parser::LetCmdNode*) override;
+        virtual Parser::CmdNode* visit_fn_cmd(Parser::FnCmd*) override;
+        virtual Parser::StmtNode* visit_let_stmt(Parser::LetStmtNode*) override;
+        virtual Parser::ExprNode* visit_int_expr(Parser::IntExprNode*) override;
+        virtual Parser::ExprNode* visit_variable_expr(Parser::VariableExprNode*) override;
+        virtual Parser::ExprNode* visit_array_index_expr(Parser::ArrayIndexExprNode*) override;
+        virtual Parser::ExprNode* visit_unop_expr(Parser::UnopExprNode*) override;
+        virtual Parser::ExprNode* visit_binop_expr(Parser::BinopExprNode*) override;
+        virtual Parser::ExprNode* visit_if_expr(Parser::IfExprNode*) override;
+        virtual Parser::ExprNode* visit_loop_expr(Parser::LoopExprNode*) override;
+        virtual Parser::ExprNode* visit_inlined_call_expr(Parser::InlinedCallExprNode*) override;
+
+    private:
+        Range range_of(const Parser::ExprNode* expr) const;
+        // Keeps the limits of range with the least offsets, the likeliest to prove an index in bounds.
+        static void trim(Range& range);
+        void bind(Parser::LValue* lvalue, const Parser::ExprNode* expression);
+        void bind_dimensions(Parser::ArgumentNode* argument);
+        void bind_parameter(Parser::BindingNode* binding);
+    };
+
+    // Copies the parts of function bodies into new nodes. With rename, each variable a copy binds
+    // is given a new name, which the copies of the expressions after it read; without it the
+    // copies keep their names.
+    class BodyCopier
+    {
+    private:
+        const bool rename;
+        // The new name of each variable bound in the body being copied.
+        std::unordered_map<Lexer::Symbol, Lexer::Symbol> renamed;
+        // The number of variables renamed so far, which names the next one.
+        size_t rename_count = 0;
+        Parser::Arena& arena;
+
+    public:
+        BodyCopier(Parser::Arena& _arena, bool _rename);
+
+        // Forgets the new names; each body is copied from a clear copier.
+        void clear() {renamed.clear();}
+
+        Lexer::Symbol bind(Lexer::Symbol symbol);
+        Parser::ArgumentNode* copy_argument(const Parser::ArgumentNode* argument);
+        // A binding as the lvalue of a let, and as the parameter of a function.
+        Parser::LValue* copy_binding(const Parser::BindingNode* binding);
+        Parser::BindingNode* copy_parameter(const Parser::BindingNode* binding);
+        Parser::TypeNode* copy_type(const Parser::TypeNode* type);
+        Parser::LValue* copy_lvalue(const Parser::LValue* lvalue);
+        Parser::StmtNode* copy_stmt(const Parser::StmtNode* stmt);
+        Parser::ExprNode* copy_expr(const Parser::ExprNode* expr);
+
+    private:
+        // Nodes are copied from a list of tasks rather than by recursion, so that deeply nested
+        // ones take no more native stack than shallow ones. The forms below that take into add a
+        // task that copies into it, and a task copying a node adds tasks for its children; the
+        // tasks a task adds run in the order they were added, before any added earlier, so
+        // variables are bound in the same order as a recursive copy would bind them. The forms
+        // above run every task before returning, and are not called from a task.
+        std::vector<std::function<void()>> tasks;
+        bool copying = false;
+
+        void add_task(std::function<void()> task);
+        void copy_binding(Parser::NodePtr<Parser::LValue>& into, const Parser::BindingNode* binding);
+        void copy_parameter(Parser::NodePtr<Parser::BindingNode>& into, const Parser::BindingNode* binding);
+        void copy_type(Parser::NodePtr<Parser::TypeNode>& into, const Parser::TypeNode* type);
+        void copy_lvalue(Parser::NodePtr<Parser::LValue>& into, const Parser::LValue* lvalue);
+        void copy_stmt(Parser::NodePtr<Parser::StmtNode>& into, const Parser::StmtNode* stmt);
+        void copy_expr(Parser::NodePtr<Parser::ExprNode>& into, const Parser::ExprNode* expr);
+        // Copies expr, with tasks added that copy its operands into the copy.
+        Parser::ExprNode* copy_node(const Parser::ExprNode* expr);
+        void copy_all(Parser::ArenaVector<Parser::NodePtr<Parser::ExprNode>>& copies, const Parser::ArenaVector<Parser::NodePtr<Parser::ExprNode>>& originals);
+    };
+
+    // Replaces calls to small functions with their bodies, so that what a body computes is folded,
+    // shared and moved out of loops together with what its caller computes. A function is inlined
+    // if its body is lets and asserts followed by a return, it does not call itself, and it has at
+    // most size_limit expressions once the calls in it are inlined. The parameters are bound in
+    // order rather than in the order a call evaluates its arguments, so a call is only inlined if
+    // at most one of its arguments can fail. Calls in the arguments of MAX_NESTING others are left
+    // as they are, so that deeply nested calls do not grow into as deeply nested bodies.
+    class FunctionInlining : public ASTVisitor
+    {
+    private:
+        static constexpr size_t MAX_NESTING = 64;
+
+        struct Callee
+        {
+            Parser::FnCmd* fn_cmd;
+            size_t size;
+        };
+
+        // The functions that are inlined, by name.
+        std::unordered_map<Lexer::Symbol, Callee> callees;
+        const size_t size_limit;
+        // The function being visited, and whether it calls itself.
+        Lexer::Symbol function = Lexer::NO_SYMBOL;
+        bool recursive = false;
+        // The number of expressions in it, counting inlined bodies, and whether any can fail.
+        size_t size = 0;
+        bool may_fail = false;
+        FailureAnalysis failures;
+        size_t inlined = 0;
+        // The number of calls whose arguments the expression being visited is in.
+        size_t nesting = 0;
+        // Copies callee bodies, renaming their variables apart from the caller's.
+        BodyCopier copier;
+        Parser::Arena& arena;
+
+    public:
+        virtual ~FunctionInlining() {};
+        FunctionInlining(Parser::Arena& _arena, size_t _size_limit);
+
+        // The number of call sites inlined in each function, and in the top level.
+        std::vector<std::pair<std::string, size_t>> report;
+
+        void inline_calls(std::vector<Parser::NodePtr<Parser::CmdNode>>& cmds);
+
+    protected:
+        virtual void walk_expr(Parser::NodePtr<Parser::ExprNode>&) override;
+        virtual Parser::CmdNode* visit_fn_cmd(Parser::FnCmd*) override;
+        virtual Parser::ExprNode* visit_call_expr(Parser::CallExprNode*) override;
+
+    private:
+        // The body of callee, binding its parameters to the arguments of call_expr.
+        Parser::InlinedCallExprNode* inline_call(Parser::CallExprNode* call_expr, Parser::FnCmd* callee);
+    };
+
+    // Gives a function called with literal int, float or bool arguments a copy for each distinct
+    // tuple of them, and calls the copy instead. The copy takes only the other arguments; its body
+    // starts by letting the parameters the literals were passed to be the literals, so folding and
+    // propagation see them as constants, and the loops they bound get constant bounds. A function
+    // has at most MAX_COPIES copies. Each is placed after the function it copies and declared in
+    // scope, where code generation finds its calling convention.
+    class FunctionSpecialization : public ASTVisitor
+    {
+    private:
+        static constexpr size_t MAX_COPIES = 8;
+
+        // The functions defined so far, by name.
+        std::unordered_map<Lexer::Symbol, Parser::FnCmd*> functions;
+        // The copies of each function, in the order they were made, and by their literals.
+        std::unordered_map<Lexer::Symbol, std::vector<Parser::FnCmd*>> copies;
+        std::unordered_map<std::string, Parser::FnCmd*> copy_of;
+        size_t redirected;
+        // Copies bodies, keeping their names: a copy is a function of its own.
+        BodyCopier copier;
+        Parser::Arena& arena;
+        Typechecker::Scope& scope;
+
+    public:
+        virtual ~FunctionSpecialization() {};
+        FunctionSpecialization(Parser::Arena& _arena, Typechecker::Scope& _scope);
+
+        // The number of calls redirected to a copy in each function, and in the top level.
+        std::vector<std::pair<std::string, size_t>> report;
+
+        void specialize(std::vector<Parser::NodePtr<Parser::CmdNode>>& cmds);
+
+    protected:
+        virtual Parser::CmdNode* visit_fn_cmd(Parser::FnCmd*) override;
+        virtual Parser::ExprNode* visit_call_expr(Parser::CallExprNode*) override;
+
+    private:
+        // A copy of function taking only the arguments of call_expr that are not literals.
+        Parser::FnCmd* copy_function(Parser::FnCmd* function, Parser::CallExprNode* call_expr, const std::vector<bool>& literal);
+    };
+
+    // Removes the functions that no remaining call reaches, such as those every call to was
+    // redirected to a copy or inlined, so that no code is generated for them. A function whose
+    // definition is timed is kept, since timing it prints a time.
+    class DeadFunctionElimination : public ASTVisitor
+    {
+    private:
+        // The functions called after the command being visited.
+        std::unordered_set<Lexer::Symbol> called;
+
+    public:
+        virtual ~DeadFunctionElimination() {};
+
+        // The functions removed, in the order they were defined.
+        std::vector<std::string> report;
+
+        void eliminate(std::vector<Parser::NodePtr<Parser::CmdNode>>& cmds);
+
+    protected:
+        virtual Parser::ExprNode* visit_call_expr(Parser::CallExprNode*) override;
     };
 }
 
@@ -0,0 +1,629 @@
+#include "flat_ast.h"
+
+namespace Parser
+{
+
+#pragma region Conversion
+
+    FlatAST::FlatAST(const std::vector<NodePtr<CmdNode>>& tree)
+    {
+        for (const NodePtr<CmdNode>& cmd : tree)
+            commands.push_back(flatten(cmd.get()));
+    }
+
+    NodeIndex FlatAST::flatten(ASTNode* root)
+    {
+        std::vector<Frame> frames;
+        frames.push_back(start(root));
+
+        while (true)
+        {
+            Frame& frame = frames.back();
+            if (frame.next != frame.end)
+            {
+                ASTNode* child = waiting[frame.next++];
+                frames.push_back(start(child));
+                continue;
+            }
+
+            NodeIndex index = add(frame.flat, frame.node, frame.pending_base);
+            waiting.resize(frame.begin);
+            frames.pop_back();
+            if (frames.empty())
+                return index;
+            pending.push_back(index);
+        }
+    }
+
+    FlatAST::Frame FlatAST::start(ASTNode* node)
+    {
+        Frame frame;
+        frame.node = node;
+        frame.pending_base = pending.size();
+        frame.begin = waiting.size();
+        frame.flat = describe(node);
+        frame.next = frame.begin;
+        frame.end = waiting.size();
+        return frame;
+    }
+
+    void FlatAST::flattenChild(ASTNode* child)
+    {
+        waiting.push_back(child);
+    }
+
+    NodeIndex FlatAST::add(FlatNode node, ASTNode* origin, size_t pending_base)
+    {
+        node.first_child = children.size();
+        node.child_count = pending.size() - pending_base;
+        children.insert(children.end(), pending.begin() + pending_base, pending.end());
+        pending.resize(pending_base);
+
+        std::shared_ptr<Typechecker::ResolvedType> type = nullptr;
+        if (node.kind >= INT_EXPR && node.kind <= SUM_LOOP_EXPR && static_cast<ExprNode*>(origin)->resolvedType != nullptr)
+            type = static_cast<ExprNode*>(origin)->resolvedType->shared_from_this();
+
+        nodes.push_back(node);
+        lines.push_back(origin->line);
+        positions.push_back(origin->pos);
+        types.push_back(std::move(type));
+        origins.push_back(origin);
+
+        return nodes.size() - 1;
+    }
+
+    FlatNode FlatAST::describe(ASTNode* node)
+    {
+        FlatNode flat;
+        flat.kind = node->kind;
+
+        switch (node->kind)
+        {
+            case STRING:
+            {
+                flat.data = strings.size();
+                strings.push_back(node->token_s);
+                break;
+            }
+            case VAR_ARGUMENT:
+            case VARIABLE_EXPR:
+            case VARIABLE_TYPE:
+            {
+                flat.symbol = node->symbol;
+                break;
+            }
+            case ARRAY_ARGUMENT:
+            {
+                ArrayArgumentNode* argument = static_cast<ArrayArgumentNode*>(node);
+                flat.symbol = argument->array_argument_symbol;
+                flat.data = symbol_lists.size();
+                symbol_lists.push_back(argument->array_dimensions_symbols.size());
+                symbol_lists.insert(symbol_lists.end(), argument->array_dimensions_symbols.begin(), argument->array_dimensions_symbols.end());
+                break;
+            }
+            case TUPLE_BINDING:
+            {
+                for (NodePtr<BindingNode>& binding : static_cast<TupleBindingNode*>(node)->bindings)
+                    flattenChild(binding.get());
+                break;
+            }
+            case VAR_BINDING:
+            {
+                VarBindingNode* binding = static_cast<VarBindingNode*>(node);
+                flattenChild(binding->argument.get());
+                flattenChild(binding->type.get());
+                break;
+            }
+            case ARGUMENT_LVALUE:
+            {
+                flattenChild(static_cast<ArgumentLValue*>(node)->argument.get());
+                break;
+            }
+            case TUPLE_LVALUE:
+            {
+                for (NodePtr<LValue>& lvalue : static_cast<TupleLValueNode*>(node)->lvalues)
+                    flattenChild(lvalue.get());
+                break;
+            }
+            case INT_EXPR:
+            {
+                flat.data = integers.size();
+                integers.push_back(static_cast<IntExprNode*>(node)->value);
+                break;
+            }
+            case FLOAT_EXPR:
+            {
+                flat.data = floats.size();
+                floats.push_back(static_cast<FloatExprNode*>(node)->value);
+                break;
+            }
+            case TRUE_EXPR:
+            case FALSE_EXPR:
+                break;
+            case TUPLE_LITERAL_EXPR:
+            {
+                for (NodePtr<ExprNode>& element : static_cast<TupleLiteralExprNode*>(node)->tuple_expressions)
+                    flattenChild(element.get());
+                break;
+            }
+            case ARRAY_LITERAL_EXPR:
+            {
+                for (NodePtr<ExprNode>& element : static_cast<ArrayLiteralExprNode*>(node)->array_expressions)
+                    flattenChild(element.get());
+                break;
+            }
+            case TUPLE_INDEX_EXPR:
+            {
+                TupleIndexExprNode* index = static_cast<TupleIndexExprNode*>(node);
+                flattenChild(index->tuple_expression.get());
+                flat.data = integers.size();
+                integers.push_back(index->tuple_index);
+                break;
+            }
+            case ARRAY_INDEX_EXPR:
+            {
+                ArrayIndexExprNode* index = static_cast<ArrayIndexExprNode*>(node);
+                flattenChild(index->array_expression.get());
+                for (NodePtr<ExprNode>& array_index : index->array_indices)
+                    flattenChild(array_index.get());
+                break;
+            }
+            case CALL_EXPR:
+            {
+                CallExprNode* call = static_cast<CallExprNode*>(node);
+                flat.symbol = call->function_symbol;
+                for (NodePtr<ExprNode>& argument : call->arguments)
+                    flattenChild(argument.get());
+                break;
+            }
+            case UNOP_EXPR:
+            {
+                UnopExprNode* unop = static_cast<UnopExprNode*>(node);
+                flat.operation = unop->operation;
+                flattenChild(unop->expression.get());
+                break;
+            }
+            case BINOP_EXPR:
+            {
+                BinopExprNode* binop = static_cast<BinopExprNode*>(node);
+                flat.operation = binop->operation;
+                flattenChild(binop->lhs.get());
+                flattenChild(binop->rhs.get());
+                break;
+            }
+            case IF_EXPR:
+            {
+                IfExprNode* if_expr = static_cast<IfExprNode*>(node);
+                flattenChild(if_expr->condition.get());
+                flattenChild(if_expr->then_expr.get());
+                flattenChild(if_expr->else_expr.get());
+                break;
+            }
+            case ARRAY_LOOP_EXPR:
+            case SUM_LOOP_EXPR:
+            {
+                LoopExprNode* loop = static_cast<LoopExprNode*>(node);
+                flat.data = symbol_lists.size();
+                symbol_lists.insert(symbol_lists.end(), loop->bound_symbols.begin(), loop->bound_symbols.end());
+                for (auto& bound : loop->bounds)
+                    flattenChild(bound.second.get());
+                flattenChild(loop->loop_expression.get());
+                break;
+            }
+            case LET_STMT:
+            {
+                LetStmtNode* let = static_cast<LetStmtNode*>(node);
+                flattenChild(let->set_variable_name.get());
+                flattenChild(let->variable_expression.get());
+                break;
+            }
+            case ASSERT_STMT:
+            {
+                AssertStmtNode* assertion = static_cast<AssertStmtNode*>(node);
+                flattenChild(assertion->expression.get());
+                flattenChild(assertion->string.get());
+                break;
+            }
+            case RETURN_STMT:
+            {
+                flattenChild(static_cast<ReturnStmtNode*>(node)->expression.get());
+                break;
+            }
+            case INT_TYPE:
+            case BOOL_TYPE:
+            case FLOAT_TYPE:
+                break;
+            case ARRAY_TYPE:
+            {
+                ArrayTypeNode* type = static_cast<ArrayTypeNode*>(node);
+                flattenChild(type->array_type.get());
+                flat.data = type->rank;
+                break;
+            }
+            case TUPLE_TYPE:
+            {
+                for (NodePtr<TypeNode>& type : static_cast<TupleTypeNode*>(node)->tuple_types)
+                    flattenChild(type.get());
+                break;
+            }
+            case READ_CMD:
+            {
+                ReadCmdNode* read = static_cast<ReadCmdNode*>(node);
+                flattenChild(read->fileName.get());
+                flattenChild(read->readInto.get());
+                break;
+            }
+            case WRITE_CMD:
+            {
+                WriteCmdNode* write = static_cast<WriteCmdNode*>(node);
+                flattenChild(write->toSave.get());
+                flattenChild(write->fileName.get());
+                break;
+            }
+            case TYPE_CMD:
+            {
+                TypeCmdNode* type = static_cast<TypeCmdNode*>(node);
+                flat.symbol = type->variable_symbol;
+                flattenChild(type->type.get());
+                break;
+            }
+            case LET_CMD:
+            {
+                LetCmdNode* let = static_cast<LetCmdNode*>(node);
+                flattenChild(let->lvalue.get());
+                flattenChild(let->expression.get());
+                break;
+            }
+            case ASSERT_CMD:
+            {
+                AssertCmdNode* assertion = static_cast<AssertCmdNode*>(node);
+                flattenChild(assertion->expression.get());
+                flattenChild(assertion->string.get());
+                break;
+            }
+            case PRINT_CMD:
+            {
+                flattenChild(static_cast<PrintCmdNode*>(node)->string.get());
+                break;
+            }
+            case SHOW_CMD:
+            {
+                flattenChild(static_cast<ShowCmdNode*>(node)->expression.get());
+                break;
+            }
+            case TIME_CMD:
+            {
+                flattenChild(static_cast<TimeCmdNode*>(node)->command.get());
+                break;
+            }
+            case FN_CMD:
+            {
+                FnCmd* fn = static_cast<FnCmd*>(node);
+                flat.symbol = fn->function_symbol;
+                flat.data = fn->arguments.size();
+                for (NodePtr<BindingNode>& binding : fn->arguments)
+                    flattenChild(binding.get());
+                flattenChild(fn->return_type.get());
+                for (NodePtr<StmtNode>& stmt : fn->function_contents)
+                    flattenChild(stmt.get());
+                break;
+            }
+            default:
+                throw ParserException("\nCannot flatten a node of kind " + std::to_string(node->kind) + ".");
+        }
+
+        return flat;
+    }
+
+    size_t FlatAST::memoryUsage() const
+    {
+        size_t bytes = sizeof(FlatAST);
+        bytes += nodes.capacity() * sizeof(FlatNode);
+        bytes += children.capacity() * sizeof(NodeIndex);
+        bytes += commands.capacity() * sizeof(NodeIndex);
+        bytes += integers.capacity() * sizeof(long);
+        bytes += floats.capacity() * sizeof(double);
+        bytes += strings.capacity() * sizeof(std::string);
+        for (const std::string& string : strings)
+            bytes += string.capacity();
+        bytes += symbol_lists.capacity() * sizeof(Lexer::Symbol);
+        bytes += lines.capacity() * sizeof(uint32_t);
+        bytes += positions.capacity() * sizeof(uint32_t);
+        bytes += types.capacity() * sizeof(std::shared_ptr<Typechecker::ResolvedType>);
+        bytes += origins.capacity() * sizeof(ASTNode*);
+        return bytes;
+    }
+
+#pragma endregion
+
+#pragma region Printing
+
+    std::string FlatAST::toString(NodeIndex index) const
+    {
+        std::string text = "";
+        print(index, text);
+        return text;
+    }
+
+    void FlatAST::print(NodeIndex index, std::string& out) const
+    {
+        std::vector<PrintPart> work = {{index, ""}};
+        std::vector<PrintPart> parts;
+
+        while (!work.empty())
+        {
+            PrintPart part = std::move(work.back());
+            work.pop_back();
+
+            if (part.node == NO_NODE)
+            {
+                out += part.text;
+                continue;
+            }
+
+            parts.clear();
+            expand(part.node, parts);
+            // The last part is taken first, so the parts go on in reverse.
+            for (size_t i = parts.size(); i > 0; i--)
+                work.push_back(std::move(parts[i - 1]));
+        }
+    }
+
+    void FlatAST::addText(std::vector<PrintPart>& parts, const std::string& text)
+    {
+        if (parts.empty() || parts.back().node != NO_NODE)
+            parts.push_back({NO_NODE, ""});
+        parts.back().text += text;
+    }
+
+    void FlatAST::printChildren(NodeIndex index, uint32_t begin, uint32_t end, std::vector<PrintPart>& parts) const
+    {
+        for (uint32_t i = begin; i < end; i++)
+        {
+            parts.push_back({child(index, i), ""});
+            if (i != end - 1)
+                addText(parts, " ");
+        }
+    }
+
+    void FlatAST::printNamed(const char* name, NodeIndex index, std::vector<PrintPart>& parts) const
+    {
+        addText(parts, name);
+
+        if (types[index] != nullptr)
+            addText(parts, " (" + types[index].get()->toString() + ")");
+    }
+
+    void FlatAST::expand(NodeIndex index, std::vector<PrintPart>& parts) const
+    {
+        const FlatNode& node = nodes[index];
+        Lexer::Interner& names = Lexer::interner();
+
+        switch (node.kind)
+        {
+            case STRING:
+                addText(parts, strings[node.data]);
+                return;
+            case VAR_ARGUMENT:
+                addText(parts, "(VarArgument " + names.name(node.symbol) + ")");
+                return;
+            case ARRAY_ARGUMENT:
+            {
+                addText(parts, "(ArrayArgument " + names.name(node.symbol) + " ");
+                uint32_t dimension_count = symbol_lists[node.data];
+                for (uint32_t i = 0; i < dimension_count; i++)
+                {
+                    addText(parts, names.name(symbol_lists[node.data + 1 + i]));
+                    if (i != dimension_count - 1)
+                        addText(parts, " ");
+                }
+                addText(parts, ")");
+                return;
+            }
+            case TUPLE_BINDING:
+                addText(parts, "(TupleBinding ");
+                printChildren(index, 0, node.child_count, parts);
+                addText(parts, ")");
+                return;
+            case VAR_BINDING:
+                addText(parts, "(VarBinding ");
+                printChildren(index, 0, 2, parts);
+                addText(parts, ")");
+                return;
+            case ARGUMENT_LVALUE:
+                addText(parts, "(ArgLValue ");
+                parts.push_back({child(index, 0), ""});
+                addText(parts, ")");
+                return;
+            case TUPLE_LVALUE:
+                addText(parts, "(TupleLValue ");
+                printChildren(index, 0, node.child_count, parts);
+                addText(parts, ")");
+                return;
+            case INT_EXPR:
+                printNamed("(IntExpr", index, parts);
+                addText(parts, " " + std::to_string(integers[node.data]) + ")");
+                return;
+            case FLOAT_EXPR:
+                printNamed("(FloatExpr", index, parts);
+                addText(parts, " " + std::to_string(static_cast<long>(floats[node.data])) + ")");
+                return;
+            case TRUE_EXPR:
+                printNamed("(TrueExpr", index, parts);
+                addText(parts, ")");
+                return;
+            case FALSE_EXPR:
+                printNamed("(FalseExpr", index, parts);
+                addText(parts, ")");
+                return;
+            case VARIABLE_EXPR:
+                printNamed("(VarExpr", index, parts);
+                addText(parts, " " + names.name(node.symbol) + ")");
+                return;
+            case TUPLE_LITERAL_EXPR:
+                printNamed("(TupleLiteralExpr", index, parts);
+                addText(parts, " ");
+                printChildren(index, 0, node.child_count, parts);
+                addText(parts, ")");
+                return;
+            case ARRAY_LITERAL_EXPR:
+                printNamed("(ArrayLiteralExpr", index, parts);
+                addText(parts, " ");
+                printChildren(index, 0, node.child_count, parts);
+                addText(parts, ")");
+                return;
+            case TUPLE_INDEX_EXPR:
+                printNamed("(TupleIndexExpr", index, parts);
+                addText(parts, " ");
+                parts.push_back({child(index, 0), ""});
+                addText(parts, " " + std::to_string(integers[node.data]) + ")");
+                return;
+            case ARRAY_INDEX_EXPR:
+                printNamed("(ArrayIndexExpr", index, parts);
+                addText(parts, " ");
+                parts.push_back({child(index, 0), ""});
+                addText(parts, " ");
+                printChildren(index, 1, node.child_count, parts);
+                addText(parts, ")");
+                return;
+            case CALL_EXPR:
+                printNamed("(CallExpr", index, parts);
+                addText(parts, " " + names.name(node.symbol) + " ");
+                printChildren(index, 0, node.child_count, parts);
+                addText(parts, ")");
+                return;
+            case UNOP_EXPR:
+                printNamed("(UnopExpr", index, parts);
+                addText(parts, " ");
+                addText(parts, std::string(1, (char) node.operation));
+                addText(parts, " ");
+                parts.push_back({child(index, 0), ""});
+                addText(parts, ")");
+                return;
+            case BINOP_EXPR:
+                printNamed("(BinopExpr", index, parts);
+                addText(parts, " ");
+                parts.push_back({child(index, 0), ""});
+                addText(parts, " " + BinopExprNode::binopTypeToString((BinopExprNode::BinopType) node.operation) + " ");
+                parts.push_back({child(index, 1), ""});
+                addText(parts, ")");
+                return;
+            case IF_EXPR:
+                printNamed("(IfExpr", index, parts);
+                addText(parts, " ");
+                printChildren(index, 0, 3, parts);
+                addText(parts, ")");
+                return;
+            case ARRAY_LOOP_EXPR:
+            case SUM_LOOP_EXPR:
+            {
+                printNamed(node.kind == ARRAY_LOOP_EXPR ? "(ArrayLoopExpr" : "(SumLoopExpr", index, parts);
+                addText(parts, " ");
+                uint32_t bound_count = node.child_count - 1;
+                for (uint32_t i = 0; i < bound_count; i++)
+                {
+                    addText(parts, names.name(symbol_lists[node.data + i]) + " ");
+                    parts.push_back({child(index, i), ""});
+                    addText(parts, " ");
+                }
+                parts.push_back({child(index, bound_count), ""});
+                addText(parts, ")");
+                return;
+            }
+            case LET_STMT:
+                addText(parts, "(LetStmt ");
+                printChildren(index, 0, 2, parts);
+                addText(parts, ")");
+                return;
+            case ASSERT_STMT:
+                addText(parts, "(AssertStmt ");
+                printChildren(index, 0, 2, parts);
+                addText(parts, ")");
+                return;
+            case RETURN_STMT:
+                addText(parts, "(ReturnStmt ");
+                parts.push_back({child(index, 0), ""});
+                addText(parts, ")");
+                return;
+            case INT_TYPE:
+                addText(parts, "(IntType)");
+                return;
+            case BOOL_TYPE:
+                addText(parts, "(BoolType)");
+                return;
+            case FLOAT_TYPE:
+                addText(parts, "(FloatType)");
+                return;
+            case VARIABLE_TYPE:
+                addText(parts, "(VarType " + names.name(node.symbol) + ")");
+                return;
+            case ARRAY_TYPE:
+                addText(parts, "(ArrayType ");
+                parts.push_back({child(index, 0), ""});
+                addText(parts, " " + std::to_string(node.data) + ")");
+                return;
+            case TUPLE_TYPE:
+                addText(parts, "(TupleType ");
+                printChildren(index, 0, node.child_count, parts);
+                addText(parts, ")");
+                return;
+            case READ_CMD:
+                addText(parts, "(ReadCmd ");
+                printChildren(index, 0, 2, parts);
+                addText(parts, ")");
+                return;
+            case WRITE_CMD:
+                addText(parts, "(WriteCmd ");
+                printChildren(index, 0, 2, parts);
+                addText(parts, ")");
+                return;
+            case TYPE_CMD:
+                addText(parts, "(TypeCmd " + names.name(node.symbol) + " ");
+                parts.push_back({child(index, 0), ""});
+                addText(parts, ")");
+                return;
+            case LET_CMD:
+                addText(parts, "(LetCmd ");
+                printChildren(index, 0, 2, parts);
+                addText(parts, ")");
+                return;
+            case ASSERT_CMD:
+                addText(parts, "(AssertCmd ");
+                printChildren(index, 0, 2, parts);
+                addText(parts, ")");
+                return;
+            case PRINT_CMD:
+                addText(parts, "(PrintCmd ");
+                parts.push_back({child(index, 0), ""});
+                addText(parts, ")");
+                return;
+            case SHOW_CMD:
+                addText(parts, "(ShowCmd ");
+                parts.push_back({child(index, 0), ""});
+                addText(parts, ")");
+                return;
+            case TIME_CMD:
+                addText(parts, "(TimeCmd ");
+                parts.push_back({child(index, 0), ""});
+                addText(parts, ")");
+                return;
+            case FN_CMD:
+            {
+                uint32_t binding_count = node.data;
+                addText(parts, "(FnCmd " + names.name(node.symbol) + " (");
+                printChildren(index, 0, binding_count, parts);
+                addText(parts, ") ");
+                parts.push_back({child(index, binding_count), ""});
+                addText(parts, " ");
+                printChildren(index, binding_count + 1, node.child_count, parts);
+                addText(parts, ")");
+                return;
+            }
+            default:
+                return;
+        }
+    }
+
+#pragma endregion
+
+}
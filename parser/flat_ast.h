@@ -0,0 +1,153 @@
+#include <string>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include "parser.h"
+
+#ifndef __FLAT_AST_H__
+#define __FLAT_AST_H__
+
+namespace Parser
+{
+    // The position of a node in a FlatAST.
+    typedef uint32_t NodeIndex;
+    constexpr NodeIndex NO_NODE = UINT32_MAX;
+
+    // A node of a FlatAST. What each field holds depends on the kind of the node:
+    //
+    //  kind                      children                              data                          symbol
+    //  STRING                    -                                     index into strings            -
+    //  VAR_ARGUMENT              -                                     -                             name
+    //  ARRAY_ARGUMENT            -                                     index into symbol_lists (*)   name
+    //  TUPLE_BINDING             bindings                              -                             -
+    //  VAR_BINDING               argument, type                        -                             -
+    //  ARGUMENT_LVALUE           argument                              -                             -
+    //  TUPLE_LVALUE              lvalues                               -                             -
+    //  INT_EXPR                  -                                     index into integers           -
+    //  FLOAT_EXPR                -                                     index into floats             -
+    //  TRUE_EXPR, FALSE_EXPR     -                                     -                             -
+    //  VARIABLE_EXPR             -                                     -                             name
+    //  TUPLE/ARRAY_LITERAL_EXPR  elements                              -                             -
+    //  TUPLE_INDEX_EXPR          tuple                                 index into integers           -
+    //  ARRAY_INDEX_EXPR          array, indices...                     -                             -
+    //  CALL_EXPR                 arguments                             -                             function
+    //  UNOP_EXPR                 operand                               -                             -
+    //  BINOP_EXPR                lhs, rhs                              -                             -
+    //  IF_EXPR                   condition, then, else                 -                             -
+    //  ARRAY/SUM_LOOP_EXPR       bounds..., body                       index into symbol_lists (**)  -
+    //  LET_STMT, LET_CMD         lvalue, expression                    -                             -
+    //  ASSERT_STMT, ASSERT_CMD   expression, string                    -                             -
+    //  RETURN_STMT, SHOW_CMD     expression                            -                             -
+    //  INT/BOOL/FLOAT_TYPE       -                                     -                             -
+    //  VARIABLE_TYPE             -                                     -                             name
+    //  ARRAY_TYPE                element type                          rank                          -
+    //  TUPLE_TYPE                types                                 -                             -
+    //  READ_CMD                  string, argument                      -                             -
+    //  WRITE_CMD                 expression, string                    -                             -
+    //  TYPE_CMD                  type                                  -                             name
+    //  PRINT_CMD                 string                                -                             -
+    //  TIME_CMD                  command                               -                             -
+    //  FN_CMD                    bindings..., return type, statements  number of bindings            function
+    //
+    //  (*) The number of dimensions, followed by the name of each.
+    //  (**) The name of each bound, one per bound.
+    struct FlatNode
+    {
+        NodeKind kind;
+        // The UnopType or BinopType of operator expressions.
+        unsigned char operation = 0;
+        // The children of the node are children[first_child, first_child + child_count).
+        uint32_t first_child = 0;
+        uint32_t child_count = 0;
+        uint32_t data = 0;
+        Lexer::Symbol symbol = Lexer::NO_SYMBOL;
+    };
+
+    // A syntax tree stored as one contiguous array of nodes that refer to their children by
+    // index. Nodes are stored in post-order, so a forward scan reaches every child before its
+    // parent. Data that most passes do not look at is kept in side tables.
+    class FlatAST
+    {
+        public:
+            std::vector<FlatNode> nodes;
+            std::vector<NodeIndex> children;
+            // The top-level commands, in program order.
+            std::vector<NodeIndex> commands;
+
+            // Side tables indexed by FlatNode::data.
+            std::vector<long> integers;
+            std::vector<double> floats;
+            std::vector<std::string> strings;
+            std::vector<Lexer::Symbol> symbol_lists;
+
+            // Side tables parallel to nodes.
+            std::vector<uint32_t> lines;
+            std::vector<uint32_t> positions;
+            // The resolved type of each expression, once the tree it came from was typechecked.
+            std::vector<std::shared_ptr<Typechecker::ResolvedType>> types;
+            // The tree node each node was converted from, so that a pass ported to the flat
+            // representation can hand its results to passes that still walk the tree.
+            std::vector<ASTNode*> origins;
+
+            FlatAST() = default;
+            // Converts a parsed (and possibly typechecked) tree. The tree is left unchanged.
+            FlatAST(const std::vector<NodePtr<CmdNode>>& tree);
+
+            const FlatNode& operator[](NodeIndex index) const {return nodes[index];}
+            NodeIndex child(NodeIndex index, uint32_t i) const {return children[nodes[index].first_child + i];}
+            size_t size() const {return nodes.size();}
+
+            // The number of bytes held by the representation and its side tables.
+            size_t memoryUsage() const;
+
+            // The same text as toString() on the tree node the node was converted from.
+            std::string toString(NodeIndex index) const;
+            // Appends that text to out, which keeps printing linear in the size of the tree.
+            void print(NodeIndex index, std::string& out) const;
+
+        private:
+            // A tree node being converted, whose children are waiting[begin, end), of which
+            // those before next are converted and have their indices in pending.
+            struct Frame
+            {
+                ASTNode* node;
+                FlatNode flat;
+                size_t pending_base;
+                size_t begin;
+                size_t next;
+                size_t end;
+            };
+
+            // A node to print, or text to append when node is NO_NODE.
+            struct PrintPart
+            {
+                NodeIndex node;
+                std::string text;
+            };
+
+            // Child indices of the nodes being converted, before they are copied into children.
+            std::vector<NodeIndex> pending;
+            // The children of the nodes being converted, in the order they are converted.
+            std::vector<ASTNode*> waiting;
+
+            // Converts node and everything under it from a list of frames rather than by
+            // recursion, so that deeply nested trees do not overflow the native stack.
+            NodeIndex flatten(ASTNode* node);
+            Frame start(ASTNode* node);
+            // Fills in the fields of node other than its children, which it adds to waiting.
+            FlatNode describe(ASTNode* node);
+            void flattenChild(ASTNode* child);
+            // Appends node, whose children are pending[pending_base, ...).
+            NodeIndex add(FlatNode node, ASTNode* origin, size_t pending_base);
+
+            // Adds the parts that print the node at index, with its children as parts of
+            // their own, which print then expands in turn.
+            void expand(NodeIndex index, std::vector<PrintPart>& parts) const;
+            static void addText(std::vector<PrintPart>& parts, const std::string& text);
+            void printChildren(NodeIndex index, uint32_t begin, uint32_t end, std::vector<PrintPart>& parts) const;
+            // Adds name and the resolved type of the expression at index, if it has one.
+            void printNamed(const char* name, NodeIndex index, std::vector<PrintPart>& parts) const;
+    };
+}
+
+#endif
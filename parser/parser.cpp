@@ -1,8 +1,10 @@
+#include <algorithm>
 #include <cstring>
 #include <cstdlib>
 #include <math.h>
 #include <errno.h>
 #include "parser.h"
+#include "flat_ast.h"
 
 namespace Parser
 {
@@ -23,7 +25,7 @@ namespace Parser
     }
 
     template<class T>
-    std::string NodeVectorToString(std::vector<std::unique_ptr<T>>& v)
+    std::string NodeVectorToString(ArenaVector<NodePtr<T>>& v)
     {
         std::string concat = "";
 
@@ -38,6 +40,49 @@ namespace Parser
         return concat;
     }
 
+    // Cuts the text of a newly built node, so that the text of its ancestors stays bounded too.
+    template<class T>
+    T* clipText(T* node)
+    {
+        if (node->token_s.size() > ASTNode::MAX_TEXT_LENGTH)
+        {
+            node->token_s.resize(ASTNode::MAX_TEXT_LENGTH);
+            node->token_s += "...";
+        }
+        return node;
+    }
+
+    // Parses <element> , ... and then close, as tasks, into elements, adding their text to the
+    // text of node. A comma may follow the last element.
+    template<class T>
+    void parseList(Context& context, ASTNode* node, ArenaVector<NodePtr<T>>& elements, void (*parseElement)(Context&, NodePtr<T>&), Lexer::TokenType close, const char* close_text)
+    {
+        addTask(context, [&context, node, &elements, parseElement, close, close_text]
+        {
+            if (peekToken(context, context.token_index) == close)
+            {
+                consumeToken(context, context.token_index++, close);
+                node->token_s += close_text;
+                return;
+            }
+
+            elements.emplace_back();
+            parseElement(context, elements.back());
+            then(context, [&context, node, &elements, parseElement, close, close_text]
+            {
+                node->token_s += " " + elements.back()->token_s;
+
+                if (peekToken(context, context.token_index) != close)
+                {
+                    consumeToken(context, context.token_index++, Lexer::COMMA);
+                    node->token_s += ",";
+                }
+
+                parseList(context, node, elements, parseElement, close, close_text);
+            });
+        });
+    }
+
     long castStringToInt(const std::string& text, Lexer::token errorLoc)
     {
         const char* begin = text.c_str();
@@ -54,11 +99,46 @@ namespace Parser
         return value;
     }
 
+#pragma region Arena Implementation
+
+    void Arena::release()
+    {
+        for (char* block : blocks)
+            std::free(block);
+        blocks.clear();
+        next = limit = nullptr;
+        reserved = 0;
+    }
+
+    void* Arena::allocateBlock(size_t size, size_t alignment)
+    {
+        // malloc aligns blocks for any type, so only larger alignments need padding.
+        size_t padding = (alignment > alignof(std::max_align_t)) ? alignment : 0;
+        size_t block_size = std::max(BLOCK_SIZE, size + padding);
+
+        char* block = (char*) std::malloc(block_size);
+        if (block == nullptr)
+            throw std::bad_alloc();
+        blocks.push_back(block);
+        reserved += block_size;
+
+        // Oversized allocations get a block of their own, leaving the current block in use.
+        if (block_size > BLOCK_SIZE)
+            return block + (-(uintptr_t) block & (alignment - 1));
+
+        next = block;
+        limit = block + block_size;
+        return allocate(size, alignment);
+    }
+
+#pragma endregion
+
 #pragma region ASTNode Implementations
 
-    StringNode::StringNode(ASTNODE_CONSTRUCTOR_ARGS)
+    StringNode::StringNode(ASTNODE_CONSTRUCTOR_ARGS) : StringNode(context.arena)
     {
-        const Lexer::token t = consumeToken(token_index++, Lexer::STRING);
+        kind = KIND;
+        const Lexer::token t = consumeToken(context, context.token_index++, Lexer::STRING);
 
         std::string text(t.text);
         token_s = text;
@@ -79,15 +159,16 @@ namespace Parser
 #pragma region Command ASTNodes
 
     // read image <string> to <argument>
-    ReadCmdNode::ReadCmdNode(ASTNODE_CONSTRUCTOR_ARGS)
+    ReadCmdNode::ReadCmdNode(ASTNODE_CONSTRUCTOR_ARGS) : ReadCmdNode(context.arena)
     {
-        Lexer::token readToken = consumeToken(token_index++, Lexer::READ);
+        kind = KIND;
+        Lexer::token readToken = consumeToken(context, context.token_index++, Lexer::READ);
         std::string readToken_s(readToken.text);
-        std::string imageToken_s(consumeToken(token_index++, Lexer::IMAGE).text);
-        std::unique_ptr<StringNode> _fileName(new StringNode());
+        std::string imageToken_s(consumeToken(context, context.token_index++, Lexer::IMAGE).text);
+        NodePtr<StringNode> _fileName(new (context.arena) StringNode(context));
         fileName = std::move(_fileName);
-        std::string toToken_s(consumeToken(token_index++, Lexer::TO).text);
-        std::unique_ptr<ArgumentNode> _readInto(parseArgument());
+        std::string toToken_s(consumeToken(context, context.token_index++, Lexer::TO).text);
+        NodePtr<ArgumentNode> _readInto(parseArgument(context));
         readInto = std::move(_readInto);
         
         token_s = readToken_s + " " + imageToken_s + " " + fileName.get()->token_s + " " + toToken_s + " " + readInto.get()->token_s;
@@ -101,15 +182,16 @@ namespace Parser
     }
 
     // write image <expr> to <string>
-    WriteCmdNode::WriteCmdNode(ASTNODE_CONSTRUCTOR_ARGS)
+    WriteCmdNode::WriteCmdNode(ASTNODE_CONSTRUCTOR_ARGS) : WriteCmdNode(context.arena)
     {
-        Lexer::token writeToken = consumeToken(token_index++, Lexer::WRITE);
+        kind = KIND;
+        Lexer::token writeToken = consumeToken(context, context.token_index++, Lexer::WRITE);
         std::string writeToken_s(writeToken.text);
-        std::string imageToken_s(consumeToken(token_index++, Lexer::IMAGE).text);
-        std::unique_ptr<ExprNode> _toSave(parseExpr());
+        std::string imageToken_s(consumeToken(context, context.token_index++, Lexer::IMAGE).text);
+        NodePtr<ExprNode> _toSave(parseExpr(context));
         toSave = std::move(_toSave);
-        std::string toToken_s(consumeToken(token_index++, Lexer::TO).text);
-        std::unique_ptr<StringNode> _fileName(new StringNode());
+        std::string toToken_s(consumeToken(context, context.token_index++, Lexer::TO).text);
+        NodePtr<StringNode> _fileName(new (context.arena) StringNode(context));
         fileName = std::move(_fileName);
         
         token_s = writeToken_s + " " + imageToken_s + " " + toSave.get()->token_s + " " + toToken_s + " " + fileName.get()->token_s;
@@ -123,14 +205,17 @@ namespace Parser
     }
 
     // type <variable> = <type>
-    TypeCmdNode::TypeCmdNode(ASTNODE_CONSTRUCTOR_ARGS)
+    TypeCmdNode::TypeCmdNode(ASTNODE_CONSTRUCTOR_ARGS) : TypeCmdNode(context.arena)
     {
-        Lexer::token typeKeywordToken = consumeToken(token_index++, Lexer::TYPE);
+        kind = KIND;
+        Lexer::token typeKeywordToken = consumeToken(context, context.token_index++, Lexer::TYPE);
         std::string typeKeywordToken_s(typeKeywordToken.text);
-        std::string _variable(consumeToken(token_index++, Lexer::VARIABLE).text);
+        const Lexer::token variableToken = consumeToken(context, context.token_index++, Lexer::VARIABLE);
+        std::string _variable(variableToken.text);
         variable = _variable;
-        std::string equalToken_s(consumeToken(token_index++, Lexer::EQUALS).text);
-        std::unique_ptr<TypeNode> _type(parseType());
+        variable_symbol = variableToken.symbol;
+        std::string equalToken_s(consumeToken(context, context.token_index++, Lexer::EQUALS).text);
+        NodePtr<TypeNode> _type(parseType(context));
         type = std::move(_type);
         
         token_s = typeKeywordToken_s + " " + variable + " " + equalToken_s + " " + type.get()->token_s;
@@ -144,14 +229,15 @@ namespace Parser
     }
 
     // let <lvalue> = <expr>
-    LetCmdNode::LetCmdNode(ASTNODE_CONSTRUCTOR_ARGS)
+    LetCmdNode::LetCmdNode(ASTNODE_CONSTRUCTOR_ARGS) : LetCmdNode(context.arena)
     {   
-        Lexer::token letToken = consumeToken(token_index++, Lexer::LET);
+        kind = KIND;
+        Lexer::token letToken = consumeToken(context, context.token_index++, Lexer::LET);
         std::string letToken_s(letToken.text);
-        std::unique_ptr<LValue> _lvalue(parseLValue());
+        NodePtr<LValue> _lvalue(parseLValue(context));
         lvalue = std::move(_lvalue);
-        std::string equalToken_s(consumeToken(token_index++, Lexer::EQUALS).text);
-        std::unique_ptr<ExprNode> _expression(parseExpr());
+        std::string equalToken_s(consumeToken(context, context.token_index++, Lexer::EQUALS).text);
+        NodePtr<ExprNode> _expression(parseExpr(context));
         expression = std::move(_expression);
         
         token_s = letToken_s + " " + lvalue.get()->token_s + " " + equalToken_s + " " + expression.get()->token_s;
@@ -165,14 +251,15 @@ namespace Parser
     }
 
     // assert <expr> , <string>
-    AssertCmdNode::AssertCmdNode(ASTNODE_CONSTRUCTOR_ARGS)
+    AssertCmdNode::AssertCmdNode(ASTNODE_CONSTRUCTOR_ARGS) : AssertCmdNode(context.arena)
     {
-        Lexer::token assertToken = consumeToken(token_index++, Lexer::ASSERT);
+        kind = KIND;
+        Lexer::token assertToken = consumeToken(context, context.token_index++, Lexer::ASSERT);
         std::string assertToken_s(assertToken.text);
-        std::unique_ptr<ExprNode> _expression(parseExpr());
+        NodePtr<ExprNode> _expression(parseExpr(context));
         expression = std::move(_expression);
-        std::string commaToken_s(consumeToken(token_index++, Lexer::COMMA).text);
-        std::unique_ptr<StringNode> _string(new StringNode());
+        std::string commaToken_s(consumeToken(context, context.token_index++, Lexer::COMMA).text);
+        NodePtr<StringNode> _string(new (context.arena) StringNode(context));
         string = std::move(_string);
         
         token_s = assertToken_s + " " + expression.get()->token_s + " " + commaToken_s + " " + string.get()->token_s;
@@ -186,11 +273,12 @@ namespace Parser
     }
 
     // print <string>
-    PrintCmdNode::PrintCmdNode(ASTNODE_CONSTRUCTOR_ARGS)
+    PrintCmdNode::PrintCmdNode(ASTNODE_CONSTRUCTOR_ARGS) : PrintCmdNode(context.arena)
     {   
-        Lexer::token printToken = consumeToken(token_index++, Lexer::PRINT);
+        kind = KIND;
+        Lexer::token printToken = consumeToken(context, context.token_index++, Lexer::PRINT);
         std::string printToken_s(printToken.text);
-        std::unique_ptr<StringNode> _string(new StringNode());
+        NodePtr<StringNode> _string(new (context.arena) StringNode(context));
         string = std::move(_string);
         
         token_s = printToken_s + " " + string.get()->token_s;
@@ -204,11 +292,12 @@ namespace Parser
     }
 
     // show <expr>
-    ShowCmdNode::ShowCmdNode(ASTNODE_CONSTRUCTOR_ARGS)
+    ShowCmdNode::ShowCmdNode(ASTNODE_CONSTRUCTOR_ARGS) : ShowCmdNode(context.arena)
     {
-        Lexer::token showToken = consumeToken(token_index++, Lexer::SHOW);
+        kind = KIND;
+        Lexer::token showToken = consumeToken(context, context.token_index++, Lexer::SHOW);
         std::string showToken_s(showToken.text);
-        std::unique_ptr<ExprNode> _expression(parseExpr());
+        NodePtr<ExprNode> _expression(parseExpr(context));
         expression = std::move(_expression);
         
         token_s = showToken_s + " " + expression.get()->token_s;
@@ -227,17 +316,16 @@ namespace Parser
 
     
     // time <cmd>
-    TimeCmdNode::TimeCmdNode()
+    TimeCmdNode::TimeCmdNode(ASTNODE_CONSTRUCTOR_ARGS) : TimeCmdNode(context.arena)
     {
-        Lexer::token time = consumeToken(token_index++, Lexer::TIME);
+        kind = KIND;
+        Lexer::token time = consumeToken(context, context.token_index++, Lexer::TIME);
         token_s = "time ";
         line = time.line_number;
         pos = time.char_numer;
 
-        CmdNode* cmd = parseCmd();
-        token_s += cmd->token_s;
-        std::unique_ptr<CmdNode> u_command(cmd);
-        command = std::move(u_command);
+        parseCmd(context, command);
+        then(context, [this] {token_s += command->token_s;});
     }
     std::string TimeCmdNode::toString()
     {
@@ -247,75 +335,77 @@ namespace Parser
     // fn <variable> ( <binding> , ... ) : <type> { ;
     //     <stmt> ; ... ;
     // }
-    FnCmd::FnCmd()
+    FnCmd::FnCmd(ASTNODE_CONSTRUCTOR_ARGS) : FnCmd(context.arena)
     {
+        kind = KIND;
         // fn
         {
-            Lexer::token fn = consumeToken(token_index++, Lexer::FN);
+            Lexer::token fn = consumeToken(context, context.token_index++, Lexer::FN);
             token_s = "fn ";
             line = fn.line_number;
             pos = fn.char_numer;
         }
         // <variable>
         {
-            Lexer::token variable = consumeToken(token_index++, Lexer::VARIABLE);
+            Lexer::token variable = consumeToken(context, context.token_index++, Lexer::VARIABLE);
             std::string variable_s(variable.text);
             token_s += variable_s + " ";
             function_name = variable_s;
+            function_symbol = variable.symbol;
         }
         //( <binding>, ... )
         {
-            consumeToken(token_index++, Lexer::LPAREN);
+            consumeToken(context, context.token_index++, Lexer::LPAREN);
             token_s += "(";
 
-            while (peekToken(token_index) != Lexer::RPAREN)
+            while (peekToken(context, context.token_index) != Lexer::RPAREN)
             {
-                std::unique_ptr<BindingNode> u_binding(parseBinding()); 
+                NodePtr<BindingNode> u_binding(parseBinding(context)); 
                 
                 token_s += " " + u_binding.get()->token_s;
                 
                 arguments.push_back(std::move(u_binding));
                 
-                if (peekToken(token_index) != Lexer::RPAREN)
+                if (peekToken(context, context.token_index) != Lexer::RPAREN)
                 {
-                    consumeToken(token_index++, Lexer::COMMA);
+                    consumeToken(context, context.token_index++, Lexer::COMMA);
                     token_s += ",";
                 }
             }
 
-            consumeToken(token_index++, Lexer::RPAREN);
+            consumeToken(context, context.token_index++, Lexer::RPAREN);
             token_s += " )";
         }
         // :
         {
-            consumeToken(token_index++, Lexer::COLON);
+            consumeToken(context, context.token_index++, Lexer::COLON);
             token_s += ": ";
         }
         // <type>
         {
-            TypeNode* type = parseType();
+            TypeNode* type = parseType(context);
             token_s += type->token_s + " ";
-            std::unique_ptr<TypeNode> u_type(type);
+            NodePtr<TypeNode> u_type(type);
             return_type = std::move(u_type);
         }
         // {; <stmt> ; ... ;}
         {
-            consumeToken(token_index++, Lexer::LCURLY);
-            consumeToken(token_index++, Lexer::NEWLINE);
+            consumeToken(context, context.token_index++, Lexer::LCURLY);
+            consumeToken(context, context.token_index++, Lexer::NEWLINE);
             token_s += "{\n";
 
-            while (peekToken(token_index) != Lexer::RCURLY)
+            while (peekToken(context, context.token_index) != Lexer::RCURLY)
             {
-                std::unique_ptr<StmtNode> u_stmt(parseStmt()); 
+                NodePtr<StmtNode> u_stmt(parseStmt(context)); 
                 
                 token_s += u_stmt.get()->token_s + "\n";
                 
                 function_contents.push_back(std::move(u_stmt));
                 
-                consumeToken(token_index++, Lexer::NEWLINE);
+                consumeToken(context, context.token_index++, Lexer::NEWLINE);
             }
 
-            consumeToken(token_index++, Lexer::RCURLY);
+            consumeToken(context, context.token_index++, Lexer::RCURLY);
             token_s += "}";
         }
     }
@@ -332,17 +422,20 @@ namespace Parser
 
 #pragma region Expression Nodes
     
+    ExprNode::ExprNode(Arena& arena) : ASTNode(arena), cp(arena.make<CPValue>()) {}
+
     std::string ExprNode::rtypeToString()
     {
         if (resolvedType == nullptr)
             return "";
         
-        return " (" + resolvedType.get()->toString() + ")";
+        return " (" + resolvedType->toString() + ")";
     }
 
-    IntExprNode::IntExprNode(ASTNODE_CONSTRUCTOR_ARGS)
+    IntExprNode::IntExprNode(ASTNODE_CONSTRUCTOR_ARGS) : IntExprNode(context.arena)
     {
-        const Lexer::token t = consumeToken(token_index++, Lexer::INTVAL);
+        kind = KIND;
+        const Lexer::token t = consumeToken(context, context.token_index++, Lexer::INTVAL);
 
         std::string text(t.text);
 
@@ -358,9 +451,10 @@ namespace Parser
         return "(IntExpr" + rtypeToString() + " " + std::to_string(value) + ")";
     }
     
-    FloatExprNode::FloatExprNode(ASTNODE_CONSTRUCTOR_ARGS)
+    FloatExprNode::FloatExprNode(ASTNODE_CONSTRUCTOR_ARGS) : FloatExprNode(context.arena)
     {
-        const Lexer::token t = consumeToken(token_index++, Lexer::FLOATVAL);
+        kind = KIND;
+        const Lexer::token t = consumeToken(context, context.token_index++, Lexer::FLOATVAL);
 
         std::string text(t.text);
 
@@ -385,9 +479,10 @@ namespace Parser
         return "(FloatExpr" + rtypeToString() + " " + std::to_string(static_cast<long>(value)) + ")";
     }
 
-    TrueExprNode::TrueExprNode(ASTNODE_CONSTRUCTOR_ARGS)
+    TrueExprNode::TrueExprNode(ASTNODE_CONSTRUCTOR_ARGS) : TrueExprNode(context.arena)
     {
-        const Lexer::token t = consumeToken(token_index++, Lexer::TRUE);
+        kind = KIND;
+        const Lexer::token t = consumeToken(context, context.token_index++, Lexer::TRUE);
 
         value = true;
 
@@ -402,9 +497,10 @@ namespace Parser
         return "(TrueExpr" + rtypeToString() + ")";
     }
 
-    FalseExprNode::FalseExprNode(ASTNODE_CONSTRUCTOR_ARGS)
+    FalseExprNode::FalseExprNode(ASTNODE_CONSTRUCTOR_ARGS) : FalseExprNode(context.arena)
     {
-        const Lexer::token t = consumeToken(token_index++, Lexer::FALSE);
+        kind = KIND;
+        const Lexer::token t = consumeToken(context, context.token_index++, Lexer::FALSE);
 
         value = false;
 
@@ -419,12 +515,14 @@ namespace Parser
         return "(FalseExpr" + rtypeToString() + ")";
     }
 
-    VariableExprNode::VariableExprNode(ASTNODE_CONSTRUCTOR_ARGS)
+    VariableExprNode::VariableExprNode(ASTNODE_CONSTRUCTOR_ARGS) : VariableExprNode(context.arena)
     {
-        const Lexer::token t = consumeToken(token_index++, Lexer::VARIABLE);
+        kind = KIND;
+        const Lexer::token t = consumeToken(context, context.token_index++, Lexer::VARIABLE);
 
         std::string text(t.text);
         token_s = text;
+        symbol = t.symbol;
         line = t.line_number;
         pos = t.char_numer;
     }
@@ -439,32 +537,17 @@ namespace Parser
     ////////////////////////////////////////////
     
     // { <expr> , ... }
-    TupleLiteralExprNode::TupleLiteralExprNode(ASTNODE_CONSTRUCTOR_ARGS)
+    TupleLiteralExprNode::TupleLiteralExprNode(ASTNODE_CONSTRUCTOR_ARGS) : TupleLiteralExprNode(context.arena)
     {
-        Lexer::token t = consumeToken(token_index++, Lexer::LCURLY);
+        kind = KIND;
+        Lexer::token t = consumeToken(context, context.token_index++, Lexer::LCURLY);
         
         std::string text(t.text);
         token_s = text;
         line = t.line_number;
         pos = t.char_numer;
 
-        while (peekToken(token_index) != Lexer::RCURLY)
-        {
-            std::unique_ptr<ExprNode> u_type(parseExpr()); 
-            
-            token_s += " " + u_type.get()->token_s;
-            
-            tuple_expressions.push_back(std::move(u_type));
-            
-            if (peekToken(token_index) != Lexer::RCURLY)
-            {
-                consumeToken(token_index++, Lexer::COMMA);
-                token_s += ",";
-            }
-        }
-
-        consumeToken(token_index++, Lexer::RCURLY);
-        token_s += " }";
+        parseList(context, this, tuple_expressions, parseExpr, Lexer::RCURLY, " }");
     }
     std::string TupleLiteralExprNode::toString()
     {
@@ -472,32 +555,17 @@ namespace Parser
     }
 
     // [ <expr> , ... ]
-    ArrayLiteralExprNode::ArrayLiteralExprNode(ASTNODE_CONSTRUCTOR_ARGS)
+    ArrayLiteralExprNode::ArrayLiteralExprNode(ASTNODE_CONSTRUCTOR_ARGS) : ArrayLiteralExprNode(context.arena)
     {
-        Lexer::token t = consumeToken(token_index++, Lexer::LSQUARE);
+        kind = KIND;
+        Lexer::token t = consumeToken(context, context.token_index++, Lexer::LSQUARE);
         
         std::string text(t.text);
         token_s = text;
         line = t.line_number;
         pos = t.char_numer;
 
-        while (peekToken(token_index) != Lexer::RSQUARE)
-        {
-            std::unique_ptr<ExprNode> u_type(parseExpr()); 
-            
-            token_s += " " + u_type.get()->token_s;
-            
-            array_expressions.push_back(std::move(u_type));
-            
-            if (peekToken(token_index) != Lexer::RSQUARE)
-            {
-                consumeToken(token_index++, Lexer::COMMA);
-                token_s += ",";
-            }
-        }
-
-        consumeToken(token_index++, Lexer::RSQUARE);
-        token_s += " ]";
+        parseList(context, this, array_expressions, parseExpr, Lexer::RSQUARE, " ]");
     }
     std::string ArrayLiteralExprNode::toString()
     {
@@ -505,24 +573,21 @@ namespace Parser
     }
 
     // <expr> { <integer> }
-    TupleIndexExprNode::TupleIndexExprNode(ASTNODE_CONSTRUCTOR_ARGS ExprNode* head)
+    TupleIndexExprNode::TupleIndexExprNode(ASTNODE_CONSTRUCTOR_ARGS, NodePtr<ExprNode>& head) : TupleIndexExprNode(context.arena)
     {
-        std::unique_ptr<ExprNode> u_head(head);
+        kind = KIND;
 
-        token_s = head->token_s;
-        line = head->line;
-        pos = head->pos;
-
-        tuple_expression = std::move(u_head);
-
-        consumeToken(token_index++, Lexer::LCURLY);
-        token_s += "{ ";
-        const Lexer::token intval = consumeToken(token_index++, Lexer::INTVAL);
+        consumeToken(context, context.token_index++, Lexer::LCURLY);
+        const Lexer::token intval = consumeToken(context, context.token_index++, Lexer::INTVAL);
         std::string intstr(intval.text);
         tuple_index = castStringToInt(intstr, intval);
-        token_s += std::to_string(tuple_index);
-        consumeToken(token_index++, Lexer::RCURLY);
-        token_s += " }";
+        consumeToken(context, context.token_index++, Lexer::RCURLY);
+
+        // Takes head only once nothing can fail, so that a failed parse leaves it to the caller.
+        token_s = head->token_s + "{ " + std::to_string(tuple_index) + " }";
+        line = head->line;
+        pos = head->pos;
+        tuple_expression = std::move(head);
     }
     std::string TupleIndexExprNode::toString()
     {
@@ -531,36 +596,18 @@ namespace Parser
 
 
     // <expr> [ <expr> , ... ]
-    ArrayIndexExprNode::ArrayIndexExprNode(ASTNODE_CONSTRUCTOR_ARGS ExprNode* head)
+    ArrayIndexExprNode::ArrayIndexExprNode(ASTNODE_CONSTRUCTOR_ARGS, NodePtr<ExprNode>& head) : ArrayIndexExprNode(context.arena)
     {
-        std::unique_ptr<ExprNode> u_head(head);
+        kind = KIND;
+
+        consumeToken(context, context.token_index++, Lexer::LSQUARE);
 
-        token_s = head->token_s;
+        token_s = head->token_s + "[";
         line = head->line;
         pos = head->pos;
+        array_expression = std::move(head);
 
-        array_expression = std::move(u_head);
-
-        consumeToken(token_index++, Lexer::LSQUARE);
-        token_s += "[";
-
-        while (peekToken(token_index) != Lexer::RSQUARE)
-        {
-            std::unique_ptr<ExprNode> u_type(parseExpr()); 
-            
-            token_s += " " + u_type.get()->token_s;
-            
-            array_indices.push_back(std::move(u_type));
-            
-            if (peekToken(token_index) != Lexer::RSQUARE)
-            {
-                consumeToken(token_index++, Lexer::COMMA);
-                token_s += ",";
-            }
-        }
-
-        consumeToken(token_index++, Lexer::RSQUARE);
-        token_s += " ]";
+        parseList(context, this, array_indices, parseExpr, Lexer::RSQUARE, " ]");
     }
     std::string ArrayIndexExprNode::toString()
     {
@@ -568,8 +615,9 @@ namespace Parser
     }
 
     // <variable> ( <expr> , ... )
-    CallExprNode::CallExprNode(ASTNODE_CONSTRUCTOR_ARGS const Lexer::token& variable)
+    CallExprNode::CallExprNode(ASTNODE_CONSTRUCTOR_ARGS, const Lexer::token& variable) : CallExprNode(context.arena)
     {
+        kind = KIND;
         if (variable.type != Lexer::VARIABLE)
             throw ParserException("\nExpected a token of type VARIABLE; got a " + Lexer::tokenTypeToString(variable.type) + " instead.", variable);
 
@@ -579,27 +627,12 @@ namespace Parser
         pos = variable.char_numer;
 
         function_name = text;
+        function_symbol = variable.symbol;
 
-        consumeToken(token_index++, Lexer::LPAREN);
+        consumeToken(context, context.token_index++, Lexer::LPAREN);
         token_s += "(";
 
-        while (peekToken(token_index) != Lexer::RPAREN)
-        {
-            std::unique_ptr<ExprNode> u_type(parseExpr()); 
-            
-            token_s += " " + u_type.get()->token_s;
-            
-            arguments.push_back(std::move(u_type));
-            
-            if (peekToken(token_index) != Lexer::RPAREN)
-            {
-                consumeToken(token_index++, Lexer::COMMA);
-                token_s += ",";
-            }
-        }
-
-        consumeToken(token_index++, Lexer::RPAREN);
-        token_s += " )";
+        parseList(context, this, arguments, parseExpr, Lexer::RPAREN, " )");
     }
     std::string CallExprNode::toString()
     {
@@ -612,9 +645,10 @@ namespace Parser
 
     // - <expr>
     // ! <expr>
-    UnopExprNode::UnopExprNode(ASTNODE_CONSTRUCTOR_ARGS)
+    UnopExprNode::UnopExprNode(ASTNODE_CONSTRUCTOR_ARGS) : UnopExprNode(context.arena)
     {
-        Lexer::token unop_token = consumeToken(token_index++, Lexer::OP);
+        kind = KIND;
+        Lexer::token unop_token = consumeToken(context, context.token_index++, Lexer::OP);
         std::string text(unop_token.text);
         
         line = unop_token.line_number;
@@ -623,10 +657,8 @@ namespace Parser
 
         operation = tokenToUnopType(unop_token);
 
-        ExprNode* expr = parseUnopExpr();
-        token_s += expr->token_s;
-        std::unique_ptr<ExprNode> u_expr(expr);
-        expression = std::move(u_expr);
+        parseUnopExpr(context, expression);
+        then(context, [this] {token_s += expression->token_s;});
     }
 
     std::string UnopExprNode::toString()
@@ -648,20 +680,22 @@ namespace Parser
         }
     }
 
-    BinopExprNode::BinopExprNode(ASTNODE_CONSTRUCTOR_ARGS std::unique_ptr<ExprNode>& _lhs, const Lexer::token& binop_token, std::unique_ptr<ExprNode>& _rhs)
+    BinopExprNode::BinopExprNode(ASTNODE_CONSTRUCTOR_ARGS, NodePtr<ExprNode>& _lhs, const Lexer::token& binop_token) : BinopExprNode(context.arena)
     {
+        kind = KIND;
+        operation = tokenToBinopType(binop_token);
+
         line = _lhs.get()->line;
         pos = _lhs.get()->pos;
-        token_s = _lhs.get()->token_s + " ";
+        // Sized up front for the text of an rhs as long as lhs's, so that it is mostly built with
+        // a single allocation.
+        token_s.reserve(2 * _lhs.get()->token_s.size() + binop_token.text.size() + 2);
+        token_s += _lhs.get()->token_s;
+        token_s += ' ';
+        token_s += binop_token.text;
+        token_s += ' ';
 
         lhs = std::move(_lhs);
-        
-        std::string text(binop_token.text);
-        token_s += text + " ";
-        operation = tokenToBinopType(binop_token);
-
-        token_s += _rhs.get()->token_s;
-        rhs = std::move(_rhs);
     }
 
     std::string BinopExprNode::toString()
@@ -737,34 +771,35 @@ namespace Parser
     }
 
     // if <expr> then <expr> else <expr>
-    IfExprNode::IfExprNode(ASTNODE_CONSTRUCTOR_ARGS)
+    IfExprNode::IfExprNode(ASTNODE_CONSTRUCTOR_ARGS) : IfExprNode(context.arena)
     {
-        const Lexer::token& if_token = consumeToken(token_index++, Lexer::IF);
+        kind = KIND;
+        const Lexer::token& if_token = consumeToken(context, context.token_index++, Lexer::IF);
         
         line = if_token.line_number;
         pos = if_token.char_numer;
         token_s = "if ";
 
-        ExprNode* _condition = parseExpr();
-        token_s += _condition->token_s;
-        std::unique_ptr<ExprNode> u_condition(_condition);
-        condition = std::move(u_condition);
+        parseExpr(context, condition);
+        then(context, [this, &context]
+        {
+            token_s += condition->token_s;
 
-        consumeToken(token_index++, Lexer::THEN);
-        token_s += " then ";
+            consumeToken(context, context.token_index++, Lexer::THEN);
+            token_s += " then ";
 
-        ExprNode* _then_expr = parseExpr();
-        token_s += _then_expr->token_s;
-        std::unique_ptr<ExprNode> u_then_expr(_then_expr);
-        then_expr = std::move(u_then_expr);
+            parseExpr(context, then_expr);
+            then(context, [this, &context]
+            {
+                token_s += then_expr->token_s;
 
-        consumeToken(token_index++, Lexer::ELSE);
-        token_s += " else ";
+                consumeToken(context, context.token_index++, Lexer::ELSE);
+                token_s += " else ";
 
-        ExprNode* _else_expr = parseExpr();
-        token_s += _else_expr->token_s;
-        std::unique_ptr<ExprNode> u_else_expr(_else_expr);
-        else_expr = std::move(u_else_expr);
+                parseExpr(context, else_expr);
+                then(context, [this] {token_s += else_expr->token_s;});
+            });
+        });
     }
 
     std::string IfExprNode::toString()
@@ -772,79 +807,85 @@ namespace Parser
         return "(IfExpr" + rtypeToString() + " " + condition.get()->toString() + " " + then_expr.get()->toString() + " " + else_expr.get()->toString() + ")";
     }
 
-    // [ <variable> : <expr> , ... ]
-    std::vector<std::unique_ptr<std::pair<std::string, std::unique_ptr<ExprNode>>>> LoopExprNode::parseBounds()
+    // [ <variable> : <expr> , ... ] <expr>
+    void LoopExprNode::parseLoop(Context& context)
     {
-
-        std::vector<std::unique_ptr<std::pair<std::string, std::unique_ptr<ExprNode>>>> bounds;
-        
-        consumeToken(token_index++, Lexer::LSQUARE);
+        consumeToken(context, context.token_index++, Lexer::LSQUARE);
         token_s += " [";
 
-        while (peekToken(token_index) != Lexer::RSQUARE)
-        {
-            const Lexer::token& var_token = consumeToken(token_index++, Lexer::VARIABLE);
-            std::string var_name(var_token.text);
+        parseBound(context);
+    }
 
-            consumeToken(token_index++, Lexer::COLON);
+    // Parses the next bound, or the end of the bounds and the body.
+    void LoopExprNode::parseBound(Context& context)
+    {
+        addTask(context, [this, &context]
+        {
+            if (peekToken(context, context.token_index) == Lexer::RSQUARE)
+            {
+                consumeToken(context, context.token_index++, Lexer::RSQUARE);
+                token_s += " ]";
 
-            std::unique_ptr<ExprNode> u_expr(parseExpr()); 
-            
-            token_s += " " + var_name + " : " + u_expr.get()->token_s;
+                for(const auto& bound : bounds)
+                {
+                    token_s += bound.first;
+                    token_s += " " + bound.second.get()->token_s + " ";
+                }
 
-            std::unique_ptr<std::pair<std::string, std::unique_ptr<ExprNode>>> u_bound(new std::pair(var_name, std::move(u_expr)));
-            bounds.push_back(std::move(u_bound));
-            
-            if (peekToken(token_index) != Lexer::RSQUARE)
-            {
-                consumeToken(token_index++, Lexer::COMMA);
-                token_s += ",";
-                if (peekToken(token_index) == Lexer::RSQUARE)
-                    throw ParserException(" Trailing comma detected.", consumeToken(--token_index, Lexer::COMMA));
+                parseExpr(context, loop_expression);
+                then(context, [this] {token_s += loop_expression->token_s;});
+                return;
             }
 
-        }
+            const Lexer::token& var_token = consumeToken(context, context.token_index++, Lexer::VARIABLE);
 
-        consumeToken(token_index++, Lexer::RSQUARE);
-        token_s += " ]";
+            consumeToken(context, context.token_index++, Lexer::COLON);
+
+            bounds.emplace_back(Text(context.arena, var_token.text), nullptr);
+            bound_symbols.push_back(var_token.symbol);
+
+            parseExpr(context, bounds.back().second);
+            then(context, [this, &context]
+            {
+                token_s += " " + bounds.back().first + " : " + bounds.back().second.get()->token_s;
+
+                if (peekToken(context, context.token_index) != Lexer::RSQUARE)
+                {
+                    consumeToken(context, context.token_index++, Lexer::COMMA);
+                    token_s += ",";
+                    if (peekToken(context, context.token_index) == Lexer::RSQUARE)
+                        throw ParserException(" Trailing comma detected.", consumeToken(context, --context.token_index, Lexer::COMMA));
+                }
 
-        return bounds;
+                parseBound(context);
+            });
+        });
     }
 
-    std::string LoopExprNode::boundstoString(const std::vector<std::unique_ptr<std::pair<std::string, std::unique_ptr<ExprNode>>>>& bounds)
+    std::string LoopExprNode::boundstoString(const ArenaVector<std::pair<Text, NodePtr<ExprNode>>>& bounds)
     {
         std::string bounds_s = "";
 
         for(const auto& bound : bounds)
         {
-            bounds_s += bound.get()->first + " ";
-            bounds_s += bound.get()->second.get()->toString() + " ";
+            bounds_s += bound.first + " ";
+            bounds_s += bound.second.get()->toString() + " ";
         }
 
         return bounds_s;
     }
 
     // array [ <variable> : <expr> , ... ] <expr>
-    ArrayLoopExprNode::ArrayLoopExprNode(ASTNODE_CONSTRUCTOR_ARGS)
+    ArrayLoopExprNode::ArrayLoopExprNode(ASTNODE_CONSTRUCTOR_ARGS) : ArrayLoopExprNode(context.arena)
     {
-        const Lexer::token& array_token = consumeToken(token_index++, Lexer::ARRAY);
+        kind = KIND;
+        const Lexer::token& array_token = consumeToken(context, context.token_index++, Lexer::ARRAY);
 
         line = array_token.line_number;
         pos = array_token.char_numer;
         token_s = "array ";
 
-        bounds = parseBounds();
-
-        for(const auto& bound : bounds)
-        {
-            token_s += bound.get()->first;
-            token_s += " " + bound.get()->second.get()->token_s + " ";
-        }
-
-        ExprNode* _loop_expression = parseExpr();
-        token_s += _loop_expression->token_s;
-        std::unique_ptr<ExprNode> u_loop_expression(_loop_expression);
-        loop_expression = std::move(u_loop_expression);
+        parseLoop(context);
     }
 
     std::string ArrayLoopExprNode::toString()
@@ -853,26 +894,16 @@ namespace Parser
     }
 
     // sum [ <variable> : <expr> , ... ] <expr>
-    SumLoopExprNode::SumLoopExprNode(ASTNODE_CONSTRUCTOR_ARGS)
+    SumLoopExprNode::SumLoopExprNode(ASTNODE_CONSTRUCTOR_ARGS) : SumLoopExprNode(context.arena)
     {
-        const Lexer::token& sum_token = consumeToken(token_index++, Lexer::SUM);
+        kind = KIND;
+        const Lexer::token& sum_token = consumeToken(context, context.token_index++, Lexer::SUM);
 
         line = sum_token.line_number;
         pos = sum_token.char_numer;
         token_s = "sum ";
 
-        bounds = parseBounds();
-
-        for(const auto& bound : bounds)
-        {
-            token_s += bound.get()->first;
-            token_s += " " + bound.get()->second.get()->token_s + " ";
-        }
-
-        ExprNode* _loop_expression = parseExpr();
-        token_s += _loop_expression->token_s;
-        std::unique_ptr<ExprNode> u_loop_expression(_loop_expression);
-        loop_expression = std::move(u_loop_expression);
+        parseLoop(context);
     }
 
     std::string SumLoopExprNode::toString()
@@ -880,13 +911,19 @@ namespace Parser
         return "(SumLoopExpr" + rtypeToString() + " " + boundstoString(bounds) + loop_expression.get()->toString() + ")";
     }
 
+    std::string InlinedCallExprNode::toString()
+    {
+        return "(InlinedCallExpr" + rtypeToString() + " " + function_name + " " + NodeVectorToString<StmtNode>(statements) + " " + result->toString() + ")";
+    }
+
 
 #pragma endregion
 
 #pragma region Type Nodes
-    IntTypeNode::IntTypeNode(ASTNODE_CONSTRUCTOR_ARGS)
+    IntTypeNode::IntTypeNode(ASTNODE_CONSTRUCTOR_ARGS) : IntTypeNode(context.arena)
     {
-        const Lexer::token t = consumeToken(token_index++, Lexer::INT);
+        kind = KIND;
+        const Lexer::token t = consumeToken(context, context.token_index++, Lexer::INT);
 
         std::string text(t.text);
         token_s = text;
@@ -899,9 +936,10 @@ namespace Parser
         return "(IntType)";
     }
 
-    BoolTypeNode::BoolTypeNode(ASTNODE_CONSTRUCTOR_ARGS)
+    BoolTypeNode::BoolTypeNode(ASTNODE_CONSTRUCTOR_ARGS) : BoolTypeNode(context.arena)
     {
-        const Lexer::token t = consumeToken(token_index++, Lexer::BOOL);
+        kind = KIND;
+        const Lexer::token t = consumeToken(context, context.token_index++, Lexer::BOOL);
 
         std::string text(t.text);
         token_s = text;
@@ -914,9 +952,10 @@ namespace Parser
         return "(BoolType)";
     }
 
-    FloatTypeNode::FloatTypeNode(ASTNODE_CONSTRUCTOR_ARGS)
+    FloatTypeNode::FloatTypeNode(ASTNODE_CONSTRUCTOR_ARGS) : FloatTypeNode(context.arena)
     {
-        const Lexer::token t = consumeToken(token_index++, Lexer::FLOAT);
+        kind = KIND;
+        const Lexer::token t = consumeToken(context, context.token_index++, Lexer::FLOAT);
 
         std::string text(t.text);
         token_s = text;
@@ -929,12 +968,14 @@ namespace Parser
         return "(FloatType)";
     }
 
-    VariableTypeNode::VariableTypeNode(ASTNODE_CONSTRUCTOR_ARGS)
+    VariableTypeNode::VariableTypeNode(ASTNODE_CONSTRUCTOR_ARGS) : VariableTypeNode(context.arena)
     {
-        const Lexer::token t = consumeToken(token_index++, Lexer::VARIABLE);
+        kind = KIND;
+        const Lexer::token t = consumeToken(context, context.token_index++, Lexer::VARIABLE);
 
         std::string text(t.text);
         token_s = text;
+        symbol = t.symbol;
         line = t.line_number;
         pos = t.char_numer;
     }
@@ -949,28 +990,26 @@ namespace Parser
     ////////////////////////////////////////////
 
     // <type> [ , ... ]
-    ArrayTypeNode::ArrayTypeNode(ASTNODE_CONSTRUCTOR_ARGS TypeNode* head)
+    ArrayTypeNode::ArrayTypeNode(ASTNODE_CONSTRUCTOR_ARGS, NodePtr<TypeNode>& head) : ArrayTypeNode(context.arena)
     {
-
-        std::unique_ptr<TypeNode> u_head(head);
-        array_type = std::move(u_head);
-
-        line = head->line;
-        pos = head->pos;
-        token_s = head->token_s + "[";
+        kind = KIND;
 
         rank = 1;
-        consumeToken(token_index++, Lexer::LSQUARE);
+        consumeToken(context, context.token_index++, Lexer::LSQUARE);
 
-        while (peekToken(token_index) != Lexer::RSQUARE)
+        while (peekToken(context, context.token_index) != Lexer::RSQUARE)
         {
             rank++;
-            consumeToken(token_index++, Lexer::COMMA);
-            token_s += ",";
+            consumeToken(context, context.token_index++, Lexer::COMMA);
         }
 
-        consumeToken(token_index++, Lexer::RSQUARE);
-        token_s += "]";
+        consumeToken(context, context.token_index++, Lexer::RSQUARE);
+
+        // Takes head only once nothing can fail, so that a failed parse leaves it to the caller.
+        line = head->line;
+        pos = head->pos;
+        token_s = head->token_s + "[" + std::string(rank - 1, ',') + "]";
+        array_type = std::move(head);
     }
 
     std::string ArrayTypeNode::toString()
@@ -981,33 +1020,17 @@ namespace Parser
     
 
     // { <type> , ... }
-    TupleTypeNode::TupleTypeNode(ASTNODE_CONSTRUCTOR_ARGS)
+    TupleTypeNode::TupleTypeNode(ASTNODE_CONSTRUCTOR_ARGS) : TupleTypeNode(context.arena)
     {
-        const Lexer::token lcurly = consumeToken(token_index++, Lexer::LCURLY);
+        kind = KIND;
+        const Lexer::token lcurly = consumeToken(context, context.token_index++, Lexer::LCURLY);
 
         line = lcurly.line_number;
         pos = lcurly.char_numer;
         std::string text(lcurly.text);
         token_s = text;
 
-        while (peekToken(token_index) != Lexer::RCURLY)
-        {
-            std::unique_ptr<TypeNode> u_type(parseType()); 
-            
-            token_s += " " + u_type.get()->token_s;
-            
-            tuple_types.push_back(std::move(u_type));
-            
-            if (peekToken(token_index) != Lexer::RCURLY)
-            {
-                consumeToken(token_index++, Lexer::COMMA);
-                token_s += ",";
-            }
-
-        }
-
-        consumeToken(token_index++, Lexer::RCURLY);
-        token_s += "}";
+        parseList(context, this, tuple_types, parseType, Lexer::RCURLY, "}");
     }
     
     std::string TupleTypeNode::toString()
@@ -1019,12 +1042,14 @@ namespace Parser
 
 #pragma region Argument Nodes
 
-    VarArgumentNode::VarArgumentNode(ASTNODE_CONSTRUCTOR_ARGS)
+    VarArgumentNode::VarArgumentNode(ASTNODE_CONSTRUCTOR_ARGS) : VarArgumentNode(context.arena)
     {
-        const Lexer::token t = consumeToken(token_index++, Lexer::VARIABLE);
+        kind = KIND;
+        const Lexer::token t = consumeToken(context, context.token_index++, Lexer::VARIABLE);
 
         std::string text(t.text);
         token_s = text;
+        symbol = t.symbol;
         line = t.line_number;
         pos = t.char_numer;
     }
@@ -1039,8 +1064,9 @@ namespace Parser
     ////////////////////////////////////////////
     
     // <variable> [ <variable> , ... ]
-    ArrayArgumentNode::ArrayArgumentNode(ASTNODE_CONSTRUCTOR_ARGS const Lexer::token& variable)
+    ArrayArgumentNode::ArrayArgumentNode(ASTNODE_CONSTRUCTOR_ARGS, const Lexer::token& variable) : ArrayArgumentNode(context.arena)
     {
+        kind = KIND;
 
         if (variable.type != Lexer::VARIABLE)
             throw ParserException("\nExpected a token of type VARIABLE; got a " + Lexer::tokenTypeToString(variable.type) + " instead.", variable);
@@ -1051,28 +1077,30 @@ namespace Parser
         pos = variable.char_numer;
         
         array_argument_name = text;
+        array_argument_symbol = variable.symbol;
 
-        consumeToken(token_index++, Lexer::LSQUARE);
+        consumeToken(context, context.token_index++, Lexer::LSQUARE);
         token_s += "[";
 
-        while (peekToken(token_index) != Lexer::RSQUARE)
+        while (peekToken(context, context.token_index) != Lexer::RSQUARE)
         {
-            Lexer::token dimension_var = consumeToken(token_index++, Lexer::VARIABLE); 
+            Lexer::token dimension_var = consumeToken(context, context.token_index++, Lexer::VARIABLE); 
             
             std::string text(dimension_var.text);
             token_s += " " + text;
             
-            array_dimensions_names.push_back(text);
+            array_dimensions_names.emplace_back(context.arena, text);
+            array_dimensions_symbols.push_back(dimension_var.symbol);
             
-            if (peekToken(token_index) != Lexer::RSQUARE)
+            if (peekToken(context, context.token_index) != Lexer::RSQUARE)
             {
-                consumeToken(token_index++, Lexer::COMMA);
+                consumeToken(context, context.token_index++, Lexer::COMMA);
                 token_s += ",";
             }
 
         }
 
-        consumeToken(token_index++, Lexer::RSQUARE);
+        consumeToken(context, context.token_index++, Lexer::RSQUARE);
         token_s += " ]";
     }
 
@@ -1095,8 +1123,10 @@ namespace Parser
 
 #pragma region LValue Nodes
 
-    ArgumentLValue::ArgumentLValue(ASTNODE_CONSTRUCTOR_ARGS) : argument(parseArgument()) 
+    ArgumentLValue::ArgumentLValue(ASTNODE_CONSTRUCTOR_ARGS) : ArgumentLValue(context.arena)
     {
+        kind = KIND;
+        argument.reset(parseArgument(context));
         token_s = argument.get()->token_s;
         line = argument.get()->line;
         pos = argument.get()->pos;
@@ -1113,33 +1143,17 @@ namespace Parser
 
     
     // { <lvalue> , ... }
-    TupleLValueNode::TupleLValueNode(ASTNODE_CONSTRUCTOR_ARGS)
+    TupleLValueNode::TupleLValueNode(ASTNODE_CONSTRUCTOR_ARGS) : TupleLValueNode(context.arena)
     {
-        Lexer::token t = consumeToken(token_index++, Lexer::LCURLY);
+        kind = KIND;
+        Lexer::token t = consumeToken(context, context.token_index++, Lexer::LCURLY);
         
         std::string text(t.text);
         token_s = text;
         line = t.line_number;
         pos = t.char_numer;
 
-        while (peekToken(token_index) != Lexer::RCURLY)
-        {
-            std::unique_ptr<LValue> u_lvalue(parseLValue()); 
-            
-            token_s += " " + u_lvalue.get()->token_s;
-            
-            lvalues.push_back(std::move(u_lvalue));
-            
-            if (peekToken(token_index) != Lexer::RCURLY)
-            {
-                consumeToken(token_index++, Lexer::COMMA);
-                token_s += ",";
-            }
-
-        }
-
-        consumeToken(token_index++, Lexer::RCURLY);
-        token_s += " }";
+        parseList(context, this, lvalues, parseLValue, Lexer::RCURLY, " }");
     }
 
     std::string TupleLValueNode::toString()
@@ -1156,33 +1170,17 @@ namespace Parser
 
     
     // { <binding> , ... }
-    TupleBindingNode::TupleBindingNode(ASTNODE_CONSTRUCTOR_ARGS)
+    TupleBindingNode::TupleBindingNode(ASTNODE_CONSTRUCTOR_ARGS) : TupleBindingNode(context.arena)
     {
-        Lexer::token t = consumeToken(token_index++, Lexer::LCURLY);
+        kind = KIND;
+        Lexer::token t = consumeToken(context, context.token_index++, Lexer::LCURLY);
         
         std::string text(t.text);
         token_s = text;
         line = t.line_number;
         pos = t.char_numer;
 
-        while (peekToken(token_index) != Lexer::RCURLY)
-        {
-            std::unique_ptr<BindingNode> u_binding(parseBinding()); 
-            
-            token_s += " " + u_binding.get()->token_s;
-            
-            bindings.push_back(std::move(u_binding));
-            
-            if (peekToken(token_index) != Lexer::RCURLY)
-            {
-                consumeToken(token_index++, Lexer::COMMA);
-                token_s += ",";
-            }
-
-        }
-
-        consumeToken(token_index++, Lexer::RCURLY);
-        token_s += " }";
+        parseList(context, this, bindings, parseBinding, Lexer::RCURLY, " }");
     }
 
     std::string TupleBindingNode::toString()
@@ -1191,24 +1189,23 @@ namespace Parser
     }
 
     // <argument> : <type>
-    VarBindingNode::VarBindingNode()
+    VarBindingNode::VarBindingNode(ASTNODE_CONSTRUCTOR_ARGS) : VarBindingNode(context.arena)
     {
-        ArgumentNode* arg = parseArgument();
+        kind = KIND;
+        ArgumentNode* arg = parseArgument(context);
 
         line = arg->line;
         pos = arg->pos;
         token_s = arg->token_s + " ";
 
-        std::unique_ptr<ArgumentNode> u_arg(arg);
+        NodePtr<ArgumentNode> u_arg(arg);
         argument = std::move(u_arg);
 
-        consumeToken(token_index++, Lexer::COLON);
+        consumeToken(context, context.token_index++, Lexer::COLON);
         token_s += ": ";
 
-        TypeNode* t = parseType();
-        token_s += t->token_s;
-        std::unique_ptr<TypeNode> u_type(t);
-        type = std::move(u_type);
+        parseType(context, type);
+        then(context, [this] {token_s += type->token_s;});
     }
 
     std::string VarBindingNode::toString()
@@ -1226,28 +1223,29 @@ namespace Parser
 
     
     // let <lvalue> = <expr>
-    LetStmtNode::LetStmtNode(ASTNODE_CONSTRUCTOR_ARGS)
+    LetStmtNode::LetStmtNode(ASTNODE_CONSTRUCTOR_ARGS) : LetStmtNode(context.arena)
     {
+        kind = KIND;
 
-        Lexer::token let_t = consumeToken(token_index++, Lexer::LET);
+        Lexer::token let_t = consumeToken(context, context.token_index++, Lexer::LET);
         std::string text(let_t.text);
 
         token_s = text + " ";
         line = let_t.line_number;
         pos = let_t.char_numer;
 
-        LValue* lvalue = parseLValue();
+        LValue* lvalue = parseLValue(context);
         token_s += lvalue->token_s + " ";
-        std::unique_ptr<LValue> u_lvalue(lvalue);
+        NodePtr<LValue> u_lvalue(lvalue);
         set_variable_name = std::move(u_lvalue);
 
 
-        consumeToken(token_index++, Lexer::EQUALS);
+        consumeToken(context, context.token_index++, Lexer::EQUALS);
         token_s += "= ";
 
-        ExprNode* expr = parseExpr();
+        ExprNode* expr = parseExpr(context);
         token_s += expr->token_s;
-        std::unique_ptr<ExprNode> u_expr(expr);
+        NodePtr<ExprNode> u_expr(expr);
         variable_expression = std::move(u_expr);
     }
     std::string LetStmtNode::toString()
@@ -1256,15 +1254,16 @@ namespace Parser
     }
 
     // assert <expr> , <string>
-    AssertStmtNode::AssertStmtNode()
+    AssertStmtNode::AssertStmtNode(ASTNODE_CONSTRUCTOR_ARGS) : AssertStmtNode(context.arena)
     {
+        kind = KIND;
         
-        Lexer::token assertToken = consumeToken(token_index++, Lexer::ASSERT);
+        Lexer::token assertToken = consumeToken(context, context.token_index++, Lexer::ASSERT);
         std::string assertToken_s(assertToken.text);
-        std::unique_ptr<ExprNode> _expression(parseExpr());
+        NodePtr<ExprNode> _expression(parseExpr(context));
         expression = std::move(_expression);
-        std::string commaToken_s(consumeToken(token_index++, Lexer::COMMA).text);
-        std::unique_ptr<StringNode> _string(new StringNode());
+        std::string commaToken_s(consumeToken(context, context.token_index++, Lexer::COMMA).text);
+        NodePtr<StringNode> _string(new (context.arena) StringNode(context));
         string = std::move(_string);
         
         token_s = assertToken_s + " " + expression.get()->token_s + " " + commaToken_s + " " + string.get()->token_s;
@@ -1277,19 +1276,20 @@ namespace Parser
     }
 
     // return <expr>
-    ReturnStmtNode::ReturnStmtNode()
+    ReturnStmtNode::ReturnStmtNode(ASTNODE_CONSTRUCTOR_ARGS) : ReturnStmtNode(context.arena)
     {
+        kind = KIND;
 
-        Lexer::token return_t = consumeToken(token_index++, Lexer::RETURN);
+        Lexer::token return_t = consumeToken(context, context.token_index++, Lexer::RETURN);
         std::string text(return_t.text);
 
         token_s = text + " ";
         line = return_t.line_number;
         pos = return_t.char_numer;
 
-        ExprNode* expr = parseExpr();
+        ExprNode* expr = parseExpr(context);
         token_s += expr->token_s;
-        std::unique_ptr<ExprNode> u_expr(expr);
+        NodePtr<ExprNode> u_expr(expr);
         expression = std::move(u_expr);
     }
     std::string ReturnStmtNode::toString()
@@ -1302,55 +1302,118 @@ namespace Parser
 #pragma endregion
 
 #pragma region Parser Implementation
-    std::vector<std::unique_ptr<CmdNode>> parse(std::vector<Lexer::token>* _tokens) 
+    std::vector<NodePtr<CmdNode>> parse(Lexer::TokenStream* tokens, Arena& arena) 
     {
-        tokens = _tokens;
-        return parseAllTokens();
+        Context context(tokens, arena);
+
+        try
+        {
+            return parseAllTokens(context);
+        }
+        catch (const ParserException& e)
+        {
+            // Lexing errors take precedence, as if the whole source were lexed before parsing.
+            tokens->drain();
+            throw;
+        }
     }
 
-    std::string parseToString(std::vector<Lexer::token>* _tokens)
-    {
-        std::vector<std::unique_ptr<CmdNode>> tree;
+    // Nothing in a tree is destroyed, so nothing in it may need to be.
+    static_assert(std::is_trivially_destructible<StringNode>::value, "StringNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<VarArgumentNode>::value, "VarArgumentNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<ArrayArgumentNode>::value, "ArrayArgumentNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<TupleBindingNode>::value, "TupleBindingNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<VarBindingNode>::value, "VarBindingNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<ArgumentLValue>::value, "ArgumentLValue must be freed with its arena");
+    static_assert(std::is_trivially_destructible<TupleLValueNode>::value, "TupleLValueNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<IntExprNode>::value, "IntExprNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<FloatExprNode>::value, "FloatExprNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<TrueExprNode>::value, "TrueExprNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<FalseExprNode>::value, "FalseExprNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<VariableExprNode>::value, "VariableExprNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<TupleLiteralExprNode>::value, "TupleLiteralExprNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<ArrayLiteralExprNode>::value, "ArrayLiteralExprNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<TupleIndexExprNode>::value, "TupleIndexExprNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<ArrayIndexExprNode>::value, "ArrayIndexExprNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<CallExprNode>::value, "CallExprNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<UnopExprNode>::value, "UnopExprNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<BinopExprNode>::value, "BinopExprNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<IfExprNode>::value, "IfExprNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<ArrayLoopExprNode>::value, "ArrayLoopExprNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<SumLoopExprNode>::value, "SumLoopExprNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<InlinedCallExprNode>::value, "InlinedCallExprNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<LetStmtNode>::value, "LetStmtNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<AssertStmtNode>::value, "AssertStmtNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<ReturnStmtNode>::value, "ReturnStmtNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<IntTypeNode>::value, "IntTypeNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<BoolTypeNode>::value, "BoolTypeNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<FloatTypeNode>::value, "FloatTypeNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<VariableTypeNode>::value, "VariableTypeNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<ArrayTypeNode>::value, "ArrayTypeNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<TupleTypeNode>::value, "TupleTypeNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<ReadCmdNode>::value, "ReadCmdNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<WriteCmdNode>::value, "WriteCmdNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<TypeCmdNode>::value, "TypeCmdNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<LetCmdNode>::value, "LetCmdNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<AssertCmdNode>::value, "AssertCmdNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<PrintCmdNode>::value, "PrintCmdNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<ShowCmdNode>::value, "ShowCmdNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<TimeCmdNode>::value, "TimeCmdNode must be freed with its arena");
+    static_assert(std::is_trivially_destructible<FnCmd>::value, "FnCmd must be freed with its arena");
+
+    void destroy_tree(std::vector<NodePtr<CmdNode>>& tree, Arena& arena)
+    {
+        tree.clear();
+        arena.release();
+    }
+
+    std::string parseToString(Lexer::TokenStream* tokens)
+    {
+        Arena arena;
+        std::vector<NodePtr<CmdNode>> tree;
 
         try
         {
-            tree = parse(_tokens);
+            tree = parse(tokens, arena);
         }
         catch(const std::exception& e)
         {
             return "Compilation failed\n";
         }
 
+        FlatAST flat(tree);
         std::string message = "";
 
-        for (int i = 0; i < tree.size(); i++)
+        for (NodeIndex cmd : flat.commands)
         {
-            message += tree[i].get()->toString() + "\n";
+            flat.print(cmd, message);
+            message += "\n";
         }
+        destroy_tree(tree, arena);
 
         return message + "Compilation succeeded\n";
     }
 
-    Lexer::TokenType peekToken(int index_to_peek)
+    Lexer::TokenType peekToken(Context& context, int index_to_peek)
     {
         if (index_to_peek < 0)
             throw ParserException("\nAsked to see a token at index < 0 " + std::to_string(index_to_peek) + ".");
         
-        if (index_to_peek >= (*tokens).size())
-            throw ParserException("\nTried to query a token when there were none left; # of tokens: " + std::to_string((*tokens).size()) + ", index to peek " + std::to_string(index_to_peek) + ".");
+        if (!context.tokens->has(index_to_peek))
+            throw ParserException("\nTried to query a token when there were none left; # of tokens: " + std::to_string(context.tokens->lexed()) + ", index to peek " + std::to_string(index_to_peek) + ".");
 
-        return (*tokens)[index_to_peek].type;
+        return context.tokens->type(index_to_peek);
     }
 
-    const Lexer::token consumeToken(int index_to_consume, Lexer::TokenType expected_token_type)
+    const Lexer::token consumeToken(Context& context, int index_to_consume, Lexer::TokenType expected_token_type)
     {
         if (index_to_consume < 0)
             throw ParserException("\nExpected to see a " + Lexer::tokenTypeToString(expected_token_type) +  " token at index < 0 " + std::to_string(expected_token_type) + ".");
         
-        if (index_to_consume >= (*tokens).size())
-            throw ParserException("\nExpected to see a " + Lexer::tokenTypeToString(expected_token_type) + " token when there were none left; # of tokens: " + std::to_string((*tokens).size()) + ", index to consume " + std::to_string(expected_token_type) + ".");
+        if (!context.tokens->has(index_to_consume))
+            throw ParserException("\nExpected to see a " + Lexer::tokenTypeToString(expected_token_type) + " token when there were none left; # of tokens: " + std::to_string(context.tokens->lexed()) + ", index to consume " + std::to_string(expected_token_type) + ".");
 
-        Lexer::token token_of_interest = (*tokens)[index_to_consume];
+        Lexer::token token_of_interest = (*context.tokens)[index_to_consume];
 
         if (token_of_interest.type != expected_token_type)
             throw ParserException("\nExpected token of type " + Lexer::tokenTypeToString(expected_token_type) + ", but got a token of type " + Lexer::tokenTypeToString(token_of_interest.type) + "." , token_of_interest);
@@ -1358,364 +1421,441 @@ namespace Parser
         return token_of_interest;
     }
 
-    std::vector<std::unique_ptr<CmdNode>> parseAllTokens()
+    // Returns the token at index_to_peek if it has the expected type, or nothing otherwise.
+    // Never throws a ParserException, so speculative parses can look at a token before committing to consume it.
+    std::optional<Lexer::token> tryPeekToken(Context& context, int index_to_peek, Lexer::TokenType expected_token_type)
     {
-        std::vector<std::unique_ptr<CmdNode>> treeNodes;
-
-        if (peekToken(token_index) == Lexer::NEWLINE)
-            consumeToken(token_index++, Lexer::NEWLINE);
+        if (index_to_peek < 0 || !context.tokens->has(index_to_peek) || context.tokens->type(index_to_peek) != expected_token_type)
+            return std::nullopt;
 
-        while (peekToken(token_index) != Lexer::END_OF_FILE)
-        {
-            std::unique_ptr<CmdNode> unique_ast(parseCmd()); 
-            treeNodes.push_back(std::move(unique_ast));
-            consumeToken(token_index++, Lexer::NEWLINE);
-        }
-        
+        return (*context.tokens)[index_to_peek];
+    }
 
-        return treeNodes;
+    void addTask(Context& context, std::function<void()> task)
+    {
+        context.tasks.push_back(std::move(task));
     }
 
-    CmdNode* parseCmd()
+    void then(Context& context, std::function<void()> work)
     {
-        Lexer::TokenType tokenType = peekToken(token_index);
+        addTask(context, std::move(work));
+    }
 
-        switch(tokenType)
+    void runTasks(Context& context, size_t base)
+    {
+        while (context.tasks.size() > base)
         {
-            case Lexer::READ:
-                return new ReadCmdNode();
-            case Lexer::WRITE:
-                return new WriteCmdNode();
-            case Lexer::TYPE:
-                return new TypeCmdNode();
-            case Lexer::LET:
-                return new LetCmdNode();
-            case Lexer::ASSERT:
-                return new AssertCmdNode();
-            case Lexer::PRINT:
-                return new PrintCmdNode();
-            case Lexer::SHOW:
-                return new ShowCmdNode();
-            case Lexer::TIME:
-                return new TimeCmdNode();
-            case Lexer::FN:
-                return new FnCmd();
-            default:
-                throw ParserException("\nFailed to parse a command; got a " + Lexer::tokenTypeToString(tokenType) + " token instead.", (*tokens)[token_index]);
+            std::function<void()> next = std::move(context.tasks.back());
+            context.tasks.pop_back();
+            size_t added = context.tasks.size();
+            next();
+            // The stack runs the tasks just added last first, so they are turned around.
+            std::reverse(context.tasks.begin() + added, context.tasks.end());
         }
     }
 
-    TypeNode* parseType()
+    // Parses a node with parse and runs its tasks. If the parse fails, the tasks left are dropped;
+    // what was parsed stays in the arena until the arena is freed.
+    template<class T>
+    T* parseNow(Context& context, void (*parse)(Context&, NodePtr<T>&))
     {
-        
-        TypeNode* head = parseTypeHead();
-        TypeNode* full = parseTypeCont(head);
-        return full;
+        NodePtr<T> node;
+        size_t base = context.tasks.size();
+
+        try
+        {
+            parse(context, node);
+            runTasks(context, base);
+        }
+        catch (...)
+        {
+            context.tasks.erase(context.tasks.begin() + base, context.tasks.end());
+            throw;
+        }
+
+        return node.release();
     }
 
-    TypeNode* parseTypeHead()
+    std::vector<NodePtr<CmdNode>> parseAllTokens(Context& context)
     {
-        Lexer::TokenType tokenType = peekToken(token_index);
+        std::vector<NodePtr<CmdNode>> treeNodes;
 
-        switch(tokenType)
+        if (peekToken(context, context.token_index) == Lexer::NEWLINE)
+            consumeToken(context, context.token_index++, Lexer::NEWLINE);
+
+        while (peekToken(context, context.token_index) != Lexer::END_OF_FILE)
         {
-            case Lexer::INT:
-                return new IntTypeNode();
-            case Lexer::BOOL:
-                return new BoolTypeNode();
-            case Lexer::FLOAT:
-                return new FloatTypeNode();
-            case Lexer::VARIABLE:
-                return new VariableTypeNode();
-            case Lexer::LCURLY:
-                return new TupleTypeNode();
-            default:
-                throw ParserException("\nFailed to parse a type; got a " + Lexer::tokenTypeToString(tokenType) + " token instead.", (*tokens)[token_index]);
+            NodePtr<CmdNode> unique_ast(parseCmd(context)); 
+            treeNodes.push_back(std::move(unique_ast));
+            consumeToken(context, context.token_index++, Lexer::NEWLINE);
         }
+
+        return treeNodes;
     }
 
-    TypeNode* parseTypeCont(TypeNode* t)
+    CmdNode* parseCmd(Context& context)
     {
-        Lexer::TokenType tokenType = peekToken(token_index);
+        return parseNow(context, parseCmd);
+    }
 
-        switch(tokenType)
+    void parseCmd(Context& context, NodePtr<CmdNode>& into)
+    {
+        addTask(context, [&context, &into]
         {
-            case Lexer::LSQUARE:
-                return parseTypeCont(new ArrayTypeNode(t));
-            default:
-                return t;
-        }
+            Lexer::TokenType tokenType = peekToken(context, context.token_index);
+            CmdNode* cmd;
+
+            switch(tokenType)
+            {
+                case Lexer::READ:
+                    cmd = new (context.arena) ReadCmdNode(context);
+                    break;
+                case Lexer::WRITE:
+                    cmd = new (context.arena) WriteCmdNode(context);
+                    break;
+                case Lexer::TYPE:
+                    cmd = new (context.arena) TypeCmdNode(context);
+                    break;
+                case Lexer::LET:
+                    cmd = new (context.arena) LetCmdNode(context);
+                    break;
+                case Lexer::ASSERT:
+                    cmd = new (context.arena) AssertCmdNode(context);
+                    break;
+                case Lexer::PRINT:
+                    cmd = new (context.arena) PrintCmdNode(context);
+                    break;
+                case Lexer::SHOW:
+                    cmd = new (context.arena) ShowCmdNode(context);
+                    break;
+                case Lexer::TIME:
+                    cmd = new (context.arena) TimeCmdNode(context);
+                    break;
+                case Lexer::FN:
+                    cmd = new (context.arena) FnCmd(context);
+                    break;
+                default:
+                    throw ParserException("\nFailed to parse a command; got a " + Lexer::tokenTypeToString(tokenType) + " token instead.", (*context.tokens)[context.token_index]);
+            }
+
+            into.reset(cmd);
+            then(context, [cmd] {clipText(cmd);});
+        });
     }
 
-    ExprNode* parseExpr()
+    TypeNode* parseType(Context& context)
     {
-        return parseBoolopExpr();
+        return parseNow(context, parseType);
     }
 
-    ExprNode* parseBoolopExpr()
+    void parseType(Context& context, NodePtr<TypeNode>& into)
     {
-        std::unique_ptr<ExprNode> head(parseComparisonExpr());
-        return parseBoolopExprCont(head);
+        addTask(context, [&context, &into]
+        {
+            parseTypeHead(context, into);
+            then(context, [&context, &into]
+            {
+                clipText(into.get());
+                parseTypeCont(context, into);
+            });
+        });
     }
 
-    ExprNode* parseBoolopExprCont(std::unique_ptr<ExprNode>& head)
+    void parseTypeHead(Context& context, NodePtr<TypeNode>& into)
     {
-        Lexer::TokenType tokenType = peekToken(token_index);
-        
-        if (tokenType != Lexer::OP)
-            return head.release();
-        
-        const Lexer::token& binop_token = consumeToken(token_index++, Lexer::OP);
-        std::string text(binop_token.text);
+        Lexer::TokenType tokenType = peekToken(context, context.token_index);
 
-        bool is_boolop = text == "&&" || text == "||";
-        
-        if (!is_boolop)
+        switch(tokenType)
         {
-            token_index--;
-            return head.release();
+            case Lexer::INT:
+                into.reset(new (context.arena) IntTypeNode(context));
+                break;
+            case Lexer::BOOL:
+                into.reset(new (context.arena) BoolTypeNode(context));
+                break;
+            case Lexer::FLOAT:
+                into.reset(new (context.arena) FloatTypeNode(context));
+                break;
+            case Lexer::VARIABLE:
+                into.reset(new (context.arena) VariableTypeNode(context));
+                break;
+            case Lexer::LCURLY:
+                into.reset(new (context.arena) TupleTypeNode(context));
+                break;
+            default:
+                throw ParserException("\nFailed to parse a type; got a " + Lexer::tokenTypeToString(tokenType) + " token instead.", (*context.tokens)[context.token_index]);
         }
-
-        std::unique_ptr<ExprNode> _rhs(parseComparisonExpr());
-        std::unique_ptr<ExprNode> fullexpr(new BinopExprNode(head, binop_token, _rhs));
-        return parseBoolopExprCont(fullexpr);
     }
 
-    ExprNode* parseComparisonExpr()
+    void parseTypeCont(Context& context, NodePtr<TypeNode>& into)
     {
-        std::unique_ptr<ExprNode> head(parseAddExpr());
-        return parseComparisonExprCont(head);
+        while (peekToken(context, context.token_index) == Lexer::LSQUARE)
+            into.reset(clipText(new (context.arena) ArrayTypeNode(context, into)));
     }
 
-    ExprNode* parseComparisonExprCont(std::unique_ptr<ExprNode>& head)
+    ExprNode* parseExpr(Context& context)
     {
-        Lexer::TokenType tokenType = peekToken(token_index);
-        
-        if (tokenType != Lexer::OP)
-            return head.release();
-        
-        const Lexer::token& binop_token = consumeToken(token_index++, Lexer::OP);
-        std::string text(binop_token.text);
-
-        bool is_lt = text == "<" || text == "<=";
-        bool is_gt = text == ">" || text == ">=";
-        bool is_equ =  text == "==" || text == "!=";
-        
-        if ( !(is_lt || is_gt || is_equ))
-        {
-            token_index--;
-            return head.release();
-        }
-
-        std::unique_ptr<ExprNode> _rhs(parseAddExpr());
-        std::unique_ptr<ExprNode> fullexpr(new BinopExprNode(head, binop_token, _rhs));
-        return parseComparisonExprCont(fullexpr);
+        return parseNow(context, parseExpr);
     }
 
-    ExprNode* parseAddExpr()
+    void parseExpr(Context& context, NodePtr<ExprNode>& into)
     {
-        std::unique_ptr<ExprNode> head(parseMultExpr());
-        return parseAddExprCont(head);
+        addTask(context, [&context, &into] {parseBinopExpr(context, into, BOOLOP_PRECEDENCE);});
     }
 
-    ExprNode* parseAddExprCont(std::unique_ptr<ExprNode>& head)
+    int binopPrecedence(std::string_view op)
     {
-        Lexer::TokenType tokenType = peekToken(token_index);
-        
-        if (tokenType != Lexer::OP)
-            return head.release();
-        
-        const Lexer::token& binop_token = consumeToken(token_index++, Lexer::OP);
-        switch (binop_token.text[0])
+        switch (op[0])
         {
+        case '&':
+        case '|':
+            return BOOLOP_PRECEDENCE;
+        case '!':
+            // "!" on its own is a unary operator.
+            if (op != "!=")
+                return NO_PRECEDENCE;
+            [[fallthrough]];
+        case '<':
+        case '>':
+        case '=':
+            return COMPARISON_PRECEDENCE;
         case '+':
         case '-':
-            {
-                std::unique_ptr<ExprNode> _rhs(parseMultExpr());
-                std::unique_ptr<ExprNode> fullexpr(new BinopExprNode(head, binop_token, _rhs));
-                return parseAddExprCont(fullexpr);
-            }   
+            return ADD_PRECEDENCE;
+        case '*':
+        case '/':
+        case '%':
+            return MULT_PRECEDENCE;
         default:
-            token_index--;
-            return head.release();
+            return NO_PRECEDENCE;
         }
     }
 
-    ExprNode* parseMultExpr()
+    // Parses an operand and every binary operator of at least min_precedence that follows it.
+    // Operators of equal precedence associate to the left, so the right operand of an operator
+    // only takes operators that bind more tightly.
+    void parseBinopExpr(Context& context, NodePtr<ExprNode>& into, int min_precedence)
     {
-        std::unique_ptr<ExprNode> head(parseUnopExpr());
-        return parseMultExprCont(head);
+        parseUnopExpr(context, into);
+        then(context, [&context, &into, min_precedence] {parseBinopCont(context, into, min_precedence);});
     }
 
-    ExprNode* parseMultExprCont(std::unique_ptr<ExprNode>& head)
+    // Parses the operators of at least min_precedence that follow the expression in into.
+    void parseBinopCont(Context& context, NodePtr<ExprNode>& into, int min_precedence)
     {
-        Lexer::TokenType tokenType = peekToken(token_index);
-        
-        if (tokenType != Lexer::OP)
-            return head.release();
-        
-        const Lexer::token& binop_token = consumeToken(token_index++, Lexer::OP);
-        switch (binop_token.text[0])
+        if (!context.tokens->has(context.token_index) || context.tokens->type(context.token_index) != Lexer::OP)
+            return;
+
+        int precedence = binopPrecedence(context.tokens->text(context.token_index));
+        if (precedence < min_precedence)
+            return;
+
+        const Lexer::token binop_token = consumeToken(context, context.token_index++, Lexer::OP);
+        BinopExprNode* binop = new (context.arena) BinopExprNode(context, into, binop_token);
+        into.reset(binop);
+
+        parseBinopExpr(context, binop->rhs, precedence + 1);
+        then(context, [&context, &into, binop, min_precedence]
         {
-        case '*':
-        case '/':
-        case '%':
-            {
-                std::unique_ptr<ExprNode> _rhs(parseUnopExpr());
-                std::unique_ptr<ExprNode> fullexpr(new BinopExprNode(head, binop_token, _rhs));
-                return parseMultExprCont(fullexpr);
-            }   
-        default:
-            token_index--;
-            return head.release();
-        }
+            binop->token_s += binop->rhs->token_s;
+            clipText(binop);
+            parseBinopCont(context, into, min_precedence);
+        });
     }
 
-    ExprNode* parseUnopExpr()
+    void parseUnopExpr(Context& context, NodePtr<ExprNode>& into)
     {
-        Lexer::TokenType tokenType = peekToken(token_index);
-        
-        if( tokenType != Lexer::OP)
-            return parseBaseExpr();
+        addTask(context, [&context, &into]
+        {
+            Lexer::TokenType tokenType = peekToken(context, context.token_index);
+
+            if( tokenType != Lexer::OP)
+                return parseBaseExpr(context, into);
 
-        return new UnopExprNode();
+            UnopExprNode* unop = new (context.arena) UnopExprNode(context);
+            into.reset(unop);
+            then(context, [unop] {clipText(unop);});
+        });
     }
 
-    ExprNode* parseBaseExpr()
+    void parseBaseExpr(Context& context, NodePtr<ExprNode>& into)
     {
-        ExprNode* head = parseBaseExprHead();
-        ExprNode* full = parseBaseExprCont(head);
-        return full;
+        parseBaseExprHead(context, into);
+        then(context, [&context, &into]
+        {
+            clipText(into.get());
+            parseBaseExprCont(context, into);
+        });
     }
 
-    ExprNode* parseBaseExprHead()
+    void parseBaseExprHead(Context& context, NodePtr<ExprNode>& into)
     {
-        Lexer::TokenType tokenType = peekToken(token_index);
+        Lexer::TokenType tokenType = peekToken(context, context.token_index);
 
         switch(tokenType)
         {
             case Lexer::INTVAL: // int expr
-                return new IntExprNode();
+                into.reset(new (context.arena) IntExprNode(context));
+                break;
             case Lexer::FLOATVAL: // float expr
-                return new FloatExprNode();
+                into.reset(new (context.arena) FloatExprNode(context));
+                break;
             case Lexer::TRUE: // true expr
-                return new TrueExprNode();
+                into.reset(new (context.arena) TrueExprNode(context));
+                break;
             case Lexer::FALSE: // false expr
-                return new FalseExprNode();
+                into.reset(new (context.arena) FalseExprNode(context));
+                break;
             case Lexer::VARIABLE: // var expr or call expr
-                return parseBaseExprVarCont(consumeToken(token_index++, Lexer::VARIABLE));
+                parseBaseExprVarCont(context, into, (*context.tokens)[context.token_index]);
+                break;
             case Lexer::LPAREN: // ( <expr> )
-                {
-                    consumeToken(token_index++, Lexer::LPAREN);
-                    ExprNode* expr = parseExpr();
-                    consumeToken(token_index++, Lexer::RPAREN);
-                    return expr;
-                }
+                consumeToken(context, context.token_index++, Lexer::LPAREN);
+                parseExpr(context, into);
+                then(context, [&context] {consumeToken(context, context.token_index++, Lexer::RPAREN);});
+                break;
             case Lexer::LCURLY:
-                return new TupleLiteralExprNode();
+                into.reset(new (context.arena) TupleLiteralExprNode(context));
+                break;
             case Lexer::LSQUARE:
-                return new ArrayLiteralExprNode();
+                into.reset(new (context.arena) ArrayLiteralExprNode(context));
+                break;
             case Lexer::IF:
-                return new IfExprNode();
+                into.reset(new (context.arena) IfExprNode(context));
+                break;
             case Lexer::ARRAY:
-                return new ArrayLoopExprNode();
+                into.reset(new (context.arena) ArrayLoopExprNode(context));
+                break;
             case Lexer::SUM:
-                return new SumLoopExprNode();
+                into.reset(new (context.arena) SumLoopExprNode(context));
+                break;
             default:
-                throw ParserException("\nFailed to parse an expression; got a " + Lexer::tokenTypeToString(tokenType) + " token instead.", (*tokens)[token_index]);
+                throw ParserException("\nFailed to parse an expression; got a " + Lexer::tokenTypeToString(tokenType) + " token instead.", (*context.tokens)[context.token_index]);
         }
     }
 
-    ExprNode* parseBaseExprVarCont(const Lexer::token& variable)
+    void parseBaseExprVarCont(Context& context, NodePtr<ExprNode>& into, const Lexer::token& variable)
     {
         if (variable.type != Lexer::VARIABLE)
             throw ParserException("\nExpected a token of type VARIABLE; got a " + Lexer::tokenTypeToString(variable.type) + " instead.", variable);
         
-        Lexer::TokenType tokenType = peekToken(token_index);
-        
-        switch(tokenType)
+        // Look past the variable instead of consuming it and backing up.
+        if (!tryPeekToken(context, context.token_index + 1, Lexer::LPAREN))
         {
-            case Lexer::LPAREN:
-                return new CallExprNode(variable);
-            default:
-                token_index--;
-                return new VariableExprNode();
+            into.reset(new (context.arena) VariableExprNode(context));
+            return;
         }
+
+        context.token_index++;
+        into.reset(new (context.arena) CallExprNode(context, variable));
     }
 
-    ExprNode* parseBaseExprCont(ExprNode* head)
+    void parseBaseExprCont(Context& context, NodePtr<ExprNode>& into)
     {
-        Lexer::TokenType tokenType = peekToken(token_index);
-
-        switch(tokenType)
+        while (true)
         {
-            case Lexer::LCURLY:
-                return parseBaseExprCont(new TupleIndexExprNode(head));
-            case Lexer::LSQUARE:
-                return parseBaseExprCont(new ArrayIndexExprNode(head));
-            default:
-                return head;
+            switch(peekToken(context, context.token_index))
+            {
+                case Lexer::LCURLY:
+                    into.reset(clipText(new (context.arena) TupleIndexExprNode(context, into)));
+                    break;
+                case Lexer::LSQUARE:
+                {
+                    ArrayIndexExprNode* index = new (context.arena) ArrayIndexExprNode(context, into);
+                    into.reset(index);
+                    then(context, [&context, &into, index]
+                    {
+                        clipText(index);
+                        parseBaseExprCont(context, into);
+                    });
+                    return;
+                }
+                default:
+                    return;
+            }
         }
     }
 
-    ArgumentNode* parseArgument()
+    ArgumentNode* parseArgument(Context& context)
     {
-        const Lexer::token variable = consumeToken(token_index++, Lexer::VARIABLE);
-        
-        Lexer::TokenType tokenType = peekToken(token_index);
+        // Look past the variable instead of consuming it and backing up.
+        if (!tryPeekToken(context, context.token_index + 1, Lexer::LSQUARE))
+            return new (context.arena) VarArgumentNode(context);
 
-        switch(tokenType)
-        {
-            case Lexer::LSQUARE:
-                return new ArrayArgumentNode(variable);
-            default:
-                token_index--;
-                return new VarArgumentNode();
-        }
+        const Lexer::token variable = consumeToken(context, context.token_index++, Lexer::VARIABLE);
+        return new (context.arena) ArrayArgumentNode(context, variable);
     }
 
-    LValue* parseLValue()
+    LValue* parseLValue(Context& context)
     {
-        Lexer::TokenType tokenType = peekToken(token_index);
+        return parseNow(context, parseLValue);
+    }
 
-        switch(tokenType)
-        {       
-            case Lexer::LCURLY:
-                return new TupleLValueNode();
-            default:
-                return new ArgumentLValue();
-        }
+    void parseLValue(Context& context, NodePtr<LValue>& into)
+    {
+        addTask(context, [&context, &into]
+        {
+            Lexer::TokenType tokenType = peekToken(context, context.token_index);
+
+            switch(tokenType)
+            {       
+                case Lexer::LCURLY:
+                {
+                    TupleLValueNode* lvalue = new (context.arena) TupleLValueNode(context);
+                    into.reset(lvalue);
+                    then(context, [lvalue] {clipText(lvalue);});
+                    break;
+                }
+                default:
+                    into.reset(clipText(new (context.arena) ArgumentLValue(context)));
+                    break;
+            }
+        });
     }
 
-    BindingNode* parseBinding()
+    BindingNode* parseBinding(Context& context)
     {
-        Lexer::TokenType tokenType = peekToken(token_index);
+        return parseNow(context, parseBinding);
+    }
 
-        switch(tokenType)
+    void parseBinding(Context& context, NodePtr<BindingNode>& into)
+    {
+        addTask(context, [&context, &into]
         {
-            case Lexer::VARIABLE:
-                return new VarBindingNode();
-            case Lexer::LCURLY:
-                return new TupleBindingNode();
-            default:
-                throw ParserException("\nFailed to parse a binding; got a " + Lexer::tokenTypeToString(tokenType) + " token instead.", (*tokens)[token_index]);
-        }
+            Lexer::TokenType tokenType = peekToken(context, context.token_index);
+            BindingNode* binding;
+
+            switch(tokenType)
+            {
+                case Lexer::VARIABLE:
+                    binding = new (context.arena) VarBindingNode(context);
+                    break;
+                case Lexer::LCURLY:
+                    binding = new (context.arena) TupleBindingNode(context);
+                    break;
+                default:
+                    throw ParserException("\nFailed to parse a binding; got a " + Lexer::tokenTypeToString(tokenType) + " token instead.", (*context.tokens)[context.token_index]);
+            }
+
+            into.reset(binding);
+            then(context, [binding] {clipText(binding);});
+        });
     }
 
-    StmtNode* parseStmt()
+    StmtNode* parseStmt(Context& context)
     {
-        Lexer::TokenType tokenType = peekToken(token_index);
+        Lexer::TokenType tokenType = peekToken(context, context.token_index);
 
         switch (tokenType)
         {
             case Lexer::LET:
-                return new LetStmtNode();
+                return new (context.arena) LetStmtNode(context);
             case Lexer::ASSERT:
-                return new AssertStmtNode();
+                return new (context.arena) AssertStmtNode(context);
             case Lexer::RETURN:
-                return new ReturnStmtNode();
+                return new (context.arena) ReturnStmtNode(context);
             default:
-                throw ParserException("Failed to parse a statement; got a " + Lexer::tokenTypeToString(tokenType) + " token instead.", (*tokens)[token_index]);
+                throw ParserException("Failed to parse a statement; got a " + Lexer::tokenTypeToString(tokenType) + " token instead.", (*context.tokens)[context.token_index]);
         }
     }
 #pragma endregion
@@ -1,16 +1,355 @@
 #include <string>
 #include <memory>
 #include <utility>
+#include <optional>
+#include <vector>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <ostream>
+#include <string_view>
+#include <type_traits>
 #include "../lexer/lexer.h"
 #include "../typechecker/types.h"
 
 #ifndef __PARSER_H__
 #define __PARSER_H__
 
-#define ASTNODE_CONSTRUCTOR_ARGS
+#define ASTNODE_CONSTRUCTOR_ARGS Context& context
 
 namespace Parser
 {
+    struct Context;
+
+#pragma region Arena
+
+    template<class T>
+    class ArenaAllocator;
+
+    // Owns the memory of every node and constant propagation value of one compilation unit.
+    // Allocations bump a pointer through large blocks and are never freed individually; the
+    // blocks are released together when the arena is destroyed, so it must outlive its tree.
+    class Arena
+    {
+        public:
+            Arena() = default;
+            Arena(const Arena&) = delete;
+            Arena& operator=(const Arena&) = delete;
+            ~Arena() {release();}
+
+            // Frees every block at once. Whatever was allocated in the arena is gone.
+            void release();
+
+            void* allocate(size_t size, size_t alignment)
+            {
+                size_t padding = -(uintptr_t) next & (alignment - 1);
+                if (size + padding > (size_t) (limit - next))
+                    return allocateBlock(size, alignment);
+
+                void* allocation = next + padding;
+                next += padding + size;
+                return allocation;
+            }
+
+            // Makes a T in the arena. Its destructor never runs, so it must not need to.
+            template<class T, class... Args>
+            T* make(Args&&... args)
+            {
+                static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+                return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+            }
+
+            // The number of bytes in the blocks the arena holds.
+            size_t memoryUsage() const {return reserved;}
+
+        private:
+            static constexpr size_t BLOCK_SIZE = 1 << 16;
+            std::vector<char*> blocks;
+            char* next = nullptr;
+            char* limit = nullptr;
+            size_t reserved = 0;
+
+            void* allocateBlock(size_t size, size_t alignment);
+    };
+
+    // Lets standard containers and shared pointers allocate from an Arena.
+    template<class T>
+    class ArenaAllocator
+    {
+        public:
+            typedef T value_type;
+            Arena* arena;
+
+            ArenaAllocator(Arena& _arena) : arena(&_arena) {}
+            template<class U>
+            ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+            T* allocate(size_t n) {return (T*) arena->allocate(n * sizeof(T), alignof(T));}
+            void deallocate(T*, size_t) {}
+
+            template<class U>
+            bool operator==(const ArenaAllocator<U>& other) const {return arena == other.arena;}
+            template<class U>
+            bool operator!=(const ArenaAllocator<U>& other) const {return arena != other.arena;}
+    };
+
+    // Owns a node of a tree, as far as moving it between parents goes. The node itself belongs
+    // to the Arena of the tree, so dropping the pointer frees nothing.
+    template<class T>
+    class NodePtr
+    {
+        public:
+            NodePtr() = default;
+            NodePtr(std::nullptr_t) {}
+            explicit NodePtr(T* _node) : node(_node) {}
+            NodePtr(NodePtr&& other) : node(other.release()) {}
+            template<class U>
+            NodePtr(NodePtr<U>&& other) : node(other.release()) {}
+            NodePtr(const NodePtr&) = delete;
+
+            NodePtr& operator=(NodePtr&& other) {node = other.release(); return *this;}
+            template<class U>
+            NodePtr& operator=(NodePtr<U>&& other) {node = other.release(); return *this;}
+            NodePtr& operator=(std::nullptr_t) {node = nullptr; return *this;}
+            NodePtr& operator=(const NodePtr&) = delete;
+
+            T* get() const {return node;}
+            T* release() {T* released = node; node = nullptr; return released;}
+            void reset(T* _node = nullptr) {node = _node;}
+
+            T* operator->() const {return node;}
+            T& operator*() const {return *node;}
+            explicit operator bool() const {return node != nullptr;}
+            bool operator==(std::nullptr_t) const {return node == nullptr;}
+            bool operator!=(std::nullptr_t) const {return node != nullptr;}
+
+        private:
+            T* node = nullptr;
+    };
+
+    // A vector whose elements are kept in an Arena. Growing leaves the old elements behind in
+    // the arena, and nothing is ever freed, so the vector and its elements need no destructor.
+    template<class T>
+    class ArenaVector
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena vectors never destroy their elements");
+
+        public:
+            typedef T value_type;
+            typedef T* iterator;
+            typedef const T* const_iterator;
+
+            explicit ArenaVector(Arena& arena) : allocator(arena) {}
+            ArenaVector(ArenaVector&& other) : allocator(other.allocator), elements(other.elements), count(other.count), capacity(other.capacity) {other.forget();}
+            ArenaVector(const ArenaVector&) = delete;
+
+            ArenaVector& operator=(ArenaVector&& other)
+            {
+                elements = other.elements;
+                count = other.count;
+                capacity = other.capacity;
+                other.forget();
+                return *this;
+            }
+            ArenaVector& operator=(const ArenaVector&) = delete;
+            // Takes the elements of a vector built outside of the tree.
+            ArenaVector& operator=(std::vector<T>&& other)
+            {
+                clear();
+                reserve(other.size());
+                for (T& element : other)
+                    new (elements + count++) T(std::move(element));
+                other.clear();
+                return *this;
+            }
+
+            size_t size() const {return count;}
+            bool empty() const {return count == 0;}
+            T* begin() {return elements;}
+            T* end() {return elements + count;}
+            const T* begin() const {return elements;}
+            const T* end() const {return elements + count;}
+            T& operator[](size_t i) {return elements[i];}
+            const T& operator[](size_t i) const {return elements[i];}
+            T& front() {return elements[0];}
+            T& back() {return elements[count - 1];}
+            const T& back() const {return elements[count - 1];}
+
+            void reserve(size_t wanted)
+            {
+                if (wanted <= capacity)
+                    return;
+                T* grown = allocator.allocate(wanted);
+                for (size_t i = 0; i < count; i++)
+                    new (grown + i) T(std::move(elements[i]));
+                elements = grown;
+                capacity = wanted;
+            }
+
+            void push_back(T&& element) {emplace_back(std::move(element));}
+            void push_back(const T& element) {emplace_back(element);}
+            template<class... Args>
+            T& emplace_back(Args&&... args)
+            {
+                if (count == capacity)
+                    reserve(capacity < 4 ? 4 : 2 * capacity);
+                return *new (elements + count++) T(std::forward<Args>(args)...);
+            }
+            void pop_back() {count--;}
+            void clear() {count = 0;}
+
+            void resize(size_t wanted)
+            {
+                reserve(wanted);
+                while (count < wanted)
+                    new (elements + count++) T();
+                count = wanted;
+            }
+            void resize(size_t wanted, const T& value)
+            {
+                reserve(wanted);
+                while (count < wanted)
+                    new (elements + count++) T(value);
+                count = wanted;
+            }
+            void assign(size_t wanted, const T& value)
+            {
+                clear();
+                resize(wanted, value);
+            }
+
+            T* insert(T* at, T&& element)
+            {
+                size_t index = at - elements;
+                emplace_back(std::move(element));
+                std::rotate(elements + index, elements + count - 1, elements + count);
+                return elements + index;
+            }
+            template<class Iterator>
+            T* insert(T* at, Iterator first, Iterator last)
+            {
+                size_t index = at - elements;
+                size_t old_count = count;
+                for (; first != last; ++first)
+                    emplace_back(*first);
+                std::rotate(elements + index, elements + old_count, elements + count);
+                return elements + index;
+            }
+
+            T* erase(T* at) {return erase(at, at + 1);}
+            T* erase(T* first, T* last)
+            {
+                T* kept = std::move(last, end(), first);
+                count = kept - elements;
+                return first;
+            }
+
+        private:
+            ArenaAllocator<T> allocator;
+            T* elements = nullptr;
+            size_t count = 0;
+            size_t capacity = 0;
+
+            void forget() {elements = nullptr; count = 0; capacity = 0;}
+    };
+
+    // Text kept in an Arena. Copies share the characters of the original, so appending to a
+    // copy, or to text that was cut short, first copies the characters to a block of its own.
+    class Text
+    {
+        public:
+            // Text that is only ever copied from other text, never appended to.
+            Text() = default;
+            explicit Text(Arena& _arena) : arena(&_arena) {}
+            Text(Arena& _arena, std::string_view text) : arena(&_arena) {*this += text;}
+            Text(const Text& other) : arena(other.arena), characters(other.characters), used(other.used), room(other.used) {}
+
+            Text& operator=(const Text& other)
+            {
+                if (arena == nullptr)
+                    arena = other.arena;
+                characters = other.characters;
+                used = other.used;
+                room = other.used;
+                return *this;
+            }
+            Text& operator=(std::string_view text)
+            {
+                characters = nullptr;
+                used = room = 0;
+                return *this += text;
+            }
+            Text& operator=(const std::string& text) {return *this = std::string_view(text);}
+            Text& operator=(const char* text) {return *this = std::string_view(text);}
+
+            Text& operator+=(std::string_view text)
+            {
+                reserve(used + text.size());
+                std::copy(text.begin(), text.end(), characters + used);
+                used += text.size();
+                return *this;
+            }
+            Text& operator+=(const std::string& text) {return *this += std::string_view(text);}
+            Text& operator+=(const char* text) {return *this += std::string_view(text);}
+            Text& operator+=(const Text& text) {return *this += text.view();}
+            Text& operator+=(char character) {return *this += std::string_view(&character, 1);}
+
+            void reserve(size_t wanted)
+            {
+                if (wanted <= room)
+                    return;
+                size_t grown = std::max(wanted, 2 * (size_t) room);
+                char* copied = (char*) arena->allocate(grown, 1);
+                std::copy(characters, characters + used, copied);
+                characters = copied;
+                room = grown;
+            }
+            // Only cuts text short.
+            void resize(size_t wanted)
+            {
+                used = std::min((size_t) used, wanted);
+                room = used;
+            }
+
+            size_t size() const {return used;}
+            size_t length() const {return used;}
+            bool empty() const {return used == 0;}
+            const char* data() const {return characters;}
+            std::string_view view() const {return std::string_view(characters, used);}
+            std::string str() const {return std::string(characters, used);}
+            std::string substr(size_t position, size_t count = std::string::npos) const {return std::string(view().substr(position, count));}
+            char operator[](size_t i) const {return characters[i];}
+
+            operator std::string_view() const {return view();}
+            operator std::string() const {return str();}
+
+            friend bool operator==(const Text& a, const Text& b) {return a.view() == b.view();}
+            friend bool operator==(const Text& a, std::string_view b) {return a.view() == b;}
+            friend bool operator==(std::string_view a, const Text& b) {return a == b.view();}
+            friend bool operator!=(const Text& a, const Text& b) {return a.view() != b.view();}
+            friend bool operator!=(const Text& a, std::string_view b) {return a.view() != b;}
+            friend bool operator!=(std::string_view a, const Text& b) {return a != b.view();}
+
+            friend std::string operator+(const Text& a, const Text& b) {return a.str() += b.view();}
+            friend std::string operator+(const Text& a, const std::string& b) {return a.str() += b;}
+            friend std::string operator+(const Text& a, const char* b) {return a.str() += b;}
+            friend std::string operator+(const Text& a, char b) {return a.str() += b;}
+            friend std::string operator+(const std::string& a, const Text& b) {return std::string(a) += b.view();}
+            friend std::string operator+(std::string&& a, const Text& b) {return std::move(a += b.view());}
+            friend std::string operator+(const char* a, const Text& b) {return std::string(a) += b.view();}
+
+            friend std::ostream& operator<<(std::ostream& out, const Text& text) {return out << text.view();}
+
+        private:
+            Arena* arena = nullptr;
+            char* characters = nullptr;
+            uint32_t used = 0;
+            uint32_t room = 0;
+    };
+
+#pragma endregion
+
     class ParserException : public std::exception 
     {
         public:
@@ -43,79 +382,126 @@ namespace Parser
     typedef struct ArrayValue : public CPValue
     {
     public:
-        std::vector<std::shared_ptr<CPValue>> lengths;
-        ArrayValue(std::vector<std::shared_ptr<CPValue>>& _lengths) : lengths(_lengths) {type = ARRAY;} 
+        ArenaVector<CPValue*> lengths;
+        ArrayValue(Arena& arena, const std::vector<CPValue*>& _lengths) : lengths(arena)
+        {
+            type = ARRAY;
+            lengths.insert(lengths.end(), _lengths.begin(), _lengths.end());
+        }
     } ArrayValue;
 
 #pragma endregion
 
 #pragma region Root Nodes
 
+    // The concrete class of a node, so that passes can switch over nodes instead of casting.
+    enum NodeKind : unsigned char
+    {
+        STRING,
+        // Arguments, bindings and lvalues
+        VAR_ARGUMENT, ARRAY_ARGUMENT, TUPLE_BINDING, VAR_BINDING, ARGUMENT_LVALUE, TUPLE_LVALUE,
+        // Expressions
+        INT_EXPR, FLOAT_EXPR, TRUE_EXPR, FALSE_EXPR, VARIABLE_EXPR, TUPLE_LITERAL_EXPR, ARRAY_LITERAL_EXPR,
+        TUPLE_INDEX_EXPR, ARRAY_INDEX_EXPR, CALL_EXPR, UNOP_EXPR, BINOP_EXPR, IF_EXPR, ARRAY_LOOP_EXPR, SUM_LOOP_EXPR,
+        // Statements
+        LET_STMT, ASSERT_STMT, RETURN_STMT,
+        // Types
+        INT_TYPE, BOOL_TYPE, FLOAT_TYPE, VARIABLE_TYPE, ARRAY_TYPE, TUPLE_TYPE,
+        // Commands
+        READ_CMD, WRITE_CMD, TYPE_CMD, LET_CMD, ASSERT_CMD, PRINT_CMD, SHOW_CMD, TIME_CMD, FN_CMD,
+        // LValues the typechecker makes out of bindings
+        PSEUDO_ARGUMENT_LVALUE, PSEUDO_TUPLE_LVALUE,
+        // Expressions the optimizer makes
+        INLINED_CALL_EXPR
+    };
+
     class ASTNode {
         public:
             virtual std::string toString() = 0;
-            virtual ~ASTNode() {};
 
-            std::string token_s;
-            unsigned long line;
-            unsigned long pos;
+            // Nodes are allocated in the Arena of their parse, along with their text and child
+            // lists. None of them has a destructor to run: a tree is freed with its arena.
+            static void* operator new(size_t size, Arena& arena) {return arena.allocate(size, alignof(std::max_align_t));}
+            static void operator delete(void*, Arena&) {}
+            static void operator delete(void*) = delete;
+
+            // Set by the constructor of every concrete node class to that class's KIND. Besides the
+            // constructor that parses it, each concrete class has a constructor that takes only the
+            // arena and makes an empty node of its kind for callers that fill in the fields themselves. Parsing
+            // constructors of nodes with children add the parses of the children as tasks of the
+            // Context, so the node is only complete, text included, once those tasks have run.
+            NodeKind kind;
+            // The source text of the node. Nodes include the text of their children, so the text
+            // is cut to MAX_TEXT_LENGTH characters (and "...") to keep deep programs linear in size.
+            Text token_s;
+            static constexpr size_t MAX_TEXT_LENGTH = 256;
+            unsigned long line = 0;
+            unsigned long pos = 0;
+            // For nodes that are a single name (variables, var arguments, type variables), the interned name.
+            Lexer::Symbol symbol = Lexer::NO_SYMBOL;
+
+        protected:
+            ASTNode(Arena& arena) : token_s(arena) {}
+            // For nodes outside of any tree, which only copy the text of other nodes.
+            ASTNode() = default;
     };
 
     class StringNode: public ASTNode
     {
         public:
+            static constexpr NodeKind KIND = STRING;
             StringNode(ASTNODE_CONSTRUCTOR_ARGS);
+            StringNode(Arena& arena) : ASTNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~StringNode() {};
             std::string getValue();
     };
 
     class ArgumentNode: public ASTNode
     {
-        public:
-            virtual ~ArgumentNode() {};
+        protected:
+            ArgumentNode(Arena& arena) : ASTNode(arena) {}
     };
 
     class LValue: public ASTNode
     {
-        public:
-            virtual ~LValue() {};
+        protected:
+            LValue(Arena& arena) : ASTNode(arena) {}
+            LValue() = default;
     };
 
     class BindingNode: public ASTNode
     {
-        public:
-            virtual ~BindingNode() {};
+        protected:
+            BindingNode(Arena& arena) : ASTNode(arena) {}
     };
 
     class ExprNode: public ASTNode 
     {
         public:
-            std::shared_ptr<CPValue> cp;
-
-            virtual ~ExprNode() {};
-            mutable std::shared_ptr<Typechecker::ResolvedType> resolvedType = nullptr;
+            CPValue* cp;
+            // Interned, so it lives as long as the program.
+            mutable Typechecker::ResolvedType* resolvedType = nullptr;
         protected:
-            ExprNode() {cp = std::make_shared<CPValue>();}
+            ExprNode(Arena& arena);
             std::string rtypeToString();
     };
 
     class StmtNode: public ASTNode
     {
-        public:
-            virtual ~StmtNode() {};
+        protected:
+            StmtNode(Arena& arena) : ASTNode(arena) {}
     };
 
-    class TypeNode: public ASTNode 
+    class TypeNode: public ASTNode
     {
-        public: 
-            virtual ~TypeNode() {};
+        protected:
+            TypeNode(Arena& arena) : ASTNode(arena) {}
     };
 
-    class CmdNode : public ASTNode
+    class CmdNode: public ASTNode
     {
-        public:
-            virtual ~CmdNode() {};
+        protected:
+            CmdNode(Arena& arena) : ASTNode(arena) {}
     };
 
 #pragma endregion
@@ -125,9 +511,10 @@ namespace Parser
     class VarArgumentNode : public ArgumentNode
     {
         public:
+            static constexpr NodeKind KIND = VAR_ARGUMENT;
             VarArgumentNode(ASTNODE_CONSTRUCTOR_ARGS);
+            VarArgumentNode(Arena& arena) : ArgumentNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~VarArgumentNode() {};
     };
 
     ////////////////////////////////////////////
@@ -139,11 +526,14 @@ namespace Parser
     class ArrayArgumentNode: public ArgumentNode
     {
         public:
-            ArrayArgumentNode(ASTNODE_CONSTRUCTOR_ARGS const Lexer::token& variable);
+            static constexpr NodeKind KIND = ARRAY_ARGUMENT;
+            ArrayArgumentNode(ASTNODE_CONSTRUCTOR_ARGS, const Lexer::token& variable);
+            ArrayArgumentNode(Arena& arena) : ArgumentNode(arena), array_argument_name(arena), array_dimensions_names(arena), array_dimensions_symbols(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~ArrayArgumentNode() {};
-            std::string array_argument_name;
-            std::vector<std::string> array_dimensions_names;
+            Text array_argument_name;
+            ArenaVector<Text> array_dimensions_names;
+            Lexer::Symbol array_argument_symbol;
+            ArenaVector<Lexer::Symbol> array_dimensions_symbols;
     };
     
 
@@ -160,21 +550,23 @@ namespace Parser
     class TupleBindingNode: public BindingNode
     {
         public:
+            static constexpr NodeKind KIND = TUPLE_BINDING;
             TupleBindingNode(ASTNODE_CONSTRUCTOR_ARGS);
+            TupleBindingNode(Arena& arena) : BindingNode(arena), bindings(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~TupleBindingNode() {};
-            std::vector<std::unique_ptr<BindingNode>> bindings;
+            ArenaVector<NodePtr<BindingNode>> bindings;
     };
 
     // <argument> : <type>
     class VarBindingNode: public BindingNode
     {
         public:
+            static constexpr NodeKind KIND = VAR_BINDING;
             VarBindingNode(ASTNODE_CONSTRUCTOR_ARGS);
+            VarBindingNode(Arena& arena) : BindingNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~VarBindingNode() {};
-            std::unique_ptr<ArgumentNode> argument;
-            std::unique_ptr<TypeNode> type;
+            NodePtr<ArgumentNode> argument;
+            NodePtr<TypeNode> type;
     };
 
 #pragma endregion
@@ -184,10 +576,11 @@ namespace Parser
     class ArgumentLValue: public LValue
     {
         public:
+            static constexpr NodeKind KIND = ARGUMENT_LVALUE;
             ArgumentLValue(ASTNODE_CONSTRUCTOR_ARGS);
+            ArgumentLValue(Arena& arena) : LValue(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~ArgumentLValue() {};
-            std::unique_ptr<ArgumentNode> argument;
+            NodePtr<ArgumentNode> argument;
     };
 
     ////////////////////////////////////////////
@@ -198,10 +591,11 @@ namespace Parser
     class TupleLValueNode: public LValue
     {
         public:
+            static constexpr NodeKind KIND = TUPLE_LVALUE;
             TupleLValueNode(ASTNODE_CONSTRUCTOR_ARGS);
+            TupleLValueNode(Arena& arena) : LValue(arena), lvalues(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~TupleLValueNode() {};
-            std::vector<std::unique_ptr<LValue>> lvalues;
+            ArenaVector<NodePtr<LValue>> lvalues;
     };
     
 
@@ -212,45 +606,50 @@ namespace Parser
     class IntExprNode : public ExprNode
     {
         public:
+            static constexpr NodeKind KIND = INT_EXPR;
             IntExprNode(ASTNODE_CONSTRUCTOR_ARGS);
+            IntExprNode(Arena& arena) : ExprNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~IntExprNode() {};
             long value;
     };
 
     class FloatExprNode : public ExprNode
     {
         public:
+            static constexpr NodeKind KIND = FLOAT_EXPR;
             FloatExprNode(ASTNODE_CONSTRUCTOR_ARGS);
+            FloatExprNode(Arena& arena) : ExprNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~FloatExprNode() {};
             double value;
     };
 
     class TrueExprNode : public ExprNode
     {
         public:
+            static constexpr NodeKind KIND = TRUE_EXPR;
             TrueExprNode(ASTNODE_CONSTRUCTOR_ARGS);
+            TrueExprNode(Arena& arena) : ExprNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~TrueExprNode() {};
             bool value;
     };
 
     class FalseExprNode : public ExprNode
     {
         public:
+            static constexpr NodeKind KIND = FALSE_EXPR;
             FalseExprNode(ASTNODE_CONSTRUCTOR_ARGS);
+            FalseExprNode(Arena& arena) : ExprNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~FalseExprNode() {};
             bool value;
     };
 
     class VariableExprNode : public ExprNode
     {
         public:
+            static constexpr NodeKind KIND = VARIABLE_EXPR;
             VariableExprNode(ASTNODE_CONSTRUCTOR_ARGS);
+            VariableExprNode(Arena& arena) : ExprNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~VariableExprNode() {};
     };
 
     ////////////////////////////////////////////
@@ -262,30 +661,33 @@ namespace Parser
     class TupleLiteralExprNode: public ExprNode
     {
         public:
+            static constexpr NodeKind KIND = TUPLE_LITERAL_EXPR;
             TupleLiteralExprNode(ASTNODE_CONSTRUCTOR_ARGS);
+            TupleLiteralExprNode(Arena& arena) : ExprNode(arena), tuple_expressions(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~TupleLiteralExprNode() {};
-            std::vector<std::unique_ptr<ExprNode>> tuple_expressions;
+            ArenaVector<NodePtr<ExprNode>> tuple_expressions;
     };
 
     // [ <expr> , ... ]
     class ArrayLiteralExprNode: public ExprNode
     {
         public:
+            static constexpr NodeKind KIND = ARRAY_LITERAL_EXPR;
             ArrayLiteralExprNode(ASTNODE_CONSTRUCTOR_ARGS);
+            ArrayLiteralExprNode(Arena& arena) : ExprNode(arena), array_expressions(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~ArrayLiteralExprNode() {};
-            std::vector<std::unique_ptr<ExprNode>> array_expressions;
+            ArenaVector<NodePtr<ExprNode>> array_expressions;
     };
 
     // <expr> { <integer> }
     class TupleIndexExprNode: public ExprNode
     {
         public:
-            TupleIndexExprNode(ASTNODE_CONSTRUCTOR_ARGS ExprNode* head);
+            static constexpr NodeKind KIND = TUPLE_INDEX_EXPR;
+            TupleIndexExprNode(ASTNODE_CONSTRUCTOR_ARGS, NodePtr<ExprNode>& head);
+            TupleIndexExprNode(Arena& arena) : ExprNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~TupleIndexExprNode() {};
-            std::unique_ptr<ExprNode> tuple_expression;
+            NodePtr<ExprNode> tuple_expression;
             long tuple_index;
     };
 
@@ -293,22 +695,30 @@ namespace Parser
     class ArrayIndexExprNode: public ExprNode
     {
         public:
-            ArrayIndexExprNode(ASTNODE_CONSTRUCTOR_ARGS ExprNode* head);
+            static constexpr NodeKind KIND = ARRAY_INDEX_EXPR;
+            ArrayIndexExprNode(ASTNODE_CONSTRUCTOR_ARGS, NodePtr<ExprNode>& head);
+            ArrayIndexExprNode(Arena& arena) : ExprNode(arena), array_indices(arena), nonnegative(arena), in_bounds(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~ArrayIndexExprNode() {};
-            std::unique_ptr<ExprNode> array_expression;
-            std::vector<std::unique_ptr<ExprNode>> array_indices;
+            NodePtr<ExprNode> array_expression;
+            ArenaVector<NodePtr<ExprNode>> array_indices;
+
+            // Set by the optimizer: for each index, whether it is known to be at least zero, and
+            // whether it is known to be less than its length. Checks known to pass are left out.
+            ArenaVector<bool> nonnegative;
+            ArenaVector<bool> in_bounds;
     };
 
     // <variable> ( <expr> , ... )
     class CallExprNode: public ExprNode
     {
         public:
-            CallExprNode(ASTNODE_CONSTRUCTOR_ARGS const Lexer::token& variable);
+            static constexpr NodeKind KIND = CALL_EXPR;
+            CallExprNode(ASTNODE_CONSTRUCTOR_ARGS, const Lexer::token& variable);
+            CallExprNode(Arena& arena) : ExprNode(arena), function_name(arena), arguments(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~CallExprNode() {};
-            std::string function_name;
-            std::vector<std::unique_ptr<ExprNode>> arguments;
+            Text function_name;
+            Lexer::Symbol function_symbol;
+            ArenaVector<NodePtr<ExprNode>> arguments;
     };
 
     ////////////////////////////////////////////
@@ -321,9 +731,10 @@ namespace Parser
     {
 
         public:
+            static constexpr NodeKind KIND = UNOP_EXPR;
             UnopExprNode(ASTNODE_CONSTRUCTOR_ARGS);
+            UnopExprNode(Arena& arena) : ExprNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~UnopExprNode() {};
 
             enum UnopType {
                 NEGATION = '-',
@@ -331,7 +742,7 @@ namespace Parser
             };
 
             UnopType operation;
-            std::unique_ptr<ExprNode> expression;
+            NodePtr<ExprNode> expression;
         
         private:
             static UnopType tokenToUnopType(const Lexer::token& toConvert);
@@ -341,9 +752,12 @@ namespace Parser
     class BinopExprNode: public ExprNode
     {
         public:
-            BinopExprNode(ASTNODE_CONSTRUCTOR_ARGS std::unique_ptr<ExprNode>& _lhs, const Lexer::token& binop_token, std::unique_ptr<ExprNode>& _rhs);
+            static constexpr NodeKind KIND = BINOP_EXPR;
+            // Takes lhs and the operator. The caller parses rhs, whose operators depend on the
+            // operator's precedence, and adds its text.
+            BinopExprNode(ASTNODE_CONSTRUCTOR_ARGS, NodePtr<ExprNode>& _lhs, const Lexer::token& binop_token);
+            BinopExprNode(Arena& arena) : ExprNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~BinopExprNode() {};
 
             enum BinopType{
                 PLUS,
@@ -361,56 +775,90 @@ namespace Parser
                 OR
             };
 
-            std::unique_ptr<ExprNode> lhs;
+            NodePtr<ExprNode> lhs;
             BinopType operation;
-            std::unique_ptr<ExprNode> rhs;
+            NodePtr<ExprNode> rhs;
+
+            static std::string binopTypeToString(const BinopType& toConvert);
         
         private:
             static BinopType tokenToBinopType(const Lexer::token& toConvert);
-            static std::string binopTypeToString(const BinopType& toConvert);
     };
     
     
     class IfExprNode: public ExprNode
     {
         public:
+            static constexpr NodeKind KIND = IF_EXPR;
             IfExprNode(ASTNODE_CONSTRUCTOR_ARGS);
+            IfExprNode(Arena& arena) : ExprNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~IfExprNode() {};
 
-            std::unique_ptr<ExprNode> condition;
-            std::unique_ptr<ExprNode> then_expr;
-            std::unique_ptr<ExprNode> else_expr;
+            NodePtr<ExprNode> condition;
+            NodePtr<ExprNode> then_expr;
+            NodePtr<ExprNode> else_expr;
     };
 
     
     class LoopExprNode: public ExprNode
     {
         public:
-            virtual ~LoopExprNode() {};
-            std::vector<std::unique_ptr<std::pair<std::string, std::unique_ptr<ExprNode>>>> bounds;
-            std::unique_ptr<ExprNode> loop_expression;
+            ArenaVector<std::pair<Text, NodePtr<ExprNode>>> bounds;
+            // The interned name of each bound's index variable.
+            ArenaVector<Lexer::Symbol> bound_symbols;
+            NodePtr<ExprNode> loop_expression;
+
+            // A part of the body that only depends on the first level indices, moved out of it by
+            // the optimizer. It is computed before the body whenever one of those indices changes,
+            // and the body reads it as the variable symbol.
+            struct Invariant
+            {
+                size_t level;
+                Lexer::Symbol symbol;
+                NodePtr<ExprNode> expression;
+            };
+            ArenaVector<Invariant> invariants;
         protected:
-            std::vector<std::unique_ptr<std::pair<std::string, std::unique_ptr<ExprNode>>>> parseBounds();
-            static std::string boundstoString(const std::vector<std::unique_ptr<std::pair<std::string, std::unique_ptr<ExprNode>>>>& bounds); 
+            LoopExprNode(Arena& arena) : ExprNode(arena), bounds(arena), bound_symbols(arena), invariants(arena) {}
+            // [ <variable> : <expr> , ... ] <expr>
+            void parseLoop(Context& context);
+            void parseBound(Context& context);
+            static std::string boundstoString(const ArenaVector<std::pair<Text, NodePtr<ExprNode>>>& bounds); 
     };
 
     // array [ <variable> : <expr> , ... ] <expr>
     class ArrayLoopExprNode: public LoopExprNode
     {
         public:
+            static constexpr NodeKind KIND = ARRAY_LOOP_EXPR;
             ArrayLoopExprNode(ASTNODE_CONSTRUCTOR_ARGS);
+            ArrayLoopExprNode(Arena& arena) : LoopExprNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~ArrayLoopExprNode() {};
     };
 
     // sum [ <variable> : <expr> , ... ] <expr>
     class SumLoopExprNode: public LoopExprNode
     {
         public:
+            static constexpr NodeKind KIND = SUM_LOOP_EXPR;
             SumLoopExprNode(ASTNODE_CONSTRUCTOR_ARGS);
+            SumLoopExprNode(Arena& arena) : LoopExprNode(arena) {kind = KIND;}
+            virtual std::string toString();
+    };
+
+    // A call the optimizer replaced with the body of its function. Never parsed: statements bind
+    // the parameters to the arguments, in order, and then run the lets and asserts of the body,
+    // with every variable the body binds renamed so that none clashes with the caller's. result
+    // is what the body returns.
+    class InlinedCallExprNode: public ExprNode
+    {
+        public:
+            static constexpr NodeKind KIND = INLINED_CALL_EXPR;
+            InlinedCallExprNode(Arena& arena) : ExprNode(arena), function_name(arena), statements(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~SumLoopExprNode() {};
+            Text function_name;
+            ArenaVector<NodePtr<StmtNode>> statements;
+            NodePtr<ExprNode> result;
     };
     
 #pragma endregion
@@ -426,32 +874,35 @@ namespace Parser
     class LetStmtNode: public StmtNode
     {
         public:
+            static constexpr NodeKind KIND = LET_STMT;
             LetStmtNode(ASTNODE_CONSTRUCTOR_ARGS);
+            LetStmtNode(Arena& arena) : StmtNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~LetStmtNode() {};
-            std::unique_ptr<LValue> set_variable_name;
-            std::unique_ptr<ExprNode> variable_expression;
+            NodePtr<LValue> set_variable_name;
+            NodePtr<ExprNode> variable_expression;
     };
 
     // assert <expr> , <string>
     class AssertStmtNode: public StmtNode
     {
         public:
+            static constexpr NodeKind KIND = ASSERT_STMT;
             AssertStmtNode(ASTNODE_CONSTRUCTOR_ARGS);
+            AssertStmtNode(Arena& arena) : StmtNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~AssertStmtNode() {};
-            std::unique_ptr<ExprNode> expression;
-            std::unique_ptr<StringNode> string;
+            NodePtr<ExprNode> expression;
+            NodePtr<StringNode> string;
     };
 
     // return <expr>
     class ReturnStmtNode: public StmtNode
     {
         public:
+            static constexpr NodeKind KIND = RETURN_STMT;
             ReturnStmtNode(ASTNODE_CONSTRUCTOR_ARGS);
+            ReturnStmtNode(Arena& arena) : StmtNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~ReturnStmtNode() {};
-            std::unique_ptr<ExprNode> expression;
+            NodePtr<ExprNode> expression;
     };
     
 
@@ -461,30 +912,34 @@ namespace Parser
 
     class IntTypeNode: public TypeNode {
         public:
+            static constexpr NodeKind KIND = INT_TYPE;
             IntTypeNode(ASTNODE_CONSTRUCTOR_ARGS);
+            IntTypeNode(Arena& arena) : TypeNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~IntTypeNode() {};
     };
 
     class BoolTypeNode: public TypeNode {
         public:
+            static constexpr NodeKind KIND = BOOL_TYPE;
             BoolTypeNode(ASTNODE_CONSTRUCTOR_ARGS);
+            BoolTypeNode(Arena& arena) : TypeNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~BoolTypeNode() {};
     };
 
     class FloatTypeNode: public TypeNode {
         public:
+            static constexpr NodeKind KIND = FLOAT_TYPE;
             FloatTypeNode(ASTNODE_CONSTRUCTOR_ARGS);
+            FloatTypeNode(Arena& arena) : TypeNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~FloatTypeNode() {};
     };
 
     class VariableTypeNode: public TypeNode {
         public:
+            static constexpr NodeKind KIND = VARIABLE_TYPE;
             VariableTypeNode(ASTNODE_CONSTRUCTOR_ARGS);
+            VariableTypeNode(Arena& arena) : TypeNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~VariableTypeNode() {};
     };
 
     ////////////////////////////////////////////
@@ -494,20 +949,22 @@ namespace Parser
     // <type> [ , ... ]
     class ArrayTypeNode: public TypeNode {
         public:
-            ArrayTypeNode(ASTNODE_CONSTRUCTOR_ARGS TypeNode* head);
+            static constexpr NodeKind KIND = ARRAY_TYPE;
+            ArrayTypeNode(ASTNODE_CONSTRUCTOR_ARGS, NodePtr<TypeNode>& head);
+            ArrayTypeNode(Arena& arena) : TypeNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~ArrayTypeNode() {};
-            std::unique_ptr<TypeNode> array_type;
+            NodePtr<TypeNode> array_type;
             int rank;
     };
 
     // { <type> , ... }
     class TupleTypeNode: public TypeNode {
         public:
+            static constexpr NodeKind KIND = TUPLE_TYPE;
             TupleTypeNode(ASTNODE_CONSTRUCTOR_ARGS);
+            TupleTypeNode(Arena& arena) : TypeNode(arena), tuple_types(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~TupleTypeNode() {};
-            std::vector<std::unique_ptr<TypeNode>> tuple_types;
+            ArenaVector<NodePtr<TypeNode>> tuple_types;
     };
 
 #pragma endregion   
@@ -518,69 +975,77 @@ namespace Parser
     class ReadCmdNode : public CmdNode
     {
         public:
+            static constexpr NodeKind KIND = READ_CMD;
             ReadCmdNode(ASTNODE_CONSTRUCTOR_ARGS);
+            ReadCmdNode(Arena& arena) : CmdNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~ReadCmdNode() {};
-            std::unique_ptr<StringNode> fileName;
-            std::unique_ptr<ArgumentNode> readInto;
+            NodePtr<StringNode> fileName;
+            NodePtr<ArgumentNode> readInto;
     };
 
     class WriteCmdNode : public CmdNode
     {
         public:
+            static constexpr NodeKind KIND = WRITE_CMD;
             WriteCmdNode(ASTNODE_CONSTRUCTOR_ARGS);
+            WriteCmdNode(Arena& arena) : CmdNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~WriteCmdNode() {};
-            std::unique_ptr<ExprNode> toSave;
-            std::unique_ptr<StringNode> fileName;
+            NodePtr<ExprNode> toSave;
+            NodePtr<StringNode> fileName;
     };
 
     class TypeCmdNode : public CmdNode
     {
         public:
+            static constexpr NodeKind KIND = TYPE_CMD;
             TypeCmdNode(ASTNODE_CONSTRUCTOR_ARGS);
+            TypeCmdNode(Arena& arena) : CmdNode(arena), variable(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~TypeCmdNode() {};
-            std::string variable;
-            std::unique_ptr<TypeNode> type;
+            Text variable;
+            Lexer::Symbol variable_symbol;
+            NodePtr<TypeNode> type;
     };
 
     class LetCmdNode : public CmdNode
     {
         public:
+            static constexpr NodeKind KIND = LET_CMD;
             LetCmdNode(ASTNODE_CONSTRUCTOR_ARGS);
+            LetCmdNode(Arena& arena) : CmdNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~LetCmdNode() {};
-            std::unique_ptr<LValue> lvalue;
-            std::unique_ptr<ExprNode> expression;
+            NodePtr<LValue> lvalue;
+            NodePtr<ExprNode> expression;
     };
 
     class AssertCmdNode : public CmdNode
     {
         public:
+            static constexpr NodeKind KIND = ASSERT_CMD;
             AssertCmdNode(ASTNODE_CONSTRUCTOR_ARGS);
+            AssertCmdNode(Arena& arena) : CmdNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~AssertCmdNode() {};
-            std::unique_ptr<ExprNode> expression;
-            std::unique_ptr<StringNode> string;
+            NodePtr<ExprNode> expression;
+            NodePtr<StringNode> string;
     };
 
     class PrintCmdNode : public CmdNode
     {
         public:
+            static constexpr NodeKind KIND = PRINT_CMD;
             PrintCmdNode(ASTNODE_CONSTRUCTOR_ARGS);
+            PrintCmdNode(Arena& arena) : CmdNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~PrintCmdNode() {};
-            std::unique_ptr<StringNode> string;
+            NodePtr<StringNode> string;
     };
 
     class ShowCmdNode : public CmdNode
     {
         public:
+            static constexpr NodeKind KIND = SHOW_CMD;
             ShowCmdNode(ASTNODE_CONSTRUCTOR_ARGS);
+            ShowCmdNode(Arena& arena) : CmdNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~ShowCmdNode() {};
-            std::unique_ptr<ExprNode> expression;
+            NodePtr<ExprNode> expression;
     };
 
     ////////////////////////////////////////////
@@ -592,10 +1057,11 @@ namespace Parser
     class TimeCmdNode: public CmdNode
     {
         public:
+            static constexpr NodeKind KIND = TIME_CMD;
             TimeCmdNode (ASTNODE_CONSTRUCTOR_ARGS);
+            TimeCmdNode(Arena& arena) : CmdNode(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~TimeCmdNode() {};
-            std::unique_ptr<CmdNode> command;
+            NodePtr<CmdNode> command;
     };
 
     // fn <variable> ( <binding> , ... ) : <type> { ;
@@ -604,14 +1070,15 @@ namespace Parser
     class FnCmd: public CmdNode
     {
         public:
+            static constexpr NodeKind KIND = FN_CMD;
             FnCmd (ASTNODE_CONSTRUCTOR_ARGS);
+            FnCmd(Arena& arena) : CmdNode(arena), function_name(arena), arguments(arena), function_contents(arena) {kind = KIND;}
             virtual std::string toString();
-            virtual ~FnCmd() {};
-            std::string function_name;
-            std::vector<std::unique_ptr<BindingNode>> arguments;
-            std::unique_ptr<TypeNode> return_type;
-            std::vector<std::unique_ptr<StmtNode>> function_contents;
-            std::shared_ptr<void> scope;
+            Text function_name;
+            Lexer::Symbol function_symbol;
+            ArenaVector<NodePtr<BindingNode>> arguments;
+            NodePtr<TypeNode> return_type;
+            ArenaVector<NodePtr<StmtNode>> function_contents;
     };
     
 
@@ -619,50 +1086,74 @@ namespace Parser
 
 #pragma endregion
     
-        std::vector<std::unique_ptr<CmdNode>> parse(std::vector<Lexer::token>*);
+        // The state of a single parse. Every parse function takes the context of the parse
+        // it belongs to, so separate sources can be parsed at the same time on different threads.
+        struct Context
+        {
+            Lexer::TokenStream* tokens;
+            int token_index = 0;
+            Arena& arena;
+            // The steps of the parse still to run, the next one last. Nodes parse their children
+            // as tasks instead of recursing, so that nesting grows this list and not the stack.
+            std::vector<std::function<void()>> tasks;
 
-        // Debugging
-        std::string parseToString();
+            Context(Lexer::TokenStream* _tokens, Arena& _arena) : tokens(_tokens), arena(_arena) {}
+        };
 
-        // Instance Variables
-        std::vector<Lexer::token>* tokens;
-        int token_index = 0;
+        std::vector<NodePtr<CmdNode>> parse(Lexer::TokenStream*, Arena&);
+
+        // Frees a tree, which takes no more than freeing the arena it was parsed into.
+        void destroy_tree(std::vector<NodePtr<CmdNode>>& tree, Arena& arena);
+
+        // Debugging
+        std::string parseToString(Lexer::TokenStream*);
 
         // Helpers
-        Lexer::TokenType peekToken(int index_to_peek);
-        const Lexer::token consumeToken(int index_to_consume, Lexer::TokenType expected_type);
+        Lexer::TokenType peekToken(Context& context, int index_to_peek);
+        const Lexer::token consumeToken(Context& context, int index_to_consume, Lexer::TokenType expected_type);
+        std::optional<Lexer::token> tryPeekToken(Context& context, int index_to_peek, Lexer::TokenType expected_type);
+
+        // Tasks
+        // Adds a step to the parse. The tasks a task adds run in the order they were added, and
+        // all of them (with the tasks they add in turn) before the tasks added earlier.
+        void addTask(Context& context, std::function<void()> task);
+        // Adds the rest of a parse, to run once the parses added before it are done.
+        void then(Context& context, std::function<void()> work);
+        // Runs tasks until only the first base of them are left.
+        void runTasks(Context& context, size_t base);
 
         // Parse Functions
-        std::vector<std::unique_ptr<CmdNode>> parseAllTokens();
-        CmdNode* parseCmd();
-        TypeNode* parseType();
-        TypeNode* parseTypeHead();
-        TypeNode* parseTypeCont(TypeNode* t);
-        ExprNode* parseExpr();
+        // Those that return a node parse it and its children before returning. Those that take
+        // into add a task that parses the node into it.
+        std::vector<NodePtr<CmdNode>> parseAllTokens(Context& context);
+        CmdNode* parseCmd(Context& context);
+        void parseCmd(Context& context, NodePtr<CmdNode>& into);
+        TypeNode* parseType(Context& context);
+        void parseType(Context& context, NodePtr<TypeNode>& into);
+        void parseTypeHead(Context& context, NodePtr<TypeNode>& into);
+        void parseTypeCont(Context& context, NodePtr<TypeNode>& into);
+        ExprNode* parseExpr(Context& context);
+        void parseExpr(Context& context, NodePtr<ExprNode>& into);
         
-        ExprNode* parseBoolopExpr();
-        ExprNode* parseBoolopExprCont(std::unique_ptr<ExprNode>& head);
+        // Binary operator precedences, from loosest to tightest. NO_PRECEDENCE ends an expression.
+        enum BinopPrecedence {NO_PRECEDENCE, BOOLOP_PRECEDENCE, COMPARISON_PRECEDENCE, ADD_PRECEDENCE, MULT_PRECEDENCE};
+        int binopPrecedence(std::string_view op);
+        void parseBinopExpr(Context& context, NodePtr<ExprNode>& into, int min_precedence);
+        void parseBinopCont(Context& context, NodePtr<ExprNode>& into, int min_precedence);
 
-        ExprNode* parseComparisonExpr();
-        ExprNode* parseComparisonExprCont(std::unique_ptr<ExprNode>& head);
-        
-        ExprNode* parseAddExpr();
-        ExprNode* parseAddExprCont(std::unique_ptr<ExprNode>& head);
-        
-        ExprNode* parseMultExpr();
-        ExprNode* parseMultExprCont(std::unique_ptr<ExprNode>& head);
-        
-        ExprNode* parseUnopExpr();
+        void parseUnopExpr(Context& context, NodePtr<ExprNode>& into);
         
-        ExprNode* parseBaseExpr();
-        ExprNode* parseBaseExprHead();
-        ExprNode* parseBaseExprVarCont(const Lexer::token& t);
-        ExprNode* parseBaseExprCont(ExprNode* head);
-        ArgumentNode* parseArgument();
-        LValue* parseLValue();
-
-        BindingNode* parseBinding();
-        StmtNode* parseStmt();
+        void parseBaseExpr(Context& context, NodePtr<ExprNode>& into);
+        void parseBaseExprHead(Context& context, NodePtr<ExprNode>& into);
+        void parseBaseExprVarCont(Context& context, NodePtr<ExprNode>& into, const Lexer::token& t);
+        void parseBaseExprCont(Context& context, NodePtr<ExprNode>& into);
+        ArgumentNode* parseArgument(Context& context);
+        LValue* parseLValue(Context& context);
+        void parseLValue(Context& context, NodePtr<LValue>& into);
+
+        BindingNode* parseBinding(Context& context);
+        void parseBinding(Context& context, NodePtr<BindingNode>& into);
+        StmtNode* parseStmt(Context& context);
         
 }
 
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""Prints a JPL program nested to the given depth in one of these shapes:
+
+  sum     1 + 1 + ... + 1
+  parens  ((((1))))
+  neg     - - - 1
+  calls   f(f(...f(1)))
+  if      if true then if true then ... 1 else 0 else 0
+  loops   sum[i0 : 3] sum[i1 : 3] ... i0
+  tuple   {{{1, 1}, 1}, ... 1}
+  types   type t = {{{int}}}
+  lvalue  let {{{x}}} = {{{1}}}
+  binding fn f({{{x : int}}}) : int
+  time    time time ... show 1
+
+Usage: deep.py <shape> <depth>
+"""
+
+import sys
+
+
+def sum_(depth):
+    return "show " + " + ".join(["1"] * depth) + "\n"
+
+
+def parens(depth):
+    return "show " + "(" * depth + "1" + ")" * depth + "\n"
+
+
+def neg(depth):
+    return "show " + "- " * depth + "1\n"
+
+
+def calls(depth):
+    return ("fn f(x : int) : int {\n    return x + 1\n}\n"
+            "show " + "f(" * depth + "1" + ")" * depth + "\n")
+
+
+def if_(depth):
+    return "show " + "if true then " * depth + "1" + " else 0" * depth + "\n"
+
+
+def loops(depth):
+    return "show " + "".join(f"sum[i{i} : 3] " for i in range(depth)) + "i0\n"
+
+
+def tuple_(depth):
+    return "show " + "{" * depth + "1" + ", 1}" * depth + "\n"
+
+
+def types(depth):
+    return "type t = " + "{" * depth + "int" + "}" * depth + "\n"
+
+
+def lvalue(depth):
+    return "let " + "{" * depth + "x" + "}" * depth + " = " + "{" * depth + "1" + "}" * depth + "\nshow x\n"
+
+
+def binding(depth):
+    return ("fn f(" + "{" * depth + "x : int" + "}" * depth + ") : int {\n    return x\n}\n"
+            "show f(" + "{" * depth + "1" + "}" * depth + ")\n")
+
+
+def time(depth):
+    return "time " * depth + "show 1\n"
+
+
+SHAPES = {"sum": sum_, "parens": parens, "neg": neg, "calls": calls, "if": if_, "loops": loops, "tuple": tuple_,
+          "types": types, "lvalue": lvalue, "binding": binding, "time": time}
+
+
+def main():
+    if len(sys.argv) != 3 or sys.argv[1] not in SHAPES:
+        sys.exit(__doc__)
+    sys.stdout.write(SHAPES[sys.argv[1]](int(float(sys.argv[2]))))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,214 @@
+#!/usr/bin/env python3
+"""Prints a random JPL program, the same for the same seed, made mostly of constants for the
+optimizer to fold and propagate.
+
+The program binds constants, shows int, float and bool expressions over them, loops over
+constant bounds with invariant bodies, indexes arrays of known size, and calls small
+functions with constant arguments, from top-level commands and from other functions.
+Expressions wrap around on overflow and divide floats by zero. Every fourth seed also
+divides integers by zero and indexes out of bounds, so that programs fail at runtime.
+
+Usage: constants.py <seed>
+"""
+
+import random
+import sys
+
+INTS = ["0", "1", "2", "3", "7", "10", "100", "65536", "3037000500", "4611686018427387904",
+        "9223372036854775807"]
+FLOATS = ["0.0", "1.0", "0.5", "2.5", "3.0", "0.1", "1000000000000000000000.0"]
+INT_OPERATORS = ["+", "-", "*", "/", "%"]
+FLOAT_OPERATORS = ["+", "-", "*", "/", "%"]
+COMPARISONS = ["<", ">", "<=", ">=", "==", "!="]
+FLOAT_FUNCTIONS = ["sqrt", "exp", "sin", "cos", "atan", "log"]
+COMMANDS = 30
+DEPTH = 4
+
+
+class Program:
+    def __init__(self, seed):
+        self.random = random.Random(seed)
+        self.risky = seed % 4 == 0
+        self.names = 0
+        self.lines = []
+        # The variables in scope at top level, by type, and the length of each array.
+        self.variables = {"int": [], "float": [], "bool": []}
+        self.arrays = []
+        # The functions defined so far: name, argument types and return type.
+        self.functions = []
+
+    def name(self, prefix):
+        self.names += 1
+        return f"{prefix}{self.names}"
+
+    def choose(self, options):
+        return self.random.choice(options)
+
+    def chance(self, probability):
+        return self.random.random() < probability
+
+    def divisor(self, variables, depth):
+        """An int expression that is never zero, unless the program may fail."""
+        if self.risky and self.chance(0.25):
+            return self.int_expr(variables, depth)
+        return self.choose(["1", "2", "3", "7", "10", "65536"] + [f"({v} * 0 + 5)" for v in variables["int"][-2:]])
+
+    def index(self, length, variables, depth):
+        """An index into an array of length, in bounds unless the program may fail."""
+        if self.risky and self.chance(0.25):
+            return self.int_expr(variables, depth)
+        expression = self.int_expr(variables, depth)
+        return f"({expression} % {length} + {length}) % {length}"
+
+    def int_expr(self, variables, depth):
+        if depth <= 0 or self.chance(0.2):
+            if variables["int"] and self.chance(0.6):
+                return self.choose(variables["int"])
+            return self.choose(INTS)
+
+        kind = self.random.randrange(10)
+        if kind < 4:
+            operator = self.choose(INT_OPERATORS)
+            lhs = self.int_expr(variables, depth - 1)
+            if operator in "/%":
+                return f"({lhs} {operator} {self.divisor(variables, depth - 1)})"
+            return f"({lhs} {operator} {self.int_expr(variables, depth - 1)})"
+        if kind == 4:
+            return f"-{self.int_expr(variables, depth - 1)}"
+        if kind == 5:
+            return (f"(if {self.bool_expr(variables, depth - 1)} then {self.int_expr(variables, depth - 1)} "
+                    f"else {self.int_expr(variables, depth - 1)})")
+        if kind == 6:
+            return self.loop("int", variables, depth)
+        if kind == 7 and self.arrays:
+            array, length = self.choose(self.arrays)
+            return f"{array}[{self.index(length, variables, depth - 1)}]"
+        if kind == 8:
+            return f"to_int({self.float_expr(variables, depth - 1)})"
+        if kind == 9:
+            return self.call("int", variables, depth) or self.choose(INTS)
+        return self.choose(INTS)
+
+    def float_expr(self, variables, depth):
+        if depth <= 0 or self.chance(0.2):
+            if variables["float"] and self.chance(0.6):
+                return self.choose(variables["float"])
+            return self.choose(FLOATS)
+
+        kind = self.random.randrange(8)
+        if kind < 3:
+            operator = self.choose(FLOAT_OPERATORS)
+            return f"({self.float_expr(variables, depth - 1)} {operator} {self.float_expr(variables, depth - 1)})"
+        if kind == 3:
+            return f"-{self.float_expr(variables, depth - 1)}"
+        if kind == 4:
+            return (f"(if {self.bool_expr(variables, depth - 1)} then {self.float_expr(variables, depth - 1)} "
+                    f"else {self.float_expr(variables, depth - 1)})")
+        if kind == 5:
+            return f"to_float({self.int_expr(variables, depth - 1)})"
+        if kind == 6:
+            return f"{self.choose(FLOAT_FUNCTIONS)}({self.float_expr(variables, depth - 1)})"
+        return self.call("float", variables, depth) or self.loop("float", variables, depth)
+
+    def bool_expr(self, variables, depth):
+        if depth <= 0 or self.chance(0.2):
+            if variables["bool"] and self.chance(0.6):
+                return self.choose(variables["bool"])
+            return self.choose(["true", "false"])
+
+        kind = self.random.randrange(6)
+        if kind == 0:
+            return f"({self.int_expr(variables, depth - 1)} {self.choose(COMPARISONS)} {self.int_expr(variables, depth - 1)})"
+        if kind == 1:
+            return f"({self.float_expr(variables, depth - 1)} {self.choose(COMPARISONS)} {self.float_expr(variables, depth - 1)})"
+        if kind == 2:
+            operator = self.choose(["&&", "||", "==", "!="])
+            return f"({self.bool_expr(variables, depth - 1)} {operator} {self.bool_expr(variables, depth - 1)})"
+        if kind == 3:
+            return f"!{self.bool_expr(variables, depth - 1)}"
+        if kind == 4:
+            return (f"(if {self.bool_expr(variables, depth - 1)} then {self.bool_expr(variables, depth - 1)} "
+                    f"else {self.bool_expr(variables, depth - 1)})")
+        return self.call("bool", variables, depth) or "true"
+
+    def expr(self, type_, variables, depth):
+        return {"int": self.int_expr, "float": self.float_expr, "bool": self.bool_expr}[type_](variables, depth)
+
+    def loop(self, type_, variables, depth):
+        """A sum of up to three nested loops over constant bounds, whose body mostly does not
+        depend on the inner indices."""
+        indices = [self.name("i") for _ in range(self.random.randint(1, 3))]
+        bounds = ", ".join(f"{index} : {self.choose(['1', '2', '3', '4'])}" for index in indices)
+        inner = {key: list(names) for key, names in variables.items()}
+        inner["int"] = inner["int"] + indices[:1]
+        body = self.expr(type_, inner, depth - 1)
+        return f"(sum[{bounds}] {body} + {self.expr(type_, {**inner, 'int': inner['int'] + indices}, 1)})"
+
+    def call(self, type_, variables, depth):
+        candidates = [f for f in self.functions if f[2] == type_]
+        if not candidates:
+            return None
+        name, arguments, _ = self.choose(candidates)
+        values = ", ".join(self.expr(argument, variables, min(depth - 1, 1)) for argument in arguments)
+        return f"{name}({values})"
+
+    def function(self):
+        name = self.name("f")
+        arguments = [(self.name("a"), self.choose(["int", "float", "bool"])) for _ in range(self.random.randint(1, 3))]
+        result = self.choose(["int", "float", "bool"])
+        variables = {"int": [], "float": [], "bool": []}
+        for argument, type_ in arguments:
+            variables[type_].append(argument)
+
+        lines = [f"fn {name}({', '.join(f'{a} : {t}' for a, t in arguments)}) : {result} {{"]
+        for _ in range(self.random.randint(1, 4)):
+            type_ = self.choose(["int", "float", "bool"])
+            local = self.name("l")
+            lines.append(f"    let {local} = {self.expr(type_, variables, DEPTH - 1)}")
+            # Some lets are never read, and only some of those cannot fail.
+            if self.chance(0.8):
+                variables[type_].append(local)
+        if self.chance(0.3):
+            lines.append(f"    assert {self.bool_expr(variables, 2)} || !{self.bool_expr(variables, 1)} || true, \"{name} failed\"")
+        lines.append(f"    return {self.expr(result, variables, DEPTH - 1)}")
+        lines.append("}")
+        self.lines.extend(lines)
+        self.functions.append((name, [t for _, t in arguments], result))
+
+    def command(self):
+        kind = self.random.randrange(10)
+        if kind < 3:
+            type_ = self.choose(["int", "float", "bool"])
+            variable = self.name("v")
+            self.lines.append(f"let {variable} = {self.expr(type_, self.variables, DEPTH)}")
+            self.variables[type_].append(variable)
+        elif kind < 7:
+            self.lines.append(f"show {self.expr(self.choose(['int', 'float', 'bool']), self.variables, DEPTH)}")
+        elif kind == 7:
+            array = self.name("c")
+            length = self.random.randint(1, 5)
+            index = self.name("i")
+            body = self.int_expr({**self.variables, "int": self.variables["int"] + [index]}, 2)
+            self.lines.append(f"let {array} = array[{index} : {length}] {body}")
+            self.lines.append(f"show {array}")
+            self.arrays.append((array, length))
+        elif kind == 8:
+            self.function()
+        else:
+            type_ = self.choose(["int", "float"])
+            self.lines.append(f"show {self.loop(type_, self.variables, DEPTH)}")
+
+    def generate(self):
+        for _ in range(COMMANDS):
+            self.command()
+        return "\n".join(self.lines) + "\n"
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+    sys.stdout.write(Program(int(sys.argv[1])).generate())
+
+
+if __name__ == "__main__":
+    main()
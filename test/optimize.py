@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+"""Compiles each given file at -O0 through -O3, assembles and links it with the test runtime,
+runs it, and fails unless every level prints what -O0 prints and exits the same way.
+
+Usage: optimize.py <compiler> <assembler> <linker> <file>...
+
+The assembler and linker are commands, such as "nasm -f elf64" and "cc test/runtime.o -lm",
+to which the input and output files are appended.
+"""
+
+import os
+import shlex
+import subprocess
+import sys
+import tempfile
+
+LEVELS = ["-O0", "-O1", "-O2", "-O3"]
+TIMEOUT = 60
+
+
+def build(compiler, assembler, linker, filename, level, directory):
+    """Compiles filename at level into an executable in directory and returns its path."""
+    compiled = subprocess.run([compiler, filename, "-s", level], stdout=subprocess.PIPE,
+                              check=True, text=True).stdout
+    assembly, _, status = compiled.rstrip("\n").rpartition("\n")
+    if status != "Compilation succeeded":
+        sys.exit(f"{filename} {level}: does not compile")
+
+    name = os.path.join(directory, level.lstrip("-"))
+    with open(name + ".asm", "w") as asm_file:
+        asm_file.write(assembly + "\n")
+    subprocess.run(shlex.split(assembler) + ["-o", name + ".o", name + ".asm"], check=True)
+    subprocess.run([shlex.split(linker)[0], name + ".o"] + shlex.split(linker)[1:] + ["-o", name], check=True)
+    return name
+
+
+def run(executable, directory):
+    result = subprocess.run([executable], cwd=directory, stdout=subprocess.PIPE, timeout=TIMEOUT)
+    return result.returncode, result.stdout
+
+
+def main():
+    if len(sys.argv) < 5:
+        sys.exit(__doc__)
+    compiler, assembler, linker = sys.argv[1:4]
+
+    failures = 0
+    for filename in sys.argv[4:]:
+        with tempfile.TemporaryDirectory() as directory:
+            results = {}
+            for level in LEVELS:
+                results[level] = run(build(compiler, assembler, linker, filename, level, directory), directory)
+
+        expected = results["-O0"]
+        differing = [level for level in LEVELS if results[level] != expected]
+        if differing:
+            failures += 1
+            print(f"{filename}: {', '.join(differing)} differ from -O0")
+            for level in differing:
+                print(f"  {level} exited {results[level][0]}, -O0 exited {expected[0]}")
+        else:
+            print(f"{filename}: exited {expected[0]} at every level")
+
+    print(f"{len(sys.argv) - 4} files, {failures} differ")
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
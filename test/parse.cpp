@@ -0,0 +1,73 @@
+// Parses every file named on the command line at once, one thread per file, and checks each
+// parse against a serial one. Rounds alternate between lexing on the parsing thread and lexing
+// ahead on a thread of its own.
+//
+// Usage: parse.out <file>...
+#include "../lexer/lexer.cpp"
+#include "../parser/parser.cpp"
+#include "../parser/flat_ast.cpp"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+    constexpr size_t ROUNDS = 20;
+
+    std::string read_file(const char* filename)
+    {
+        std::ifstream file(filename);
+        std::stringstream contents;
+        contents << file.rdbuf();
+        return contents.str();
+    }
+
+    std::string parse_file(const std::string& source, bool threaded)
+    {
+        Lexer::TokenStream* tokens = new Lexer::TokenStream(source, threaded);
+        std::string printed = Parser::parseToString(tokens);
+        Lexer::destroy_token_list(tokens);
+        return printed;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> sources;
+    std::vector<std::string> expected;
+    for (int i = 1; i < argc; i++)
+    {
+        sources.push_back(read_file(argv[i]));
+        expected.push_back(parse_file(sources.back(), false));
+        if (expected.back().rfind("Compilation succeeded\n") == std::string::npos)
+        {
+            std::fprintf(stderr, "%s: does not parse\n", argv[i]);
+            return 1;
+        }
+    }
+
+    size_t failures = 0;
+    for (size_t round = 0; round < ROUNDS; round++)
+    {
+        bool threaded = round % 2 == 1;
+        std::vector<std::string> parsed(sources.size());
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < sources.size(); i++)
+            workers.emplace_back([&, i] {parsed[i] = parse_file(sources[i], threaded);});
+        for (std::thread& worker : workers)
+            worker.join();
+
+        for (size_t i = 0; i < sources.size(); i++)
+        {
+            if (parsed[i] != expected[i])
+            {
+                std::fprintf(stderr, "%s: round %zu (%s lexing) differs from a serial parse\n",
+                    argv[i + 1], round, threaded ? "threaded" : "unthreaded");
+                failures++;
+            }
+        }
+    }
+
+    std::printf("%zu files, %zu rounds: %zu parses differ from a serial parse\n", sources.size(), ROUNDS, failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,250 @@
+// A runtime for running compiled JPL programs in tests. Its output depends only on what the
+// program computes: read_image makes up an image from the file name, write_image prints the
+// image instead of writing it, and timings are not printed.
+//
+// The compiler calls each function by its name with a leading underscore, as C symbols are
+// named on macOS; the asm labels give them those names everywhere.
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define JPL_NAME(name) __asm__("_" #name)
+
+typedef struct
+{
+    int64_t rows;
+    int64_t cols;
+    double* data;
+} pict;
+
+void jpl_main(void) JPL_NAME(jpl_main);
+
+// Prints the value of the given type at data and returns the text after the type.
+static const char* show_value(const char* type, const char** data);
+
+static const char* skip_spaces(const char* text)
+{
+    while (*text == ' ')
+        text++;
+    return text;
+}
+
+static int starts_with(const char* text, const char* prefix)
+{
+    return strncmp(text, prefix, strlen(prefix)) == 0;
+}
+
+// The number of bytes a value of the type takes, and the text after the type in end.
+static size_t type_size(const char* type, const char** end)
+{
+    type = skip_spaces(type);
+    if (starts_with(type, "(TupleType"))
+    {
+        size_t size = 0;
+        type = skip_spaces(type + strlen("(TupleType"));
+        while (*type == '(')
+        {
+            size += type_size(type, &type);
+            type = skip_spaces(type);
+        }
+        *end = type + 1;
+        return size;
+    }
+    if (starts_with(type, "(ArrayType"))
+    {
+        type_size(type + strlen("(ArrayType"), &type);
+        long rank = strtol(type, (char**) &type, 10);
+        *end = skip_spaces(type) + 1;
+        return (rank + 1) * 8;
+    }
+    *end = strchr(type, ')') + 1;
+    return 8;
+}
+
+static void show_array(const char* element, size_t element_size, const int64_t* dimensions, long rank, const char* data)
+{
+    printf("[");
+    for (int64_t i = 0; i < dimensions[0]; i++)
+    {
+        if (i > 0)
+            printf(rank > 1 ? "; " : ", ");
+        if (rank > 1)
+        {
+            size_t stride = element_size;
+            for (long d = 1; d < rank; d++)
+                stride *= dimensions[d];
+            show_array(element, element_size, dimensions + 1, rank - 1, data + i * stride);
+        }
+        else
+        {
+            const char* element_data = data + i * element_size;
+            show_value(element, &element_data);
+        }
+    }
+    printf("]");
+}
+
+static const char* show_value(const char* type, const char** data)
+{
+    type = skip_spaces(type);
+    if (starts_with(type, "(IntType)"))
+    {
+        printf("%ld", (long) *(const int64_t*) *data);
+        *data += 8;
+        return type + strlen("(IntType)");
+    }
+    if (starts_with(type, "(FloatType)"))
+    {
+        printf("%.17g", *(const double*) *data);
+        *data += 8;
+        return type + strlen("(FloatType)");
+    }
+    if (starts_with(type, "(BoolType)"))
+    {
+        printf(*(const int64_t*) *data ? "true" : "false");
+        *data += 8;
+        return type + strlen("(BoolType)");
+    }
+    if (starts_with(type, "(TupleType"))
+    {
+        printf("{");
+        type = skip_spaces(type + strlen("(TupleType"));
+        for (int first = 1; *type == '('; first = 0)
+        {
+            if (!first)
+                printf(", ");
+            type = skip_spaces(show_value(type, data));
+        }
+        printf("}");
+        return type + 1;
+    }
+    if (starts_with(type, "(ArrayType"))
+    {
+        const char* element = type + strlen("(ArrayType");
+        const char* rest;
+        size_t element_size = type_size(element, &rest);
+        long rank = strtol(rest, (char**) &rest, 10);
+        const int64_t* header = (const int64_t*) *data;
+        show_array(element, element_size, header, rank, (const char*) header[rank]);
+        *data += (rank + 1) * 8;
+        return skip_spaces(rest) + 1;
+    }
+    fprintf(stderr, "show: unknown type %s\n", type);
+    exit(2);
+}
+
+void show(const char* type, void* data) JPL_NAME(show);
+void show(const char* type, void* data)
+{
+    const char* position = data;
+    show_value(type, &position);
+    printf("\n");
+}
+
+void print(const char* text) JPL_NAME(print);
+void print(const char* text)
+{
+    printf("%s\n", text);
+}
+
+void fail_assertion(const char* message) JPL_NAME(fail_assertion);
+void fail_assertion(const char* message)
+{
+    printf("[abort] %s\n", message);
+    exit(1);
+}
+
+void* jpl_alloc(size_t size) JPL_NAME(jpl_alloc);
+void* jpl_alloc(size_t size)
+{
+    void* memory = malloc(size > 0 ? size : 1);
+    if (memory == NULL)
+        fail_assertion("out of memory");
+    return memory;
+}
+
+double get_time(void) JPL_NAME(get_time);
+double get_time(void)
+{
+    return 0.0;
+}
+
+void print_time(double seconds) JPL_NAME(print_time);
+void print_time(double seconds)
+{
+    (void) seconds;
+    printf("[time]\n");
+}
+
+pict read_image(const char* filename) JPL_NAME(read_image);
+pict read_image(const char* filename)
+{
+    unsigned long hash = 5381;
+    for (const char* c = filename; *c; c++)
+        hash = hash * 33 + (unsigned char) *c;
+
+    pict image;
+    image.rows = 3 + hash % 4;
+    image.cols = 3 + hash / 4 % 4;
+    image.data = jpl_alloc(image.rows * image.cols * 4 * sizeof(double));
+    for (int64_t i = 0; i < image.rows * image.cols * 4; i++)
+        image.data[i] = (double) ((hash + i * 37) % 256) / 255.0;
+    return image;
+}
+
+void write_image(pict image, const char* filename) JPL_NAME(write_image);
+void write_image(pict image, const char* filename)
+{
+    printf("%s: %ld x %ld\n", filename, (long) image.rows, (long) image.cols);
+    for (int64_t i = 0; i < image.rows * image.cols; i++)
+        printf("%.17g %.17g %.17g %.17g\n", image.data[4 * i], image.data[4 * i + 1], image.data[4 * i + 2], image.data[4 * i + 3]);
+}
+
+double to_float(int64_t value) JPL_NAME(to_float);
+double to_float(int64_t value)
+{
+    return (double) value;
+}
+
+int64_t to_int(double value) JPL_NAME(to_int);
+int64_t to_int(double value)
+{
+    if (isnan(value))
+        return 0;
+    if (value >= 9223372036854775807.0)
+        return INT64_MAX;
+    if (value <= -9223372036854775808.0)
+        return INT64_MIN;
+    return (int64_t) value;
+}
+
+// Where C symbols have no leading underscore, the math library is called through wrappers.
+#ifndef __APPLE__
+#define JPL_MATH(name) \
+    double jpl_##name(double x) JPL_NAME(name); \
+    double jpl_##name(double x) {return name(x);}
+#define JPL_MATH2(name) \
+    double jpl_##name(double x, double y) JPL_NAME(name); \
+    double jpl_##name(double x, double y) {return name(x, y);}
+
+JPL_MATH(sqrt)
+JPL_MATH(exp)
+JPL_MATH(sin)
+JPL_MATH(cos)
+JPL_MATH(tan)
+JPL_MATH(asin)
+JPL_MATH(acos)
+JPL_MATH(atan)
+JPL_MATH(log)
+JPL_MATH2(pow)
+JPL_MATH2(atan2)
+JPL_MATH2(fmod)
+#endif
+
+int main(void)
+{
+    jpl_main();
+    return 0;
+}
@@ -1,13 +1,24 @@
+#include <type_traits>
 #include "parser/parser.h"
 
 #ifndef __TRYCASTS_CPP__
 #define __TRYCASTS_CPP__
 
+// Whether F is a concrete node class, which is identified by its KIND.
+template<typename F, typename = void>
+struct hasNodeKind : std::false_type {};
+
+template<typename F>
+struct hasNodeKind<F, std::void_t<decltype(F::KIND)>> : std::true_type {};
+
 template<typename T, typename F>
 bool tryCast(T* super, F*& sub)
 {
     static_assert(std::is_base_of<T, F>::value, "cannot convert super class to an class that does not inherit from super class.");
-    sub = dynamic_cast<F*>(super);
+    if constexpr (hasNodeKind<F>::value)
+        sub = (super != nullptr && super->kind == F::KIND) ? static_cast<F*>(super) : nullptr;
+    else
+        sub = dynamic_cast<F*>(super);
     return sub != nullptr;
 }
 
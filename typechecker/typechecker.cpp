@@ -1,6 +1,9 @@
 #include "typechecker.h"
 #include "../trycasts.cpp"
 #include <type_traits>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 namespace Typechecker
 {
@@ -17,152 +20,244 @@ namespace Typechecker
         return message.c_str();
     }
 
+#pragma region Types
+    TypeInterner::TypeInterner() : int_type(new IntRType()), float_type(new FloatRType()), bool_type(new BoolRType()) {}
+
+    TypeInterner& typeInterner()
+    {
+        static TypeInterner global_interner;
+        return global_interner;
+    }
+
+    std::shared_ptr<ResolvedType> TypeInterner::arrayType(const std::shared_ptr<ResolvedType>& element_type, int rank)
+    {
+        std::vector<uintptr_t> key = {(uintptr_t) element_type.get(), (uintptr_t) rank};
+        std::lock_guard<std::mutex> guard(lock);
+
+        std::shared_ptr<ResolvedType>& type = arrays[key];
+        if (type == nullptr)
+            type.reset(new ArrayRType(element_type, rank));
+        return type;
+    }
+
+    std::shared_ptr<ResolvedType> TypeInterner::tupleType(const std::vector<std::shared_ptr<ResolvedType>>& element_types)
+    {
+        std::vector<uintptr_t> key;
+        key.reserve(element_types.size());
+        for (const std::shared_ptr<ResolvedType>& element_type : element_types)
+            key.push_back((uintptr_t) element_type.get());
+        std::lock_guard<std::mutex> guard(lock);
+
+        std::shared_ptr<ResolvedType>& type = tuples[key];
+        if (type == nullptr)
+            type.reset(new TupleRType(element_types));
+        return type;
+    }
+#pragma endregion
+
 #pragma region Scope
 
-    std::shared_ptr<Scope> Scope::createNestedScope()
+    Scope::Scope() : slots(64) {}
+
+    std::shared_ptr<Scope> Scope::global_view() const
+    {
+        std::shared_ptr<Scope> view = std::make_shared<Scope>();
+        view->slots = slots;
+        view->slots_used = slots_used;
+        view->visible_globals = visible_globals;
+        return view;
+    }
+
+    size_t Scope::probe(Lexer::Symbol name) const
     {
-        std::shared_ptr<Scope> child = std::make_shared<Scope>();
-        child->parent = this;
-        return child;
+        size_t mask = slots.size() - 1;
+        size_t slot = (name * 2654435769u) & mask;
+        while (slots[slot].symbol != name && slots[slot].symbol != Lexer::NO_SYMBOL)
+            slot = (slot + 1) & mask;
+        return slot;
     }
 
-    bool Scope::add(std::string name, NameInfo* info)
+    size_t Scope::claim(Lexer::Symbol name)
     {
-        [[maybe_unused]] NameInfo* _;
-        if (lookup(name, _))
+        size_t slot = probe(name);
+        if (slots[slot].symbol == name)
+            return slot;
+
+        // Keep the table at most half full so that probes stay short.
+        if ((slots_used + 1) * 2 > slots.size())
+        {
+            std::vector<Slot> old_slots(slots.size() * 2);
+            old_slots.swap(slots);
+            for (const Slot& old_slot : old_slots)
+                if (old_slot.symbol != Lexer::NO_SYMBOL)
+                    slots[probe(old_slot.symbol)] = old_slot;
+            slot = probe(name);
+        }
+
+        slots[slot].symbol = name;
+        slots_used++;
+        return slot;
+    }
+
+    void Scope::enter()
+    {
+        marks.push_back(changes.size());
+    }
+
+    void Scope::leave()
+    {
+        size_t mark = marks.back();
+        marks.pop_back();
+
+        while (changes.size() > mark)
+        {
+            Change& change = changes.back();
+            slots[probe(change.hidden.symbol)] = change.hidden;
+            changes.pop_back();
+        }
+    }
+
+    bool Scope::add(Lexer::Symbol name, NameInfo* info)
+    {
+        Slot& slot = slots[claim(name)];
+        if (visible(slot))
             return false;
-        
-        symbol_table.insert(std::make_pair(name, std::unique_ptr<NameInfo>(info)));
+
+        if (marks.empty())
+        {
+            globals.push_back({name, std::unique_ptr<NameInfo>(info)});
+            slot.global = globals.size() - 1;
+        }
+        else
+            changes.push_back({std::unique_ptr<NameInfo>(info), slot});
+
+        slot.info = info;
+        slot.depth = marks.size();
         return true;
     }
 
     void Scope::add_argument(Parser::ArgumentNode* argument, std::shared_ptr<ResolvedType>& rtype)
     {
-        // <variable>
+        switch (argument->kind)
         {
-            Parser::VarArgumentNode* result;
-            if (tryCast<Parser::ArgumentNode, Parser::VarArgumentNode>(argument, result))
+            // <variable>
+            case Parser::VAR_ARGUMENT:
             {
+                Parser::VarArgumentNode* result = static_cast<Parser::VarArgumentNode*>(argument);
                 NameInfo* varinfo = new VariableInfo(rtype);
-                if (!add(result->token_s, varinfo))
+                if (!add(result->symbol, varinfo))
                 {
                     delete varinfo;
                     throw TypeException("Caught argument with already defined name \"" + result->token_s + "\".", argument);
                 }
                 return;
             }
-        }
 
-        // <variable> [ <variable> , ... ]
-        {
-            Parser::ArrayArgumentNode* result;
-            if (tryCast<Parser::ArgumentNode, Parser::ArrayArgumentNode>(argument, result))
+            // <variable> [ <variable> , ... ]
+            case Parser::ARRAY_ARGUMENT:
             {
+                Parser::ArrayArgumentNode* result = static_cast<Parser::ArrayArgumentNode*>(argument);
                 ArrayRType* array_rtype;
                 if (!tryCast<ResolvedType, ArrayRType>(rtype.get(), array_rtype))
                     throw TypeException("Caught an array argument assigned non-array type. Got a type of " + rtype->toString() + ".", argument);
                 if (result->array_dimensions_names.size() != array_rtype->rank)
                     throw TypeException("Caught an argument array rank mis-match. The argument expected an array of rank " + std::to_string(result->array_dimensions_names.size()) + " but was assigned an array of size " + std::to_string(array_rtype->rank) + ".", argument);
                 NameInfo* varinfo = new VariableInfo(rtype);
-                if (! add(result->array_argument_name, varinfo))
+                if (! add(result->array_argument_symbol, varinfo))
                 {
                     delete varinfo;
                     throw TypeException("Caught argument with already defined name \"" + result->array_argument_name + "\".", argument);
                 }
-                for (std::string& dimension_name : result->array_dimensions_names)
+                for (int i = 0; i < result->array_dimensions_symbols.size(); i++)
                 {
-                    std::shared_ptr<ResolvedType> intType = std::make_shared<IntRType>();
-                    NameInfo* dim_varinfo = new VariableInfo(intType);
-                    if (! add(dimension_name, dim_varinfo))
+                    std::shared_ptr<ResolvedType> int_type = intType();
+                    NameInfo* dim_varinfo = new VariableInfo(int_type);
+                    if (! add(result->array_dimensions_symbols[i], dim_varinfo))
                     {
                         delete dim_varinfo;
-                        throw TypeException("Caught argument dimension with already defined name \"" + dimension_name + "\".", argument);
+                        throw TypeException("Caught argument dimension with already defined name \"" + result->array_dimensions_names[i] + "\".", argument);
                     }
                 }
                 return;
             }
+            default:
+                break;
         }
     }
 
-    void Scope::add_lvalue(Parser::LValue* lvalue, std::shared_ptr<ResolvedType>& rtype)
+    // Adds the lvalues from an explicit list rather than by recursion, so that deeply nested
+    // lvalues take no more native stack than shallow ones.
+    void Scope::add_lvalue(Parser::LValue* root, std::shared_ptr<ResolvedType>& root_rtype)
     {
-        // <argument>
-        {
-            Parser::ArgumentLValue* result;
-            if (tryCast<Parser::LValue, Parser::ArgumentLValue>(lvalue, result))
-            {
-                add_argument(result->argument.get(), rtype);
-                return;
-            }
-        }
+        std::vector<std::pair<Parser::LValue*, std::shared_ptr<ResolvedType>>> work = {{root, root_rtype}};
 
-        // pseudo arg
+        while (!work.empty())
         {
-            PseudoArgumentLValue* result;
-            if (tryCast<Parser::LValue, PseudoArgumentLValue>(lvalue, result))
+            Parser::LValue* lvalue = work.back().first;
+            std::shared_ptr<ResolvedType> rtype = std::move(work.back().second);
+            work.pop_back();
+
+            switch (lvalue->kind)
             {
-                add_argument(result->argument, rtype);
-                return;
-            }
-        }
+                // <argument>
+                case Parser::ARGUMENT_LVALUE:
+                {
+                    Parser::ArgumentLValue* result = static_cast<Parser::ArgumentLValue*>(lvalue);
+                    add_argument(result->argument.get(), rtype);
+                    break;
+                }
 
-        // { <lvalue>, }
-        {
-            Parser::TupleLValueNode* result;
-            if (tryCast<Parser::LValue, Parser::TupleLValueNode>(lvalue, result))
-            {
-                TupleRType* tuple_rtype;
-                if (! tryCast<ResolvedType, TupleRType>(rtype.get(), tuple_rtype))
-                    throw TypeException("Caught tuple lvalue assigned non-tuple type: " + rtype->toString() + ".", lvalue);
-                if (result->lvalues.size() != tuple_rtype->element_types.size())
-                    throw TypeException("Caught tuple lvalue assinged a tuple type with a different number of elements. LValue: " + std::to_string(result->lvalues.size()) + ", Assigned Type: " + std::to_string(tuple_rtype->element_types.size()) + ".", lvalue);
-                for (int i = 0; i < result->lvalues.size(); i++)
+                // pseudo arg
+                case Parser::PSEUDO_ARGUMENT_LVALUE:
                 {
-                    Parser::LValue* sub_lvalue = result->lvalues[i].get();
-                    std::shared_ptr<ResolvedType> sub_rtype = tuple_rtype->element_types[i];
-                    add_lvalue(sub_lvalue, sub_rtype);
+                    PseudoArgumentLValue* result = static_cast<PseudoArgumentLValue*>(lvalue);
+                    add_argument(result->argument, rtype);
+                    break;
                 }
-                return;
-            }
-        }
 
-        // pseudo tuple
-        {
-            PseudoTupleLValue* result;
-            if (tryCast<Parser::LValue, PseudoTupleLValue>(lvalue, result))
-            {
-                TupleRType* tuple_rtype;
-                if (! tryCast<ResolvedType, TupleRType>(rtype.get(), tuple_rtype))
-                    throw TypeException("Caught tuple lvalue assigned non-tuple type: " + rtype->toString() + ".", lvalue);
-                if (result->lvalues.size() != tuple_rtype->element_types.size())
-                    throw TypeException("Caught tuple lvalue assinged a tuple type with a different number of elements. LValue: " + std::to_string(result->lvalues.size()) + ", Assigned Type: " + std::to_string(tuple_rtype->element_types.size()) + ".", lvalue);
-                for (int i = 0; i < result->lvalues.size(); i++)
+                // { <lvalue>, }
+                case Parser::TUPLE_LVALUE:
                 {
-                    Parser::LValue* sub_lvalue = result->lvalues[i].get();
-                    std::shared_ptr<ResolvedType> sub_rtype = tuple_rtype->element_types[i];
-                    add_lvalue(sub_lvalue, sub_rtype);
+                    Parser::TupleLValueNode* result = static_cast<Parser::TupleLValueNode*>(lvalue);
+                    TupleRType* tuple_rtype;
+                    if (! tryCast<ResolvedType, TupleRType>(rtype.get(), tuple_rtype))
+                        throw TypeException("Caught tuple lvalue assigned non-tuple type: " + rtype->toString() + ".", lvalue);
+                    if (result->lvalues.size() != tuple_rtype->element_types.size())
+                        throw TypeException("Caught tuple lvalue assinged a tuple type with a different number of elements. LValue: " + std::to_string(result->lvalues.size()) + ", Assigned Type: " + std::to_string(tuple_rtype->element_types.size()) + ".", lvalue);
+                    // The last element is taken first, so the elements go on in reverse.
+                    for (size_t i = result->lvalues.size(); i > 0; i--)
+                        work.push_back({result->lvalues[i - 1].get(), tuple_rtype->element_types[i - 1]});
+                    break;
                 }
-                return;
+
+                // pseudo tuple
+                case Parser::PSEUDO_TUPLE_LVALUE:
+                {
+                    PseudoTupleLValue* result = static_cast<PseudoTupleLValue*>(lvalue);
+                    TupleRType* tuple_rtype;
+                    if (! tryCast<ResolvedType, TupleRType>(rtype.get(), tuple_rtype))
+                        throw TypeException("Caught tuple lvalue assigned non-tuple type: " + rtype->toString() + ".", lvalue);
+                    if (result->lvalues.size() != tuple_rtype->element_types.size())
+                        throw TypeException("Caught tuple lvalue assinged a tuple type with a different number of elements. LValue: " + std::to_string(result->lvalues.size()) + ", Assigned Type: " + std::to_string(tuple_rtype->element_types.size()) + ".", lvalue);
+                    // The last element is taken first, so the elements go on in reverse.
+                    for (size_t i = result->lvalues.size(); i > 0; i--)
+                        work.push_back({result->lvalues[i - 1].get(), tuple_rtype->element_types[i - 1]});
+                    break;
+                }
+                default:
+                    break;
             }
         }
     }
 
-    bool Scope::lookup(std::string name, NameInfo*& info)
-    {     
-        if (symbol_table.count(name) > 0)
-        {
-            info = symbol_table[name].get();
-            return true;
-        }
-        else if (parent != nullptr)
-            return parent->lookup(name, info);
-        else
+    bool Scope::lookup(Lexer::Symbol name, NameInfo*& info) const
+    {
+        const Slot& slot = slots[probe(name)];
+        if (!visible(slot))
             return false;
-    }
 
-    NameInfo* Scope::get_info(std::string name)
-    {
-        return symbol_table[name].get();
+        info = slot.info;
+        return true;
     }
 
     std::shared_ptr<Scope> create_global_scope()
@@ -171,59 +266,59 @@ namespace Typechecker
 
         // args (int[])
         {
-            std::shared_ptr<ResolvedType> arg_type = std::make_shared<IntRType>();
-            std::shared_ptr<ResolvedType> arg_types = ArrayRType::make_array(arg_type, 1);
-            global_scope->add("args",new VariableInfo(arg_types));
+            std::shared_ptr<ResolvedType> arg_type = intType();
+            std::shared_ptr<ResolvedType> arg_types = arrayType(arg_type, 1);
+            global_scope->add(Lexer::intern("args"), new VariableInfo(arg_types));
         }
 
         // argnum (int)
         {
-            std::shared_ptr<ResolvedType> argnum_type = std::make_shared<IntRType>();
-            global_scope->add("argnum", new VariableInfo(argnum_type));
+            std::shared_ptr<ResolvedType> argnum_type = intType();
+            global_scope->add(Lexer::intern("argnum"), new VariableInfo(argnum_type));
         }
         
         // runtime functions
         {
-            std::shared_ptr<ResolvedType> return_type = std::make_shared<FloatRType>();
-            std::vector<std::shared_ptr<ResolvedType>> args = {std::make_shared<FloatRType>()};
+            std::shared_ptr<ResolvedType> return_type = floatType();
+            std::vector<std::shared_ptr<ResolvedType>> args = {floatType()};
             // float sqrt(float)
-            global_scope->add("sqrt", new FuncInfo(return_type, args));
+            global_scope->add(Lexer::intern("sqrt"), new FuncInfo(return_type, args));
             // float exp(float)
-            global_scope->add("exp", new FuncInfo(return_type, args));
+            global_scope->add(Lexer::intern("exp"), new FuncInfo(return_type, args));
             // float sin(float)
-            global_scope->add("sin", new FuncInfo(return_type, args));
+            global_scope->add(Lexer::intern("sin"), new FuncInfo(return_type, args));
             // float cos(float)
-            global_scope->add("cos", new FuncInfo(return_type, args));
+            global_scope->add(Lexer::intern("cos"), new FuncInfo(return_type, args));
             // float tan(float)
-            global_scope->add("tan", new FuncInfo(return_type, args));
+            global_scope->add(Lexer::intern("tan"), new FuncInfo(return_type, args));
             // float asin(float)
-            global_scope->add("asin", new FuncInfo(return_type, args));
+            global_scope->add(Lexer::intern("asin"), new FuncInfo(return_type, args));
             // float acos(float)
-            global_scope->add("acos", new FuncInfo(return_type, args));
+            global_scope->add(Lexer::intern("acos"), new FuncInfo(return_type, args));
             // float atan(float)
-            global_scope->add("atan", new FuncInfo(return_type, args));
+            global_scope->add(Lexer::intern("atan"), new FuncInfo(return_type, args));
             // float log(float)
-            global_scope->add("log", new FuncInfo(return_type, args));
+            global_scope->add(Lexer::intern("log"), new FuncInfo(return_type, args));
         }
         {
-            std::shared_ptr<ResolvedType> return_type = std::make_shared<FloatRType>();
-            std::vector<std::shared_ptr<ResolvedType>> args = {std::make_shared<FloatRType>(), std::make_shared<FloatRType>()};
+            std::shared_ptr<ResolvedType> return_type = floatType();
+            std::vector<std::shared_ptr<ResolvedType>> args = {floatType(), floatType()};
             // float pow(float, float)
-            global_scope->add("pow", new FuncInfo(return_type, args));
+            global_scope->add(Lexer::intern("pow"), new FuncInfo(return_type, args));
             // float atan2(float, float)
-            global_scope->add("atan2", new FuncInfo(return_type, args));
+            global_scope->add(Lexer::intern("atan2"), new FuncInfo(return_type, args));
         }
         // int to_int(float)
         {
-            std::shared_ptr<ResolvedType> return_type = std::make_shared<IntRType>();
-            std::vector<std::shared_ptr<ResolvedType>> args = {std::make_shared<FloatRType>()};
-            global_scope->add("to_int", new FuncInfo(return_type, args));
+            std::shared_ptr<ResolvedType> return_type = intType();
+            std::vector<std::shared_ptr<ResolvedType>> args = {floatType()};
+            global_scope->add(Lexer::intern("to_int"), new FuncInfo(return_type, args));
         }
         // float to_float(int)
         {
-            std::shared_ptr<ResolvedType> return_type = std::make_shared<FloatRType>();
-            std::vector<std::shared_ptr<ResolvedType>> args = {std::make_shared<IntRType>()};
-            global_scope->add("to_float", new FuncInfo(return_type, args));
+            std::shared_ptr<ResolvedType> return_type = floatType();
+            std::vector<std::shared_ptr<ResolvedType>> args = {intType()};
+            global_scope->add(Lexer::intern("to_float"), new FuncInfo(return_type, args));
         }
 
         return global_scope;
@@ -231,128 +326,290 @@ namespace Typechecker
 
 #pragma endregion
 
-    std::shared_ptr<ResolvedType> resolve_type(std::unique_ptr<Parser::TypeNode>& u_type, std::shared_ptr<Scope>& scope)
+    // A type being resolved by resolve_type, and how many of its element types are resolved.
+    struct ResolvingFrame
     {
-        Parser::TypeNode* _type = u_type.get();
+        Parser::TypeNode* type;
+        size_t resolved;
+    };
 
-        // int
-        {
-            Parser::IntTypeNode* result;
-            if (tryCast<Parser::TypeNode, Parser::IntTypeNode>(_type, result))
-                return std::make_shared<IntRType>();
-        }
-        // float
-        {
-            Parser::FloatTypeNode* result;
-            if (tryCast<Parser::TypeNode, Parser::FloatTypeNode>(_type, result))
-                return std::make_shared<FloatRType>();
-        }
-        // bool
-        {
-            Parser::BoolTypeNode* result;
-            if (tryCast<Parser::TypeNode, Parser::BoolTypeNode>(_type, result))
-                return std::make_shared<BoolRType>();
-        }
-        // <variable>
+    // Resolves the element types of each type before the type itself, from an explicit stack
+    // of the types being resolved rather than by recursion, like type_of.
+    std::shared_ptr<ResolvedType> resolve_type(Parser::NodePtr<Parser::TypeNode>& u_type, std::shared_ptr<Scope>& scope)
+    {
+        std::vector<ResolvingFrame> frames;
+        frames.push_back({u_type.get(), 0});
+        // The resolved element types of the types in frames, innermost last.
+        std::vector<std::shared_ptr<ResolvedType>> resolved;
+
+        while (true)
         {
-            Parser::VariableTypeNode* result;
-            if (tryCast<Parser::TypeNode, Parser::VariableTypeNode>(_type, result))
+            ResolvingFrame& frame = frames.back();
+            Parser::TypeNode* _type = frame.type;
+            std::shared_ptr<ResolvedType> rtype;
+
+            switch (_type->kind)
             {
-                NameInfo* info;
-                if (! scope->lookup(result->token_s, info))
-                    throw TypeException("Undefined reference to type variable " + result->token_s + ".", _type);
-                TypeInfo* typeinfo;
-                if (! tryCast<NameInfo, TypeInfo>(info, typeinfo))
-                    throw TypeException("Reference to variable " + result->token_s + " as a type value; but it isn't.", _type);
-                return typeinfo->stored_type;
+                // int
+                case Parser::INT_TYPE:
+                {
+                    rtype = intType();
+                    break;
+                }
+                // float
+                case Parser::FLOAT_TYPE:
+                {
+                    rtype = floatType();
+                    break;
+                }
+                // bool
+                case Parser::BOOL_TYPE:
+                {
+                    rtype = boolType();
+                    break;
+                }
+                // <variable>
+                case Parser::VARIABLE_TYPE:
+                {
+                    Parser::VariableTypeNode* result = static_cast<Parser::VariableTypeNode*>(_type);
+                    NameInfo* info;
+                    if (! scope->lookup(result->symbol, info))
+                        throw TypeException("Undefined reference to type variable " + result->token_s + ".", _type);
+                    TypeInfo* typeinfo;
+                    if (! tryCast<NameInfo, TypeInfo>(info, typeinfo))
+                        throw TypeException("Reference to variable " + result->token_s + " as a type value; but it isn't.", _type);
+                    rtype = typeinfo->stored_type;
+                    break;
+                }
+                // <type> [, ... ]
+                case Parser::ARRAY_TYPE:
+                {
+                    Parser::ArrayTypeNode* result = static_cast<Parser::ArrayTypeNode*>(_type);
+                    if (frame.resolved == 0)
+                    {
+                        frame.resolved++;
+                        frames.push_back({result->array_type.get(), 0});
+                        continue;
+                    }
+                    rtype = arrayType(resolved.back(), result->rank);
+                    resolved.pop_back();
+                    break;
+                }
+                // {<type>, ... }
+                case Parser::TUPLE_TYPE:
+                {
+                    Parser::TupleTypeNode* result = static_cast<Parser::TupleTypeNode*>(_type);
+                    size_t element_count = result->tuple_types.size();
+                    if (frame.resolved < element_count)
+                    {
+                        Parser::TypeNode* element = result->tuple_types[frame.resolved++].get();
+                        frames.push_back({element, 0});
+                        continue;
+                    }
+                    std::vector<std::shared_ptr<ResolvedType>> r_types(resolved.end() - element_count, resolved.end());
+                    resolved.resize(resolved.size() - element_count);
+                    rtype = tupleType(r_types);
+                    break;
+                }
+                default:
+                    throw TypeException("Could not identify type.", _type);
             }
+
+            frames.pop_back();
+            if (frames.empty())
+                return rtype;
+            resolved.push_back(std::move(rtype));
         }
-        // <type> [, ... ]
+    }
+
+    // An expression being typed by type_of, and how many of its operands are typed so far.
+    struct TypingFrame
+    {
+        Parser::ExprNode* expr;
+        size_t typed;
+        // The scope of a loop's variables, open from before its bounds are typed until it is.
+        std::unique_ptr<NestedScope> loop_scope;
+    };
+
+    // Checks the bound of a loop just typed, before any of the loop variables are in scope.
+    void check_loop_bound(Parser::LoopExprNode* loop, size_t i, std::shared_ptr<Scope>& scope)
+    {
+        auto& index_pair = loop->bounds[i];
+        Parser::NodePtr<Parser::ExprNode>& sub_expr = index_pair.second;
+        std::shared_ptr<ResolvedType> bound_rtype = sub_expr->resolvedType->shared_from_this();
+        IntRType* bound_rtype_as_int;
+        if (! tryCast<ResolvedType, IntRType>(bound_rtype.get(), bound_rtype_as_int))
+            throw TypeException("Caught loop iterating over non-int type: " + bound_rtype->toString() + ".", sub_expr.get());
+
+        NameInfo* _;
+        const Parser::ArenaVector<Lexer::Symbol>& bound_symbols = loop->bound_symbols;
+        auto earlier_end = bound_symbols.begin() + i;
+        if (scope->lookup(bound_symbols[i], _) || std::find(bound_symbols.begin(), earlier_end, bound_symbols[i]) != earlier_end)
+            throw TypeException("Caught loop iterating variable with already defined name \"" + index_pair.first + "\".", sub_expr.get());
+    }
+
+    // The next operand of the expression in frame to type, after checking what can be checked
+    // of the operands typed so far; nullptr once every operand is typed. Each typed operand has
+    // its resolvedType.
+    Parser::NodePtr<Parser::ExprNode>* next_operand(TypingFrame& frame, std::shared_ptr<Scope>& scope)
+    {
+        Parser::ExprNode* expr = frame.expr;
+        size_t typed = frame.typed;
+
+        switch (expr->kind)
         {
-            Parser::ArrayTypeNode* result;
-            if (tryCast<Parser::TypeNode, Parser::ArrayTypeNode>(_type, result))
+            case Parser::BINOP_EXPR:
             {
-                std::shared_ptr<ResolvedType> element_type = resolve_type(result->array_type, scope);
-                return std::make_shared<ArrayRType>(element_type, result->rank);
+                Parser::BinopExprNode* result = static_cast<Parser::BinopExprNode*>(expr);
+                if (typed == 0)
+                    return &result->lhs;
+                return typed == 1 ? &result->rhs : nullptr;
             }
-        }
-        // {<type>, ... }
-        {
-            Parser::TupleTypeNode* result;
-            if (tryCast<Parser::TypeNode, Parser::TupleTypeNode>(_type, result))
+            case Parser::UNOP_EXPR:
             {
-                std::vector<std::shared_ptr<ResolvedType>> r_types;
-                for (std::unique_ptr<Parser::TypeNode>& tuple_element_type : result->tuple_types)
-                    r_types.push_back(resolve_type(tuple_element_type, scope));
-                return std::make_shared<TupleRType>(r_types);
+                Parser::UnopExprNode* result = static_cast<Parser::UnopExprNode*>(expr);
+                return typed == 0 ? &result->expression : nullptr;
             }
-        }
+            case Parser::TUPLE_LITERAL_EXPR:
+            {
+                Parser::TupleLiteralExprNode* result = static_cast<Parser::TupleLiteralExprNode*>(expr);
+                return typed < result->tuple_expressions.size() ? &result->tuple_expressions[typed] : nullptr;
+            }
+            case Parser::ARRAY_LITERAL_EXPR:
+            {
+                Parser::ArrayLiteralExprNode* result = static_cast<Parser::ArrayLiteralExprNode*>(expr);
+                if (result->array_expressions.size() == 0)
+                    throw TypeException("Caught array literal expression with no elements. Unidentifyable subtype.", result);
 
-        throw TypeException("Could not identify type.", _type);
-    }
+                if (typed > 1)
+                {
+                    std::shared_ptr<ResolvedType> element_rtype = result->array_expressions[0]->resolvedType->shared_from_this();
+                    std::shared_ptr<ResolvedType> _elmnt_rtype = result->array_expressions[typed - 1]->resolvedType->shared_from_this();
+                    if (*element_rtype.get() != *_elmnt_rtype.get())
+                        throw TypeException("Caught array literal with mismatched element types. 1st type: " + element_rtype.get()->toString() + ", " + std::to_string(typed) + "th type: " + _elmnt_rtype.get()->toString(), result);
+                }
+                return typed < result->array_expressions.size() ? &result->array_expressions[typed] : nullptr;
+            }
+            case Parser::IF_EXPR:
+            {
+                Parser::IfExprNode* result = static_cast<Parser::IfExprNode*>(expr);
+                Parser::NodePtr<Parser::ExprNode>* operands[] = {&result->condition, &result->then_expr, &result->else_expr};
+                return typed < 3 ? operands[typed] : nullptr;
+            }
+            case Parser::TUPLE_INDEX_EXPR:
+            {
+                Parser::TupleIndexExprNode* result = static_cast<Parser::TupleIndexExprNode*>(expr);
+                return typed == 0 ? &result->tuple_expression : nullptr;
+            }
+            // The array is checked before its indices are typed.
+            case Parser::ARRAY_INDEX_EXPR:
+            {
+                Parser::ArrayIndexExprNode* result = static_cast<Parser::ArrayIndexExprNode*>(expr);
+                if (typed == 0)
+                    return &result->array_expression;
 
-    std::shared_ptr<Scope> type_of_loop_bounds(std::vector<std::unique_ptr<std::pair<std::string, std::unique_ptr<Parser::ExprNode>>>>& bounds, std::shared_ptr<Scope>& scope)
-    {
-        std::shared_ptr<Scope> child_scope = scope->createNestedScope();
+                if (typed == 1)
+                {
+                    std::shared_ptr<ResolvedType> expr_rtype = result->array_expression->resolvedType->shared_from_this();
+                    if (expr_rtype.get()->type_name != ARRAY)
+                        throw TypeException("Caught array indexing into a non-array expression. Expression type: " + expr_rtype.get()->toString(), result);
 
-        for(auto& index_pair : bounds)
-        {
-            std::unique_ptr<Parser::ExprNode>& sub_expr = index_pair->second;
-            std::shared_ptr<ResolvedType> bound_rtype = type_of(sub_expr, scope);
-            IntRType* bound_rtype_as_int;
-            if (! tryCast<ResolvedType, IntRType>(bound_rtype.get(), bound_rtype_as_int))
-                throw TypeException("Caught loop iterating over non-int type: " + bound_rtype->toString() + ".", sub_expr.get());
-            sub_expr->resolvedType = bound_rtype;
-            NameInfo* info = new VariableInfo(bound_rtype);
-            if (! child_scope->add(index_pair->first, info))
-            {
-                delete info;
-                throw TypeException("Caught loop iterating variable with already defined name \"" + index_pair->first + "\".", sub_expr.get());
+                    const ArrayRType* array_expr_rtype = static_cast<ArrayRType*>(expr_rtype.get());
+                    if (array_expr_rtype->rank != result->array_indices.size())
+                        throw TypeException("Caught indexing into an array with rank " + std::to_string(array_expr_rtype->rank) + " with " + std::to_string(result->array_indices.size()) + " indices.", result);
+                }
+                else
+                {
+                    std::shared_ptr<ResolvedType> index_expr_type = result->array_indices[typed - 2]->resolvedType->shared_from_this();
+                    if (index_expr_type.get()->type_name != INT)
+                        throw TypeException("Caught indexing into an array with non-int index expression. Expression type: " + index_expr_type.get()->toString(), result);
+                }
+                return typed - 1 < result->array_indices.size() ? &result->array_indices[typed - 1] : nullptr;
             }
-        }
+            // Every bound is typed, in the loop's own scope, before any of the variables are
+            // added to it for the body.
+            case Parser::ARRAY_LOOP_EXPR:
+            case Parser::SUM_LOOP_EXPR:
+            {
+                Parser::LoopExprNode* result = static_cast<Parser::LoopExprNode*>(expr);
+                size_t bound_count = result->bounds.size();
+                if (typed == 0)
+                {
+                    if (bound_count < 1)
+                        throw TypeException(expr->kind == Parser::ARRAY_LOOP_EXPR ? "Caught array loop with no bounds." : "Caught sum loop with no bounds.", expr);
+                    frame.loop_scope.reset(new NestedScope(*scope));
+                }
+                else if (typed <= bound_count)
+                    check_loop_bound(result, typed - 1, scope);
+
+                if (typed < bound_count)
+                    return &result->bounds[typed].second;
+                if (typed > bound_count)
+                    return nullptr;
+                for (size_t i = 0; i < bound_count; i++)
+                    scope->add(result->bound_symbols[i], new VariableInfo(result->bounds[i].second->resolvedType->shared_from_this()));
+                return &result->loop_expression;
+            }
+            // The function is looked up before its arguments are typed.
+            case Parser::CALL_EXPR:
+            {
+                Parser::CallExprNode* result = static_cast<Parser::CallExprNode*>(expr);
+                NameInfo* info;
+                if (! scope->lookup(result->function_symbol, info))
+                    throw TypeException("Undefined reference to function " + result->function_name + ".", expr);
+                FuncInfo* funcinfo;
+                if (! tryCast<NameInfo, FuncInfo>(info, funcinfo))
+                    throw TypeException("Referenced non-function " + result->function_name + " as a function.", expr);
+                if (funcinfo->arguments.size() != result->arguments.size())
+                    throw TypeException("Function " + result->function_name + " expects " + std::to_string(funcinfo->arguments.size()) + " arguments, but got " + std::to_string(result->arguments.size()) + ".", result);
 
-        return child_scope;
+                if (typed > 0)
+                {
+                    std::shared_ptr<ResolvedType> expected_type = funcinfo->arguments[typed - 1];
+                    std::shared_ptr<ResolvedType> got_type = result->arguments[typed - 1]->resolvedType->shared_from_this();
+                    if (*expected_type != *got_type)
+                        throw TypeException("Function " + result->function_name + " expects a " + expected_type->toString() + " as its " + std::to_string(typed) + "th argument, but got a " + got_type->toString() + ".", result);
+                }
+                return typed < result->arguments.size() ? &result->arguments[typed] : nullptr;
+            }
+            default:
+                return nullptr;
+        }
     }
 
-    std::shared_ptr<ResolvedType> type_of(std::unique_ptr<Parser::ExprNode>& u_expr, std::shared_ptr<Scope>& scope)
+    // The type of expr, once every operand has been typed.
+    std::shared_ptr<ResolvedType> type_from_operands(Parser::ExprNode* expr, std::shared_ptr<Scope>& scope)
     {
-        Parser::ExprNode* expr = u_expr.get();
-
-        // <integer>
-        {
-            Parser::IntExprNode* result;
-            if (tryCastExpr<Parser::IntExprNode>(expr, result))
-                return std::make_shared<IntRType>();
-        }
-        // <float>
-        {
-            Parser::FloatExprNode* result;
-            if (tryCastExpr<Parser::FloatExprNode>(expr, result))
-                return std::make_shared<FloatRType>();
-        }
-        // true
-        {
-            Parser::TrueExprNode* result;
-            if (tryCastExpr<Parser::TrueExprNode>(expr, result))
-                return std::make_shared<BoolRType>();
-        }
-        // false
+        switch (expr->kind)
         {
-            Parser::FalseExprNode* result;
-            if (tryCastExpr<Parser::FalseExprNode>(expr, result))
-                return std::make_shared<BoolRType>();
-        }
-
-        // binop exprs
-        {
-            Parser::BinopExprNode* result;
-            if (tryCastExpr<Parser::BinopExprNode>(expr, result))
+            // <integer>
+            case Parser::INT_EXPR:
+            {
+                return intType();
+            }
+            // <float>
+            case Parser::FLOAT_EXPR:
+            {
+                return floatType();
+            }
+            // true
+            case Parser::TRUE_EXPR:
+            {
+                return boolType();
+            }
+            // false
+            case Parser::FALSE_EXPR:
             {
-                std::shared_ptr<ResolvedType> lhs_rtype = type_of(result->lhs, scope);
-                std::shared_ptr<ResolvedType> rhs_rtype = type_of(result->rhs, scope);
+                return boolType();
+            }
 
-                result->lhs.get()->resolvedType = lhs_rtype;
-                result->rhs.get()->resolvedType = rhs_rtype;
+            // binop exprs
+            case Parser::BINOP_EXPR:
+            {
+                Parser::BinopExprNode* result = static_cast<Parser::BinopExprNode*>(expr);
+                std::shared_ptr<ResolvedType> lhs_rtype = result->lhs->resolvedType->shared_from_this();
+                std::shared_ptr<ResolvedType> rhs_rtype = result->rhs->resolvedType->shared_from_this();
+                
                 
                 switch (result->operation)
                 {
@@ -371,10 +628,10 @@ namespace Typechecker
                             throw TypeException("Types do not match for arithmetic operation. lhs: " + lhs_rtype.get()->toString() + " rhs: " + rhs_rtype.get()->toString(), result);
                         
                         if (lhs_rtype.get()->type_name == INT)
-                            return std::make_shared<IntRType>();
+                            return intType();
                         
                         if (lhs_rtype.get()->type_name == FLOAT)
-                            return std::make_shared<FloatRType>();
+                            return floatType();
                         
                         throw TypeException("No supported arithmetic operation for " + lhs_rtype.get()->toString() + ". Expects two ints or floats.", result);
                     }
@@ -396,7 +653,7 @@ namespace Typechecker
                         if (!(int_args || float_args))
                             throw TypeException("No supported comparison operation for " + lhs_rtype.get()->toString() + ". Expects two ints or floats.", result);
                         
-                        return std::make_shared<BoolRType>();
+                        return boolType();
                     }
                 // <expr> == <expr>
                 case Parser::BinopExprNode::EQUALS:
@@ -413,7 +670,7 @@ namespace Typechecker
                         if (!(int_args || float_args || bool_args))
                             throw TypeException("No supported equality operation for " + lhs_rtype.get()->toString() + ". Expects two ints, floats, or bools.", result);
                         
-                        return std::make_shared<BoolRType>();
+                        return boolType();
                     }
                 // <expr> && <expr>
                 case Parser::BinopExprNode::AND:
@@ -423,20 +680,17 @@ namespace Typechecker
                         if (lhs_rtype.get()->type_name != BOOL || rhs_rtype.get()->type_name != BOOL)
                             throw TypeException("No supported boolean operation for given types. Expects two booleans. lhs: " + lhs_rtype.get()->toString() + " rhs: " + rhs_rtype.get()->toString(), result);
                         
-                        return std::make_shared<BoolRType>();
+                        return boolType();
                     }
                 }
+                break;
             }
-        }
 
-        // unop exprs
-        {
-            Parser::UnopExprNode* result;
-            if (tryCastExpr<Parser::UnopExprNode>(expr, result))
+            // unop exprs
+            case Parser::UNOP_EXPR:
             {
-                std::unique_ptr<Parser::ExprNode>& u_expr = result->expression;
-                std::shared_ptr<ResolvedType> expr_rtype = type_of(u_expr, scope);
-                u_expr.get()->resolvedType = expr_rtype;
+                Parser::UnopExprNode* result = static_cast<Parser::UnopExprNode*>(expr);
+                std::shared_ptr<ResolvedType> expr_rtype = result->expression->resolvedType->shared_from_this();
 
                 switch (result->operation)
                 {
@@ -444,9 +698,9 @@ namespace Typechecker
                 case Parser::UnopExprNode::NEGATION:
                     {
                         if (expr_rtype.get()->type_name == INT)
-                            return std::make_shared<IntRType>();
+                            return intType();
                         if (expr_rtype.get()->type_name == FLOAT)
-                            return std::make_shared<FloatRType>();
+                            return floatType();
                         throw TypeException("No supported unary - for " + expr_rtype.get()->toString() + ". Expects an int or float.", result);
                     }
                 // ! <expr>
@@ -454,64 +708,36 @@ namespace Typechecker
                     {
                         if (expr_rtype.get()->type_name != BOOL)
                             throw TypeException("No supported unary ! for " + expr_rtype.get()->toString() + ". Expects a boolean.", result);
-                        return std::make_shared<BoolRType>();
+                        return boolType();
                     }
                 }
                 
+                break;
             }
-        }
 
-        // { <expr>, ... }
-        {
-            Parser::TupleLiteralExprNode* result;
-            if (tryCastExpr<Parser::TupleLiteralExprNode>(expr, result))
+            // { <expr>, ... }
+            case Parser::TUPLE_LITERAL_EXPR:
             {
+                Parser::TupleLiteralExprNode* result = static_cast<Parser::TupleLiteralExprNode*>(expr);
                 std::vector<std::shared_ptr<ResolvedType>> expression_rtypes;
-                for(std::unique_ptr<Parser::ExprNode>& sub_expr : result->tuple_expressions)
-                {
-                    std::shared_ptr<ResolvedType> sub_expr_rtype = type_of(sub_expr, scope);
-                    expression_rtypes.push_back(sub_expr_rtype);
-                    sub_expr.get()->resolvedType = sub_expr_rtype;
-                }
+                for(Parser::NodePtr<Parser::ExprNode>& sub_expr : result->tuple_expressions)
+                    expression_rtypes.push_back(sub_expr->resolvedType->shared_from_this());
 
-                return std::make_shared<TupleRType>(expression_rtypes);
+                return tupleType(expression_rtypes);
             }
-        }
-        // [ <expr>, ... ]
-        {
-            Parser::ArrayLiteralExprNode* result;
-            if (tryCastExpr<Parser::ArrayLiteralExprNode>(expr, result))
+            // [ <expr>, ... ]
+            case Parser::ARRAY_LITERAL_EXPR:
             {
-                int element_count = result->array_expressions.size();
-
-                if (element_count == 0)
-                    throw TypeException("Caught array literal expression with no elements. Unidentifyable subtype.", result);
-                
-                std::shared_ptr<ResolvedType> element_rtype = type_of(result->array_expressions[0], scope);
-                result->array_expressions[0].get()->resolvedType = element_rtype;
-
-                for (int i = 1; i < element_count; i++)
-                {
-                    std::shared_ptr<ResolvedType> _elmnt_rtype = type_of(result->array_expressions[i], scope);
-                    result->array_expressions[i].get()->resolvedType = _elmnt_rtype;
-                    if (*element_rtype.get() != *_elmnt_rtype.get())
-                        throw TypeException("Caught array literal with mismatched element types. 1st type: " + element_rtype.get()->toString() + ", " + std::to_string(i + 1) + "th type: " + _elmnt_rtype.get()->toString(), result);
-                }
-
-                return std::make_shared<ArrayRType>(element_rtype, 1);
+                Parser::ArrayLiteralExprNode* result = static_cast<Parser::ArrayLiteralExprNode*>(expr);
+                return arrayType(result->array_expressions[0]->resolvedType->shared_from_this(), 1);
             }
-        }
-        // if <expr> then <expr> else <expr>
-        {
-            Parser::IfExprNode* result;
-            if (tryCastExpr<Parser::IfExprNode>(expr, result))
+            // if <expr> then <expr> else <expr>
+            case Parser::IF_EXPR:
             {
-                std::shared_ptr<ResolvedType> condition_rtype = type_of(result->condition, scope);
-                result->condition.get()->resolvedType = condition_rtype;
-                std::shared_ptr<ResolvedType> then_rtype = type_of(result->then_expr, scope);
-                result->then_expr.get()->resolvedType = then_rtype;
-                std::shared_ptr<ResolvedType> else_rtype = type_of(result->else_expr, scope);
-                result->else_expr.get()->resolvedType = else_rtype;
+                Parser::IfExprNode* result = static_cast<Parser::IfExprNode*>(expr);
+                std::shared_ptr<ResolvedType> condition_rtype = result->condition->resolvedType->shared_from_this();
+                std::shared_ptr<ResolvedType> then_rtype = result->then_expr->resolvedType->shared_from_this();
+                std::shared_ptr<ResolvedType> else_rtype = result->else_expr->resolvedType->shared_from_this();
 
                 if (condition_rtype.get()->type_name != BOOL)
                     throw TypeException("Caught if expression with non-boolean conditional expression type " + condition_rtype.get()->toString() + ".", result);
@@ -519,16 +745,13 @@ namespace Typechecker
                 if (*then_rtype.get() != *else_rtype.get())
                     throw TypeException("Caught if expression with non-matching then else expressions. Then: " + then_rtype.get()->toString() + "Else: " + else_rtype.get()->toString() + ".", result);
                 
-                return std::shared_ptr<ResolvedType>(then_rtype.get()->clone());
+                return then_rtype;
             }
-        }
-        // <expr> { <integer> }
-        {
-            Parser::TupleIndexExprNode* result;
-            if (tryCastExpr<Parser::TupleIndexExprNode>(expr, result))
+            // <expr> { <integer> }
+            case Parser::TUPLE_INDEX_EXPR:
             {
-                std::shared_ptr<ResolvedType> expr_rtype = type_of(result->tuple_expression, scope);
-                result->tuple_expression.get()->resolvedType = expr_rtype;
+                Parser::TupleIndexExprNode* result = static_cast<Parser::TupleIndexExprNode*>(expr);
+                std::shared_ptr<ResolvedType> expr_rtype = result->tuple_expression->resolvedType->shared_from_this();
 
                 if (expr_rtype.get()->type_name != TUPLE)
                     throw TypeException("Caught tuple indexing into a non-tuple expression. Expression type: " + expr_rtype.get()->toString(), result);
@@ -538,168 +761,200 @@ namespace Typechecker
                 if (tuple_expr_rtype->element_types.size() <= result->tuple_index || result->tuple_index < 0)
                     throw TypeException("Caught indexing into a tuple with " + std::to_string(tuple_expr_rtype->element_types.size()) + " elements at illegal index " + std::to_string(result->tuple_index), result);
 
-                return std::shared_ptr<ResolvedType>(tuple_expr_rtype->element_types[result->tuple_index].get()->clone()); 
+                return tuple_expr_rtype->element_types[result->tuple_index]; 
             }
-        }
-        // <expr> [ <expr>, ... ]
-        {
-            Parser::ArrayIndexExprNode* result;
-            if (tryCastExpr<Parser::ArrayIndexExprNode>(expr, result))
+            // <expr> [ <expr>, ... ]
+            case Parser::ARRAY_INDEX_EXPR:
             {
-                std::shared_ptr<ResolvedType> expr_rtype = type_of(result->array_expression, scope);
-                result->array_expression.get()->resolvedType = expr_rtype;
-
-                if (expr_rtype.get()->type_name != ARRAY)
-                    throw TypeException("Caught array indexing into a non-array expression. Expression type: " + expr_rtype.get()->toString(), result);
-                
-                const ArrayRType* array_expr_rtype = static_cast<ArrayRType*>(expr_rtype.get());
-
-                if (array_expr_rtype->rank != result->array_indices.size())
-                    throw TypeException("Caught indexing into an array with rank " + std::to_string(array_expr_rtype->rank) + " with " + std::to_string(result->array_indices.size()) + " indices.", result);
-                
-                for (std::unique_ptr<Parser::ExprNode>& index_expr : result->array_indices)
-                {
-                    std::shared_ptr<ResolvedType> index_expr_type = type_of(index_expr, scope);
-                    index_expr.get()->resolvedType = index_expr_type;
-                    if (index_expr_type.get()->type_name != INT)
-                        throw TypeException("Caught indexing into an array with non-int index expression. Expression type: " + index_expr_type.get()->toString(), result);
-                }
-
-                return std::shared_ptr<ResolvedType>(array_expr_rtype->element_type.get()->clone());
+                Parser::ArrayIndexExprNode* result = static_cast<Parser::ArrayIndexExprNode*>(expr);
+                return static_cast<ArrayRType*>(result->array_expression->resolvedType)->element_type;
             }
-        }
-        // <variable>
-        {
-            Parser::VariableExprNode* result;
-            if (tryCastExpr<Parser::VariableExprNode>(expr, result))
+            // <variable>
+            case Parser::VARIABLE_EXPR:
             {
+                Parser::VariableExprNode* result = static_cast<Parser::VariableExprNode*>(expr);
                 NameInfo* info;
-                if (! scope->lookup(result->token_s, info))
+                if (! scope->lookup(result->symbol, info))
                     throw TypeException("Undefined reference to variable " + result->token_s + ".", expr);
                 VariableInfo* varinfo;
                 if (! tryCast<NameInfo, VariableInfo>(info, varinfo))
                     throw TypeException("Reference to variable " + result->token_s + " as an expression value; but it isn't.", expr);
                 return varinfo->rtype;
             }
-        }
-        // array [ <variable> : <expr> , ... ] <expr>
-        {
-            Parser::ArrayLoopExprNode* result;
-            if (tryCastExpr<Parser::ArrayLoopExprNode>(expr, result))
-            {
-                // Add all index iterators to the scope.
-                 if (result->bounds.size() < 1)
-                    throw TypeException("Caught array loop with no bounds.", expr);
-                std::shared_ptr<Scope> child_scope = type_of_loop_bounds(result->bounds, scope);
-                // Get the expression type.
-                std::shared_ptr<ResolvedType> array_rtype = type_of(result->loop_expression, child_scope);
-                result->loop_expression->resolvedType = array_rtype;
-                // Turn it into an array and return.
-                return ArrayRType::make_array(array_rtype, result->bounds.size());
+            // array [ <variable> : <expr> , ... ] <expr>
+            case Parser::ARRAY_LOOP_EXPR:
+            {
+                Parser::ArrayLoopExprNode* result = static_cast<Parser::ArrayLoopExprNode*>(expr);
+                // Turn the expression type into an array and return.
+                return arrayType(result->loop_expression->resolvedType->shared_from_this(), result->bounds.size());
             }
-        }
-        // sum [ <variable> : <expr> , ... ] <expr>
-        {
-            Parser::SumLoopExprNode* result;
-            if (tryCastExpr<Parser::SumLoopExprNode>(expr, result))
+            // sum [ <variable> : <expr> , ... ] <expr>
+            case Parser::SUM_LOOP_EXPR:
             {
-                // Add all index iterators to the scope.
-                if (result->bounds.size() < 1)
-                    throw TypeException("Caught sum loop with no bounds.", expr);
-                std::shared_ptr<Scope> child_scope = type_of_loop_bounds(result->bounds, scope);
                 // Check that the expression is an int or float.
-                std::shared_ptr<ResolvedType> sum_rtype = type_of(result->loop_expression, child_scope);
-                result->loop_expression->resolvedType = sum_rtype;
+                std::shared_ptr<ResolvedType> sum_rtype = static_cast<Parser::SumLoopExprNode*>(expr)->loop_expression->resolvedType->shared_from_this();
                 if (sum_rtype->type_name == INT)
-                    return std::make_shared<IntRType>();
+                    return intType();
                 if (sum_rtype->type_name == FLOAT)
-                    return std::make_shared<FloatRType>();
+                    return floatType();
                 throw TypeException("Caught sum loop with non-numerical type " + sum_rtype->toString() + ". Expected an int or a float.", expr);
             }
-        }
 
-        // <variable> ( <expr> , ... )
-        {
-            Parser::CallExprNode* result;
-            if (tryCastExpr<Parser::CallExprNode>(expr, result))
+            // <variable> ( <expr> , ... )
+            case Parser::CALL_EXPR:
             {
                 NameInfo* info;
-                if (! scope->lookup(result->function_name, info))
-                    throw TypeException("Undefined reference to function " + result->function_name + ".", expr);
-                FuncInfo* funcinfo;
-                if (! tryCast<NameInfo, FuncInfo>(info, funcinfo))
-                    throw TypeException("Referenced non-function " + result->function_name + " as a function.", expr);
-                if (funcinfo->arguments.size() != result->arguments.size())
-                    throw TypeException("Function " + result->function_name + " expects " + std::to_string(funcinfo->arguments.size()) + " arguments, but got " + std::to_string(result->arguments.size()) + ".", result);
-                for (int i = 0; i < funcinfo->arguments.size(); i++)
-                {
-                    std::shared_ptr<ResolvedType> expected_type = funcinfo->arguments[i];
-                    std::shared_ptr<ResolvedType> got_type = type_of(result->arguments[i], scope);
-                    if (*expected_type != *got_type)
-                        throw TypeException("Function " + result->function_name + " expects a " + expected_type->toString() + " as its " + std::to_string(i + 1) + "th argument, but got a " + got_type->toString() + ".", result);
-                    result->arguments[i]->resolvedType = got_type;
-                }
-                return funcinfo->return_type;
+                scope->lookup(static_cast<Parser::CallExprNode*>(expr)->function_symbol, info);
+                return static_cast<FuncInfo*>(info)->return_type;
             }
+            default:
+                break;
         }
 
         throw TypeException("Could not identify expression type.", expr);
     }
 
-    std::shared_ptr<Scope> typecheck(std::vector<std::unique_ptr<Parser::CmdNode>>& commands)
+    // Types the operands of each expression before the expression itself, from an explicit
+    // stack of the expressions being typed rather than by recursion, so that deeply nested
+    // expressions take no more native stack than shallow ones.
+    std::shared_ptr<ResolvedType> type_of(Parser::NodePtr<Parser::ExprNode>& u_expr, std::shared_ptr<Scope>& scope)
+    {
+        std::vector<TypingFrame> frames;
+        frames.push_back({u_expr.get(), 0, nullptr});
+        std::shared_ptr<ResolvedType> rtype;
+
+        while (true)
+        {
+            TypingFrame& frame = frames.back();
+            Parser::NodePtr<Parser::ExprNode>* operand = next_operand(frame, scope);
+            if (operand != nullptr)
+            {
+                frames.push_back({operand->get(), 0, nullptr});
+                continue;
+            }
+
+            rtype = type_from_operands(frame.expr, scope);
+            Parser::ExprNode* typed_expr = frame.expr;
+            frames.pop_back();
+            if (frames.empty())
+                return rtype;
+            typed_expr->resolvedType = rtype.get();
+            frames.back().typed++;
+        }
+    }
+
+    std::shared_ptr<Scope> typecheck(std::vector<Parser::NodePtr<Parser::CmdNode>>& commands)
     {
         std::shared_ptr<Scope> scope = create_global_scope();
 
-        for (std::unique_ptr<Parser::CmdNode>& u_cmd : commands)
+        // Check the commands in order, leaving function bodies for later. Nothing after the
+        // first command that fails is checked.
+        std::vector<FunctionBody> bodies;
+        std::exception_ptr command_error;
+
+        for (Parser::NodePtr<Parser::CmdNode>& u_cmd : commands)
         {
-            typecheckCmd(u_cmd, scope);
+            try
+            {
+                if (u_cmd->kind == Parser::FN_CMD)
+                    bodies.push_back(typecheckSignature(static_cast<Parser::FnCmd*>(u_cmd.get()), scope));
+                else
+                    typecheckCmd(u_cmd, scope);
+            }
+            catch (...)
+            {
+                command_error = std::current_exception();
+                break;
+            }
         }
 
+        // Every body comes before the failed command, so an error in a body is reported first.
+        typecheckBodies(bodies, *scope);
+        if (command_error)
+            std::rethrow_exception(command_error);
+
         return scope;
     }
 
-    void typecheckCmd(std::unique_ptr<Parser::CmdNode>& u_cmd, std::shared_ptr<Scope>& scope)
+    void typecheckBodies(std::vector<FunctionBody>& bodies, const Scope& scope)
+    {
+        std::vector<std::exception_ptr> errors(bodies.size());
+        std::atomic<size_t> next_body(0);
+        // Bodies after one that failed are not reported, so they need not be checked.
+        std::atomic<size_t> first_error(bodies.size());
+
+        auto work = [&]()
+        {
+            std::shared_ptr<Scope> view = scope.global_view();
+            for (size_t i = next_body++; i < first_error; i = next_body++)
+            {
+                try
+                {
+                    typecheckBody(bodies[i], view);
+                }
+                catch (...)
+                {
+                    errors[i] = std::current_exception();
+                    size_t error = first_error;
+                    while (i < error && !first_error.compare_exchange_weak(error, i));
+                }
+            }
+        };
+
+        size_t worker_count = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), bodies.size());
+        std::vector<std::thread> workers;
+        for (size_t w = 1; w < worker_count; w++)
+            workers.emplace_back(work);
+        work();
+        for (std::thread& worker : workers)
+            worker.join();
+
+        if (first_error < bodies.size())
+            std::rethrow_exception(errors[first_error]);
+    }
+
+    void typecheckCmd(Parser::NodePtr<Parser::CmdNode>& u_cmd, std::shared_ptr<Scope>& scope)
     {
         Parser::CmdNode* cmd = u_cmd.get();
+        // time <cmd> checks as <cmd> does, so nested time commands are unwrapped by a loop.
+        while (cmd->kind == Parser::TIME_CMD)
+            cmd = static_cast<Parser::TimeCmdNode*>(cmd)->command.get();
             
-        // show <expr>
+        switch (cmd->kind)
         {
-            Parser::ShowCmdNode* result;
-            if (tryCastCmd<Parser::ShowCmdNode>(cmd, result))
+            // show <expr>
+            case Parser::SHOW_CMD:
             {
+                Parser::ShowCmdNode* result = static_cast<Parser::ShowCmdNode*>(cmd);
                 std::shared_ptr<ResolvedType> rtype = type_of(result->expression, scope);
-                result->expression->resolvedType = rtype;
+                result->expression->resolvedType = rtype.get();
                 return;
             }
-        }
-        
-        // read image <string> to <argument>
-        {
-            Parser::ReadCmdNode* result;
-            if (tryCastCmd<Parser::ReadCmdNode>(cmd, result))
+
+            // read image <string> to <argument>
+            case Parser::READ_CMD:
             {
+                Parser::ReadCmdNode* result = static_cast<Parser::ReadCmdNode*>(cmd);
                 // TODO: Add image to scope.
                 std::vector<std::shared_ptr<ResolvedType>> tuple_floats;
                 for (int i = 0; i < 4; i++)
-                    tuple_floats.push_back(std::make_shared<FloatRType>());
+                    tuple_floats.push_back(floatType());
                 
-                std::shared_ptr<ResolvedType> tuple = std::make_shared<TupleRType>(tuple_floats);
-                std::shared_ptr<ResolvedType> array = std::make_shared<ArrayRType>(tuple, 2);
+                std::shared_ptr<ResolvedType> tuple = tupleType(tuple_floats);
+                std::shared_ptr<ResolvedType> array = arrayType(tuple, 2);
 
                 Parser::ArgumentNode* argument = result->readInto.get();
                 scope->add_argument(argument, array);
                 return;
             }
-        }
-        
-        // write image <expr> to <string>
-        {
-            Parser::WriteCmdNode* result;
-            if (tryCastCmd<Parser::WriteCmdNode>(cmd, result))
+
+            // write image <expr> to <string>
+            case Parser::WRITE_CMD:
             {
+                Parser::WriteCmdNode* result = static_cast<Parser::WriteCmdNode*>(cmd);
                 ArrayRType* target_type;
                 std::shared_ptr<ResolvedType> rtype = type_of(result->toSave, scope);
-                result->toSave->resolvedType = rtype;
+                result->toSave->resolvedType = rtype.get();
                 if (! tryCast<ResolvedType, ArrayRType>(rtype.get(), target_type))
                     throw TypeException("Caught write with expression of non-array type " + rtype->toString() + ". Write expects a {float, float, float, float}[,].", result);
                 TupleRType* target_element_type;
@@ -720,213 +975,270 @@ namespace Typechecker
                     throw TypeException("Caught write with expression of non-rank-2 4-float tuple array type " + rtype->toString() + ". Write expects a {float, float, float, float}[,].", result);
                 return;
             }
-        }
-        
-        // let <lvalue> = <expr>
-        {
-            Parser::LetCmdNode* result;
-            if (tryCastCmd<Parser::LetCmdNode>(cmd, result))
+
+            // let <lvalue> = <expr>
+            case Parser::LET_CMD:
             {
+                Parser::LetCmdNode* result = static_cast<Parser::LetCmdNode*>(cmd);
                 std::shared_ptr<ResolvedType> rtype = type_of(result->expression, scope);
-                result->expression->resolvedType = rtype;
+                result->expression->resolvedType = rtype.get();
                 scope->add_lvalue(result->lvalue.get(), rtype);
                 return;
             }
-        }
-        
-        // assert <expr> , <string>
-        {
-            Parser::AssertCmdNode* result;
-            if (tryCastCmd<Parser::AssertCmdNode>(cmd, result))
+
+            // assert <expr> , <string>
+            case Parser::ASSERT_CMD:
             {
+                Parser::AssertCmdNode* result = static_cast<Parser::AssertCmdNode*>(cmd);
                 std::shared_ptr<ResolvedType> rtype = type_of(result->expression, scope);
                 if (rtype.get()->type_name != BOOL)
                     throw TypeException("Assert takes a boolean as its first argument. Detected an assert with an expression of type " + rtype->toString() + ".", result);
-                result->expression->resolvedType = rtype;
+                result->expression->resolvedType = rtype.get();
                 return;
             }
-        }
-        
-        // print <string>
-        {
-            Parser::PrintCmdNode* result;
-            if (tryCastCmd<Parser::PrintCmdNode>(cmd, result))
-                return;
-        }
-        
-        // time <cmd>
-        {
-            Parser::TimeCmdNode* result;
-            if (tryCastCmd<Parser::TimeCmdNode>(cmd, result))
+
+            // print <string>
+            case Parser::PRINT_CMD:
             {
-                typecheckCmd(result->command, scope);
                 return;
             }
-        }
 
-        // type <variable> = <type>
-        {
-            Parser::TypeCmdNode* result;
-            if (tryCastCmd<Parser::TypeCmdNode>(cmd, result))
+            // type <variable> = <type>
+            case Parser::TYPE_CMD:
             {
+                Parser::TypeCmdNode* result = static_cast<Parser::TypeCmdNode*>(cmd);
                 TypeInfo* typeinfo = new TypeInfo(resolve_type(result->type, scope));
                 
-                if (! scope->add(result->variable, typeinfo))
+                if (! scope->add(result->variable_symbol, typeinfo))
                 {
                     delete typeinfo;
                     throw TypeException("Defined variable " + result->variable + " twice.", cmd);
                 }
                 return;
             }
-        }
 
-        // fn <variable> ( <binding> , ... ) : <type> { ;
-        //   <stmt> ; ... ;
-        // }
-        {
-            Parser::FnCmd* result;
-            if (tryCastCmd<Parser::FnCmd> (cmd, result))
+            // fn <variable> ( <binding> , ... ) : <type> { ;
+            //   <stmt> ; ... ;
+            // }
+            case Parser::FN_CMD:
             {
-                std::shared_ptr<Scope> function_scope = scope->createNestedScope();
-                result->scope = function_scope;
+                FunctionBody body = typecheckSignature(static_cast<Parser::FnCmd*>(cmd), scope);
+                typecheckBody(body, scope);
+                return;
+            }
+            default:
+                break;
+        }
+    }
+    
+    FunctionBody typecheckSignature(Parser::FnCmd* function, std::shared_ptr<Scope>& scope)
+    {
+        FunctionBody body;
+        body.function = function;
 
+        // The signature only refers to global types, so it is resolved before the
+        // arguments are in scope.
+        for (int i = 0; i < function->arguments.size(); i++)
+        {
+            Parser::NodePtr<Parser::BindingNode>& u_binding = function->arguments[i]; 
+            std::pair<PseudoLValue*, std::shared_ptr<ResolvedType>> p = decompose_binding(u_binding, scope);
+            body.arg_lvalues.emplace_back(p.first);
+            body.arg_rtypes.push_back(p.second);
+        }
 
-                std::vector<std::unique_ptr<PseudoLValue>> arg_lvalues;
-                std::vector<std::shared_ptr<ResolvedType>> arg_rtypes;
+        body.return_type = resolve_type(function->return_type, scope);
 
-                for (int i = 0; i < result->arguments.size(); i++)
-                {
-                    std::unique_ptr<Parser::BindingNode>& u_binding = result->arguments[i]; 
-                    std::pair<PseudoLValue*, std::shared_ptr<ResolvedType>> p = decompose_binding(u_binding, scope);
-                    arg_lvalues.emplace_back(p.first);
-                    arg_rtypes.push_back(p.second);
+        // Catch arguments whose names are taken now, while only the globals before the function are in scope.
+        {
+            NestedScope argument_scope(*scope);
+            for (int i = 0; i < body.arg_lvalues.size(); i++)
+                scope->add_lvalue(body.arg_lvalues[i].get(), body.arg_rtypes[i]);
+        }
 
-                    function_scope->add_lvalue(p.first, p.second);
-                }
+        FuncInfo* funcinfo = new FuncInfo(body.return_type, body.arg_rtypes);
 
-                std::shared_ptr<ResolvedType> return_type = resolve_type(result->return_type, scope);
+        if (! scope->add(function->function_symbol, funcinfo))
+        {
+            delete funcinfo;
+            throw TypeException("Function " + function->function_name + " was defined twice.", function);
+        }
 
-                FuncInfo* funcinfo = new FuncInfo(return_type, arg_rtypes);
-                
-                if (! scope->add(result->function_name, funcinfo))
-                {
-                    delete funcinfo;
-                    throw TypeException("Function " + result->function_name + " was defined twice.", cmd);
-                }
+        body.global = scope->globals.size() - 1;
+        return body;
+    }
 
-                bool has_return = false;
+    void typecheckBody(FunctionBody& body, std::shared_ptr<Scope>& scope)
+    {
+        Parser::FnCmd* function = body.function;
 
-                for(std::unique_ptr<Parser::StmtNode>& u_stmt : result->function_contents)
-                {
-                    has_return = has_return | typecheckStmt(u_stmt, function_scope, return_type);
-                }
+        // The arguments were checked with the function's own name not yet defined, and may hide it.
+        scope->show_globals(body.global);
+        NestedScope function_scope(*scope);
+        for (int i = 0; i < body.arg_lvalues.size(); i++)
+            scope->add_lvalue(body.arg_lvalues[i].get(), body.arg_rtypes[i]);
+        scope->show_globals(body.global + 1);
 
-                bool is_empty_tuple = *return_type == TupleRType(std::vector<std::shared_ptr<ResolvedType>>());
+        bool has_return = false;
 
-                if ((!is_empty_tuple) && (!has_return))
-                    throw TypeException("Function " + result->function_name + " has a non-{} return type, but never returns.", cmd);
-                return;
-            }
+        for(Parser::NodePtr<Parser::StmtNode>& u_stmt : function->function_contents)
+        {
+            has_return = has_return | typecheckStmt(u_stmt, scope, body.return_type);
         }
+
+        bool is_empty_tuple = body.return_type == tupleType({});
+
+        if ((!is_empty_tuple) && (!has_return))
+            throw TypeException("Function " + function->function_name + " has a non-{} return type, but never returns.", function);
+
+        scope->show_globals(SIZE_MAX);
     }
-    
+
     PseudoLValue::PseudoLValue(Parser::ASTNode* _replacement)
     {
         line = _replacement->line;
         pos = _replacement->pos;
         token_s = _replacement->token_s;
+        symbol = _replacement->symbol;
         replacement = _replacement;
     }
 
     PseudoTupleLValue::PseudoTupleLValue(std::vector<PseudoLValue*> _tuple, Parser::ASTNode* replacement) : PseudoLValue(replacement)
     {
+        kind = KIND;
         for(PseudoLValue* tuple_lvalue : _tuple)
         {
             lvalues.emplace_back(tuple_lvalue);
         }
     }
 
-    std::pair<PseudoLValue*, std::shared_ptr<ResolvedType>> decompose_binding(std::unique_ptr<Parser::BindingNode>& u_binding, std::shared_ptr<Scope>& scope)
+    PseudoTupleLValue::~PseudoTupleLValue()
     {
-        Parser::BindingNode* binding = u_binding.get();
-
-        PseudoLValue* lvalue;
-        std::shared_ptr<ResolvedType> rtype;
-        
-        // <argument> : <type>
+        std::vector<std::unique_ptr<PseudoLValue>> pending = std::move(lvalues);
+        while (!pending.empty())
         {
-            Parser::VarBindingNode* result;
-            if (tryCast<Parser::BindingNode, Parser::VarBindingNode>(binding, result))
-            {
-                lvalue = new PseudoArgumentLValue(result->argument.get(), binding);
-                rtype = resolve_type(result->type, scope);
-            }
+            std::unique_ptr<PseudoLValue> lvalue = std::move(pending.back());
+            pending.pop_back();
+            if (lvalue->kind != Parser::PSEUDO_TUPLE_LVALUE)
+                continue;
+            // Its elements are taken out, so destroying it destroys nothing nested.
+            std::vector<std::unique_ptr<PseudoLValue>>& elements = static_cast<PseudoTupleLValue*>(lvalue.get())->lvalues;
+            for (std::unique_ptr<PseudoLValue>& element : elements)
+                pending.push_back(std::move(element));
+            elements.clear();
         }
-        // { <binding>, ... }
+    }
+
+    // A binding being decomposed by decompose_binding, and how many of its bindings are.
+    struct DecomposingFrame
+    {
+        Parser::BindingNode* binding;
+        size_t decomposed;
+    };
+
+    // Decomposes the bindings of each tuple binding before the tuple binding itself, from an
+    // explicit stack of the bindings being decomposed rather than by recursion, like type_of.
+    std::pair<PseudoLValue*, std::shared_ptr<ResolvedType>> decompose_binding(Parser::NodePtr<Parser::BindingNode>& u_binding, std::shared_ptr<Scope>& scope)
+    {
+        std::vector<DecomposingFrame> frames;
+        frames.push_back({u_binding.get(), 0});
+        // The decomposed bindings of the tuple bindings in frames, innermost last.
+        std::vector<std::unique_ptr<PseudoLValue>> sub_lvalues;
+        std::vector<std::shared_ptr<ResolvedType>> sub_rtypes;
+
+        while (true)
         {
-            Parser::TupleBindingNode* result;
-            if (tryCast<Parser::BindingNode, Parser::TupleBindingNode>(binding, result))
-            {
-                std::vector<PseudoLValue*> sub_lvalues;
-                std::vector<std::shared_ptr<ResolvedType>> sub_rtypes;
+            DecomposingFrame& frame = frames.back();
+            Parser::BindingNode* binding = frame.binding;
+
+            std::unique_ptr<PseudoLValue> lvalue;
+            std::shared_ptr<ResolvedType> rtype;
 
-                for (std::unique_ptr<Parser::BindingNode>& u_binding : result->bindings)
+            switch (binding->kind)
+            {
+                // <argument> : <type>
+                case Parser::VAR_BINDING:
                 {
-                    std::pair<PseudoLValue*, std::shared_ptr<ResolvedType>> decomp = decompose_binding(u_binding, scope);
-                    sub_lvalues.push_back(decomp.first);
-                    sub_rtypes.push_back(decomp.second);
+                    Parser::VarBindingNode* result = static_cast<Parser::VarBindingNode*>(binding);
+                    lvalue.reset(new PseudoArgumentLValue(result->argument.get(), binding));
+                    rtype = resolve_type(result->type, scope);
+                    break;
                 }
+                // { <binding>, ... }
+                case Parser::TUPLE_BINDING:
+                {
+                    Parser::TupleBindingNode* result = static_cast<Parser::TupleBindingNode*>(binding);
+                    size_t binding_count = result->bindings.size();
+                    if (frame.decomposed < binding_count)
+                    {
+                        Parser::BindingNode* sub_binding = result->bindings[frame.decomposed++].get();
+                        frames.push_back({sub_binding, 0});
+                        continue;
+                    }
+
+                    std::vector<PseudoLValue*> tuple_lvalues;
+                    for (size_t i = sub_lvalues.size() - binding_count; i < sub_lvalues.size(); i++)
+                        tuple_lvalues.push_back(sub_lvalues[i].release());
+                    std::vector<std::shared_ptr<ResolvedType>> tuple_rtypes(sub_rtypes.end() - binding_count, sub_rtypes.end());
+                    sub_lvalues.resize(sub_lvalues.size() - binding_count);
+                    sub_rtypes.resize(sub_rtypes.size() - binding_count);
 
-                lvalue = new PseudoTupleLValue(sub_lvalues, binding);
-                rtype = std::make_shared<TupleRType>(sub_rtypes);
+                    lvalue.reset(new PseudoTupleLValue(tuple_lvalues, binding));
+                    rtype = tupleType(tuple_rtypes);
+                    break;
+                }
+                default:
+                    break;
             }
-        }
 
-        return std::pair<PseudoLValue*, std::shared_ptr<ResolvedType>>(lvalue, rtype);
+            frames.pop_back();
+            if (frames.empty())
+                return std::pair<PseudoLValue*, std::shared_ptr<ResolvedType>>(lvalue.release(), rtype);
+            sub_lvalues.push_back(std::move(lvalue));
+            sub_rtypes.push_back(std::move(rtype));
+        }
     }
 
-    bool typecheckStmt(std::unique_ptr<Parser::StmtNode>& u_stmt, std::shared_ptr<Scope>& scope, const std::shared_ptr<ResolvedType>& return_type)
+    bool typecheckStmt(Parser::NodePtr<Parser::StmtNode>& u_stmt, std::shared_ptr<Scope>& scope, const std::shared_ptr<ResolvedType>& return_type)
     {
         Parser::StmtNode* stmt = u_stmt.get();
 
-        // let <lvalue> = <expr>
+        switch (stmt->kind)
         {
-            Parser::LetStmtNode* result;
-            if (tryCastStmt<Parser::LetStmtNode>(stmt, result))
+            // let <lvalue> = <expr>
+            case Parser::LET_STMT:
             {
+                Parser::LetStmtNode* result = static_cast<Parser::LetStmtNode*>(stmt);
                 std::shared_ptr<ResolvedType> rtype = type_of(result->variable_expression, scope);
-                result->variable_expression->resolvedType = rtype;
+                result->variable_expression->resolvedType = rtype.get();
                 scope->add_lvalue(result->set_variable_name.get(), rtype);
                 return false;
             }
-        }
 
-        // assert <expr> , <string>
-        {
-            Parser::AssertStmtNode* result;
-            if (tryCastStmt<Parser::AssertStmtNode>(stmt, result))
+            // assert <expr> , <string>
+            case Parser::ASSERT_STMT:
             {
+                Parser::AssertStmtNode* result = static_cast<Parser::AssertStmtNode*>(stmt);
                 std::shared_ptr<ResolvedType> rtype = type_of(result->expression, scope);
                 if (rtype.get()->type_name != BOOL)
                     throw TypeException("Assert takes a boolean as its first argument. Detected an assert with an expression of type " + rtype->toString() + ".", result);
-                result->expression->resolvedType = rtype;
+                result->expression->resolvedType = rtype.get();
                 return false;
             }
-        }
 
-        // return <expr>
-        {
-            // Check to see if return type matches function signature.
-            // There can be no return IF the the function returns {}
-            Parser::ReturnStmtNode* result;
-            if (tryCastStmt<Parser::ReturnStmtNode>(stmt, result))
+            // return <expr>
+            case Parser::RETURN_STMT:
             {
+                // Check to see if return type matches function signature.
+                // There can be no return IF the the function returns {}
+                Parser::ReturnStmtNode* result = static_cast<Parser::ReturnStmtNode*>(stmt);
                 std::shared_ptr<ResolvedType> rtype = type_of(result->expression, scope);
                 if (*rtype != *return_type)
                     throw TypeException("Return type does not match type of function. Expected return of type " + return_type->toString() + ". Got " + rtype->toString() + ".", result);
-                result->expression->resolvedType = rtype;
+                result->expression->resolvedType = rtype.get();
                 return true;
             }
+            default:
+                break;
         }
 
         throw TypeException("Could not identify statement.", stmt);
@@ -25,7 +25,7 @@ namespace Typechecker
     {
         public:
             std::shared_ptr<ResolvedType> rtype;
-            VariableInfo(std::shared_ptr<ResolvedType>& _rtype) : rtype(_rtype) {};
+            VariableInfo(const std::shared_ptr<ResolvedType>& _rtype) : rtype(_rtype) {};
             virtual ~VariableInfo() {}
     };
 
@@ -46,33 +46,96 @@ namespace Typechecker
             virtual ~FuncInfo() {};
     };
 
+    // Every name in scope, in one open-addressing table keyed by symbol. Nested scopes are
+    // entered and left rather than allocated: each name added inside one is recorded in an undo
+    // log, and leaving the scope undoes exactly those additions. A lookup is one probe, however
+    // deeply the scope is nested.
     class Scope
     {
-        private:
-            Scope* parent;
         public:
-            std::unordered_map<std::string, std::unique_ptr<NameInfo>> symbol_table;
+            struct Binding
+            {
+                Lexer::Symbol symbol;
+                std::unique_ptr<NameInfo> info;
+            };
+
+            // The names of the global scope, in the order they were added.
+            std::vector<Binding> globals;
 
         public:
-            // Constructs a root (global) scope. 
-            Scope(){parent = nullptr;}
-            // Constructs a new child scope and returns it.
-            std::shared_ptr<Scope> createNestedScope();
-            // Adds the given name to this scope's symbol table.
+            // Constructs a root (global) scope.
+            Scope();
+            // Constructs a scope that sees the global names of global_scope without owning them,
+            // so that function bodies can be checked on several threads at once. global_scope
+            // must not change while the view is in use.
+            std::shared_ptr<Scope> global_view() const;
+            // Opens a nested scope; names added until the matching leave() belong to it.
+            void enter();
+            // Closes the innermost nested scope, removing its names.
+            void leave();
+            // Adds the given name to the innermost scope, taking ownership of info.
             // If the name already exists in this scope or a parent, returns false.
-            bool add(std::string name, NameInfo* info);
+            bool add(Lexer::Symbol name, NameInfo* info);
+            // Hides every global after the first count, as if they were not defined yet.
+            void show_globals(size_t count) {visible_globals = count;}
             void add_argument(Parser::ArgumentNode* argument, std::shared_ptr<ResolvedType>& rtype);
             void add_lvalue(Parser::LValue* lvalue, std::shared_ptr<ResolvedType>& rtype);
             // Checks if the given name exists in this scope or a parent.
             // Returns whether the lookup was successful. Fills out the info pointer
             // if so.
-            bool lookup(std::string name, NameInfo*& info);
-            NameInfo* get_info(std::string name);
+            bool lookup(Lexer::Symbol name, NameInfo*& info) const;
+
+        private:
+            // The innermost binding of a symbol, or an empty slot if info is null. A symbol
+            // keeps its slot once it has one, so slots are never removed.
+            struct Slot
+            {
+                Lexer::Symbol symbol = Lexer::NO_SYMBOL;
+                NameInfo* info = nullptr;
+                // How many nested scopes were open when info was added.
+                uint32_t depth = 0;
+                // The position of a global binding in globals.
+                uint32_t global = 0;
+            };
+
+            // A name added to a nested scope, and the slot as it was before.
+            struct Change
+            {
+                std::unique_ptr<NameInfo> info;
+                Slot hidden;
+            };
+
+            std::vector<Slot> slots;
+            size_t slots_used = 0;
+            std::vector<Change> changes;
+            // The size of changes when each open nested scope was entered.
+            std::vector<size_t> marks;
+            size_t visible_globals = SIZE_MAX;
+
+            bool visible(const Slot& slot) const {return slot.info != nullptr && (slot.depth > 0 || slot.global < visible_globals);}
+
+            // The slot of name, or of the empty slot where it would go.
+            size_t probe(Lexer::Symbol name) const;
+            // The slot of name, claiming one if it has none.
+            size_t claim(Lexer::Symbol name);
+    };
+
+    // Keeps a nested scope open for as long as it lives.
+    class NestedScope
+    {
+        public:
+            NestedScope(Scope& _scope) : scope(_scope) {scope.enter();}
+            ~NestedScope() {scope.leave();}
+            NestedScope(const NestedScope&) = delete;
+            NestedScope& operator=(const NestedScope&) = delete;
+
+        private:
+            Scope& scope;
     };
 
     std::shared_ptr<Scope> create_global_scope();
     // Used in bindings
-    std::shared_ptr<ResolvedType> resolve_type(std::unique_ptr<Parser::TypeNode>& u_type, std::shared_ptr<Scope>& scope);
+    std::shared_ptr<ResolvedType> resolve_type(Parser::NodePtr<Parser::TypeNode>& u_type, std::shared_ptr<Scope>& scope);
     
     class PseudoLValue : public Parser::LValue
     {
@@ -81,12 +144,17 @@ namespace Typechecker
             Parser::ASTNode* replacement;
             virtual ~PseudoLValue() {};
             virtual std::string toString() {return "( ~PseudoLValue " + replacement->toString() + " )";}
+
+            // Not part of any tree, so these live on the heap rather than in an Arena.
+            static void* operator new(size_t size) {return ::operator new(size);}
+            static void operator delete(void* pointer) {::operator delete(pointer);}
     };
 
     class PseudoArgumentLValue : public PseudoLValue
     {
         public:
-            PseudoArgumentLValue(Parser::ArgumentNode* _arg, Parser::ASTNode* replacement) : PseudoLValue(replacement), argument(_arg) {};
+            static constexpr Parser::NodeKind KIND = Parser::PSEUDO_ARGUMENT_LVALUE;
+            PseudoArgumentLValue(Parser::ArgumentNode* _arg, Parser::ASTNode* replacement) : PseudoLValue(replacement), argument(_arg) {kind = KIND;};
             virtual ~PseudoArgumentLValue() {};
             Parser::ArgumentNode* argument;
     };
@@ -94,23 +162,45 @@ namespace Typechecker
     class PseudoTupleLValue : public PseudoLValue
     {
         public:
+            static constexpr Parser::NodeKind KIND = Parser::PSEUDO_TUPLE_LVALUE;
             PseudoTupleLValue(std::vector<PseudoLValue*> _tuple, Parser::ASTNode* replacement);
-            virtual ~PseudoTupleLValue() {};
+            // Destroys nested tuples by a loop rather than one destructor frame for each level.
+            virtual ~PseudoTupleLValue();
             std::vector<std::unique_ptr<PseudoLValue>> lvalues;
     };
     
-    std::pair<PseudoLValue*, std::shared_ptr<ResolvedType>> decompose_binding(std::unique_ptr<Parser::BindingNode>& u_binding, std::shared_ptr<Scope>& scope);
+    std::pair<PseudoLValue*, std::shared_ptr<ResolvedType>> decompose_binding(Parser::NodePtr<Parser::BindingNode>& u_binding, std::shared_ptr<Scope>& scope);
     // Get an expression and return its resolved type based on the
     // expression type (arithmetic, array, etc.).
-    std::shared_ptr<ResolvedType> type_of(std::unique_ptr<Parser::ExprNode>& expr, std::shared_ptr<Scope>& scope);
+    std::shared_ptr<ResolvedType> type_of(Parser::NodePtr<Parser::ExprNode>& expr, std::shared_ptr<Scope>& scope);
     // Get a list of commands and ensure that the types of the command
     // expressions make sense. Also, assign the expression nodes resolved
     // types.
-    std::shared_ptr<Scope> typecheck(std::vector<std::unique_ptr<Parser::CmdNode>>& commands);
+    std::shared_ptr<Scope> typecheck(std::vector<Parser::NodePtr<Parser::CmdNode>>& commands);
+
+    void typecheckCmd(Parser::NodePtr<Parser::CmdNode>& u_cmd, std::shared_ptr<Scope>& scope);
+
+    // A function whose signature is in the global scope, and whose body is still to be checked.
+    struct FunctionBody
+    {
+        Parser::FnCmd* function;
+        std::vector<std::unique_ptr<PseudoLValue>> arg_lvalues;
+        std::vector<std::shared_ptr<ResolvedType>> arg_rtypes;
+        std::shared_ptr<ResolvedType> return_type;
+        // The position of the function in the globals. Its body sees only the globals before it.
+        size_t global;
+    };
 
-    void typecheckCmd(std::unique_ptr<Parser::CmdNode>& u_cmd, std::shared_ptr<Scope>& scope);
+    // Checks the signature of a function and adds the function to the global scope.
+    FunctionBody typecheckSignature(Parser::FnCmd* function, std::shared_ptr<Scope>& scope);
+    // Checks the body of a function. Only reads the global scope, so the bodies of different
+    // functions may be checked at once, each with its own view of the globals.
+    void typecheckBody(FunctionBody& body, std::shared_ptr<Scope>& scope);
+    // Checks function bodies on a pool of worker threads. If any fail, rethrows the error of
+    // the first in source order.
+    void typecheckBodies(std::vector<FunctionBody>& bodies, const Scope& scope);
     // Returns true if this stmt was a return statement.
-    bool typecheckStmt(std::unique_ptr<Parser::StmtNode>& u_stmt, std::shared_ptr<Scope>& scope, const std::shared_ptr<ResolvedType>& return_type);
+    bool typecheckStmt(Parser::NodePtr<Parser::StmtNode>& u_stmt, std::shared_ptr<Scope>& scope, const std::shared_ptr<ResolvedType>& return_type);
 }//namespace Typechecker
 
 #endif
@@ -3,6 +3,8 @@
 #include <utility>
 #include <vector>
 #include <unordered_map>
+#include <mutex>
+#include <cstdint>
 
 
 #ifndef __TYPES_H__
@@ -30,147 +32,204 @@ namespace Typechecker
         }
     }
 
-    class ResolvedType
+    class TypeInterner;
+
+    // Types are only made by the TypeInterner (through the functions below), which keeps one
+    // instance of each structurally distinct type. Equal types are therefore the same object and
+    // are compared by address. Nodes point to their types directly, and the types they point to
+    // give back the shared pointers the interner keeps.
+    class ResolvedType : public std::enable_shared_from_this<ResolvedType>
     {
         public:
-            virtual std::string toString() {return typenameToString(type_name);};
+            std::string toString() const;
             const TYPE_NAME type_name;
-            virtual bool operator== (const ResolvedType& other)
-            {
-                return type_name == other.type_name;
-            }
-            
-            bool operator!= (const ResolvedType& other)
+            // The bytes a value of the type takes.
+            const unsigned int size;
+
+            bool operator== (const ResolvedType& other) const {return this == &other;}
+            bool operator!= (const ResolvedType& other) const {return this != &other;}
+
+            ResolvedType(const ResolvedType&) = delete;
+            ResolvedType& operator=(const ResolvedType&) = delete;
+            virtual ~ResolvedType()
             {
-                // NOTE: ensure INHERITED operator== is called here. Not base operator==.
-                return !(operator==(other));
+                Released& pending = released();
+                if (pending.releasing)
+                    return;
+                pending.releasing = true;
+                while (!pending.types.empty())
+                {
+                    std::shared_ptr<ResolvedType> last = std::move(pending.types.back());
+                    pending.types.pop_back();
+                }
+                pending.releasing = false;
             }
-            
-            virtual ~ResolvedType() {}
-            virtual ResolvedType* clone() = 0;
 
         protected:
-            ResolvedType(TYPE_NAME _tn) : type_name(_tn) {}
+            ResolvedType(TYPE_NAME _tn, unsigned int _size = 8) : type_name(_tn), size(_size) {}
+
+            // The destructor of a type releases its elements here rather than destroying them,
+            // and the outermost destructor destroys them in turn, so that destroying a nested
+            // type takes a loop rather than one destructor frame for each level.
+            static void release(const std::shared_ptr<ResolvedType>& element) {released().types.push_back(element);}
+
+        private:
+            struct Released
+            {
+                std::vector<std::shared_ptr<ResolvedType>> types;
+                bool releasing = false;
+            };
+
+            // Never destroyed, as types may be destroyed after the thread's own variables.
+            static Released& released()
+            {
+                static thread_local Released* pending = new Released();
+                return *pending;
+            }
     };
 
     class IntRType : public ResolvedType
     {
-        public:
+        private:
+            friend class TypeInterner;
             IntRType() : ResolvedType(INT) {}
-            virtual ResolvedType* clone()
-            {
-                return (ResolvedType*) new IntRType();
-            }
     };
 
     class FloatRType : public ResolvedType
     {
-        public:
+        private:
+            friend class TypeInterner;
             FloatRType() : ResolvedType(FLOAT) {}
-            virtual ResolvedType* clone()
-            {
-                return (ResolvedType*) new FloatRType();
-            }
     };
 
     class BoolRType : public ResolvedType
     {
-        public:
+        private:
+            friend class TypeInterner;
             BoolRType() : ResolvedType(BOOL) {}
-            virtual ResolvedType* clone()
-            {
-                return (ResolvedType*) new BoolRType();
-            }
     };
 
     class ArrayRType : public ResolvedType
     {
         public:
-            std::shared_ptr<ResolvedType> element_type;
-            int rank;
-            ArrayRType(std::shared_ptr<ResolvedType>& _et, const int& _r) : ResolvedType(ARRAY), element_type(_et), rank(_r) {}
-            virtual bool operator==(const ResolvedType& other)
-            {
-                if (other.type_name != ARRAY)
-                    return false;
-                
-                const ArrayRType& other_array = static_cast<const ArrayRType&>(other);
+            const std::shared_ptr<ResolvedType> element_type;
+            const int rank;
 
-                bool sameRank = rank == other_array.rank;
-                bool sameElementType = *element_type.get() == *other_array.element_type.get();  
+            ~ArrayRType() {release(element_type);}
 
-                return sameRank && sameElementType;
-            }
+        private:
+            friend class TypeInterner;
+            ArrayRType(const std::shared_ptr<ResolvedType>& _et, int _r) : ResolvedType(ARRAY, 8 + 8 * _r), element_type(_et), rank(_r) {}
+    };
 
-            virtual std::string toString()
-            {
-                if (element_type.get() == nullptr)
-                    std::printf("Got it\n");
-                return typenameToString(type_name) + " (" + element_type.get()->toString() + ") " + std::to_string(rank);
-            }
-            
-            virtual ResolvedType* clone()
+    class TupleRType : public ResolvedType
+    {
+        public:
+            const std::vector<std::shared_ptr<ResolvedType>> element_types;
+
+            ~TupleRType()
             {
-                return (ResolvedType*) new ArrayRType(element_type, rank);
+                for (const std::shared_ptr<ResolvedType>& element_type : element_types)
+                    release(element_type);
             }
 
-            static std::shared_ptr<ArrayRType> make_array(std::shared_ptr<ResolvedType>& elm_type, const int& rank)
+        private:
+            friend class TypeInterner;
+            TupleRType(const std::vector<std::shared_ptr<ResolvedType>>& _ets) : ResolvedType(TUPLE, sizeOf(_ets)), element_types(_ets) {}
+
+            static unsigned int sizeOf(const std::vector<std::shared_ptr<ResolvedType>>& element_types)
             {
-                return std::make_shared<ArrayRType>(elm_type, rank);
+                unsigned int size = 0;
+                for (const std::shared_ptr<ResolvedType>& element_type : element_types)
+                    size += element_type->size;
+                return size;
             }
     };
 
-    class TupleRType : public ResolvedType
+    // Arrays print as "ArrayType (element) rank" and tuples as "TupleType (element) ...". The
+    // text is built from a stack of the types still to print and the text between them.
+    inline std::string ResolvedType::toString() const
     {
-        public:
-            std::vector<std::shared_ptr<ResolvedType>> element_types;
-            TupleRType(const std::vector<std::shared_ptr<ResolvedType>>& _ets) : ResolvedType(TUPLE)
+        struct Part
+        {
+            const ResolvedType* type;
+            std::string text;
+        };
+
+        std::string result;
+        std::vector<Part> parts = {{this, ""}};
+        while (!parts.empty())
+        {
+            Part part = std::move(parts.back());
+            parts.pop_back();
+            if (part.type == nullptr)
             {
-                for(const std::shared_ptr<ResolvedType>&  element_type : _ets)
-                {
-                    element_types.push_back(element_type);
-                }
+                result += part.text;
+                continue;
             }
 
-            virtual bool operator==(const ResolvedType& other)
+            result += typenameToString(part.type->type_name);
+            if (part.type->type_name == ARRAY)
             {
-                if (other.type_name != TUPLE)
-                    return false;
-                
-                const TupleRType& other_tuple = static_cast<const TupleRType&>(other);
-
-                if (element_types.size() != other_tuple.element_types.size())
-                    return false;
-                
-                for(int i = 0; i < element_types.size(); i++)
+                const ArrayRType* array = static_cast<const ArrayRType*>(part.type);
+                parts.push_back({nullptr, ") " + std::to_string(array->rank)});
+                parts.push_back({array->element_type.get(), ""});
+                parts.push_back({nullptr, " ("});
+            }
+            else if (part.type->type_name == TUPLE)
+            {
+                const TupleRType* tuple = static_cast<const TupleRType*>(part.type);
+                for (size_t i = tuple->element_types.size(); i-- > 0;)
                 {
-                    ResolvedType* first = element_types[i].get();
-                    ResolvedType* second = other_tuple.element_types[i].get();
-
-                    if (*first != *second)
-                        return false;
+                    parts.push_back({nullptr, ")"});
+                    parts.push_back({tuple->element_types[i].get(), ""});
+                    parts.push_back({nullptr, " ("});
                 }
-
-                return true;
             }
+        }
+        return result;
+    }
 
-            virtual std::string toString()
-            {
-                std::string types_str = "";
+    // The table of every type made so far. Safe to use from multiple threads.
+    class TypeInterner
+    {
+        public:
+            TypeInterner();
 
-                for(const std::shared_ptr<ResolvedType>& element_type : element_types)
-                {
-                    types_str += " (" + element_type.get()->toString() + ")";
-                }
+            std::shared_ptr<ResolvedType> intType() const {return int_type;}
+            std::shared_ptr<ResolvedType> floatType() const {return float_type;}
+            std::shared_ptr<ResolvedType> boolType() const {return bool_type;}
+            std::shared_ptr<ResolvedType> arrayType(const std::shared_ptr<ResolvedType>& element_type, int rank);
+            std::shared_ptr<ResolvedType> tupleType(const std::vector<std::shared_ptr<ResolvedType>>& element_types);
 
-                return typenameToString(type_name) + types_str;
-            }
-            
-            virtual ResolvedType* clone()
+        private:
+            // Arrays and tuples are keyed by the addresses of their (already unique) elements.
+            struct KeyHash
             {
-                return (ResolvedType*) new TupleRType(element_types);
-            }
+                size_t operator()(const std::vector<uintptr_t>& key) const
+                {
+                    size_t hash = key.size();
+                    for (uintptr_t part : key)
+                        hash = (hash ^ part) * 0x100000001b3;
+                    return hash;
+                }
+            };
+
+            std::mutex lock;
+            std::shared_ptr<ResolvedType> int_type;
+            std::shared_ptr<ResolvedType> float_type;
+            std::shared_ptr<ResolvedType> bool_type;
+            std::unordered_map<std::vector<uintptr_t>, std::shared_ptr<ResolvedType>, KeyHash> arrays;
+            std::unordered_map<std::vector<uintptr_t>, std::shared_ptr<ResolvedType>, KeyHash> tuples;
     };
+
+    TypeInterner& typeInterner();
+
+    inline std::shared_ptr<ResolvedType> intType() {return typeInterner().intType();}
+    inline std::shared_ptr<ResolvedType> floatType() {return typeInterner().floatType();}
+    inline std::shared_ptr<ResolvedType> boolType() {return typeInterner().boolType();}
+    inline std::shared_ptr<ResolvedType> arrayType(const std::shared_ptr<ResolvedType>& element_type, int rank) {return typeInterner().arrayType(element_type, rank);}
+    inline std::shared_ptr<ResolvedType> tupleType(const std::vector<std::shared_ptr<ResolvedType>>& element_types) {return typeInterner().tupleType(element_types);}
 } // namespace Typechecker
 
 #endif
\ No newline at end of file